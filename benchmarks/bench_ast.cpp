@@ -0,0 +1,129 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <typeinfo>
+
+#include "../src/h/ast.h"
+#include "../src/h/flatAst.h"
+#include "../src/h/parser.h"
+#include "bench_parser.cpp"
+
+struct astBench {
+    static void bench_ast() {
+        bench_traversal();
+    }
+
+    // the kind of walk a later pass does: visit every node, act on a few kinds
+    static long sumIntLiterals(Node *node) {
+        if (node == nullptr) {
+            return 0;
+        }
+        if (typeid(*node) == typeid(IntLiteral)) {
+            auto *n = static_cast<IntLiteral *>(node);
+            return n->value;
+        }
+        if (typeid(*node) == typeid(InfixExpression)) {
+            auto *n = static_cast<InfixExpression *>(node);
+            return sumIntLiterals(n->lhs) + sumIntLiterals(n->rhs);
+        }
+        if (typeid(*node) == typeid(PrefixExpression)) {
+            auto *n = static_cast<PrefixExpression *>(node);
+            return sumIntLiterals(n->rhs);
+        }
+        if (typeid(*node) == typeid(CallExpression)) {
+            auto *n = static_cast<CallExpression *>(node);
+            long sum = sumIntLiterals(n->callee);
+            for (Expression *arg : n->arguments) {
+                sum += sumIntLiterals(arg);
+            }
+            return sum;
+        }
+        if (typeid(*node) == typeid(IndexExpression)) {
+            auto *n = static_cast<IndexExpression *>(node);
+            return sumIntLiterals(n->array) + sumIntLiterals(n->index);
+        }
+        if (typeid(*node) == typeid(ArrayLiteral)) {
+            auto *n = static_cast<ArrayLiteral *>(node);
+            long sum = 0;
+            for (Expression *e : n->elements) {
+                sum += sumIntLiterals(e);
+            }
+            return sum;
+        }
+        if (typeid(*node) == typeid(FuncLiteral)) {
+            auto *n = static_cast<FuncLiteral *>(node);
+            return sumIntLiterals(n->body);
+        }
+        if (typeid(*node) == typeid(IfExpression)) {
+            auto *n = static_cast<IfExpression *>(node);
+            return sumIntLiterals(n->condition) + sumIntLiterals(n->consequence) + sumIntLiterals(n->alternative);
+        }
+        if (typeid(*node) == typeid(WhileExpression)) {
+            auto *n = static_cast<WhileExpression *>(node);
+            return sumIntLiterals(n->condition) + sumIntLiterals(n->consequence);
+        }
+        if (typeid(*node) == typeid(BlockStatement)) {
+            auto *n = static_cast<BlockStatement *>(node);
+            long sum = 0;
+            for (Statement *s : n->statements) {
+                sum += sumIntLiterals(s);
+            }
+            return sum;
+        }
+        if (typeid(*node) == typeid(DeclareStatement)) {
+            auto *n = static_cast<DeclareStatement *>(node);
+            return sumIntLiterals(n->value);
+        }
+        if (typeid(*node) == typeid(ReturnStatement)) {
+            auto *n = static_cast<ReturnStatement *>(node);
+            return sumIntLiterals(n->returnVal);
+        }
+        if (typeid(*node) == typeid(ExpressionStatement)) {
+            auto *n = static_cast<ExpressionStatement *>(node);
+            return sumIntLiterals(n->expression);
+        }
+        return 0;
+    }
+
+    // the flat form needs no recursion for this at all
+    static long sumIntLiterals(const FlatAst &ast) {
+        long sum = 0;
+        for (size_t i = 0; i < ast.size(); i++) {
+            if (ast.kinds[i] == NodeKind::INT) {
+                sum += static_cast<int>(ast.a[i]);
+            }
+        }
+        return sum;
+    }
+
+    static void bench_traversal() {
+        std::string src = parserBench::syntheticProgram(50000);
+        const lex l(src);
+        parser p(l);
+        std::unique_ptr<Program> program = p.parseProgram();
+
+        const auto t0 = std::chrono::steady_clock::now();
+        const FlatAst flat = FlatAst::fromProgram(*program);
+        const auto t1 = std::chrono::steady_clock::now();
+
+        long treeSum = 0, flatSum = 0;
+        const double treeWalk = parserBench::bestOf(5, [&] {
+            treeSum = 0;
+            for (Statement *stmt : program->statements) {
+                treeSum += sumIntLiterals(stmt);
+            }
+        });
+        const double flatWalk = parserBench::bestOf(5, [&] { flatSum = sumIntLiterals(flat); });
+
+        size_t treeLen = 0, flatLen = 0;
+        const double treePrint = parserBench::bestOf(3, [&] { treeLen = program->toString().size(); });
+        const double flatPrint = parserBench::bestOf(3, [&] { flatLen = flat.toString().size(); });
+
+        std::cout << "flat ast of " << flat.size() << " nodes, converted in "
+                  << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+        std::cout << "  int literal walk: tree " << treeWalk * 1000 << " ms, flat " << flatWalk * 1000
+                  << " ms (" << (treeSum == flatSum ? "same" : "DIFFERENT") << " result)\n";
+        std::cout << "  toString:         tree " << treePrint * 1000 << " ms, flat " << flatPrint * 1000
+                  << " ms (" << (treeLen == flatLen ? "same" : "DIFFERENT") << " length)\n";
+    }
+};
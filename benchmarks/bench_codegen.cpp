@@ -0,0 +1,246 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/Threading.h>
+
+#include "../src/h/lex.h"
+#include "../src/h/parser.h"
+#include "../src/codegen/aot.h"
+#include "../src/codegen/codegen.h"
+#include "../src/codegen/jit.h"
+#include "../src/h/driver.h"
+#include "bench_parser.cpp"
+
+struct codegenBench {
+    static void bench_codegen() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+
+        bench_local_promotion();
+        bench_opt_levels();
+        bench_lazy_startup();
+        bench_target_cpu();
+        bench_parallel_compile();
+    }
+
+    static std::unique_ptr<llvm::Module> compile(const std::string &text, const CodegenOptions &options = {}) {
+        std::string src = text;
+        lex l(src);
+        parser p(l.tokenizeAll());
+        std::unique_ptr<Program> program = p.parseProgram();
+        std::vector<std::string> errors;
+        return compileProgram(*program, errors, options);
+    }
+
+    static std::unique_ptr<llvm::ExecutionEngine> jit(std::unique_ptr<llvm::Module> module) {
+        return std::unique_ptr<llvm::ExecutionEngine>(
+            llvm::EngineBuilder(std::move(module)).setEngineKind(llvm::EngineKind::JIT).create());
+    }
+
+    // a tight loop over three locals, with and without mem2reg. unpromoted,
+    // every read and write of i, sum and t goes through its stack slot.
+    static void bench_local_promotion() {
+        const int iterations = 200000000;
+        const std::string text = "var i = 0; var sum = 0; while (i < " + std::to_string(iterations) +
+                                 ") { var t = i * 3; &sum = sum + t; &i = i + 1; } return sum;";
+
+        std::cout << "loop of " << iterations << " iterations\n";
+        for (const bool promote : {false, true}) {
+            std::unique_ptr<llvm::ExecutionEngine> engine = jit(compile(text, {.promoteLocals = promote}));
+            auto *entry = reinterpret_cast<int64_t (*)()>(engine->getFunctionAddress(entryName));
+            int64_t result = 0;
+            const double t = parserBench::bestOf(3, [&] { result = entry(); });
+            std::cout << (promote ? "  registers:   " : "  stack slots: ") << t * 1000 << " ms, "
+                      << t * 1e9 / iterations << " ns/iteration (sum " << result << ")\n";
+        }
+    }
+
+    // a loop calling small functions, with work that only depends on the
+    // arguments. optimizing is paid once per module, the loop runs at
+    // whatever speed it produced.
+    static void bench_opt_levels() {
+        const int iterations = 100000000;
+        const std::string text = "var sq = func(x) { return x * x; }; var f = func(n, k) { var i = 0; var s = 0; "
+                                 "while (i < n) { &s = s + sq(i % 1000) * k + sq(k); &i = i + 1; } return s; }; "
+                                 "return f(" + std::to_string(iterations) + ", 3);";
+
+        std::cout << "call-heavy loop of " << iterations << " iterations\n";
+        const char *names[] = {"O0", "O1", "O2", "O3"};
+        for (const OptLevel level : {OptLevel::O0, OptLevel::O1, OptLevel::O2, OptLevel::O3}) {
+            std::unique_ptr<llvm::Module> module = compile(text);
+            const auto t0 = std::chrono::steady_clock::now();
+            optimizeModule(*module, {.level = level});
+            const auto t1 = std::chrono::steady_clock::now();
+
+            std::unique_ptr<llvm::ExecutionEngine> engine = jit(std::move(module));
+            auto *entry = reinterpret_cast<int64_t (*)()>(engine->getFunctionAddress(entryName));
+            int64_t result = 0;
+            const double t = parserBench::bestOf(3, [&] { result = entry(); });
+            std::cout << "  -" << names[static_cast<int>(level)] << ": optimize "
+                      << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms, run " << t * 1000
+                      << " ms (result " << result << ")\n";
+        }
+    }
+
+    // functions f0, f1, ... each summing a loop
+    static std::string loopFunctions(const int functions) {
+        std::string text;
+        for (int i = 0; i < functions; i++) {
+            const std::string n = std::to_string(i);
+            text += "var f" + n + " = func(a, b) { var s = 0; while (a < b) { &s = s + a * " + n +
+                    "; &a = a + 1; } return s; };\n";
+        }
+        return text;
+    }
+
+    // a script defining 10000 functions that only calls two of them. time
+    // from a compiled module to banter_main's result, optimizing and
+    // compiling everything up front vs on first call.
+    static void bench_lazy_startup() {
+        const int functions = 10000;
+        std::string src = loopFunctions(functions) + "return f7(0, 10) + f4242(0, 10);";
+        lex l(src);
+        parser p(l.tokenizeAll());
+        std::unique_ptr<Program> program = p.parseProgram();
+        std::vector<std::string> errors;
+
+        // codegen is left out of the timings, it's the same either way
+        auto best = [](const int runs, auto &&f) {
+            double t = 1e300;
+            for (int r = 0; r < runs; r++) {
+                t = std::min(t, f());
+            }
+            return t;
+        };
+        std::cout << "script of " << functions << " functions, 2 called\n";
+        // one run is plenty, it takes seconds
+        const double eager = best(1, [&] {
+            llvm::LLVMContext context;
+            std::unique_ptr<llvm::Module> module = compileProgram(*program, context, errors);
+            const auto start = std::chrono::steady_clock::now();
+            optimizeModule(*module, {.level = OptLevel::O2});
+            std::unique_ptr<llvm::ExecutionEngine> engine = jit(std::move(module));
+            auto *entry = reinterpret_cast<int64_t (*)()>(engine->getFunctionAddress(entryName));
+            entry();
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+        std::cout << "  eager (mcjit): " << eager * 1000 << " ms\n";
+
+        const double lazy = best(3, [&] {
+            auto context = std::make_unique<llvm::LLVMContext>();
+            std::unique_ptr<llvm::Module> module = compileProgram(*program, *context, errors);
+            const auto start = std::chrono::steady_clock::now();
+            std::unique_ptr<Jit> orc = Jit::create(OptLevel::O2, errors);
+            orc->add(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)), errors);
+            orc->run(errors);
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+        std::cout << "  lazy (orc):    " << lazy * 1000 << " ms\n";
+    }
+
+    // widest vector the optimizer used anywhere in module, in bits
+    static unsigned widestVector(llvm::Module &module) {
+        unsigned widest = 0;
+        for (llvm::Function &fn : module) {
+            for (llvm::BasicBlock &bb : fn) {
+                for (llvm::Instruction &inst : bb) {
+                    if (inst.getType()->isVectorTy()) {
+                        widest = std::max(widest, static_cast<unsigned>(
+                                                      inst.getType()->getPrimitiveSizeInBits().getFixedSize()));
+                    }
+                }
+            }
+        }
+        return widest;
+    }
+
+    // a conditional sum, optimized and compiled for the baseline x86-64 and
+    // for the host cpu. the vectorizer's cost model only takes it when the
+    // target has wide enough 64-bit compares and blends.
+    static void bench_target_cpu() {
+        const int iterations = 100000000;
+        const std::string text = "var f = func(n, k) { var i = 0; var s = 0; while (i < n) { "
+                                 "if (i * i > k) { &s = s + 3; } else { &s = s - i; } &i = i + 1; } return s; }; "
+                                 "return f(" + std::to_string(iterations) + ", " + std::to_string(iterations) + ");";
+
+        std::cout << "vectorizable loop of " << iterations << " iterations, -O3\n";
+        for (const std::string cpu : {"x86-64", "native"}) {
+            std::vector<std::string> errors;
+            std::unique_ptr<llvm::TargetMachine> target = createTargetMachine({.cpu = cpu}, OptLevel::O3, errors);
+            std::unique_ptr<llvm::Module> module = compile(text);
+            setTarget(*module, *target);
+            optimizeModule(*module, {.level = OptLevel::O3}, target.get());
+            const unsigned widest = widestVector(*module);
+
+            llvm::SmallVector<std::string, 0> features;
+            for (const llvm::StringRef f : llvm::split(target->getTargetFeatureString(), ',')) {
+                features.push_back(f.str());
+            }
+            std::unique_ptr<llvm::ExecutionEngine> engine(llvm::EngineBuilder(std::move(module))
+                                                              .setEngineKind(llvm::EngineKind::JIT)
+                                                              .setMCPU(target->getTargetCPU())
+                                                              .setMAttrs(features)
+                                                              .create());
+            auto *entry = reinterpret_cast<int64_t (*)()>(engine->getFunctionAddress(entryName));
+            int64_t result = 0;
+            const double t = parserBench::bestOf(3, [&] { result = entry(); });
+            std::cout << "  " << target->getTargetCPU().str() << ": " << t * 1000 << " ms, widest vector " << widest
+                      << " bits (result " << result << ")\n";
+        }
+    }
+
+    // a program of many functions split into modules on 1 to 2x the
+    // hardware's threads, vs compiled whole on the calling thread. codegen
+    // alone, then all the way to an -O2 object, where each module is also
+    // optimized and lowered on its own thread.
+    static void bench_parallel_compile() {
+        const unsigned hardware = llvm::hardware_concurrency(0).compute_thread_count();
+        auto seconds = [](const auto &f) {
+            const auto start = std::chrono::steady_clock::now();
+            f();
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        const int functions = 10000;
+        std::string src = loopFunctions(functions) + "return f7(0, 10);";
+        lex l(src);
+        parser p(l.tokenizeAll());
+        std::unique_ptr<Program> program = p.parseProgram();
+        std::vector<std::string> errors;
+        std::cout << "codegen of " << functions << " functions, " << hardware << " hardware threads\n";
+        const double whole = parserBench::bestOf(3, [&] {
+            llvm::LLVMContext context;
+            compileProgram(*program, context, errors);
+        });
+        std::cout << "  whole:      " << whole * 1000 << " ms\n";
+        for (unsigned threads = 1; threads <= 2 * hardware; threads *= 2) {
+            const double t = parserBench::bestOf(3, [&] { compileProgramParallel(*program, threads, errors); });
+            std::cout << "  " << threads << " threads: " << t * 1000 << " ms, " << whole / t << "x\n";
+        }
+
+        const int objectFunctions = 2000;
+        const std::string path = "/tmp/banter_bench_parallel.bt";
+        std::ofstream(path) << loopFunctions(objectFunctions) << "return f7(0, 10);";
+        std::unique_ptr<llvm::TargetMachine> target = createTargetMachine({}, OptLevel::O2, errors);
+        DriverOptions options;
+        options.emit = EmitKind::OBJECT;
+        options.output = path + ".o";
+        std::cout << "-O2 object of " << objectFunctions << " functions\n";
+        const double sequential = seconds([&] { compileFile(path, options, *target, errors); });
+        std::cout << "  whole:      " << sequential * 1000 << " ms\n";
+        for (unsigned threads = 1; threads <= 2 * hardware; threads *= 2) {
+            options.threads = threads;
+            const double t = seconds([&] { compileFile(path, options, *target, errors); });
+            std::cout << "  " << threads << " threads: " << t * 1000 << " ms, " << sequential / t << "x\n";
+        }
+        std::remove(options.output.c_str());
+        std::remove(path.c_str());
+    }
+};
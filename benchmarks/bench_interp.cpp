@@ -0,0 +1,207 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <llvm/Support/TargetSelect.h>
+
+#include "../src/h/lex.h"
+#include "../src/h/parser.h"
+#include "../src/codegen/codegen.h"
+#include "../src/codegen/jit.h"
+#include "../src/h/flatAst.h"
+#include "../src/h/types.h"
+#include "../src/interp/bytecode.h"
+#include "../src/interp/interpreter.h"
+#include "../src/interp/tier.h"
+#include "bench_parser.cpp"
+
+struct interpBench {
+    static void bench_interp() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+
+        bench_crossover("loop sum", {10, 100, 1000, 10000, 100000, 1000000}, [](const int n) {
+            return "var i = 0; var s = 0; while (i < " + std::to_string(n) + ") { &s = s + i; &i = i + 1; } return s;";
+        });
+        bench_crossover("fib", {5, 10, 15, 20, 25}, [](const int n) {
+            return "var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; return fib(" +
+                   std::to_string(n) + ");";
+        });
+
+        bench_vm("fib(27)", "var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; "
+                            "return fib(27);", 635621, "calls");
+        bench_vm("loop sum", "var i = 0; var s = 0; while (i < 10000000) { &s = s + i; &i = i + 1; } return s;",
+                 10000000, "iterations");
+        bench_vm("array index", "var a = [3, 1, 4, 1, 5, 9, 2, 6, 5, 3]; var i = 0; var s = 0; "
+                                "while (i < 10000000) { &s = s + a[i % 10]; &i = i + 1; } return s;",
+                 10000000, "iterations");
+
+        bench_vm("scaled sum", "var i = 0; var j = 0; var s = 0; "
+                               "while (i < 10000000) { &j = i * 3 % 7; &s = s + j; &i = i + 1; } return s;",
+                 10000000, "iterations");
+
+        bench_types({
+            {"fib", "var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; "
+                    "return fib(27);"},
+            {"loop sum", "var i = 0; var s = 0; while (i < 100) { &s = s + i; &i = i + 1; } return s;"},
+            {"array index", "var a = [3, 1, 4, 1, 5, 9, 2, 6, 5, 3]; var i = 0; var s = 0; "
+                            "while (i < 100) { &s = s + a[i % 10]; &i = i + 1; } return s;"},
+            {"closures", "var adder = func(n) { return func(x) { return x + n; }; }; var add5 = adder(5); "
+                         "var twice = func(f, x) { return f(f(x)); }; return twice(add5, 1);"},
+            {"closures, annotated", "var adder = func(n: int): func { return func(x: int): int { return x + n; }; }; "
+                                    "var add5 = adder(5); var twice = func(f: func, x: int): int { return f(f(x)); }; "
+                                    "return twice(add5, 1);"},
+            {"strings", "var join = func(a, b) { return a + \", \" + b; }; var s = join(\"a\", \"b\"); "
+                        "var i = 0; while (i < 3) { &s = join(s, s[i]); &i = i + 1; } return s;"},
+            {"synthetic", parserBench::syntheticProgram(1000)},
+        });
+
+        bench_tiered("fib", {10, 15, 20, 25, 30}, [](const int n) {
+            return "var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; return fib(" +
+                   std::to_string(n) + ");";
+        });
+    }
+
+    static std::unique_ptr<Program> parse(const std::string &text) {
+        std::string src = text;
+        lex l(src);
+        parser p(l.tokenizeAll());
+        return p.parseProgram();
+    }
+
+    // what banter run -interp does
+    static int64_t interpreted(const std::string &text) {
+        std::unique_ptr<Program> program = parse(text);
+        std::vector<std::string> errors;
+        return interpretProgram(*program, errors)->asInt();
+    }
+
+    // what banter run does, at the given level
+    static int64_t jitted(const std::string &text, const OptLevel level) {
+        std::unique_ptr<Program> program = parse(text);
+        std::vector<std::string> errors;
+        auto context = std::make_unique<llvm::LLVMContext>();
+        std::unique_ptr<llvm::Module> module = compileProgram(*program, *context, errors);
+        std::unique_ptr<Jit> jit = Jit::create(level, errors);
+        jit->add(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)), errors);
+        return *jit->run(errors);
+    }
+
+    // the same program run by walking the tree and as bytecode, neither
+    // counting parsing or compiling. units is how many calls or iterations
+    // the program does.
+    static void bench_vm(const std::string &name, const std::string &text, const double units,
+                         const std::string &unit) {
+        std::unique_ptr<Program> program = parse(text);
+        std::vector<std::string> errors;
+        std::unique_ptr<Bytecode> bytecode;
+        const double compile = parserBench::bestOf(5, [&] {
+            bytecode = compileBytecode(FlatAst::fromProgram(*program), errors);
+        });
+
+        int64_t walked = 0;
+        int64_t ran = 0;
+        VmStats stats;
+        const double tree = parserBench::bestOf(3, [&] { walked = interpretProgram(*program, errors)->asInt(); });
+        const double vm = parserBench::bestOf(3, [&] { ran = runBytecode(*bytecode, errors, &stats)->asInt(); });
+        if (walked != ran) {
+            std::cout << name << ": results differ, " << walked << " " << ran << "\n";
+            return;
+        }
+        std::cout << name << ", " << bytecode->functions.size() << " functions compiled in " << compile * 1000
+                  << " ms\n"
+                  << "  tree walk: " << tree * 1000 << " ms, " << units / tree / 1e6 << " M " << unit << "/s\n"
+                  << "  bytecode:  " << vm * 1000 << " ms, " << units / vm / 1e6 << " M " << unit << "/s, "
+                  << static_cast<double>(stats.instructions) / vm / 1e6 << " M instructions/s ("
+                  << stats.instructions << " run), " << tree / vm << "x\n";
+    }
+
+    // how much of each program inferTypes proves of a single type, and
+    // how long it takes
+    static void bench_types(const std::vector<std::pair<std::string, std::string>> &corpus) {
+        std::cout << "types, proven of all expressions\n";
+        size_t expressions = 0;
+        size_t proven = 0;
+        for (const auto &[name, text] : corpus) {
+            std::unique_ptr<Program> program = parse(text);
+            const FlatAst ast = FlatAst::fromProgram(*program);
+            Types types;
+            const double infer = parserBench::bestOf(5, [&] { types = inferTypes(ast); });
+            expressions += types.expressions;
+            proven += types.proven;
+            std::cout << "  " << name << ": " << types.proven << " of " << types.expressions << ", "
+                      << 100.0 * static_cast<double>(types.proven) / static_cast<double>(types.expressions)
+                      << "%, in " << infer * 1000 << " ms\n";
+        }
+        std::cout << "  all: " << proven << " of " << expressions << ", "
+                  << 100.0 * static_cast<double>(proven) / static_cast<double>(expressions) << "%\n";
+    }
+
+    // source to result as bytecode, tiered and jitted, for growing n. the
+    // tiered run counts until the program is done, not until whatever it
+    // left compiling is.
+    static void bench_tiered(const std::string &name, const std::vector<int> &sizes,
+                             const std::function<std::string(int)> &program) {
+        std::cout << name << ", source to result\n";
+        for (const int n : sizes) {
+            const std::string text = program(n);
+            int64_t a = 0;
+            int64_t b = 0;
+            int64_t c = 0;
+            std::vector<std::string> errors;
+            // kept out of the timing: waiting out a compile still running
+            std::vector<std::pair<std::unique_ptr<Program>, std::unique_ptr<Tiers>>> done;
+            const double vm = parserBench::bestOf(3, [&] {
+                a = runBytecode(*compileBytecode(FlatAst::fromProgram(*parse(text)), errors), errors)->asInt();
+            });
+            const double tiered = parserBench::bestOf(3, [&] {
+                auto &[parsed, tiers] = done.emplace_back(parse(text), nullptr);
+                tiers = Tiers::create(*parsed, {}, errors);
+                b = tiers->run(errors)->asInt();
+            });
+            const double jit = parserBench::bestOf(3, [&] { c = jitted(text, OptLevel::O2); });
+            if (a != b || a != c) {
+                std::cout << "  n=" << n << ": results differ, " << a << " " << b << " " << c << "\n";
+                return;
+            }
+            std::cout << "  n=" << n << ": bytecode " << vm * 1000 << " ms, tiered " << tiered * 1000
+                      << " ms, jit -O2 " << jit * 1000 << " ms\n";
+        }
+    }
+
+    // source to result, interpreted and jitted, for growing n. the crossover
+    // is the first n the jit gets there sooner.
+    static void bench_crossover(const std::string &name, const std::vector<int> &sizes,
+                                const std::function<std::string(int)> &program) {
+        std::cout << name << ", source to result\n";
+        int crossover = -1;
+        for (const int n : sizes) {
+            const std::string text = program(n);
+            int64_t a = 0;
+            int64_t b = 0;
+            int64_t c = 0;
+            const double interp = parserBench::bestOf(5, [&] { a = interpreted(text); });
+            const double o0 = parserBench::bestOf(5, [&] { b = jitted(text, OptLevel::O0); });
+            const double o2 = parserBench::bestOf(5, [&] { c = jitted(text, OptLevel::O2); });
+            if (a != b || a != c) {
+                std::cout << "  n=" << n << ": results differ, " << a << " " << b << " " << c << "\n";
+                return;
+            }
+            std::cout << "  n=" << n << ": interp " << interp * 1000 << " ms, jit -O0 " << o0 * 1000
+                      << " ms, jit -O2 " << o2 * 1000 << " ms\n";
+            if (crossover < 0 && std::min(o0, o2) < interp) {
+                crossover = n;
+            }
+        }
+        if (crossover < 0) {
+            std::cout << "  the interpreter was faster throughout\n";
+        } else {
+            std::cout << "  the jit is faster from n=" << crossover << "\n";
+        }
+    }
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/h/driver.h"
+#include "../src/h/lex.h"
+#include "../src/h/parser.h"
+
+struct parserBench {
+    static void bench_parser() {
+        bench_token_modes();
+        bench_ast_lifetime();
+        bench_nested_expressions();
+        bench_parallel_files();
+        bench_reparse();
+    }
+
+    // a flat script of simple declarations, functions and control flow,
+    // roughly what our generators emit
+    static std::string syntheticProgram(const int stmts) {
+        std::string src;
+        for (int i = 0; i < stmts; i++) {
+            const std::string n = std::to_string(i);
+            src += "var x" + n + " = (x" + n + " + " + n + ") * 3 - y % 7;\n";
+            src += "var f" + n + " = func(a, b) { return a + b * " + n + "; };\n";
+            src += "if (x" + n + " < " + n + ") { f" + n + "(x" + n + ", 2); } else { [1, 2, 3][0]; };\n";
+        }
+        return src;
+    }
+
+    template <typename F>
+    static double bestOf(const int runs, F &&f) {
+        double best = 1e300;
+        for (int r = 0; r < runs; r++) {
+            const auto t0 = std::chrono::steady_clock::now();
+            f();
+            const auto t1 = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+        }
+        return best;
+    }
+
+    // pull mode lexes token by token under the parser, batch mode lexes the
+    // whole input into a TokenBuffer first and parses by index. both timings
+    // include lexing.
+    static void bench_token_modes() {
+        const std::string src = syntheticProgram(20000);
+
+        std::string copy = src;
+        const size_t tokens = lex(copy).tokenizeAll().size();
+
+        const double pull = bestOf(5, [&] {
+            std::string s = src;
+            const lex l(s);
+            parser p(l);
+            auto program = p.parseProgram();
+        });
+        const double batch = bestOf(5, [&] {
+            std::string s = src;
+            lex l(s);
+            parser p(l.tokenizeAll());
+            auto program = p.parseProgram();
+        });
+
+        std::cout << "parse " << tokens << " tokens\n";
+        std::cout << "  pull mode:  " << static_cast<long>(tokens / pull) << " tokens/sec\n";
+        std::cout << "  batch mode: " << static_cast<long>(tokens / batch) << " tokens/sec\n";
+    }
+
+    // parse and teardown of a large program. the ast lives in the program's
+    // arena, so teardown should be flat regardless of node count.
+    static void bench_ast_lifetime() {
+        const std::string src = syntheticProgram(50000);
+
+        double parse = 1e300, teardown = 1e300;
+        size_t arenaBytes = 0, statements = 0;
+        for (int r = 0; r < 5; r++) {
+            std::string s = src;
+            const lex l(s);
+            parser p(l);
+
+            auto t0 = std::chrono::steady_clock::now();
+            std::unique_ptr<Program> program = p.parseProgram();
+            auto t1 = std::chrono::steady_clock::now();
+            parse = std::min(parse, std::chrono::duration<double>(t1 - t0).count());
+            arenaBytes = program->arena.bytesReserved();
+            statements = program->statements.size();
+
+            t0 = std::chrono::steady_clock::now();
+            program.reset();
+            t1 = std::chrono::steady_clock::now();
+            teardown = std::min(teardown, std::chrono::duration<double>(t1 - t0).count());
+        }
+
+        std::cout << "ast of " << statements << " statements, " << arenaBytes / 1024 << " KiB arena\n";
+        std::cout << "  parse:    " << parse * 1000 << " ms\n";
+        std::cout << "  teardown: " << teardown * 1000 << " ms\n";
+    }
+
+    // deeply nested arithmetic, where parse time is almost all prefix/infix
+    // dispatch and precedence lookups rather than statements
+    static std::string nestedExpression(const int depth) {
+        std::string expr = "1";
+        const char *ops[] = {" + ", " * ", " - ", " / ", " % ", " < ", " == "};
+        for (int i = 0; i < depth; i++) {
+            expr = "(" + expr + ops[i % 7] + std::to_string(i) + " * -x" + std::to_string(i % 10) + ")";
+        }
+        return expr + ";\n";
+    }
+
+    static void bench_nested_expressions() {
+        const std::string one = nestedExpression(200);
+        std::string src;
+        const int count = 2000;
+        for (int i = 0; i < count; i++) {
+            src += one;
+        }
+
+        // lex up front so only parsing is timed
+        std::vector<TokenBuffer> buffers;
+        for (int r = 0; r < 5; r++) {
+            std::string s = src;
+            buffers.push_back(lex(s).tokenizeAll());
+        }
+        int run = 0;
+        const double t = bestOf(5, [&] {
+            parser p(std::move(buffers[run++]));
+            auto program = p.parseProgram();
+        });
+
+        // every level adds a grouped expression and three infix/prefix nodes
+        const double exprs = count * 200.0 * 4;
+        std::cout << "nested arithmetic, depth 200 x " << count << "\n";
+        std::cout << "  " << static_cast<long>(exprs / t) << " expressions/sec\n";
+    }
+
+    // a project's worth of files parsed one by one on this thread, then
+    // through parseFiles on 1 to 2x the hardware's threads. most files are small, every 40th is 40 times the
+    // size, so a static split would leave threads idle behind the big ones.
+    static void bench_parallel_files() {
+        const int files = 400;
+        std::vector<std::string> paths;
+        size_t bytes = 0;
+        for (int i = 0; i < files; i++) {
+            const std::string src = syntheticProgram(i % 40 == 0 ? 2000 : 50);
+            paths.push_back("/tmp/banter_bench_file_" + std::to_string(i) + ".bt");
+            std::ofstream(paths.back()) << src;
+            bytes += src.size();
+        }
+
+        const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+        std::cout << files << " files, " << bytes / (1 << 20) << " MiB, " << hardware << " hardware threads\n";
+        const double serial = bestOf(5, [&] {
+            for (const std::string &path : paths) {
+                std::vector<std::string> errors;
+                parseFile(path, errors);
+            }
+        });
+        std::cout << "  one by one: " << serial * 1000 << " ms, " << files / serial << " files/s\n";
+        for (unsigned threads = 1; threads <= 2 * hardware; threads *= 2) {
+            const double t = bestOf(5, [&] { parseFiles(paths, threads); });
+            std::cout << "  " << threads << " threads: " << t * 1000 << " ms, " << files / t << " files/s, "
+                      << bytes / t / (1 << 20) << " MiB/s\n";
+        }
+        for (const std::string &path : paths) {
+            std::remove(path.c_str());
+        }
+    }
+
+    // a 50k line file edited in its middle: one digit changed in place, then
+    // a line added and taken out again, which moves every line after it.
+    // each edit is undone by the next, so every run sees the same text.
+    static void bench_reparse() {
+        const std::string src = syntheticProgram(50000 / 3);
+        const size_t middle = src.find("var x8333 ");
+        const size_t digit = src.find("+ 8333", middle) + 2;
+
+        std::unique_ptr<Program> program;
+        const double full = bestOf(5, [&] {
+            program = parser::parseEditable(std::make_shared<const SourceBuffer>(src));
+        });
+
+        auto time = [&](const TextEdit &edit, const TextEdit &undo) {
+            double best = 1e300;
+            for (int r = 0; r < 20; r++) {
+                const auto t0 = std::chrono::steady_clock::now();
+                program = parser::reparse(std::move(program), edit);
+                const auto t1 = std::chrono::steady_clock::now();
+                program = parser::reparse(std::move(program), undo);
+                best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+            }
+            return best;
+        };
+        const double inPlace = time({digit, 1, "9"}, {digit, 1, "8"});
+        const double newLine = time({middle, 0, "var w = 1;\n"}, {middle, 11, ""});
+
+        std::cout << "reparse of " << program->units.size() << " statements, " << src.size() / 1024 << " KiB\n";
+        std::cout << "  full parse:   " << full * 1000 << " ms\n";
+        std::cout << "  edit in line: " << inPlace * 1e6 << " us\n";
+        std::cout << "  add a line:   " << newLine * 1e6 << " us\n";
+    }
+};
@@ -0,0 +1,42 @@
+#include <cstdlib>
+
+#include "h/arena.h"
+
+Arena::~Arena() {
+    while (head != nullptr) {
+        Block *next = head->next;
+        std::free(head);
+        head = next;
+    }
+}
+
+Arena::Arena(Arena &&other) noexcept
+    : head(std::exchange(other.head, nullptr)), cur(std::exchange(other.cur, nullptr)),
+      end(std::exchange(other.end, nullptr)), used(std::exchange(other.used, 0)),
+      reserved(std::exchange(other.reserved, 0)) {}
+
+Arena &Arena::operator=(Arena &&other) noexcept {
+    if (this != &other) {
+        this->~Arena();
+        new (this) Arena(std::move(other));
+    }
+    return *this;
+}
+
+void *Arena::allocateSlow(const size_t size, const size_t align) {
+    // oversized requests get a block of their own, everything else starts a
+    // fresh standard block
+    const size_t payload = size + align > blockSize ? size + align : blockSize;
+    auto *block = static_cast<Block *>(std::malloc(sizeof(Block) + payload));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    block->next = head;
+    block->size = payload;
+    head = block;
+    reserved += sizeof(Block) + payload;
+
+    cur = reinterpret_cast<char *>(block + 1);
+    end = cur + payload;
+    return allocate(size, align);
+}
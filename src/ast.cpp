@@ -18,6 +18,26 @@ std::string Program::toString() {
     return res;
 }
 
+std::string_view annotationName(const Annotation annotation) {
+    switch (annotation) {
+        case Annotation::NONE: return "";
+        case Annotation::INT: return "int";
+        case Annotation::BOOL: return "bool";
+        case Annotation::STRING: return "string";
+        case Annotation::ARRAY: return "array";
+        case Annotation::FUNC: return "func";
+    }
+    return "";
+}
+
+std::string Identifier::toString() {
+    std::string res(value);
+    if (annotation != Annotation::NONE) {
+        res += ": " + std::string(annotationName(annotation));
+    }
+    return res;
+}
+
 std::string DeclareStatement::toString() {
     std::string res = tokenLiteral() + " " + name->toString() +
         " = ";
@@ -65,12 +85,12 @@ std::string BlockStatement::toString() {
 }
 
 std::string PrefixExpression::toString() {
-    std::string res = "(" + op + rhs->toString() + ")";
+    std::string res = "(" + std::string(op) + rhs->toString() + ")";
     return res;
 }
 
 std::string InfixExpression::toString() {
-    std::string res = "(" + lhs->toString() + op + rhs->toString() + ")";
+    std::string res = "(" + lhs->toString() + std::string(op) + rhs->toString() + ")";
     return res;
 }
 
@@ -93,6 +113,9 @@ std::string FuncLiteral::toString() {
         res += param->toString() + ", ";
     }
     res += ")";
+    if (returns != Annotation::NONE) {
+        res += ": " + std::string(annotationName(returns)) + " ";
+    }
     res += body->toString();
     return res;
 }
@@ -117,4 +140,107 @@ std::string CallExpression::toString() {
 
 std::string IndexExpression::toString() {
     return "(" + array->toString() + "[" + index->toString() + "])";
-}
\ No newline at end of file
+}
+// a failed parse leaves nullptrs in the tree
+static void shift(Node *node, const int delta) {
+    if (node != nullptr) {
+        node->shiftLines(delta);
+    }
+}
+
+void Program::shiftLines(const int delta) {
+    for (Statement *stmt : statements) {
+        shift(stmt, delta);
+    }
+}
+
+void Program::settleLines() {
+    for (ParsedUnit &unit : units) {
+        if (unit.shift != 0) {
+            shift(unit.statement, unit.shift);
+            unit.shift = 0;
+        }
+    }
+}
+
+void BlockStatement::shiftLines(const int delta) {
+    tok.line += delta;
+    for (Statement *stmt : statements) {
+        shift(stmt, delta);
+    }
+}
+
+void FuncLiteral::shiftLines(const int delta) {
+    tok.line += delta;
+    for (Identifier *param : params) {
+        shift(param, delta);
+    }
+    shift(body, delta);
+}
+
+void ArrayLiteral::shiftLines(const int delta) {
+    tok.line += delta;
+    for (Expression *element : elements) {
+        shift(element, delta);
+    }
+}
+
+void CallExpression::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(callee, delta);
+    for (Expression *arg : arguments) {
+        shift(arg, delta);
+    }
+}
+
+void IndexExpression::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(array, delta);
+    shift(index, delta);
+}
+
+void PrefixExpression::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(rhs, delta);
+}
+
+void InfixExpression::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(lhs, delta);
+    shift(rhs, delta);
+}
+
+void IfExpression::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(condition, delta);
+    shift(consequence, delta);
+    shift(alternative, delta);
+}
+
+void WhileExpression::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(condition, delta);
+    shift(consequence, delta);
+}
+
+void DeclareStatement::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(name, delta);
+    shift(value, delta);
+}
+
+void ReferenceStatement::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(name, delta);
+    shift(value, delta);
+}
+
+void ReturnStatement::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(returnVal, delta);
+}
+
+void ExpressionStatement::shiftLines(const int delta) {
+    tok.line += delta;
+    shift(expression, delta);
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "aot.h"
+
+static llvm::CodeGenOpt::Level codegenLevel(const OptLevel level) {
+    switch (level) {
+        case OptLevel::O0: return llvm::CodeGenOpt::None;
+        case OptLevel::O1: return llvm::CodeGenOpt::Less;
+        case OptLevel::O2: return llvm::CodeGenOpt::Default;
+        case OptLevel::O3: return llvm::CodeGenOpt::Aggressive;
+    }
+    return llvm::CodeGenOpt::Default;
+}
+
+// every feature the host cpu reports, in a stable order
+static std::string hostFeatures() {
+    llvm::StringMap<bool> host;
+    if (!llvm::sys::getHostCPUFeatures(host)) {
+        return "";
+    }
+    std::vector<std::string> names;
+    for (const auto &feature : host) {
+        names.push_back((feature.second ? "+" : "-") + feature.first().str());
+    }
+    std::sort(names.begin(), names.end());
+    llvm::SubtargetFeatures features;
+    for (const std::string &name : names) {
+        features.AddFeature(name);
+    }
+    return features.getString();
+}
+
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(const TargetSpec &spec, const OptLevel level,
+                                                         std::vector<std::string> &errors) {
+    // only the native target is linked in
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    const std::string triple =
+        spec.triple.empty() ? llvm::sys::getDefaultTargetTriple() : llvm::Triple::normalize(spec.triple);
+    std::string error;
+    const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (target == nullptr) {
+        errors.push_back("unsupported target " + triple + ": " + error);
+        return nullptr;
+    }
+
+    std::string cpu = spec.cpu;
+    std::string features = spec.features;
+    if (cpu == "native") {
+        cpu = llvm::sys::getHostCPUName().str();
+        const std::string host = hostFeatures();
+        features = features.empty() ? host : host + "," + features;
+    }
+    // llvm only warns about an unknown cpu and carries on with the baseline
+    const std::unique_ptr<llvm::MCSubtargetInfo> baseline(target->createMCSubtargetInfo(triple, "", ""));
+    if (!cpu.empty() && !baseline->isCPUStringValid(cpu)) {
+        errors.push_back("unknown cpu " + cpu + " for " + triple);
+        return nullptr;
+    }
+
+    std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+        triple, cpu, features, llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::None, codegenLevel(level)));
+    if (machine == nullptr) {
+        errors.push_back("unable to create a target machine for " + triple);
+    }
+    return machine;
+}
+
+void setTarget(llvm::Module &module, const llvm::TargetMachine &target) {
+    module.setTargetTriple(target.getTargetTriple().str());
+    module.setDataLayout(target.createDataLayout());
+}
+
+bool emitObject(llvm::Module &module, llvm::TargetMachine &target, llvm::SmallVectorImpl<char> &object,
+                std::vector<std::string> &errors) {
+    setTarget(module, target);
+
+    llvm::raw_svector_ostream out(object);
+    // machine code generation still runs on the legacy pass manager
+    llvm::legacy::PassManager passes;
+    if (target.addPassesToEmitFile(passes, out, nullptr, llvm::CGFT_ObjectFile)) {
+        errors.push_back(target.getTargetTriple().str() + " can't emit object files");
+        return false;
+    }
+    passes.run(module);
+    return true;
+}
+
+bool emitObjectFile(llvm::Module &module, llvm::TargetMachine &target, const std::string &path,
+                    std::vector<std::string> &errors) {
+    llvm::SmallVector<char, 0> object;
+    return emitObject(module, target, object, errors) &&
+           writeObjectFile(path, llvm::StringRef(object.data(), object.size()), errors);
+}
+
+bool writeObjectFile(const std::string &path, const llvm::StringRef object, std::vector<std::string> &errors) {
+    std::error_code ec;
+    llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+    if (ec) {
+        errors.push_back("unable to write " + path + ": " + ec.message());
+        return false;
+    }
+    out << object;
+    out.close();
+    if (out.has_error()) {
+        errors.push_back("unable to write " + path + ": " + out.error().message());
+        out.clear_error();
+        return false;
+    }
+    return true;
+}
+
+// renames the program's function called name, if any, out of the runtime's
+// way. banter identifiers can't contain a dot, so the new name is free.
+static void moveAside(llvm::Module &module, const llvm::StringRef name) {
+    if (llvm::Function *fn = module.getFunction(name)) {
+        fn->setName("banter." + name);
+    }
+}
+
+void addRuntimeMain(llvm::Module &module) {
+    for (llvm::Function &fn : module) {
+        if (!fn.isDeclaration()) {
+            fn.setLinkage(llvm::GlobalValue::InternalLinkage);
+        }
+    }
+    moveAside(module, "main");
+    moveAside(module, "printf");
+
+    llvm::LLVMContext &context = module.getContext();
+    llvm::Type *i32 = llvm::Type::getInt32Ty(context);
+    const llvm::FunctionCallee printf =
+        module.getOrInsertFunction("printf", llvm::FunctionType::get(i32, {llvm::Type::getInt8PtrTy(context)}, true));
+    llvm::Function *main =
+        llvm::Function::Create(llvm::FunctionType::get(i32, false), llvm::Function::ExternalLinkage, "main", module);
+
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", main));
+    llvm::Value *result = builder.CreateCall(module.getFunction(entryName), {}, "result");
+    builder.CreateCall(printf, {builder.CreateGlobalStringPtr("%lld\n", "format"), result});
+    builder.CreateRet(builder.getInt32(0));
+}
+
+void hideProgramSymbols(llvm::Module &module) {
+    for (llvm::Function &fn : module) {
+        if (fn.hasLocalLinkage() || fn.getName() == entryName) {
+            continue;
+        }
+        fn.setName("banter." + fn.getName());
+        if (!fn.isDeclaration()) {
+            fn.setVisibility(llvm::GlobalValue::HiddenVisibility);
+        }
+    }
+}
+
+// runs the system c compiler driver, $CC or else cc, on objects with flags
+// in front, writing path
+static bool runLinker(const std::vector<llvm::StringRef> &flags, const std::vector<std::string> &objects,
+                      const std::string &path, std::vector<std::string> &errors) {
+    const char *cc = std::getenv("CC");
+    const llvm::ErrorOr<std::string> program = llvm::sys::findProgramByName(cc != nullptr && *cc ? cc : "cc");
+    if (!program) {
+        errors.push_back("no c compiler to link with: " + program.getError().message());
+        return false;
+    }
+    std::vector<llvm::StringRef> args{*program};
+    args.insert(args.end(), flags.begin(), flags.end());
+    args.insert(args.end(), objects.begin(), objects.end());
+    args.insert(args.end(), {"-o", path});
+    std::string message;
+    const int status = llvm::sys::ExecuteAndWait(*program, args, llvm::None, {}, 0, 0, &message);
+    if (status != 0) {
+        errors.push_back("linking " + path + " failed" + (message.empty() ? "" : ": " + message));
+        return false;
+    }
+    return true;
+}
+
+bool linkExecutable(const std::vector<std::string> &objects, const std::string &path,
+                    std::vector<std::string> &errors) {
+    return runLinker({}, objects, path, errors);
+}
+
+bool linkObjects(const std::vector<std::string> &objects, const std::string &path, std::vector<std::string> &errors) {
+    return runLinker({"-r", "-nostdlib"}, objects, path, errors);
+}
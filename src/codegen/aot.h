@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef AOT_H
+#define AOT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "codegen.h"
+
+// the machine code is generated for
+struct TargetSpec {
+    // empty for the host's
+    std::string triple{};
+    // empty for the triple's baseline, say x86-64, or "native" for the host's
+    // cpu along with every feature it reports, avx512 included
+    std::string cpu{};
+    // llvm -mattr style, "+avx2,-fma", on top of what cpu implies
+    std::string features{};
+};
+
+// nullptr, with the reason in errors, for an unknown triple or cpu. code is
+// position independent, so objects link into the default pie executables.
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(const TargetSpec &spec, OptLevel level,
+                                                         std::vector<std::string> &errors);
+
+// stamps module with target's triple and data layout. compileProgram leaves
+// both unset, so do this before optimizing for target.
+void setTarget(llvm::Module &module, const llvm::TargetMachine &target);
+
+// lowers module through target to an object, in memory or in a file at path
+bool emitObject(llvm::Module &module, llvm::TargetMachine &target, llvm::SmallVectorImpl<char> &object,
+                std::vector<std::string> &errors);
+bool emitObjectFile(llvm::Module &module, llvm::TargetMachine &target, const std::string &path,
+                    std::vector<std::string> &errors);
+bool writeObjectFile(const std::string &path, llvm::StringRef object, std::vector<std::string> &errors);
+
+// the runtime of a standalone program: adds `int main()`, which calls
+// banter_main and prints what it returns, like banter run does. every other
+// function becomes internal, so the program's names can't clash with libc's
+// at link time and the optimizer may drop what main never reaches.
+void addRuntimeMain(llvm::Module &module);
+
+// addRuntimeMain's guard against libc for a program split into modules, see
+// compileProgramParallel, whose functions other modules call and so can't
+// be internal. renames every function, defined or declared, banter_main
+// aside, to a name banter identifiers can't spell, and hides the defined
+// ones from the dynamic linker. the same in every module of the program,
+// before addRuntimeMain on banter_main's.
+void hideProgramSymbols(llvm::Module &module);
+
+// links objects, one of which has to define main, into an executable at
+// path with the system c compiler driver, $CC or else cc
+bool linkExecutable(const std::vector<std::string> &objects, const std::string &path,
+                    std::vector<std::string> &errors);
+// merges objects into the one relocatable object at path, like ld -r, with
+// the same driver
+bool linkObjects(const std::vector<std::string> &objects, const std::string &path, std::vector<std::string> &errors);
+
+#endif //AOT_H
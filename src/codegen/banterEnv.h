@@ -9,24 +9,86 @@
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cctype>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
-static llvm::LLVMContext theContext;
-static llvm::IRBuilder<> theBuilder(theContext);
-static std::unique_ptr<llvm::Module> theModule;
-static std::map<std::string, llvm::Value *> NamedValues;
+#include "../h/intern.h"
+#include "codegen.h"
+
+// a function declared by a top-level statement. a parallel compile names
+// each up front, uniquely across the program, so the job emitting it and
+// every job calling it agree on the name.
+struct TopLevelFunction {
+    FuncLiteral *lit;
+    Symbol sym;
+    std::string name;
+    size_t position; // of its statement in the program
+};
+
+// what every job of a parallel compile knows of the top level
+struct TopLevel {
+    std::vector<TopLevelFunction> functions;
+    // each top-level declaration of a symbol in order, by position, with its
+    // function or nullptr for a variable. indexed by symbol.
+    std::vector<std::vector<std::pair<size_t, const TopLevelFunction *>>> declarations;
+    std::unordered_map<const FuncLiteral *, const TopLevelFunction *> byLiteral;
+};
+
+constexpr size_t NoPosition = SIZE_MAX;
+
+// one codegen job: the module being filled in and everything the emitter
+// tracks on its way through the tree. a job touches nothing outside itself
+// and its context, so jobs on contexts of their own can run at once.
+struct CodegenJob {
+    llvm::LLVMContext &context;
+    llvm::IRBuilder<> builder;
+    std::unique_ptr<llvm::Module> module;
+    // what each name in scope is bound to: the entry-block alloca of a local
+    // or a function. indexed by interned symbol, see Identifier::sym, with
+    // the innermost binding at the back, so shadowing is a push and a lookup
+    // never walks outward through scopes.
+    std::vector<std::vector<llvm::Value *>> bindings;
+    // the symbols each open scope declared, innermost last. closing a scope
+    // pops their bindings.
+    std::vector<std::vector<Symbol>> scopes;
+    CodegenOptions options;
+
+    // exit blocks of the while loops being emitted, innermost last
+    std::vector<llvm::BasicBlock *> loops;
+    std::vector<std::string> errors;
+
+    // set for the jobs of a parallel compile, whose top-level functions are
+    // emitted elsewhere and only declared in this module
+    const TopLevel *topLevel = nullptr;
+    // the statement position of the top-level function being emitted. a name
+    // bound nowhere in the job is the top-level function last declared
+    // before it. NoPosition in banter_main's job, which binds them in order.
+    size_t position = NoPosition;
+    // qualifies the names of nested function literals, which keeps them
+    // apart across jobs
+    std::string prefix;
+
+    CodegenJob(llvm::LLVMContext &context, const CodegenOptions &options)
+        : context(context), builder(context), module(std::make_unique<llvm::Module>("banter", context)),
+          options(options) {}
+};
 
 #endif //BANTER_H
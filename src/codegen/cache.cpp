@@ -0,0 +1,177 @@
+#include <algorithm>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SHA256.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "cache.h"
+
+std::string CompileCache::key(const std::string_view source, const std::string_view kind, const OptLevel level,
+                              const llvm::TargetMachine &target) {
+    // the host's feature list comes out of a hash map, so order it
+    llvm::SmallVector<llvm::StringRef, 64> features;
+    llvm::SplitString(target.getTargetFeatureString(), features, ",");
+    std::sort(features.begin(), features.end());
+
+    llvm::SHA256 hash;
+    // every part is length prefixed, so no two different lists hash the same
+    auto part = [&hash](const llvm::StringRef s) {
+        const uint64_t size = s.size();
+        hash.update(llvm::ArrayRef(reinterpret_cast<const uint8_t *>(&size), sizeof size));
+        hash.update(s);
+    };
+    part(compilerVersion);
+    part(LLVM_VERSION_STRING);
+    part(llvm::StringRef(kind.data(), kind.size()));
+    part(std::to_string(static_cast<int>(level)));
+    part(target.getTargetTriple().str());
+    part(target.getTargetCPU());
+    for (const llvm::StringRef f : features) {
+        part(f);
+    }
+    part(llvm::StringRef(source.data(), source.size()));
+    return llvm::toHex(hash.final(), true);
+}
+
+std::string CompileCache::key(const std::string_view source, const std::string_view kind) {
+    llvm::SHA256 hash;
+    auto part = [&hash](const llvm::StringRef s) {
+        const uint64_t size = s.size();
+        hash.update(llvm::ArrayRef(reinterpret_cast<const uint8_t *>(&size), sizeof size));
+        hash.update(s);
+    };
+    part(compilerVersion);
+    part(llvm::StringRef(kind.data(), kind.size()));
+    part(llvm::StringRef(source.data(), source.size()));
+    return llvm::toHex(hash.final(), true);
+}
+
+std::string CompileCache::pathOf(const std::string &key) const {
+    llvm::SmallString<256> path(dir);
+    llvm::sys::path::append(path, key);
+    return path.str().str();
+}
+
+bool CompileCache::write(const std::string &path, const llvm::StringRef bytes) {
+    if (llvm::sys::fs::create_directories(llvm::sys::path::parent_path(path))) {
+        return false;
+    }
+    int fd = -1;
+    llvm::SmallString<256> temp;
+    if (llvm::sys::fs::createUniqueFile(path + ".tmp%%%%%%", fd, temp)) {
+        return false;
+    }
+    {
+        llvm::raw_fd_ostream out(fd, true);
+        out << bytes;
+        out.close();
+        if (out.has_error()) {
+            out.clear_error();
+            llvm::sys::fs::remove(temp);
+            return false;
+        }
+    }
+    if (llvm::sys::fs::rename(temp, path)) {
+        llvm::sys::fs::remove(temp);
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<llvm::MemoryBuffer> CompileCache::load(const std::string &key) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file = llvm::MemoryBuffer::getFile(pathOf(key));
+    if (!file) {
+        counters.misses++;
+        return nullptr;
+    }
+    counters.hits++;
+    return std::move(*file);
+}
+
+void CompileCache::store(const std::string &key, const llvm::StringRef bytes) {
+    // a cache that can't be written to only costs the next compile its hit
+    counters.stores += write(pathOf(key), bytes);
+}
+
+static std::string objectName(const llvm::Module &module) {
+    for (const llvm::Function &fn : module) {
+        if (!fn.isDeclaration()) {
+            return fn.getName().str() + ".o";
+        }
+    }
+    return "";
+}
+
+std::vector<std::unique_ptr<llvm::MemoryBuffer>> CompileCache::loadObjects(const std::string &key) {
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects;
+    const std::string entry = pathOf(key);
+    llvm::SmallString<256> committed(entry);
+    llvm::sys::path::append(committed, "committed");
+    if (!llvm::sys::fs::exists(committed)) {
+        counters.misses++;
+        return objects;
+    }
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator it(entry, ec), end; it != end && !ec; it.increment(ec)) {
+        if (llvm::sys::path::extension(it->path()) != ".o") {
+            continue;
+        }
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file = llvm::MemoryBuffer::getFile(it->path());
+        if (!file) {
+            ec = file.getError();
+            break;
+        }
+        objects.push_back(std::move(*file));
+    }
+    if (ec) {
+        objects.clear();
+        counters.misses++;
+        return objects;
+    }
+    counters.hits++;
+    return objects;
+}
+
+void CompileCache::commitObjects() {
+    if (jitKey.empty()) {
+        return;
+    }
+    llvm::SmallString<256> committed(pathOf(jitKey));
+    llvm::sys::path::append(committed, "committed");
+    if (!llvm::sys::fs::exists(committed)) {
+        write(committed.str().str(), "");
+    }
+}
+
+void CompileCache::dropObjects(const std::string &key) {
+    llvm::sys::fs::remove_directories(pathOf(key));
+    if (counters.hits > 0) {
+        counters.hits--;
+    }
+    counters.misses++;
+}
+
+void CompileCache::notifyObjectCompiled(const llvm::Module *module, const llvm::MemoryBufferRef object) {
+    const std::string name = objectName(*module);
+    if (jitKey.empty() || name.empty()) {
+        return;
+    }
+    llvm::SmallString<256> path(pathOf(jitKey));
+    llvm::sys::path::append(path, name);
+    counters.stores += write(path.str().str(), object.getBuffer());
+}
+
+std::unique_ptr<llvm::MemoryBuffer> CompileCache::getObject(const llvm::Module *module) {
+    const std::string name = objectName(*module);
+    if (jitKey.empty() || name.empty()) {
+        return nullptr;
+    }
+    llvm::SmallString<256> path(pathOf(jitKey));
+    llvm::sys::path::append(path, name);
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file = llvm::MemoryBuffer::getFile(path);
+    return file ? std::move(*file) : nullptr;
+}
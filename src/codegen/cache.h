@@ -0,0 +1,78 @@
+#pragma once
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "codegen.h"
+
+// goes into every cache key along with llvm's version. bump it whenever the
+// same source starts compiling to different code.
+constexpr const char *compilerVersion = "banter 0.1";
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t stores = 0; // entries and jit objects written
+};
+
+// compiled code on disk, keyed by everything that decides it: the source
+// bytes, compiler and llvm versions, opt level, target and what kind of
+// output it is. an entry is either one file (an object for the whole
+// program) or a directory of jit objects, one per function, collected
+// through the llvm::ObjectCache interface as the jit compiles them.
+//
+// files are written under a temporary name and renamed into place, so
+// compilers sharing a directory never read a partial one.
+class CompileCache : public llvm::ObjectCache {
+    std::string dir;
+    std::string jitKey; // where notifyObjectCompiled files objects
+    CacheStats counters;
+
+    [[nodiscard]] std::string pathOf(const std::string &key) const;
+    bool write(const std::string &path, llvm::StringRef bytes);
+
+public:
+    // dir is created on first store
+    explicit CompileCache(std::string dir) : dir(std::move(dir)) {}
+
+    // hex digest naming an entry. kind tells outputs of one source apart,
+    // say "jit" and "object".
+    static std::string key(std::string_view source, std::string_view kind, OptLevel level,
+                           const llvm::TargetMachine &target);
+    // for outputs neither llvm nor the target has a say in, like bytecode
+    static std::string key(std::string_view source, std::string_view kind);
+
+    // single file entries. load counts a hit or a miss.
+    std::unique_ptr<llvm::MemoryBuffer> load(const std::string &key);
+    void store(const std::string &key, llvm::StringRef bytes);
+
+    // jit entries. every object of key's entry, or nothing on a miss, which
+    // is counted as such.
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> loadObjects(const std::string &key);
+    // objects the jit compiles from now on belong to key's entry, which
+    // only loads once committed, which the caller does once the jit has
+    // compiled every function, see Jit::compileAll
+    void collectObjects(const std::string &key) { jitKey = key; }
+    void commitObjects();
+    // key's entry, just loaded, didn't link after all. it's deleted, for
+    // the run to compile and collect it afresh, and its hit counts as a miss.
+    void dropObjects(const std::string &key);
+
+    // llvm::ObjectCache, for the jit's compiler. modules hold one function
+    // each, see Jit::add, and their objects are filed by its name.
+    void notifyObjectCompiled(const llvm::Module *module, llvm::MemoryBufferRef object) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *module) override;
+
+    [[nodiscard]] const CacheStats &stats() const { return counters; }
+};
+
+#endif //CACHE_H
@@ -1,82 +1,776 @@
+#include <iterator>
+
+#include <llvm/Support/ThreadPool.h>
+
 #include "banterEnv.h"
+#include "codegen.h"
 #include "../h/ast.h"
 
-llvm::Value *Node::codeGen() {
-    return nullptr;
+// a parallel compile deals the top-level functions out in this many slices
+// per thread, so a thread stuck on a slice of big functions doesn't hold
+// the others up for long
+constexpr size_t jobsPerThread = 4;
+
+// every value is either an i64 int or an i1 bool
+static llvm::Type *intType(CodegenJob &cg) {
+    return llvm::Type::getInt64Ty(cg.context);
 }
 
-llvm::Value *Statement::codeGen() {
-    return nullptr;
+static bool isBool(const llvm::Value *v) {
+    return v->getType()->isIntegerTy(1);
 }
 
-llvm::Value *Expression::codeGen() {
-    return nullptr;
+// a pointer is a function, which only a declaration can bind
+static std::string typeName(const llvm::Type *type) {
+    if (type->isPointerTy()) {
+        return "func";
+    }
+    return type->isIntegerTy(1) ? "bool" : "int";
 }
 
-llvm::Value *Program::codeGen() {
-    return nullptr;
+static llvm::Value *zero(CodegenJob &cg) {
+    return llvm::ConstantInt::get(intType(cg), 0);
 }
 
-llvm::Value *BlockStatement::codeGen() {
-    return nullptr;
+// ints are true unless 0
+static llvm::Value *truthy(CodegenJob &cg, llvm::Value *v) {
+    return isBool(v) ? v : cg.builder.CreateICmpNE(v, zero(cg), "tobool");
 }
 
-llvm::Value *IntLiteral::codeGen() {
+static llvm::Value *codegenError(CodegenJob &cg, const std::string &message, const int line) {
+    cg.errors.push_back(message + ", line=" + std::to_string(line));
     return nullptr;
 }
 
-llvm::Value *BoolLiteral::codeGen() {
-    return nullptr;
+static llvm::Value *unsupported(CodegenJob &cg, const std::string &what, const int line) {
+    return codegenError(cg, what + " not supported by codegen yet", line);
 }
 
-llvm::Value *StringLiteral::codeGen() {
-    return nullptr;
+// drops fn from the module if it fails to verify
+static llvm::Function *verified(CodegenJob &cg, llvm::Function *fn) {
+    std::string problems;
+    llvm::raw_string_ostream os(problems);
+    if (llvm::verifyFunction(*fn, &os)) {
+        cg.errors.push_back("invalid IR in " + fn->getName().str() + ": " + os.str());
+        fn->eraseFromParent();
+        return nullptr;
+    }
+    return fn;
 }
 
-llvm::Value *FuncLiteral::codeGen() {
-    return nullptr;
+static void openScope(CodegenJob &cg) {
+    cg.scopes.emplace_back();
 }
 
-llvm::Value *ArrayLiteral::codeGen() {
-    return nullptr;
+static void closeScope(CodegenJob &cg) {
+    for (const Symbol sym : cg.scopes.back()) {
+        cg.bindings[sym].pop_back();
+    }
+    cg.scopes.pop_back();
 }
 
-llvm::Value *CallExpression::codeGen() {
-    return nullptr;
+static void declare(CodegenJob &cg, const Symbol sym, llvm::Value *binding) {
+    if (sym >= cg.bindings.size()) {
+        cg.bindings.resize(sym + 1);
+    }
+    cg.bindings[sym].push_back(binding);
+    cg.scopes.back().push_back(sym);
 }
 
-llvm::Value *IndexExpression::codeGen() {
-    return nullptr;
+// functions take and return ints, bools passed in or returned are widened
+static llvm::FunctionType *functionType(CodegenJob &cg, const FuncLiteral *lit) {
+    const std::vector<llvm::Type *> params(lit->params.size(), intType(cg));
+    return llvm::FunctionType::get(intType(cg), params, false);
 }
 
-llvm::Value *PrefixExpression::codeGen() {
-    return nullptr;
+// a top-level function emitted by another job, declared in this one's module
+static llvm::Function *prototype(CodegenJob &cg, const TopLevelFunction &fn) {
+    if (llvm::Function *existing = cg.module->getFunction(fn.name)) {
+        return existing;
+    }
+    return llvm::Function::Create(functionType(cg, fn.lit), llvm::Function::ExternalLinkage, fn.name,
+                                  cg.module.get());
 }
 
-llvm::Value *InfixExpression::codeGen() {
-    return nullptr;
+// the top-level declaration of sym in scope where the job's function is
+// declared, if it's a function. a variable is nullptr like any unknown
+// name: functions can't capture it anyway.
+static llvm::Value *lookupTopLevel(CodegenJob &cg, const Symbol sym) {
+    if (cg.topLevel == nullptr || cg.position == NoPosition || sym >= cg.topLevel->declarations.size()) {
+        return nullptr;
+    }
+    const auto &declarations = cg.topLevel->declarations[sym];
+    const auto after = std::lower_bound(declarations.begin(), declarations.end(), cg.position,
+                                        [](const auto &d, const size_t position) { return d.first < position; });
+    if (after == declarations.begin() || std::prev(after)->second == nullptr) {
+        return nullptr;
+    }
+    return prototype(cg, *std::prev(after)->second);
 }
 
-llvm::Value *IfExpression::codeGen() {
-    return nullptr;
+// innermost binding of sym, nullptr if it isn't in scope
+static llvm::Value *lookup(CodegenJob &cg, const Symbol sym) {
+    if (sym < cg.bindings.size() && !cg.bindings[sym].empty()) {
+        return cg.bindings[sym].back();
+    }
+    return lookupTopLevel(cg, sym);
 }
 
-llvm::Value *WhileExpression::codeGen() {
-    return nullptr;
+// the stack slot of a local visible from the function being emitted.
+// functions don't close over the locals of the one they're declared in.
+static llvm::AllocaInst *lookupLocal(CodegenJob &cg, const Identifier *name, const int line) {
+    llvm::Value *binding = lookup(cg, name->sym);
+    if (binding == nullptr) {
+        codegenError(cg, "unknown identifier=" + std::string(name->value), line);
+        return nullptr;
+    }
+    auto *slot = llvm::dyn_cast<llvm::AllocaInst>(binding);
+    if (slot == nullptr) {
+        codegenError(cg, "function " + std::string(name->value) + " used as a value", line);
+        return nullptr;
+    }
+    if (slot->getFunction() != cg.builder.GetInsertBlock()->getParent()) {
+        codegenError(cg, "cannot capture " + std::string(name->value) + ", closures not supported by codegen yet",
+                     line);
+        return nullptr;
+    }
+    return slot;
 }
 
-llvm::Value *DeclareStatement::codeGen() {
-    return nullptr;
+// every local gets a slot at the top of its function's entry block, where
+// mem2reg can promote it
+static llvm::AllocaInst *entryBlockAlloca(CodegenJob &cg, llvm::Type *type, const std::string_view name) {
+    llvm::BasicBlock &entry = cg.builder.GetInsertBlock()->getParent()->getEntryBlock();
+    llvm::IRBuilder<> tmp(&entry, entry.begin());
+    return tmp.CreateAlloca(type, nullptr, name);
 }
 
-llvm::Value *ReferenceStatement::codeGen() {
+static void promoteLocals(llvm::Function *fn) {
+    std::vector<llvm::AllocaInst *> slots;
+    for (llvm::Instruction &inst : fn->getEntryBlock()) {
+        auto *slot = llvm::dyn_cast<llvm::AllocaInst>(&inst);
+        if (slot != nullptr && llvm::isAllocaPromotable(slot)) {
+            slots.push_back(slot);
+        }
+    }
+    if (!slots.empty()) {
+        llvm::DominatorTree dt(*fn);
+        llvm::PromoteMemToReg(slots, dt);
+    }
+}
+
+// falls off the end with 0, then promotes and verifies
+static llvm::Function *finishFunction(CodegenJob &cg, llvm::Function *fn) {
+    if (cg.builder.GetInsertBlock()->getTerminator() == nullptr) {
+        cg.builder.CreateRet(zero(cg));
+    }
+    if (cg.options.promoteLocals) {
+        promoteLocals(fn);
+    }
+    return verified(cg, fn);
+}
+
+// the module-level name of a function literal named name
+static std::string qualified(const CodegenJob &cg, const std::string_view name) {
+    return cg.prefix.empty() ? std::string(name) : cg.prefix + "." + std::string(name);
+}
+
+// a named function is bound before its body is emitted so it can recurse
+static llvm::Function *emitFunction(CodegenJob &cg, FuncLiteral *lit, const std::string &name, const Symbol sym) {
+    llvm::Function *fn =
+        llvm::Function::Create(functionType(cg, lit), llvm::Function::ExternalLinkage, name, cg.module.get());
+    if (sym != NoSymbol) {
+        declare(cg, sym, fn);
+    }
+
+    const llvm::IRBuilderBase::InsertPoint caller = cg.builder.saveIP();
+    std::vector<llvm::BasicBlock *> callerLoops = std::move(cg.loops);
+    cg.loops.clear();
+    cg.builder.SetInsertPoint(llvm::BasicBlock::Create(cg.context, "entry", fn));
+
+    // everything passed and returned is an i64, so an int annotation holds
+    // already, and no other can
+    if (lit->returns != Annotation::NONE && lit->returns != Annotation::INT) {
+        unsupported(cg, std::string(annotationName(lit->returns)) + " results", lit->tok.line);
+    }
+    openScope(cg);
+    for (size_t i = 0; i < lit->params.size(); i++) {
+        const Identifier *param = lit->params[i];
+        if (param->annotation != Annotation::NONE && param->annotation != Annotation::INT) {
+            unsupported(cg, std::string(annotationName(param->annotation)) + " parameters", param->tok.line);
+        }
+        llvm::Argument *arg = fn->getArg(i);
+        arg->setName(param->value);
+        llvm::AllocaInst *slot = entryBlockAlloca(cg, intType(cg), param->value);
+        cg.builder.CreateStore(arg, slot);
+        declare(cg, param->sym, slot);
+    }
+    if (lit->body != nullptr) {
+        lit->body->codeGen(cg);
+    }
+    closeScope(cg);
+
+    if (cg.errors.empty()) {
+        fn = finishFunction(cg, fn);
+    }
+    cg.loops = std::move(callerLoops);
+    cg.builder.restoreIP(caller);
+    return cg.errors.empty() ? fn : nullptr;
+}
+
+static llvm::Value *widen(CodegenJob &cg, llvm::Value *v) {
+    return isBool(v) ? cg.builder.CreateZExt(v, intType(cg), "booltmp") : v;
+}
+
+std::unique_ptr<llvm::Module> compileProgram(Program &program, llvm::LLVMContext &context,
+                                             std::vector<std::string> &errors, const CodegenOptions &options) {
+    program.settleLines();
+    CodegenJob cg(context, options);
+    program.codeGen(cg);
+    if (!cg.errors.empty()) {
+        errors.insert(errors.end(), cg.errors.begin(), cg.errors.end());
+        return nullptr;
+    }
+    return std::move(cg.module);
+}
+
+std::unique_ptr<llvm::Module> compileProgram(Program &program, std::vector<std::string> &errors,
+                                             const CodegenOptions &options) {
+    static llvm::LLVMContext shared;
+    return compileProgram(program, shared, errors, options);
+}
+
+// names every function a top-level statement declares, in statement order.
+// a name taken already, by banter_main or an earlier function, gets a
+// numbered suffix. nothing after a top-level return is ever emitted. token
+// lines are settled here, up front, as the jobs read them on threads.
+static TopLevel collectTopLevel(Program &program) {
+    program.settleLines();
+    TopLevel top;
+    top.functions.reserve(program.statements.size());
+    std::unordered_map<std::string_view, size_t> taken{{entryName, 1}};
+    for (size_t i = 0; i < program.statements.size(); i++) {
+        Statement *stmt = program.statements[i];
+        if (dynamic_cast<ReturnStatement *>(stmt) != nullptr) {
+            break;
+        }
+        auto *decl = dynamic_cast<DeclareStatement *>(stmt);
+        if (decl == nullptr || decl->name == nullptr) {
+            continue;
+        }
+        const TopLevelFunction *fn = nullptr;
+        if (auto *lit = dynamic_cast<FuncLiteral *>(decl->value)) {
+            std::string name(decl->name->value);
+            if (const size_t n = taken[decl->name->value]++; n > 0) {
+                name += "." + std::to_string(n);
+            }
+            fn = &top.functions.emplace_back(TopLevelFunction{lit, decl->name->sym, std::move(name), i});
+            top.byLiteral.emplace(lit, fn);
+        }
+        if (decl->name->sym >= top.declarations.size()) {
+            top.declarations.resize(decl->name->sym + 1);
+        }
+        top.declarations[decl->name->sym].emplace_back(i, fn);
+    }
+    return top;
+}
+
+std::vector<llvm::orc::ThreadSafeModule> compileProgramParallel(Program &program, const unsigned threads,
+                                                                std::vector<std::string> &errors,
+                                                                const CodegenOptions &options) {
+    const llvm::ThreadPoolStrategy strategy = llvm::hardware_concurrency(threads);
+    const TopLevel top = collectTopLevel(program);
+    const size_t functions = top.functions.size();
+    const size_t jobs = std::min<size_t>(functions, strategy.compute_thread_count() * jobsPerThread);
+
+    // banter_main's module first, then each job's
+    std::vector<llvm::orc::ThreadSafeModule> modules(jobs + 1);
+    std::vector<std::vector<std::string>> jobErrors(jobs + 1);
+    auto run = [&](const size_t job, const auto &emit) {
+        auto context = std::make_unique<llvm::LLVMContext>();
+        CodegenJob cg(*context, options);
+        cg.topLevel = &top;
+        emit(cg);
+        jobErrors[job] = std::move(cg.errors);
+        modules[job] = llvm::orc::ThreadSafeModule(std::move(cg.module), std::move(context));
+    };
+
+    llvm::ThreadPool pool(strategy);
+    pool.async([&] {
+        run(0, [&](CodegenJob &cg) {
+            cg.prefix = entryName;
+            program.codeGen(cg);
+        });
+    });
+    for (size_t job = 0; job < jobs; job++) {
+        pool.async([&, job] {
+            run(job + 1, [&](CodegenJob &cg) {
+                for (size_t i = job * functions / jobs; i < (job + 1) * functions / jobs && cg.errors.empty(); i++) {
+                    const TopLevelFunction &fn = top.functions[i];
+                    cg.position = fn.position;
+                    cg.prefix = fn.name;
+                    openScope(cg);
+                    emitFunction(cg, fn.lit, fn.name, fn.sym);
+                    closeScope(cg);
+                }
+            });
+        });
+    }
+    pool.wait();
+
+    // a job sees a slice of the program, and may have tripped over a name
+    // its function can't see, so leave wording the diagnostics to the one
+    // job that sees it all
+    if (std::any_of(jobErrors.begin(), jobErrors.end(), [](const auto &e) { return !e.empty(); })) {
+        modules.clear();
+        auto context = std::make_unique<llvm::LLVMContext>();
+        std::unique_ptr<llvm::Module> module = compileProgram(program, *context, errors, options);
+        if (module != nullptr) {
+            modules.emplace_back(std::move(module), std::move(context));
+        }
+    }
+    return modules;
+}
+
+TopLevelCompiler::TopLevelCompiler(Program &program)
+    : top(std::make_unique<TopLevel>(collectTopLevel(program))) {
+    for (const TopLevelFunction &fn : top->functions) {
+        byName.emplace(fn.name, &fn);
+    }
+}
+
+TopLevelCompiler::~TopLevelCompiler() = default;
+
+std::optional<std::string> TopLevelCompiler::nameAt(const size_t position) const {
+    const auto fn = std::lower_bound(top->functions.begin(), top->functions.end(), position,
+                                     [](const TopLevelFunction &f, const size_t p) { return f.position < p; });
+    if (fn == top->functions.end() || fn->position != position) {
+        return std::nullopt;
+    }
+    return fn->name;
+}
+
+std::optional<size_t> TopLevelCompiler::positionOf(const std::string &name) const {
+    const auto fn = byName.find(name);
+    if (fn == byName.end()) {
+        return std::nullopt;
+    }
+    return fn->second->position;
+}
+
+std::unique_ptr<llvm::Module> TopLevelCompiler::compile(const std::string &name, llvm::LLVMContext &context,
+                                                        std::vector<std::string> &errors,
+                                                        const CodegenOptions &options) {
+    const auto fn = byName.find(name);
+    if (fn == byName.end()) {
+        errors.push_back("no top-level function " + name);
+        return nullptr;
+    }
+    CodegenJob cg(context, options);
+    cg.topLevel = top.get();
+    cg.position = fn->second->position;
+    cg.prefix = name;
+    openScope(cg);
+    emitFunction(cg, fn->second->lit, name, fn->second->sym);
+    closeScope(cg);
+    if (!cg.errors.empty()) {
+        errors.insert(errors.end(), cg.errors.begin(), cg.errors.end());
+        return nullptr;
+    }
+    return std::move(cg.module);
+}
+
+llvm::Value *Node::codeGen(CodegenJob &) {
     return nullptr;
 }
 
-llvm::Value *ReturnStatement::codeGen() {
+llvm::Value *Statement::codeGen(CodegenJob &) {
     return nullptr;
 }
 
-llvm::Value *ExpressionStatement::codeGen() {
+llvm::Value *Expression::codeGen(CodegenJob &) {
     return nullptr;
 }
+
+llvm::Value *Program::codeGen(CodegenJob &cg) {
+    llvm::FunctionType *type = llvm::FunctionType::get(intType(cg), false);
+    llvm::Function *fn = llvm::Function::Create(type, llvm::Function::ExternalLinkage, entryName, cg.module.get());
+    cg.builder.SetInsertPoint(llvm::BasicBlock::Create(cg.context, "entry", fn));
+
+    openScope(cg);
+    for (Statement *stmt : statements) {
+        if (stmt == nullptr) {
+            continue;
+        }
+        stmt->codeGen(cg);
+        // anything after a top-level return is unreachable
+        if (!cg.errors.empty() || cg.builder.GetInsertBlock()->getTerminator() != nullptr) {
+            break;
+        }
+    }
+    closeScope(cg);
+    if (!cg.errors.empty()) {
+        return nullptr;
+    }
+    return finishFunction(cg, fn);
+}
+
+// a block is a scope. its value is that of its trailing expression
+// statement, if any.
+llvm::Value *BlockStatement::codeGen(CodegenJob &cg) {
+    openScope(cg);
+    llvm::Value *last = nullptr;
+    for (Statement *stmt : statements) {
+        if (stmt == nullptr) {
+            continue;
+        }
+        llvm::Value *v = stmt->codeGen(cg);
+        if (!cg.errors.empty() || cg.builder.GetInsertBlock()->getTerminator() != nullptr) {
+            last = nullptr;
+            break;
+        }
+        last = dynamic_cast<ExpressionStatement *>(stmt) != nullptr ? v : nullptr;
+    }
+    closeScope(cg);
+    return last;
+}
+
+llvm::Value *Identifier::codeGen(CodegenJob &cg) {
+    llvm::AllocaInst *slot = lookupLocal(cg, this, tok.line);
+    if (slot == nullptr) {
+        return nullptr;
+    }
+    return cg.builder.CreateLoad(slot->getAllocatedType(), slot, value);
+}
+
+llvm::Value *IntLiteral::codeGen(CodegenJob &cg) {
+    return llvm::ConstantInt::get(intType(cg), value, true);
+}
+
+llvm::Value *BoolLiteral::codeGen(CodegenJob &cg) {
+    return cg.builder.getInt1(value);
+}
+
+llvm::Value *StringLiteral::codeGen(CodegenJob &cg) {
+    return unsupported(cg, "string literals", tok.line);
+}
+
+// a function is only ever declared by name, see DeclareStatement::codeGen
+llvm::Value *FuncLiteral::codeGen(CodegenJob &cg) {
+    return unsupported(cg, "function values", tok.line);
+}
+
+llvm::Value *ArrayLiteral::codeGen(CodegenJob &cg) {
+    return unsupported(cg, "array literals", tok.line);
+}
+
+// only named functions can be called, directly
+llvm::Value *CallExpression::codeGen(CodegenJob &cg) {
+    auto *name = dynamic_cast<Identifier *>(callee);
+    if (name == nullptr) {
+        return unsupported(cg, "calls through expressions", tok.line);
+    }
+    llvm::Value *binding = lookup(cg, name->sym);
+    if (binding == nullptr) {
+        return codegenError(cg, "unknown identifier=" + std::string(name->value), tok.line);
+    }
+    auto *fn = llvm::dyn_cast<llvm::Function>(binding);
+    if (fn == nullptr) {
+        return codegenError(cg, std::string(name->value) + " is not a function", tok.line);
+    }
+    if (fn->arg_size() != arguments.size()) {
+        return codegenError(cg, std::string(name->value) + " takes " + std::to_string(fn->arg_size()) +
+                            " arguments, got " + std::to_string(arguments.size()), tok.line);
+    }
+    std::vector<llvm::Value *> args;
+    args.reserve(arguments.size());
+    for (Expression *arg : arguments) {
+        llvm::Value *v = arg ? arg->codeGen(cg) : nullptr;
+        if (v == nullptr) {
+            return nullptr;
+        }
+        args.push_back(widen(cg, v));
+    }
+    return cg.builder.CreateCall(fn, args, "calltmp");
+}
+
+llvm::Value *IndexExpression::codeGen(CodegenJob &cg) {
+    return unsupported(cg, "index expressions", tok.line);
+}
+
+llvm::Value *PrefixExpression::codeGen(CodegenJob &cg) {
+    llvm::Value *operand = rhs ? rhs->codeGen(cg) : nullptr;
+    if (operand == nullptr) {
+        return nullptr;
+    }
+    switch (tok.type) {
+        case TokenType::SUB:
+            if (isBool(operand)) {
+                return codegenError(cg, "invalid operand for -: bool", tok.line);
+            }
+            return cg.builder.CreateNeg(operand, "negtmp");
+        case TokenType::BANG:
+            // !int is true only for 0
+            if (isBool(operand)) {
+                return cg.builder.CreateNot(operand, "nottmp");
+            }
+            return cg.builder.CreateICmpEQ(operand, zero(cg), "nottmp");
+        default:
+            return codegenError(cg, "unknown prefix operator=" + std::string(op), tok.line);
+    }
+}
+
+// sdiv and srem are undefined by 0 and for INT64_MIN by -1. a divisor that
+// may be 0 is tested first, and the program traps on it where the
+// interpreter stops with an error. one that may be -1 is divided by as 1,
+// which takes % right, and / is negated instead, wrapping around the way
+// the interpreter's does: INT64_MIN / -1 is INT64_MIN.
+static llvm::Value *divide(CodegenJob &cg, llvm::Value *l, llvm::Value *r, const bool quotient) {
+    const auto *constant = llvm::dyn_cast<llvm::ConstantInt>(r);
+    if (constant != nullptr && !constant->isMinusOne()) {
+        return quotient ? cg.builder.CreateSDiv(l, r, "divtmp") : cg.builder.CreateSRem(l, r, "modtmp");
+    }
+    if (constant != nullptr) {
+        return quotient ? cg.builder.CreateNeg(l, "divtmp") : zero(cg);
+    }
+    llvm::Function *fn = cg.builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock *trap = llvm::BasicBlock::Create(cg.context, "div.zero", fn);
+    llvm::BasicBlock *ok = llvm::BasicBlock::Create(cg.context, "div.ok", fn);
+    cg.builder.CreateCondBr(cg.builder.CreateICmpEQ(r, zero(cg), "iszero"), trap, ok);
+    cg.builder.SetInsertPoint(trap);
+    cg.builder.CreateIntrinsic(llvm::Intrinsic::trap, {}, {});
+    cg.builder.CreateUnreachable();
+    cg.builder.SetInsertPoint(ok);
+
+    llvm::Value *minusOne = cg.builder.CreateICmpEQ(r, llvm::ConstantInt::get(intType(cg), -1, true), "isminusone");
+    llvm::Value *divisor = cg.builder.CreateSelect(minusOne, llvm::ConstantInt::get(intType(cg), 1), r, "divisor");
+    if (!quotient) {
+        return cg.builder.CreateSRem(l, divisor, "modtmp");
+    }
+    return cg.builder.CreateSelect(minusOne, cg.builder.CreateNeg(l, "negtmp"),
+                                   cg.builder.CreateSDiv(l, divisor, "divtmp"), "divtmp");
+}
+
+llvm::Value *InfixExpression::codeGen(CodegenJob &cg) {
+    llvm::Value *l = lhs ? lhs->codeGen(cg) : nullptr;
+    if (l == nullptr) {
+        return nullptr;
+    }
+    llvm::Value *r = rhs ? rhs->codeGen(cg) : nullptr;
+    if (r == nullptr) {
+        return nullptr;
+    }
+    if (l->getType() != r->getType()) {
+        return codegenError(cg, "type mismatch: " + typeName(l->getType()) + " " + std::string(op) + " " +
+                            typeName(r->getType()), tok.line);
+    }
+
+    // bools only compare for equality
+    if (isBool(l) && tok.type != TokenType::EQ && tok.type != TokenType::NEQ) {
+        return codegenError(cg, "invalid operands for " + std::string(op) + ": bool", tok.line);
+    }
+    // dividing by 0 traps, where the interpreter reports an error
+    if (cg.options.matchInterpreter && (tok.type == TokenType::DIV || tok.type == TokenType::MOD)) {
+        auto *divisor = dynamic_cast<IntLiteral *>(rhs);
+        if (divisor == nullptr || divisor->value <= 0) {
+            return unsupported(cg, "division by anything but a positive constant", tok.line);
+        }
+    }
+    if (tok.type == TokenType::DIV || tok.type == TokenType::MOD) {
+        if (const auto *divisor = llvm::dyn_cast<llvm::ConstantInt>(r); divisor != nullptr && divisor->isZero()) {
+            return codegenError(cg, "division by zero", tok.line);
+        }
+        return divide(cg, l, r, tok.type == TokenType::DIV);
+    }
+    switch (tok.type) {
+        case TokenType::ADD: return cg.builder.CreateAdd(l, r, "addtmp");
+        case TokenType::SUB: return cg.builder.CreateSub(l, r, "subtmp");
+        case TokenType::MUL: return cg.builder.CreateMul(l, r, "multmp");
+        case TokenType::EQ: return cg.builder.CreateICmpEQ(l, r, "eqtmp");
+        case TokenType::NEQ: return cg.builder.CreateICmpNE(l, r, "netmp");
+        case TokenType::LT: return cg.builder.CreateICmpSLT(l, r, "lttmp");
+        case TokenType::GT: return cg.builder.CreateICmpSGT(l, r, "gttmp");
+        case TokenType::LTE: return cg.builder.CreateICmpSLE(l, r, "letmp");
+        case TokenType::GTE: return cg.builder.CreateICmpSGE(l, r, "getmp");
+        default:
+            return codegenError(cg, "unknown infix operator=" + std::string(op), tok.line);
+    }
+}
+
+// the value is that of whichever branch ran. an if without an else, or whose
+// branches don't both end in a value of the same type, is 0.
+llvm::Value *IfExpression::codeGen(CodegenJob &cg) {
+    llvm::Value *cond = condition ? condition->codeGen(cg) : nullptr;
+    if (cond == nullptr) {
+        return nullptr;
+    }
+    llvm::Function *fn = cg.builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock *thenBB = llvm::BasicBlock::Create(cg.context, "if.then", fn);
+    llvm::BasicBlock *elseBB = llvm::BasicBlock::Create(cg.context, "if.else");
+    llvm::BasicBlock *mergeBB = llvm::BasicBlock::Create(cg.context, "if.end");
+    cg.builder.CreateCondBr(truthy(cg, cond), thenBB, elseBB);
+
+    std::vector<std::pair<llvm::BasicBlock *, llvm::Value *>> values;
+    auto branch = [&](llvm::BasicBlock *bb, BlockStatement *body) {
+        cg.builder.SetInsertPoint(bb);
+        llvm::Value *v = body ? body->codeGen(cg) : nullptr;
+        llvm::BasicBlock *end = cg.builder.GetInsertBlock();
+        if (cg.errors.empty() && end->getTerminator() == nullptr) {
+            cg.builder.CreateBr(mergeBB);
+            values.emplace_back(end, v);
+        }
+    };
+    branch(thenBB, consequence);
+    elseBB->insertInto(fn);
+    branch(elseBB, alternative);
+    if (!cg.errors.empty()) {
+        return nullptr;
+    }
+
+    mergeBB->insertInto(fn);
+    cg.builder.SetInsertPoint(mergeBB);
+
+    if (cg.options.matchInterpreter && alternative != nullptr) {
+        for (auto &[bb, v] : values) {
+            if (v == nullptr) {
+                v = zero(cg);
+            }
+        }
+        if (std::any_of(values.begin(), values.end(),
+                        [&](const auto &in) { return in.second->getType() != values.front().second->getType(); })) {
+            return unsupported(cg, "if branches of different types", tok.line);
+        }
+    }
+    const bool hasValue = alternative != nullptr && !values.empty() &&
+                          std::all_of(values.begin(), values.end(), [&](const auto &in) {
+                              return in.second != nullptr && in.second->getType() == values.front().second->getType();
+                          });
+    if (!hasValue) {
+        return zero(cg);
+    }
+    if (values.size() == 1) {
+        return values.front().second;
+    }
+    llvm::PHINode *phi = cg.builder.CreatePHI(values.front().second->getType(), values.size(), "iftmp");
+    for (const auto &[bb, v] : values) {
+        phi->addIncoming(v, bb);
+    }
+    return phi;
+}
+
+// lowered in the shape loop simplify expects: the block before the loop is
+// its preheader, while.cond is the header and while.latch the single back
+// edge. every exit is dedicated: the header leaves through while.exit, each
+// break through its own block, and they all meet in while.end. the value
+// is 0.
+llvm::Value *WhileExpression::codeGen(CodegenJob &cg) {
+    llvm::Function *fn = cg.builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock *header = llvm::BasicBlock::Create(cg.context, "while.cond", fn);
+    llvm::BasicBlock *body = llvm::BasicBlock::Create(cg.context, "while.body");
+    llvm::BasicBlock *done = llvm::BasicBlock::Create(cg.context, "while.exit");
+    llvm::BasicBlock *exit = llvm::BasicBlock::Create(cg.context, "while.end");
+    cg.builder.CreateBr(header);
+    cg.builder.SetInsertPoint(header);
+
+    llvm::Value *cond = condition ? condition->codeGen(cg) : nullptr;
+    if (cond == nullptr) {
+        return nullptr;
+    }
+    cg.builder.CreateCondBr(truthy(cg, cond), body, done);
+
+    body->insertInto(fn);
+    cg.builder.SetInsertPoint(body);
+    cg.loops.push_back(exit);
+    if (consequence != nullptr) {
+        consequence->codeGen(cg);
+    }
+    cg.loops.pop_back();
+    if (!cg.errors.empty()) {
+        return nullptr;
+    }
+    if (cg.builder.GetInsertBlock()->getTerminator() == nullptr) {
+        llvm::BasicBlock *latch = llvm::BasicBlock::Create(cg.context, "while.latch", fn);
+        cg.builder.CreateBr(latch);
+        cg.builder.SetInsertPoint(latch);
+        cg.builder.CreateBr(header);
+    }
+
+    done->insertInto(fn);
+    cg.builder.SetInsertPoint(done);
+    cg.builder.CreateBr(exit);
+    exit->insertInto(fn);
+    cg.builder.SetInsertPoint(exit);
+    return zero(cg);
+}
+
+// a function literal declared by name is emitted as a function of that name,
+// or only declared if another job of a parallel compile emits it. anything
+// else gets a stack slot in the current scope, declared after the value is
+// emitted so `var x = x + 1;` reads the outer x.
+llvm::Value *DeclareStatement::codeGen(CodegenJob &cg) {
+    if (auto *fn = dynamic_cast<FuncLiteral *>(value)) {
+        if (name->annotation != Annotation::NONE && name->annotation != Annotation::FUNC) {
+            return codegenError(cg, "cannot declare func as " + std::string(annotationName(name->annotation)) + " " +
+                                std::string(name->value), tok.line);
+        }
+        if (cg.topLevel != nullptr) {
+            if (const auto elsewhere = cg.topLevel->byLiteral.find(fn); elsewhere != cg.topLevel->byLiteral.end()) {
+                llvm::Function *declared = prototype(cg, *elsewhere->second);
+                declare(cg, name->sym, declared);
+                return declared;
+            }
+        }
+        return emitFunction(cg, fn, qualified(cg, name->value), name->sym);
+    }
+    llvm::Value *v = value ? value->codeGen(cg) : nullptr;
+    if (v == nullptr) {
+        return nullptr;
+    }
+    // the types are known here, so an annotation is checked once, now
+    if (name->annotation != Annotation::NONE && annotationName(name->annotation) != typeName(v->getType())) {
+        return codegenError(cg, "cannot declare " + typeName(v->getType()) + " as " +
+                            std::string(annotationName(name->annotation)) + " " + std::string(name->value), tok.line);
+    }
+    llvm::AllocaInst *slot = entryBlockAlloca(cg, v->getType(), name->value);
+    cg.builder.CreateStore(v, slot);
+    declare(cg, name->sym, slot);
+    return v;
+}
+
+// `&x = value;` stores to the innermost x in scope, which keeps its type
+llvm::Value *ReferenceStatement::codeGen(CodegenJob &cg) {
+    llvm::AllocaInst *slot = lookupLocal(cg, name, tok.line);
+    if (slot == nullptr) {
+        return nullptr;
+    }
+    llvm::Value *v = value ? value->codeGen(cg) : nullptr;
+    if (v == nullptr) {
+        return nullptr;
+    }
+    if (v->getType() != slot->getAllocatedType()) {
+        return codegenError(cg, "cannot assign " + typeName(v->getType()) + " to " +
+                            typeName(slot->getAllocatedType()) + " " + std::string(name->value), tok.line);
+    }
+    cg.builder.CreateStore(v, slot);
+    return v;
+}
+
+llvm::Value *ReturnStatement::codeGen(CodegenJob &cg) {
+    llvm::Value *v = returnVal ? returnVal->codeGen(cg) : zero(cg);
+    if (v == nullptr) {
+        return nullptr;
+    }
+    // functions return i64, true and false come back as 1 and 0
+    return cg.builder.CreateRet(widen(cg, v));
+}
+
+llvm::Value *BreakStatement::codeGen(CodegenJob &cg) {
+    if (cg.loops.empty()) {
+        return codegenError(cg, "break outside of a loop", tok.line);
+    }
+    return cg.builder.CreateBr(cg.loops.back());
+}
+
+llvm::Value *ExpressionStatement::codeGen(CodegenJob &cg) {
+    return expression ? expression->codeGen(cg) : nullptr;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "../h/ast.h"
+
+// name of the function holding a program's top-level statements
+constexpr const char *entryName = "banter_main";
+
+struct CodegenOptions {
+    // run mem2reg over each function so locals live in registers instead of
+    // their stack slots
+    bool promoteLocals = true;
+    // refuse, as errors, what would come out other than it does in the
+    // interpreter: dividing by anything but a positive int literal, which
+    // could trap, and an if whose branches end in values of different
+    // types, otherwise 0. a branch ending without a value counts as 0.
+    bool matchInterpreter = false;
+};
+
+struct TopLevel;
+struct TopLevelFunction;
+
+// lowers program into a fresh module in context, holding `i64 banter_main()`,
+// which runs the top-level statements in order and returns the value of the
+// first top-level return, or 0, plus a function for each function literal.
+// every emitted function is checked with llvm::verifyFunction. returns
+// nullptr, with errors filled in, if anything failed to lower or verify.
+std::unique_ptr<llvm::Module> compileProgram(Program &program, llvm::LLVMContext &context,
+                                             std::vector<std::string> &errors, const CodegenOptions &options = {});
+// the same, into a context shared by every module compiled this way
+std::unique_ptr<llvm::Module> compileProgram(Program &program, std::vector<std::string> &errors,
+                                             const CodegenOptions &options = {});
+// the same, on threads, 0 for one per hardware thread. the functions
+// declared by top-level statements are dealt out in slices to jobs, each
+// filling a module in a context of its own, and the rest of the program is
+// one more job. the modules, banter_main's first, declare what they call of
+// each other's by name, so they link or jit together. nested functions are
+// named after the top-level one they're in, say f.g, a top-level name taken
+// already gets a numbered suffix. empty, with errors filled in, if anything
+// failed, the errors being compileProgram's.
+std::vector<llvm::orc::ThreadSafeModule> compileProgramParallel(Program &program, unsigned threads,
+                                                                std::vector<std::string> &errors,
+                                                                const CodegenOptions &options = {});
+
+// compiles the functions a program declares at the top level one at a
+// time, as the jobs of a parallel compile do, for a caller that only wants
+// some of them and not all at once. program has to outlive it, unchanged:
+// the functions are compiled straight from its tree.
+class TopLevelCompiler {
+    std::unique_ptr<TopLevel> top;
+    std::unordered_map<std::string, const TopLevelFunction *> byName;
+
+public:
+    explicit TopLevelCompiler(Program &program);
+    ~TopLevelCompiler();
+
+    // the module-level name of the function the top-level statement at
+    // position declares, if it declares one, see compileProgramParallel
+    [[nodiscard]] std::optional<std::string> nameAt(size_t position) const;
+    // and the reverse
+    [[nodiscard]] std::optional<size_t> positionOf(const std::string &name) const;
+
+    // a module holding the function called name and the ones nested in it,
+    // declaring the other top-level functions it calls. nullptr, with errors
+    // filled in, if it failed to lower.
+    std::unique_ptr<llvm::Module> compile(const std::string &name, llvm::LLVMContext &context,
+                                          std::vector<std::string> &errors, const CodegenOptions &options = {});
+};
+
+enum struct OptLevel {
+    O0,
+    O1,
+    O2,
+    O3,
+};
+
+struct OptimizeOptions {
+    OptLevel level = OptLevel::O2;
+    // per-pass timings, like llvm's -time-passes, are written here if set
+    llvm::raw_ostream *timePasses = nullptr;
+};
+
+// runs llvm's default new pass manager pipeline for options.level over a
+// module from compileProgram. target, if given, supplies the cost models the
+// vectorizers and unroller tune against.
+void optimizeModule(llvm::Module &module, const OptimizeOptions &options, llvm::TargetMachine *target = nullptr);
+
+#endif //CODEGEN_H
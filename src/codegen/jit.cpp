@@ -0,0 +1,236 @@
+#include <chrono>
+
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include "jit.h"
+
+static double secondsSince(const std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static size_t definedFunctions(const llvm::Module &module) {
+    size_t n = 0;
+    for (const llvm::Function &fn : module) {
+        n += !fn.isDeclaration();
+    }
+    return n;
+}
+
+// splits module so each function lives in a module of its own, calling the
+// others through declarations. the lazy layer copies a whole module into a
+// new context every time it extracts a function from it, so handing it one
+// big module makes each first call cost as much as the program is large.
+// function bodies are moved, not copied, so this is linear in the program.
+static std::vector<llvm::orc::ThreadSafeModule> splitPerFunction(llvm::orc::ThreadSafeModule module) {
+    std::vector<llvm::orc::ThreadSafeModule> parts;
+    module.withModuleDo([&](llvm::Module &whole) {
+        std::vector<std::unique_ptr<llvm::Module>> modules;
+        while (!whole.empty()) {
+            llvm::Function &fn = whole.getFunctionList().front();
+            auto part = std::make_unique<llvm::Module>(fn.getName(), whole.getContext());
+            part->setDataLayout(whole.getDataLayout());
+            part->setTargetTriple(whole.getTargetTriple());
+            part->setSourceFileName(whole.getSourceFileName());
+            part->getFunctionList().splice(part->end(), whole.getFunctionList(), fn.getIterator());
+            modules.push_back(std::move(part));
+        }
+        // calls still point at functions that now live in other modules
+        for (std::unique_ptr<llvm::Module> &part : modules) {
+            for (llvm::Instruction &inst : llvm::instructions(part->getFunctionList().front())) {
+                auto *call = llvm::dyn_cast<llvm::CallInst>(&inst);
+                llvm::Function *callee = call != nullptr ? call->getCalledFunction() : nullptr;
+                if (callee != nullptr && callee->getParent() != part.get()) {
+                    call->setCalledFunction(
+                        part->getOrInsertFunction(callee->getName(), callee->getFunctionType()));
+                }
+            }
+            parts.emplace_back(std::move(part), module.getContext());
+        }
+    });
+    return parts;
+}
+
+// the default single-threaded compiler, timed and counted
+class CountingCompiler : public llvm::orc::IRCompileLayer::IRCompiler {
+    std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler> inner;
+    std::shared_ptr<JitStats> counters;
+
+public:
+    CountingCompiler(std::unique_ptr<IRCompiler> inner, std::shared_ptr<JitStats> counters)
+        : IRCompiler(inner->getManglingOptions()), inner(std::move(inner)), counters(std::move(counters)) {}
+
+    llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> operator()(llvm::Module &module) override {
+        const auto start = std::chrono::steady_clock::now();
+        auto object = (*inner)(module);
+        counters->codegenSeconds += secondsSince(start);
+        counters->functionsCompiled += definedFunctions(module);
+        return object;
+    }
+};
+
+std::unique_ptr<Jit> Jit::create(const OptLevel level, std::vector<std::string> &errors, llvm::ObjectCache *cache) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    std::unique_ptr<Jit> result(new Jit());
+    result->counters = std::make_shared<JitStats>();
+    std::shared_ptr<JitStats> counters = result->counters;
+
+    auto jit = llvm::orc::LLLazyJITBuilder()
+                   .setCompileFunctionCreator([counters, cache](llvm::orc::JITTargetMachineBuilder builder)
+                                                  -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+                       auto target = builder.createTargetMachine();
+                       if (!target) {
+                           return target.takeError();
+                       }
+                       return std::make_unique<CountingCompiler>(
+                           std::make_unique<llvm::orc::TMOwningSimpleCompiler>(std::move(*target), cache), counters);
+                   })
+                   .create();
+    if (!jit) {
+        errors.push_back("unable to create jit: " + llvm::toString(jit.takeError()));
+        return nullptr;
+    }
+    result->jit = std::move(*jit);
+
+    // the optimizer tunes against the host, like the compiler it feeds
+    auto host = llvm::orc::JITTargetMachineBuilder::detectHost();
+    llvm::Expected<std::unique_ptr<llvm::TargetMachine>> machine =
+        host ? host->createTargetMachine() : host.takeError();
+    if (!machine) {
+        errors.push_back("unable to create jit: " + llvm::toString(machine.takeError()));
+        return nullptr;
+    }
+    result->machine = std::move(*machine);
+    std::shared_ptr<llvm::TargetMachine> target = result->machine;
+
+    // each function is optimized on its own as it's pulled in, so nothing is
+    // inlined across functions
+    result->jit->getIRTransformLayer().setTransform(
+        [counters, level, target](llvm::orc::ThreadSafeModule module, const llvm::orc::MaterializationResponsibility &) {
+            const auto start = std::chrono::steady_clock::now();
+            module.withModuleDo([&](llvm::Module &m) { optimizeModule(m, {.level = level}, target.get()); });
+            counters->optimizeSeconds += secondsSince(start);
+            return llvm::Expected<llvm::orc::ThreadSafeModule>(std::move(module));
+        });
+    return result;
+}
+
+// wall time of f, less whatever compiling it triggered
+template <typename F>
+static auto timedExcludingJit(JitStats &stats, double &seconds, F f) {
+    const double jitBefore = stats.optimizeSeconds + stats.codegenSeconds;
+    const auto start = std::chrono::steady_clock::now();
+    auto result = f();
+    seconds += secondsSince(start) - (stats.optimizeSeconds + stats.codegenSeconds - jitBefore);
+    return result;
+}
+
+bool Jit::add(llvm::orc::ThreadSafeModule module, std::vector<std::string> &errors) {
+    module.withModuleDo([this](llvm::Module &m) {
+        m.setDataLayout(jit->getDataLayout());
+        counters->functions += definedFunctions(m);
+    });
+    return timedExcludingJit(*counters, counters->addSeconds, [&] {
+        for (llvm::orc::ThreadSafeModule &part : splitPerFunction(std::move(module))) {
+            part.withModuleDo([this](llvm::Module &m) {
+                const llvm::Function &fn = m.getFunctionList().front();
+                if (!fn.isDeclaration()) {
+                    lazy.push_back(fn.getName().str());
+                }
+            });
+            if (llvm::Error err = jit->addLazyIRModule(std::move(part))) {
+                errors.push_back("unable to add module: " + llvm::toString(std::move(err)));
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+bool Jit::addEagerly(llvm::orc::ThreadSafeModule module, std::vector<std::string> &errors) {
+    module.withModuleDo([this](llvm::Module &m) {
+        m.setDataLayout(jit->getDataLayout());
+        counters->functions += definedFunctions(m);
+    });
+    return timedExcludingJit(*counters, counters->addSeconds, [&] {
+        if (llvm::Error err = jit->addIRModule(std::move(module))) {
+            errors.push_back("unable to add module: " + llvm::toString(std::move(err)));
+            return false;
+        }
+        return true;
+    });
+}
+
+bool Jit::addObjects(std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects, std::vector<std::string> &errors) {
+    counters->functions += objects.size();
+    return timedExcludingJit(*counters, counters->addSeconds, [&] {
+        for (std::unique_ptr<llvm::MemoryBuffer> &object : objects) {
+            if (llvm::Error err = jit->addObjectFile(std::move(object))) {
+                errors.push_back("unable to add object: " + llvm::toString(std::move(err)));
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+bool Jit::resolve(std::vector<std::string> &errors) {
+    if (main != nullptr) {
+        return true;
+    }
+    auto entry = timedExcludingJit(*counters, counters->lookupSeconds, [&] { return jit->lookup(entryName); });
+    if (!entry) {
+        errors.push_back(llvm::toString(entry.takeError()));
+        return false;
+    }
+    main = reinterpret_cast<int64_t (*)()>(entry->getAddress());
+    return true;
+}
+
+std::optional<uint64_t> Jit::lookup(const std::string &name, std::vector<std::string> &errors) {
+    auto symbol = timedExcludingJit(*counters, counters->lookupSeconds, [&] { return jit->lookup(name); });
+    if (!symbol) {
+        errors.push_back(llvm::toString(symbol.takeError()));
+        return std::nullopt;
+    }
+    return symbol->getAddress();
+}
+
+std::optional<int64_t> Jit::run(std::vector<std::string> &errors) {
+    if (!resolve(errors)) {
+        return std::nullopt;
+    }
+    return timedExcludingJit(*counters, counters->executeSeconds, main);
+}
+
+bool Jit::compileAll(std::vector<std::string> &errors) {
+    llvm::orc::ExecutionSession &session = jit->getExecutionSession();
+    llvm::orc::SymbolLookupSet names;
+    for (const std::string &name : lazy) {
+        names.add(jit->mangleAndIntern(name));
+    }
+    // a function's body only turns up in the lazy layer's implementation
+    // dylib once its stub in main has been looked up, and looking it up
+    // there is what compiles it
+    llvm::orc::JITDylib &main = jit->getMainJITDylib();
+    auto stubs = session.lookup(llvm::orc::makeJITDylibSearchOrder(&main), names);
+    if (!stubs) {
+        errors.push_back("unable to compile: " + llvm::toString(stubs.takeError()));
+        return false;
+    }
+    llvm::orc::JITDylib *impl = session.getJITDylibByName(main.getName() + ".impl");
+    if (impl == nullptr) {
+        return true;
+    }
+    auto bodies = session.lookup(llvm::orc::makeJITDylibSearchOrder(impl), std::move(names));
+    if (!bodies) {
+        errors.push_back("unable to compile: " + llvm::toString(bodies.takeError()));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+
+#include "codegen.h"
+
+struct JitStats {
+    // functions defined by the programs added
+    size_t functions = 0;
+    // how many of those have been compiled, because they were called
+    size_t functionsCompiled = 0;
+    double optimizeSeconds = 0;
+    double codegenSeconds = 0; // ir to machine code
+    // handing modules to the jit, resolving banter_main and running it, each
+    // less any compiling they triggered
+    double addSeconds = 0;
+    double lookupSeconds = 0;
+    double executeSeconds = 0;
+};
+
+// runs compiled programs on an orc LLLazyJIT. nothing is compiled up front:
+// every function sits behind a stub until its first call, which optimizes
+// and compiles just that function. a program only pays for what it runs.
+class Jit {
+    std::unique_ptr<llvm::orc::LLLazyJIT> jit;
+    std::shared_ptr<llvm::TargetMachine> machine; // the host, which the optimizer tunes for
+    std::shared_ptr<JitStats> counters; // shared with the jit's compile callbacks
+    int64_t (*main)() = nullptr; // banter_main, once resolved
+    std::vector<std::string> lazy; // every function added through add
+
+    Jit() = default;
+
+public:
+    // nullptr, with the reason in errors, if the host can't jit. with a
+    // cache, objects come from and go to it as functions get compiled.
+    static std::unique_ptr<Jit> create(OptLevel level, std::vector<std::string> &errors,
+                                       llvm::ObjectCache *cache = nullptr);
+
+    // module has to own its context, see compileProgram
+    bool add(llvm::orc::ThreadSafeModule module, std::vector<std::string> &errors);
+    // compiled whole, by the thread that first looks up anything in it,
+    // rather than function by function as they're called. a caller that
+    // compiles on a thread of its own uses this to keep compiling there.
+    bool addEagerly(llvm::orc::ThreadSafeModule module, std::vector<std::string> &errors);
+    // already compiled functions, say from a CompileCache, linked as they are
+    bool addObjects(std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects, std::vector<std::string> &errors);
+
+    // looks up banter_main, compiling and linking it and whatever it needs
+    // to link. false, with the reason in errors, if something is missing.
+    bool resolve(std::vector<std::string> &errors);
+    // the address of the function name, compiling it and what it needs to
+    // link if it isn't yet
+    std::optional<uint64_t> lookup(const std::string &name, std::vector<std::string> &errors);
+    // calls banter_main of the program added, compiling what it reaches
+    std::optional<int64_t> run(std::vector<std::string> &errors);
+    // compiles every function added through add that no call has reached
+    // yet, say one only referenced from a branch that wasn't taken, so a
+    // cache collecting the objects gets the whole program
+    bool compileAll(std::vector<std::string> &errors);
+
+    [[nodiscard]] const JitStats &stats() const { return *counters; }
+    [[nodiscard]] const llvm::TargetMachine &target() const { return *machine; }
+};
+
+#endif //JIT_H
@@ -0,0 +1,55 @@
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/IR/PassTimingInfo.h>
+#include <llvm/Passes/OptimizationLevel.h>
+#include <llvm/Passes/PassBuilder.h>
+
+#include "codegen.h"
+
+static llvm::OptimizationLevel passBuilderLevel(const OptLevel level) {
+    switch (level) {
+        case OptLevel::O0: return llvm::OptimizationLevel::O0;
+        case OptLevel::O1: return llvm::OptimizationLevel::O1;
+        case OptLevel::O2: return llvm::OptimizationLevel::O2;
+        case OptLevel::O3: return llvm::OptimizationLevel::O3;
+    }
+    return llvm::OptimizationLevel::O2;
+}
+
+void optimizeModule(llvm::Module &module, const OptimizeOptions &options, llvm::TargetMachine *target) {
+    llvm::PassInstrumentationCallbacks callbacks;
+    llvm::TimePassesHandler timer(options.timePasses != nullptr);
+    if (options.timePasses != nullptr) {
+        timer.setOutStream(*options.timePasses);
+        timer.registerCallbacks(callbacks);
+    }
+
+    // same tuning clang picks per level: unrolling from O1, vectorizers from O2
+    llvm::PipelineTuningOptions tuning;
+    tuning.LoopUnrolling = options.level >= OptLevel::O1;
+    tuning.LoopInterleaving = options.level >= OptLevel::O2;
+    tuning.LoopVectorization = options.level >= OptLevel::O2;
+    tuning.SLPVectorization = options.level >= OptLevel::O2;
+
+    llvm::PassBuilder builder(target, tuning, llvm::None, &callbacks);
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+    builder.registerModuleAnalyses(mam);
+    builder.registerCGSCCAnalyses(cgam);
+    builder.registerFunctionAnalyses(fam);
+    builder.registerLoopAnalyses(lam);
+    builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+    const llvm::OptimizationLevel level = passBuilderLevel(options.level);
+    llvm::ModulePassManager passes = options.level == OptLevel::O0 ? builder.buildO0DefaultPipeline(level)
+                                                                   : builder.buildPerModuleDefaultPipeline(level);
+    passes.run(module, mam);
+
+    if (options.timePasses != nullptr) {
+        timer.print();
+    }
+}
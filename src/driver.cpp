@@ -0,0 +1,715 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/ThreadPool.h>
+
+#include "h/driver.h"
+#include "h/lex.h"
+#include "h/parser.h"
+#include "h/workPool.h"
+#include "codegen/jit.h"
+#include "interp/bytecode.h"
+#include "interp/interpreter.h"
+#include "interp/tier.h"
+
+DriverOptions DriverOptions::parse(const int argc, const char *const *argv, std::vector<std::string> &errors) {
+    DriverOptions options;
+    int first = 1;
+    if (argc > 1 && std::string_view(argv[1]) == "run") {
+        options.mode = DriverMode::RUN;
+        first = 2;
+    }
+    for (int i = first; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "-O0") {
+            options.optLevel = OptLevel::O0;
+        } else if (arg == "-O1") {
+            options.optLevel = OptLevel::O1;
+        } else if (arg == "-O2") {
+            options.optLevel = OptLevel::O2;
+        } else if (arg == "-O3") {
+            options.optLevel = OptLevel::O3;
+        } else if (arg == "-dump-ir-before") {
+            options.dumpIrBefore = true;
+        } else if (options.mode == DriverMode::COMPILE && arg == "-dump-ir-after") {
+            options.dumpIrAfter = true;
+        } else if (options.mode == DriverMode::COMPILE && arg == "-time-passes") {
+            options.timePasses = true;
+        } else if (arg == "-stats") {
+            options.stats = true;
+        } else if (arg.starts_with("-cache-dir=")) {
+            options.cacheDir = arg.substr(arg.find('=') + 1);
+        } else if (arg.starts_with("-threads=")) {
+            if (llvm::StringRef(arg.substr(arg.find('=') + 1)).getAsInteger(10, options.threads)) {
+                errors.push_back("-threads needs a number, got " + std::string(arg));
+            }
+        } else if (options.mode == DriverMode::RUN && arg == "-interp") {
+            options.engine = RunEngine::TREE;
+        } else if (options.mode == DriverMode::RUN && arg == "-vm") {
+            options.engine = RunEngine::BYTECODE;
+        } else if (options.mode == DriverMode::RUN && arg == "-tiered") {
+            options.engine = RunEngine::TIERED;
+        } else if (options.mode == DriverMode::COMPILE && arg == "-c") {
+            options.emit = EmitKind::OBJECT;
+        } else if (options.mode == DriverMode::COMPILE && arg == "-o") {
+            if (i + 1 == argc) {
+                errors.emplace_back("-o needs a file name");
+            } else {
+                options.output = argv[++i];
+            }
+        } else if (options.mode == DriverMode::COMPILE && (arg.starts_with("-march=") || arg.starts_with("-mcpu="))) {
+            options.target.cpu = arg.substr(arg.find('=') + 1);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            errors.push_back("unknown option " + std::string(arg));
+        } else {
+            options.inputs.emplace_back(arg);
+        }
+    }
+    if (options.inputs.empty()) {
+        errors.emplace_back("no input files");
+    } else if (options.mode == DriverMode::RUN && options.inputs.size() > 1) {
+        errors.emplace_back("run takes a single file");
+    }
+    if (options.cacheDir.empty()) {
+        const char *dir = std::getenv("BANTER_CACHE_DIR");
+        options.cacheDir = dir != nullptr ? dir : "";
+    }
+    if (options.emit == EmitKind::NOTHING && !options.output.empty()) {
+        options.emit = EmitKind::EXECUTABLE;
+    }
+    if (!options.output.empty() && options.inputs.size() > 1) {
+        errors.emplace_back("-o with more than one input");
+    } else if (options.emit == EmitKind::OBJECT && options.output.empty() &&
+               std::find(options.inputs.begin(), options.inputs.end(), "-") != options.inputs.end()) {
+        errors.emplace_back("-c from stdin needs -o");
+    }
+    return options;
+}
+
+// maps path, or reads stdin for -. nullptr, with the reason in errors, if it
+// can't be read.
+static std::shared_ptr<const SourceBuffer> loadSource(const std::string &path, std::vector<std::string> &errors) {
+    try {
+        return SourceBuffer::fromFile(path);
+    } catch (const std::runtime_error &e) {
+        errors.emplace_back(e.what());
+        return nullptr;
+    }
+}
+
+static std::unique_ptr<Program> parseSource(std::shared_ptr<const SourceBuffer> source,
+                                            std::vector<std::string> &errors) {
+    lex l(std::move(source));
+    parser p(l.tokenizeAll());
+    std::unique_ptr<Program> program = p.parseProgram();
+
+    const size_t before = errors.size();
+    for (const LexDiagnostic &d : p.LexErrors()) {
+        errors.push_back(d.toString());
+    }
+    for (const std::string &e : p.Errors()) {
+        errors.push_back(e);
+    }
+    return errors.size() == before ? std::move(program) : nullptr;
+}
+
+std::unique_ptr<Program> parseFile(const std::string &path, std::vector<std::string> &errors) {
+    std::shared_ptr<const SourceBuffer> source = loadSource(path, errors);
+    return source != nullptr ? parseSource(std::move(source), errors) : nullptr;
+}
+
+// the back half of buildModule, from a parsed program
+static std::unique_ptr<llvm::Module> lowerProgram(Program &program, const std::string &path,
+                                                  const DriverOptions &options, std::vector<std::string> &errors,
+                                                  llvm::TargetMachine *target) {
+    std::unique_ptr<llvm::Module> module = compileProgram(program, errors);
+    if (module == nullptr) {
+        return nullptr;
+    }
+    module->setSourceFileName(path);
+
+    if (target != nullptr) {
+        setTarget(*module, *target);
+    }
+    if (options.emit == EmitKind::EXECUTABLE) {
+        addRuntimeMain(*module);
+    }
+
+    if (options.dumpIrBefore) {
+        llvm::errs() << "; " << path << " before optimization\n" << *module;
+    }
+    optimizeModule(*module, {.level = options.optLevel, .timePasses = options.timePasses ? &llvm::errs() : nullptr},
+                   target);
+    if (options.dumpIrAfter) {
+        llvm::errs() << "; " << path << " after optimization\n" << *module;
+    }
+    return module;
+}
+
+std::unique_ptr<llvm::Module> buildModule(const std::string &path, const DriverOptions &options,
+                                          std::vector<std::string> &errors, llvm::TargetMachine *target) {
+    std::unique_ptr<Program> program = parseFile(path, errors);
+    return program != nullptr ? lowerProgram(*program, path, options, errors, target) : nullptr;
+}
+
+// writes each of objects to a temporary file, appending its path to paths.
+// false, with the reason in errors, at the first that can't be.
+static bool writeTemporaryObjects(const std::vector<llvm::SmallVector<char, 0>> &objects,
+                                  std::vector<std::string> &paths, std::vector<std::string> &errors) {
+    for (const llvm::SmallVector<char, 0> &object : objects) {
+        llvm::SmallString<128> path;
+        if (const std::error_code ec = llvm::sys::fs::createTemporaryFile("banter", "o", path)) {
+            errors.push_back("unable to create a temporary object file: " + ec.message());
+            return false;
+        }
+        paths.push_back(path.str().str());
+        if (!writeObjectFile(paths.back(), llvm::StringRef(object.data(), object.size()), errors)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// lowerProgram and emitObject on options.threads: each module of the split
+// program is optimized and lowered on a thread with a target machine of its
+// own, and the objects are merged into one. dumps and timings still come
+// out a module at a time, in order.
+static bool emitParallel(Program &program, const std::string &path, const DriverOptions &options,
+                         llvm::SmallVectorImpl<char> &object, std::vector<std::string> &errors) {
+    std::vector<llvm::orc::ThreadSafeModule> modules = compileProgramParallel(program, options.threads, errors);
+    if (modules.empty()) {
+        return false;
+    }
+    const size_t n = modules.size();
+    std::vector<std::string> before(n), after(n), timings(n);
+    std::vector<std::vector<std::string>> moduleErrors(n);
+    std::vector<llvm::SmallVector<char, 0>> objects(n);
+
+    llvm::ThreadPool pool(llvm::hardware_concurrency(options.threads));
+    for (size_t i = 0; i < n; i++) {
+        pool.async([&, i] {
+            modules[i].withModuleDo([&](llvm::Module &module) {
+                std::unique_ptr<llvm::TargetMachine> target =
+                    createTargetMachine(options.target, options.optLevel, moduleErrors[i]);
+                if (target == nullptr) {
+                    return;
+                }
+                module.setSourceFileName(path);
+                setTarget(module, *target);
+                if (options.emit == EmitKind::EXECUTABLE) {
+                    hideProgramSymbols(module);
+                    if (i == 0) {
+                        addRuntimeMain(module);
+                    }
+                }
+                if (options.dumpIrBefore) {
+                    llvm::raw_string_ostream(before[i]) << module;
+                }
+                llvm::raw_string_ostream timing(timings[i]);
+                optimizeModule(module,
+                               {.level = options.optLevel, .timePasses = options.timePasses ? &timing : nullptr},
+                               target.get());
+                if (options.dumpIrAfter) {
+                    llvm::raw_string_ostream(after[i]) << module;
+                }
+                emitObject(module, *target, objects[i], moduleErrors[i]);
+            });
+        });
+    }
+    pool.wait();
+
+    for (size_t i = 0; i < n; i++) {
+        if (options.dumpIrBefore) {
+            llvm::errs() << "; " << path << " module " << i << " before optimization\n" << before[i];
+        }
+        llvm::errs() << timings[i];
+        if (options.dumpIrAfter) {
+            llvm::errs() << "; " << path << " module " << i << " after optimization\n" << after[i];
+        }
+        errors.insert(errors.end(), moduleErrors[i].begin(), moduleErrors[i].end());
+    }
+    if (std::any_of(moduleErrors.begin(), moduleErrors.end(), [](const auto &e) { return !e.empty(); })) {
+        return false;
+    }
+
+    std::vector<std::string> paths;
+    llvm::SmallString<128> merged;
+    bool linked = writeTemporaryObjects(objects, paths, errors);
+    if (linked) {
+        if (const std::error_code ec = llvm::sys::fs::createTemporaryFile("banter", "o", merged)) {
+            errors.push_back("unable to create a temporary object file: " + ec.message());
+            linked = false;
+        }
+    }
+    linked = linked && linkObjects(paths, merged.str().str(), errors);
+    if (linked) {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file = llvm::MemoryBuffer::getFile(merged);
+        if (file) {
+            object.assign((*file)->getBufferStart(), (*file)->getBufferEnd());
+        } else {
+            errors.push_back("unable to read " + merged.str().str() + ": " + file.getError().message());
+            linked = false;
+        }
+    }
+    for (const std::string &p : paths) {
+        llvm::sys::fs::remove(p);
+    }
+    if (!merged.empty()) {
+        llvm::sys::fs::remove(merged);
+    }
+    return linked;
+}
+
+// compileFile once source is loaded. program is source's, parsed already, or
+// nullptr to parse it only if the cache misses.
+static bool compileSource(const std::string &path, const std::shared_ptr<const SourceBuffer> &source,
+                          std::unique_ptr<Program> program, const DriverOptions &options,
+                          llvm::TargetMachine &target, std::vector<std::string> &errors, CompileCache *cache) {
+    if (options.emit == EmitKind::NOTHING) {
+        if (program == nullptr) {
+            program = parseSource(source, errors);
+        }
+        return program != nullptr && lowerProgram(*program, path, options, errors, &target) != nullptr;
+    }
+
+    // an executable's object carries the runtime's main, a plain one doesn't.
+    // how many modules a program is split into decides what inlines.
+    std::string key;
+    std::unique_ptr<llvm::MemoryBuffer> cached;
+    if (cache != nullptr) {
+        std::string kind = options.emit == EmitKind::OBJECT ? "object" : "executable";
+        if (options.threads != 1) {
+            kind += ".threads=" + std::to_string(llvm::hardware_concurrency(options.threads).compute_thread_count());
+        }
+        key = CompileCache::key(source->view(), kind, options.optLevel, target);
+        cached = cache->load(key);
+    }
+    llvm::SmallVector<char, 0> emitted;
+    llvm::StringRef object;
+    if (cached != nullptr) {
+        object = cached->getBuffer();
+    } else {
+        if (program == nullptr) {
+            program = parseSource(source, errors);
+        }
+        if (program == nullptr) {
+            return false;
+        }
+        if (options.threads != 1) {
+            if (!emitParallel(*program, path, options, emitted, errors)) {
+                return false;
+            }
+        } else {
+            std::unique_ptr<llvm::Module> module = lowerProgram(*program, path, options, errors, &target);
+            if (module == nullptr || !emitObject(*module, target, emitted, errors)) {
+                return false;
+            }
+        }
+        object = llvm::StringRef(emitted.data(), emitted.size());
+        if (cache != nullptr) {
+            cache->store(key, object);
+        }
+    }
+
+    if (options.emit == EmitKind::OBJECT) {
+        llvm::SmallString<128> objectPath(options.output);
+        if (objectPath.empty()) {
+            objectPath = path;
+            llvm::sys::path::replace_extension(objectPath, "o");
+        }
+        return writeObjectFile(objectPath.str().str(), object, errors);
+    }
+    llvm::SmallString<128> objectPath;
+    if (const std::error_code ec = llvm::sys::fs::createTemporaryFile("banter", "o", objectPath)) {
+        errors.push_back("unable to create a temporary object file: " + ec.message());
+        return false;
+    }
+    const bool linked = writeObjectFile(objectPath.str().str(), object, errors) &&
+                        linkExecutable({objectPath.str().str()}, options.output, errors);
+    llvm::sys::fs::remove(objectPath);
+    return linked;
+}
+
+bool compileFile(const std::string &path, const DriverOptions &options, llvm::TargetMachine &target,
+                 std::vector<std::string> &errors, CompileCache *cache) {
+    const std::shared_ptr<const SourceBuffer> source = loadSource(path, errors);
+    return source != nullptr && compileSource(path, source, nullptr, options, target, errors, cache);
+}
+
+bool compileParsed(const std::string &path, std::unique_ptr<Program> program, const DriverOptions &options,
+                   llvm::TargetMachine &target, std::vector<std::string> &errors, CompileCache *cache) {
+    const std::shared_ptr<const SourceBuffer> source = program->source;
+    return compileSource(path, source, std::move(program), options, target, errors, cache);
+}
+
+std::vector<ParsedFile> parseFiles(const std::vector<std::string> &paths, const unsigned threads) {
+    std::vector<ParsedFile> files(paths.size());
+    WorkPool pool(threads);
+    for (size_t i = 0; i < paths.size(); i++) {
+        pool.submit([&files, &paths, i] { files[i].program = parseFile(paths[i], files[i].errors); });
+    }
+    pool.wait();
+    return files;
+}
+
+static void printCacheStats(const CacheStats &stats) {
+    std::cerr << "cache    " << stats.hits << " hits, " << stats.misses << " misses, " << stats.stores
+              << " stored\n";
+}
+
+static double millisSince(const std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// runFile for -interp
+static int interpretFile(const std::string &path, const DriverOptions &options) {
+    std::vector<std::string> errors;
+    auto report = [&] {
+        for (const std::string &e : errors) {
+            std::cerr << path << ": " << e << "\n";
+        }
+        return 1;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const SourceBuffer> source = loadSource(path, errors);
+    std::unique_ptr<Program> program = source != nullptr ? parseSource(source, errors) : nullptr;
+    if (program == nullptr) {
+        return report();
+    }
+    const double parseMs = millisSince(start);
+
+    start = std::chrono::steady_clock::now();
+    const std::optional<Value> result = interpretProgram(*program, errors);
+    if (!result) {
+        return report();
+    }
+    const double executeMs = millisSince(start);
+    std::cout << result->toString() << "\n";
+
+    if (options.stats) {
+        std::cerr << "parse    " << parseMs << " ms\n"
+                  << "execute  " << executeMs << " ms, interpreted\n";
+    }
+    return 0;
+}
+
+// runFile for -vm. a cache hit loads the bytecode instead of compiling it,
+// unless it doesn't load, when it's compiled and stored over
+static int runBytecodeFile(const std::string &path, const DriverOptions &options) {
+    std::vector<std::string> errors;
+    auto report = [&] {
+        for (const std::string &e : errors) {
+            std::cerr << path << ": " << e << "\n";
+        }
+        return 1;
+    };
+
+    std::shared_ptr<const SourceBuffer> source = loadSource(path, errors);
+    if (source == nullptr) {
+        return report();
+    }
+    std::unique_ptr<CompileCache> cache =
+        options.cacheDir.empty() ? nullptr : std::make_unique<CompileCache>(options.cacheDir);
+    const std::string key = cache != nullptr ? CompileCache::key(source->view(), "bytecode") : "";
+
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<Bytecode> bytecode;
+    if (cache != nullptr) {
+        if (std::unique_ptr<llvm::MemoryBuffer> bytes = cache->load(key)) {
+            std::vector<std::string> stale;
+            bytecode = deserializeBytecode(std::string_view(bytes->getBufferStart(), bytes->getBufferSize()), stale);
+        }
+    }
+    const bool cached = bytecode != nullptr;
+    double parseMs = 0;
+    if (!cached) {
+        std::unique_ptr<Program> program = parseSource(source, errors);
+        if (program == nullptr) {
+            return report();
+        }
+        parseMs = millisSince(start);
+        start = std::chrono::steady_clock::now();
+        bytecode = compileBytecode(FlatAst::fromProgram(*program), errors);
+        if (bytecode == nullptr) {
+            return report();
+        }
+        if (cache != nullptr) {
+            cache->store(key, serializeBytecode(*bytecode));
+        }
+    }
+    const double compileMs = millisSince(start);
+
+    start = std::chrono::steady_clock::now();
+    VmStats vmStats;
+    const std::optional<Value> result = runBytecode(*bytecode, errors, &vmStats);
+    if (!result) {
+        return report();
+    }
+    const double executeMs = millisSince(start);
+    std::cout << result->toString() << "\n";
+
+    if (options.stats) {
+        if (cached) {
+            std::cerr << "load     " << compileMs << " ms, cached bytecode\n";
+        } else {
+            std::cerr << "parse    " << parseMs << " ms\n"
+                      << "compile  " << compileMs << " ms, " << bytecode->functions.size() << " functions\n";
+        }
+        std::cerr << "execute  " << executeMs << " ms, " << vmStats.instructions << " instructions, "
+                  << vmStats.calls << " calls\n";
+        if (cache != nullptr) {
+            printCacheStats(cache->stats());
+        }
+    }
+    return 0;
+}
+
+static void printTiers(const std::vector<FunctionTier> &tiers) {
+    for (const FunctionTier &t : tiers) {
+        std::cerr << "tier     " << t.name << ": " << tierName(t.tier) << ", " << t.counters.calls << " calls, "
+                  << t.counters.backEdges << " back edges";
+        if (t.counters.nativeCalls != 0) {
+            std::cerr << ", " << t.counters.nativeCalls << " native calls";
+        }
+        if (t.tier == Tier::NATIVE || t.tier == Tier::FAILED) {
+            std::cerr << ", compiled in " << t.compileMs << " ms, " << t.queuedMs << " ms after getting hot";
+        }
+        if (!t.reason.empty()) {
+            std::cerr << ", " << t.reason;
+        }
+        std::cerr << "\n";
+    }
+}
+
+// runFile for -tiered. the program's result is printed before whatever is
+// still compiling is waited out.
+static int runTieredFile(const std::string &path, const DriverOptions &options) {
+    std::vector<std::string> errors;
+    auto report = [&] {
+        for (const std::string &e : errors) {
+            std::cerr << path << ": " << e << "\n";
+        }
+        return 1;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const SourceBuffer> source = loadSource(path, errors);
+    std::unique_ptr<Program> program = source != nullptr ? parseSource(source, errors) : nullptr;
+    if (program == nullptr) {
+        return report();
+    }
+    const double parseMs = millisSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::unique_ptr<Tiers> tiers = Tiers::create(*program, {.level = options.optLevel}, errors);
+    if (tiers == nullptr) {
+        return report();
+    }
+    const double compileMs = millisSince(start);
+
+    start = std::chrono::steady_clock::now();
+    VmStats vmStats;
+    const std::optional<Value> result = tiers->run(errors, &vmStats);
+    if (!result) {
+        return report();
+    }
+    const double executeMs = millisSince(start);
+    std::cout << result->toString() << "\n";
+
+    if (options.stats) {
+        std::cerr << "parse    " << parseMs << " ms\n"
+                  << "compile  " << compileMs << " ms, " << tiers->bytecode().functions.size() << " functions\n"
+                  << "execute  " << executeMs << " ms, " << vmStats.instructions << " instructions, "
+                  << vmStats.calls << " calls, " << vmStats.nativeCalls << " native calls\n";
+        printTiers(tiers->stats());
+    }
+    return 0;
+}
+
+int runFile(const std::string &path, const DriverOptions &options) {
+    if (options.engine == RunEngine::TREE) {
+        return interpretFile(path, options);
+    }
+    if (options.engine == RunEngine::BYTECODE) {
+        return runBytecodeFile(path, options);
+    }
+    if (options.engine == RunEngine::TIERED) {
+        return runTieredFile(path, options);
+    }
+    std::vector<std::string> errors;
+    auto report = [&] {
+        for (const std::string &e : errors) {
+            std::cerr << path << ": " << e << "\n";
+        }
+        return 1;
+    };
+
+    std::shared_ptr<const SourceBuffer> source = loadSource(path, errors);
+    std::unique_ptr<CompileCache> cache =
+        options.cacheDir.empty() ? nullptr : std::make_unique<CompileCache>(options.cacheDir);
+    std::unique_ptr<Jit> jit = source != nullptr ? Jit::create(options.optLevel, errors, cache.get()) : nullptr;
+    if (jit == nullptr) {
+        return report();
+    }
+
+    // a hit links last time's objects and skips the front end. if they
+    // don't add up to a program after all, the entry goes and it's compiled
+    // like a miss.
+    bool cached = false;
+    if (cache != nullptr) {
+        const std::string key = CompileCache::key(source->view(), "jit", options.optLevel, jit->target());
+        std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects = cache->loadObjects(key);
+        const bool loaded = !objects.empty();
+        cached = loaded && jit->addObjects(std::move(objects), errors) && jit->resolve(errors);
+        if (loaded && !cached) {
+            cache->dropObjects(key);
+        }
+        if (!cached) {
+            errors.clear();
+            jit = Jit::create(options.optLevel, errors, cache.get());
+            if (jit == nullptr) {
+                return report();
+            }
+        }
+        cache->collectObjects(key);
+    }
+
+    double parseMs = 0;
+    double codegenMs = 0;
+    if (!cached) {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<Program> program = parseSource(source, errors);
+        if (program == nullptr) {
+            return report();
+        }
+        parseMs = millisSince(start);
+
+        start = std::chrono::steady_clock::now();
+        std::vector<llvm::orc::ThreadSafeModule> modules;
+        if (options.threads != 1) {
+            modules = compileProgramParallel(*program, options.threads, errors);
+        } else {
+            auto context = std::make_unique<llvm::LLVMContext>();
+            std::unique_ptr<llvm::Module> module = compileProgram(*program, *context, errors);
+            if (module != nullptr) {
+                modules.emplace_back(std::move(module), std::move(context));
+            }
+        }
+        if (modules.empty()) {
+            return report();
+        }
+        for (llvm::orc::ThreadSafeModule &module : modules) {
+            module.withModuleDo([&](llvm::Module &m) {
+                m.setSourceFileName(path);
+                if (options.dumpIrBefore) {
+                    llvm::errs() << "; " << path << " before optimization\n" << m;
+                }
+            });
+        }
+        codegenMs = millisSince(start);
+
+        for (llvm::orc::ThreadSafeModule &module : modules) {
+            if (!jit->add(std::move(module), errors)) {
+                return report();
+            }
+        }
+    }
+    const std::optional<int64_t> result = jit->run(errors);
+    if (!result) {
+        return report();
+    }
+    std::cout << *result << "\n";
+    // the run only compiled what it called. what it didn't, the next run
+    // with other input might, and it links nothing but objects.
+    if (cache != nullptr && !cached && jit->compileAll(errors)) {
+        cache->commitObjects();
+    }
+
+    if (options.stats) {
+        const JitStats &stats = jit->stats();
+        std::cerr << "parse    " << parseMs << " ms\n"
+                  << "codegen  " << codegenMs << " ms, ir for " << stats.functions << " functions\n"
+                  << "jit      " << (stats.optimizeSeconds + stats.codegenSeconds) * 1000 << " ms, optimized "
+                  << stats.optimizeSeconds * 1000 << " ms, compiled " << stats.functionsCompiled << " of "
+                  << stats.functions << " functions\n"
+                  << "link     " << (stats.addSeconds + stats.lookupSeconds) * 1000 << " ms, adding modules "
+                  << stats.addSeconds * 1000 << " ms, resolving " << entryName << " " << stats.lookupSeconds * 1000
+                  << " ms\n"
+                  << "execute  " << stats.executeSeconds * 1000 << " ms\n";
+        if (cache != nullptr) {
+            printCacheStats(cache->stats());
+        }
+    }
+    return 0;
+}
+
+int driverMain(const int argc, const char *const *argv) {
+    std::vector<std::string> errors;
+    const DriverOptions options = DriverOptions::parse(argc, argv, errors);
+    if (!errors.empty()) {
+        for (const std::string &e : errors) {
+            std::cerr << "banter: " << e << "\n";
+        }
+        return 2;
+    }
+
+    if (options.mode == DriverMode::RUN) {
+        return runFile(options.inputs.front(), options);
+    }
+    std::unique_ptr<llvm::TargetMachine> target = createTargetMachine(options.target, options.optLevel, errors);
+    if (target == nullptr) {
+        for (const std::string &e : errors) {
+            std::cerr << "banter: " << e << "\n";
+        }
+        return 2;
+    }
+    std::unique_ptr<CompileCache> cache =
+        options.cacheDir.empty() ? nullptr : std::make_unique<CompileCache>(options.cacheDir);
+    // with threads to spare, every input is lexed and parsed up front, all
+    // at once. the files are still compiled, and reported on, in order.
+    std::vector<ParsedFile> parsed;
+    double parseMs = 0;
+    if (options.threads != 1 && options.inputs.size() > 1) {
+        const auto start = std::chrono::steady_clock::now();
+        parsed = parseFiles(options.inputs, options.threads);
+        parseMs = millisSince(start);
+    }
+    int status = 0;
+    for (size_t i = 0; i < options.inputs.size(); i++) {
+        const std::string &path = options.inputs[i];
+        errors.clear();
+        bool compiled;
+        if (parsed.empty()) {
+            compiled = compileFile(path, options, *target, errors, cache.get());
+        } else if (parsed[i].program == nullptr) {
+            errors = std::move(parsed[i].errors);
+            compiled = false;
+        } else {
+            compiled = compileParsed(path, std::move(parsed[i].program), options, *target, errors, cache.get());
+        }
+        if (!compiled) {
+            for (const std::string &e : errors) {
+                std::cerr << path << ": " << e << "\n";
+            }
+            status = 1;
+        }
+    }
+    if (options.stats && !parsed.empty()) {
+        std::cerr << "parse    " << parsed.size() << " files in " << parseMs << " ms, "
+                  << parsed.size() / (parseMs / 1000) << " files/s\n";
+    }
+    if (options.stats && cache != nullptr) {
+        printCacheStats(cache->stats());
+    }
+    return status;
+}
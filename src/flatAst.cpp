@@ -0,0 +1,268 @@
+#include <typeinfo>
+
+#include "h/flatAst.h"
+
+NodeIndex FlatAst::add(const NodeKind kind, const Token &tok, const uint32_t a, const uint32_t b, const uint32_t c) {
+    kinds.push_back(kind);
+    lines.push_back(tok.line);
+    text.push_back(tok.lit);
+    this->a.push_back(a);
+    this->b.push_back(b);
+    this->c.push_back(c);
+    annotations.push_back(Annotation::NONE);
+    return static_cast<NodeIndex>(kinds.size() - 1);
+}
+
+template <typename T>
+uint32_t FlatAst::flattenList(const NodeList<T> &list) {
+    // children are flattened first so their own lists don't interleave with this one
+    std::vector<NodeIndex> children;
+    children.reserve(list.size());
+    for (T *child : list) {
+        children.push_back(flatten(child));
+    }
+    const auto first = static_cast<uint32_t>(lists.size());
+    lists.insert(lists.end(), children.begin(), children.end());
+    return first;
+}
+
+NodeIndex FlatAst::flatten(Node *node) {
+    if (node == nullptr) {
+        return NoNode;
+    }
+    if (typeid(*node) == typeid(Identifier)) {
+        auto *n = static_cast<Identifier *>(node);
+        const NodeIndex ident = add(NodeKind::IDENT, n->tok, n->sym);
+        annotations[ident] = n->annotation;
+        return ident;
+    }
+    if (typeid(*node) == typeid(IntLiteral)) {
+        auto *n = static_cast<IntLiteral *>(node);
+        return add(NodeKind::INT, n->tok, static_cast<uint32_t>(n->value));
+    }
+    if (typeid(*node) == typeid(BoolLiteral)) {
+        auto *n = static_cast<BoolLiteral *>(node);
+        return add(NodeKind::BOOL, n->tok, n->value);
+    }
+    if (typeid(*node) == typeid(StringLiteral)) {
+        auto *n = static_cast<StringLiteral *>(node);
+        return add(NodeKind::STRING, n->tok, n->sym);
+    }
+    if (typeid(*node) == typeid(InfixExpression)) {
+        auto *n = static_cast<InfixExpression *>(node);
+        const NodeIndex lhs = flatten(n->lhs);
+        return add(NodeKind::INFIX, n->tok, lhs, flatten(n->rhs));
+    }
+    if (typeid(*node) == typeid(PrefixExpression)) {
+        auto *n = static_cast<PrefixExpression *>(node);
+        return add(NodeKind::PREFIX, n->tok, flatten(n->rhs));
+    }
+    if (typeid(*node) == typeid(CallExpression)) {
+        auto *n = static_cast<CallExpression *>(node);
+        const NodeIndex callee = flatten(n->callee);
+        const uint32_t first = flattenList(n->arguments);
+        return add(NodeKind::CALL, n->tok, callee, first, n->arguments.size());
+    }
+    if (typeid(*node) == typeid(IndexExpression)) {
+        auto *n = static_cast<IndexExpression *>(node);
+        const NodeIndex array = flatten(n->array);
+        return add(NodeKind::INDEX, n->tok, array, flatten(n->index));
+    }
+    if (typeid(*node) == typeid(ArrayLiteral)) {
+        auto *n = static_cast<ArrayLiteral *>(node);
+        const uint32_t first = flattenList(n->elements);
+        return add(NodeKind::ARRAY, n->tok, first, n->elements.size());
+    }
+    if (typeid(*node) == typeid(FuncLiteral)) {
+        auto *n = static_cast<FuncLiteral *>(node);
+        const uint32_t first = flattenList(n->params);
+        const NodeIndex fn = add(NodeKind::FUNC, n->tok, first, n->params.size(), flatten(n->body));
+        annotations[fn] = n->returns;
+        return fn;
+    }
+    if (typeid(*node) == typeid(IfExpression)) {
+        auto *n = static_cast<IfExpression *>(node);
+        const NodeIndex cond = flatten(n->condition);
+        const NodeIndex cons = flatten(n->consequence);
+        return add(NodeKind::IF, n->tok, cond, cons, flatten(n->alternative));
+    }
+    if (typeid(*node) == typeid(WhileExpression)) {
+        auto *n = static_cast<WhileExpression *>(node);
+        const NodeIndex cond = flatten(n->condition);
+        return add(NodeKind::WHILE, n->tok, cond, flatten(n->consequence));
+    }
+    if (typeid(*node) == typeid(BlockStatement)) {
+        auto *n = static_cast<BlockStatement *>(node);
+        const uint32_t first = flattenList(n->statements);
+        return add(NodeKind::BLOCK, n->tok, first, n->statements.size());
+    }
+    if (typeid(*node) == typeid(DeclareStatement)) {
+        auto *n = static_cast<DeclareStatement *>(node);
+        const NodeIndex name = flatten(n->name);
+        return add(NodeKind::DECLARE, n->tok, name, flatten(n->value));
+    }
+    if (typeid(*node) == typeid(ReferenceStatement)) {
+        auto *n = static_cast<ReferenceStatement *>(node);
+        const NodeIndex name = flatten(n->name);
+        return add(NodeKind::REFERENCE, n->tok, name, flatten(n->value));
+    }
+    if (typeid(*node) == typeid(ReturnStatement)) {
+        auto *n = static_cast<ReturnStatement *>(node);
+        return add(NodeKind::RETURN, n->tok, flatten(n->returnVal));
+    }
+    if (typeid(*node) == typeid(BreakStatement)) {
+        return add(NodeKind::BREAK, static_cast<BreakStatement *>(node)->tok);
+    }
+    if (typeid(*node) == typeid(ExpressionStatement)) {
+        auto *n = static_cast<ExpressionStatement *>(node);
+        return add(NodeKind::EXPRESSION_STMT, n->tok, flatten(n->expression));
+    }
+    return NoNode;
+}
+
+FlatAst FlatAst::fromProgram(Program &program) {
+    program.settleLines();
+    FlatAst ast;
+    ast.source = program.source;
+    ast.statements.reserve(program.statements.size());
+    for (Statement *stmt : program.statements) {
+        ast.statements.push_back(ast.flatten(stmt));
+    }
+    return ast;
+}
+
+std::string FlatAst::toString() const {
+    std::string out;
+    for (const NodeIndex stmt : statements) {
+        print(stmt, out);
+        out += "\n";
+    }
+    return out;
+}
+
+std::string FlatAst::toString(const NodeIndex n) const {
+    std::string out;
+    print(n, out);
+    return out;
+}
+
+void FlatAst::print(const NodeIndex n, std::string &out) const {
+    if (n == NoNode) {
+        return;
+    }
+    switch (kinds[n]) {
+        case NodeKind::DECLARE:
+        case NodeKind::REFERENCE:
+            out += text[n];
+            out += " ";
+            print(a[n], out);
+            out += " = ";
+            print(b[n], out);
+            out += ";";
+            break;
+        case NodeKind::RETURN:
+            out += text[n];
+            out += " ";
+            print(a[n], out);
+            out += ";";
+            break;
+        case NodeKind::BREAK:
+            out += "break;";
+            break;
+        case NodeKind::EXPRESSION_STMT:
+            print(a[n], out);
+            out += ";";
+            break;
+        case NodeKind::BLOCK:
+            out += "{ ";
+            for (uint32_t i = 0; i < b[n]; i++) {
+                print(listAt(a[n], i), out);
+                out += " ";
+            }
+            out += "}";
+            break;
+        case NodeKind::IDENT:
+        case NodeKind::STRING:
+            out += text[n];
+            if (annotations[n] != Annotation::NONE) {
+                out += ": ";
+                out += annotationName(annotations[n]);
+            }
+            break;
+        case NodeKind::INT:
+            out += std::to_string(static_cast<int>(a[n]));
+            break;
+        case NodeKind::BOOL:
+            out += a[n] ? "true" : "false";
+            break;
+        case NodeKind::FUNC:
+            out += text[n];
+            out += " (";
+            for (uint32_t i = 0; i < b[n]; i++) {
+                print(listAt(a[n], i), out);
+                out += ", ";
+            }
+            out += ")";
+            if (annotations[n] != Annotation::NONE) {
+                out += ": ";
+                out += annotationName(annotations[n]);
+                out += " ";
+            }
+            print(c[n], out);
+            break;
+        case NodeKind::ARRAY:
+            out += "[";
+            for (uint32_t i = 0; i < b[n]; i++) {
+                print(listAt(a[n], i), out);
+                out += ", ";
+            }
+            out += "]";
+            break;
+        case NodeKind::CALL:
+            print(a[n], out);
+            out += "(";
+            for (uint32_t i = 0; i < c[n]; i++) {
+                print(listAt(b[n], i), out);
+                out += ", ";
+            }
+            out += ")";
+            break;
+        case NodeKind::INDEX:
+            out += "(";
+            print(a[n], out);
+            out += "[";
+            print(b[n], out);
+            out += "])";
+            break;
+        case NodeKind::PREFIX:
+            out += "(";
+            out += text[n];
+            print(a[n], out);
+            out += ")";
+            break;
+        case NodeKind::INFIX:
+            out += "(";
+            print(a[n], out);
+            out += text[n];
+            print(b[n], out);
+            out += ")";
+            break;
+        case NodeKind::IF:
+            out += "if ";
+            print(a[n], out);
+            out += " ";
+            print(b[n], out);
+            out += " ";
+            if (c[n] != NoNode) {
+                out += " else ";
+                print(c[n], out);
+            }
+            break;
+        case NodeKind::WHILE:
+            out += "while ";
+            print(a[n], out);
+            out += " ";
+            print(b[n], out);
+            break;
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// bump allocator for ast nodes. everything allocated from an arena is
+// released in one go when it is destroyed and no destructor is ever run, so
+// only objects that own nothing outside the arena may live in it.
+class Arena {
+    struct Block {
+        Block *next;
+        size_t size;
+    };
+
+    Block *head = nullptr;
+    char *cur = nullptr;
+    char *end = nullptr;
+    size_t used = 0;
+    size_t reserved = 0;
+
+    void *allocateSlow(size_t size, size_t align);
+
+public:
+    static constexpr size_t blockSize = 64 * 1024;
+
+    Arena() = default;
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    Arena(Arena &&other) noexcept;
+    Arena &operator=(Arena &&other) noexcept;
+
+    void *allocate(const size_t size, const size_t align) {
+        const auto p = (reinterpret_cast<uintptr_t>(cur) + align - 1) & ~(align - 1);
+        if (cur == nullptr || p + size > reinterpret_cast<uintptr_t>(end)) {
+            return allocateSlow(size, align);
+        }
+        cur = reinterpret_cast<char *>(p + size);
+        used += size;
+        return reinterpret_cast<void *>(p);
+    }
+
+    template <typename T, typename... Args>
+    T *make(Args &&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T *allocateArray(const size_t n) {
+        return static_cast<T *>(allocate(sizeof(T) * n, alignof(T)));
+    }
+
+    // bytes handed out, and bytes reserved from the heap to serve them
+    [[nodiscard]] size_t bytesUsed() const { return used; }
+    [[nodiscard]] size_t bytesReserved() const { return reserved; }
+};
+
+// child list of an arena-allocated node. grows by doubling inside the
+// arena, so the old storage is simply abandoned until the arena goes.
+template <typename T>
+class NodeList {
+    T **items = nullptr;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+
+public:
+    void push_back(Arena &arena, T *item) {
+        if (count == capacity) {
+            const uint32_t grown = capacity == 0 ? 4 : capacity * 2;
+            T **next = arena.allocateArray<T *>(grown);
+            if (count != 0) {
+                std::memcpy(next, items, sizeof(T *) * count);
+            }
+            items = next;
+            capacity = grown;
+        }
+        items[count++] = item;
+    }
+
+    void clear() { count = 0; }
+
+    [[nodiscard]] size_t size() const { return count; }
+    [[nodiscard]] bool empty() const { return count == 0; }
+    T *operator[](const size_t i) const { return items[i]; }
+    T *const *begin() const { return items; }
+    T *const *end() const { return items + count; }
+};
+
+#endif //ARENA_H
@@ -3,12 +3,22 @@
 #ifndef AST_H
 #define AST_H
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #include <llvm/IR/Value.h>
 
+#include "../h/arena.h"
 #include "../h/lex.h"
 
+// see codegen/banterEnv.h
+struct CodegenJob;
+// see interp/interpreter.h
+struct Interpreter;
+struct Value;
+
 struct Node {
     virtual ~Node() = default;
 
@@ -18,7 +28,12 @@ struct Node {
 
     virtual std::string type() = 0;
 
-    virtual llvm::Value *codeGen() = 0;
+    // moves every token under the node by delta lines
+    virtual void shiftLines(int delta) = 0;
+
+    virtual llvm::Value *codeGen(CodegenJob &cg) = 0;
+
+    virtual Value interpret(Interpreter &in) = 0;
 };
 
 struct Statement : Node {
@@ -30,7 +45,7 @@ struct Statement : Node {
 
     std::string type() override = 0;
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
 };
 
 struct Expression : Node {
@@ -40,44 +55,117 @@ struct Expression : Node {
     std::string toString() override = 0;
     std::string type() override = 0;
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+};
+
+// one pass of the top-level parse loop of an editable program, see
+// parser::reparse, with the statement it produced or nullptr if it failed
+struct ParsedUnit {
+    Statement *statement;
+    // where lexing picks up for it, its first token or 0 for the first unit,
+    // and the lexer's line and linePos there
+    uint32_t begin;
+    int line;
+    int column;
+    // of the program whose arena and source hold its nodes
+    uint32_t generation;
+    // how many of the program's errors and diagnostics are its own
+    uint32_t errors;
+    uint32_t diagnostics;
+    // lines the tokens under statement are behind line by. reparse moves a
+    // unit by this much instead of every token in it, see
+    // Program::settleLines.
+    int shift;
 };
 
+// every node below the program is bump-allocated from its arena and linked
+// by plain pointers into it. tearing the program down frees the arena's
+// blocks without visiting a single node.
 struct Program : Node {
-    std::vector<std::unique_ptr<Statement>> statements;
+    std::vector<Statement *> statements;
+    // keeps every token literal in the tree alive
+    std::shared_ptr<const SourceBuffer> source;
+    // resolves the sym of every identifier and string literal in the tree
+    std::shared_ptr<Interner> symbols;
+    Arena arena;
+
+    // only kept by parser::parseEditable and parser::reparse. the errors and
+    // lex diagnostics are the parser's, in unit order.
+    std::vector<ParsedUnit> units;
+    std::vector<std::string> errors;
+    std::vector<LexDiagnostic> diagnostics;
+    uint32_t generation = 0;
+    // units whose generation is this program's
+    size_t ownUnits = 0;
+    // earlier programs, each with how many of units still live in it
+    std::vector<std::pair<std::shared_ptr<const Program>, size_t>> retained;
+
+    // moves the tokens of each unit reparse moved to its line. everything
+    // reading token lines out of a program, the codegen, the interpreter and
+    // FlatAst, calls this first, so the lines are settled once per edit read
+    // rather than on every edit.
+    void settleLines();
 
     ~Program() override = default;
 
     std::string tokenLiteral() override;
     std::string toString() override;
     std::string type() override { return "program"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
+// a type written after a declared name, `var x: int = 5;`, a parameter,
+// or a function's parameter list, `func(a: int): int { ... }`. what's given
+// for it has to be of that type, or the program stops. functions never take
+// or return bools, see widen in interp/interpreter.cpp, so parameters and
+// results are never annotated bool.
+enum struct Annotation : uint8_t {
+    NONE,
+    INT,
+    BOOL,
+    STRING,
+    ARRAY,
+    FUNC,
+};
+
+// as written, "" for NONE
+std::string_view annotationName(Annotation annotation);
+
 struct Identifier : Expression {
     Token tok;
-    std::string value;
+    std::string_view value;
+    Symbol sym = NoSymbol;
+    // of a declaration's name or a parameter
+    Annotation annotation = Annotation::NONE;
 
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
-    std::string toString() override { return value; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
+    std::string toString() override;
     std::string type() override { return "identifier"; }
+    void shiftLines(const int delta) override { tok.line += delta; }
+
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct BlockStatement : Statement {
     Token tok;
-    std::vector<std::unique_ptr<Statement>> statements;
+    NodeList<Statement> statements;
 
     ~BlockStatement() override = default;
     void statementNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "block_statement"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct IntLiteral : Expression {
@@ -86,11 +174,13 @@ struct IntLiteral : Expression {
 
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override { return std::to_string(value); }
     std::string type() override { return "int_literal"; }
+    void shiftLines(const int delta) override { tok.line += delta; }
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct BoolLiteral : Expression {
@@ -99,198 +189,242 @@ struct BoolLiteral : Expression {
 
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override { return value ? "true" : "false"; }
     std::string type() override { return "bool_literal"; }
+    void shiftLines(const int delta) override { tok.line += delta; }
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct StringLiteral : Expression {
     Token tok;
-    std::string value;
+    std::string_view value;
+    Symbol sym = NoSymbol;
 
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
-    std::string toString() override { return value; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
+    std::string toString() override { return std::string(value); }
     std::string type() override { return "string_literal"; }
+    void shiftLines(const int delta) override { tok.line += delta; }
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct FuncLiteral : Expression {
     Token tok;
-    std::vector<std::unique_ptr<Identifier>> params;
-    std::unique_ptr<BlockStatement> body;
+    NodeList<Identifier> params;
+    BlockStatement *body = nullptr;
+    Annotation returns = Annotation::NONE;
 
     ~FuncLiteral() override = default;
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "func_literal"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct ArrayLiteral : Expression {
     Token tok;
-    std::vector<std::unique_ptr<Expression>> elements;
+    NodeList<Expression> elements;
 
     ~ArrayLiteral() override = default;
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "array_literal"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override; // todo
+    llvm::Value *codeGen(CodegenJob &cg) override; // todo
+    Value interpret(Interpreter &in) override;
 };
 
 struct CallExpression : Expression {
     Token tok;
-    std::unique_ptr<Expression> callee;
-    std::vector<std::unique_ptr<Expression>> arguments;
+    Expression *callee = nullptr;
+    NodeList<Expression> arguments;
 
     ~CallExpression() override = default;
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string type() override { return "call_expression"; }
+    void shiftLines(int delta) override;
     std::string toString() override;
 
-    llvm::Value *codeGen() override; // todo
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct IndexExpression : Expression {
     Token tok;
-    std::unique_ptr<Expression> index;
-    std::unique_ptr<Expression> array;
+    Expression *index = nullptr;
+    Expression *array = nullptr;
 
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "index"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override; // todo
+    llvm::Value *codeGen(CodegenJob &cg) override; // todo
+    Value interpret(Interpreter &in) override;
 };
 
 struct PrefixExpression : Expression {
     Token tok;
-    std::string op;
-    std::unique_ptr<Expression> rhs;
+    std::string_view op;
+    Expression *rhs = nullptr;
 
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "prefix_expression"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct InfixExpression : Expression {
     Token tok;
-    std::unique_ptr<Expression> lhs;
-    std::unique_ptr<Expression> rhs;
-    std::string op;
+    Expression *lhs = nullptr;
+    Expression *rhs = nullptr;
+    std::string_view op;
 
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "infix_expression"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override; // todo
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct IfExpression : Expression {
     Token tok;
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<BlockStatement> consequence;
-    std::unique_ptr<BlockStatement> alternative;
+    Expression *condition = nullptr;
+    BlockStatement *consequence = nullptr;
+    BlockStatement *alternative = nullptr;
 
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "if_expression"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override; // todo
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct WhileExpression : Expression {
     Token tok;
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<BlockStatement> consequence;
+    Expression *condition = nullptr;
+    BlockStatement *consequence = nullptr;
 
     void expressionNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "while_expression"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override; // todo
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct DeclareStatement : Statement {
     Token tok;
-    std::unique_ptr<Identifier> name;
-    std::unique_ptr<Expression> value;
+    Identifier *name = nullptr;
+    Expression *value = nullptr;
 
     ~DeclareStatement() override = default;
     void statementNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "declare_statement"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct ReferenceStatement : Statement {
     Token tok;
-    std::unique_ptr<Identifier> name;
-    std::unique_ptr<Expression> value;
+    Identifier *name = nullptr;
+    Expression *value = nullptr;
 
     ~ReferenceStatement() override = default;
     void statementNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "reference_statement"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override; // todo
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct ReturnStatement : Statement {
     Token tok;
-    std::unique_ptr<Expression> returnVal;
+    Expression *returnVal = nullptr;
 
     ~ReturnStatement() override = default;
     void statementNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "return_statement"; }
+    void shiftLines(int delta) override;
+
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
+};
+
+struct BreakStatement : Statement {
+    Token tok;
+
+    void statementNode() override {}
+
+    std::string tokenLiteral() override { return std::string(tok.lit); }
+    std::string toString() override { return "break;"; }
+    std::string type() override { return "break_statement"; }
+    void shiftLines(const int delta) override { tok.line += delta; }
 
-    llvm::Value *codeGen() override;
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 struct ExpressionStatement : Statement {
     Token tok;
-    std::unique_ptr<Expression> expression;
+    Expression *expression = nullptr;
 
     ~ExpressionStatement() override = default;
     void statementNode() override {}
 
-    std::string tokenLiteral() override { return tok.lit; }
+    std::string tokenLiteral() override { return std::string(tok.lit); }
     std::string toString() override;
     std::string type() override { return "expression_statement"; }
+    void shiftLines(int delta) override;
 
-    llvm::Value *codeGen() override; // todo
+    llvm::Value *codeGen(CodegenJob &cg) override;
+    Value interpret(Interpreter &in) override;
 };
 
 
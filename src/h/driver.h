@@ -0,0 +1,136 @@
+#pragma once
+
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "../codegen/aot.h"
+#include "../codegen/cache.h"
+#include "../codegen/codegen.h"
+
+// command line of the banter executable:
+//
+//   banter [-O0|-O1|-O2|-O3] [-march=cpu|-mcpu=cpu] [-c] [-o out] [-cache-dir=dir]
+//          [-threads=n] [-dump-ir-before] [-dump-ir-after] [-time-passes] [-stats] file.bt...
+//   banter run [-O0|-O1|-O2|-O3] [-cache-dir=dir] [-threads=n] [-interp|-vm|-tiered] [-dump-ir-before]
+//              [-stats] file.bt
+//
+// the first compiles each file, run jits one and prints what it returns. a
+// file named - is read from stdin. the jit optimizes each function as it's
+// first called, so run has no ir after optimization or pass timings to show.
+//
+// -interp runs the tree as it is, see interpretProgram, instead of compiling
+// it: no startup to speak of, for scripts too short to make up for codegen.
+// -vm compiles to bytecode and runs that, see runBytecode, which takes
+// about as little to start and runs several times faster. with a cache the
+// bytecode is kept too. -tiered starts out as -vm does, then compiles the
+// functions that get hot as -O says, see Tiers, and -stats lists where each
+// function ended up. the last of the three given wins.
+//
+// -c writes an object file per input, next to it with a .o extension unless
+// -o names it. -o without -c links the one input into an executable that
+// prints what the program returns. with neither the files are only checked.
+// -march and -mcpu both pick the cpu, the way clang reads them on x86, and
+// native is the host's.
+//
+// -threads splits codegen into modules, see compileProgramParallel, on n
+// threads, 0 for all of the hardware's. run jits the modules together, a
+// compile also optimizes and lowers each on its own thread and links the
+// objects into one. functions then only inline across what shares a module.
+// given more than one input, a compile also lexes and parses them all up
+// front, at once, see parseFiles.
+//
+// -cache-dir, or else $BANTER_CACHE_DIR, keeps compiled code between runs,
+// see CompileCache. a hit skips lexing, parsing, codegen and optimizing, so
+// nothing is dumped or timed for it. run stores every function, called or
+// not, and a hit that fails to link is deleted and counted as a miss.
+enum struct DriverMode {
+    COMPILE,
+    RUN,
+};
+
+// what run runs the program with
+enum struct RunEngine {
+    JIT,
+    TREE,
+    BYTECODE,
+    TIERED,
+};
+
+enum struct EmitKind {
+    NOTHING,
+    OBJECT,
+    EXECUTABLE,
+};
+
+struct DriverOptions {
+    DriverMode mode = DriverMode::COMPILE;
+    std::vector<std::string> inputs;
+    OptLevel optLevel = OptLevel::O2;
+    // ir of each module straight out of codegen and after the pipeline, on stderr
+    bool dumpIrBefore = false;
+    bool dumpIrAfter = false;
+    // per-pass timings of the pipeline, on stderr
+    bool timePasses = false;
+    // where the time went, compiling vs executing, and cache hits, on stderr
+    bool stats = false;
+    std::string cacheDir; // empty for no cache
+    unsigned threads = 1;
+    // run only
+    RunEngine engine = RunEngine::JIT;
+    // compile only
+    EmitKind emit = EmitKind::NOTHING;
+    std::string output; // -o
+    TargetSpec target;
+
+    // unknown flags and a missing input file end up in errors
+    static DriverOptions parse(int argc, const char *const *argv, std::vector<std::string> &errors);
+};
+
+// lexes and parses path. nullptr, with every lex and parse error in errors,
+// unless it parses cleanly.
+std::unique_ptr<Program> parseFile(const std::string &path, std::vector<std::string> &errors);
+
+// a file through the front end: its program, or nullptr with errors saying why
+struct ParsedFile {
+    std::unique_ptr<Program> program;
+    std::vector<std::string> errors;
+};
+
+// lexes and parses every one of paths on threads, 0 for one per hardware
+// thread, of a work-stealing pool, see WorkPool, so a few big files don't
+// hold up the rest. the results are in the order of paths, whatever order
+// they finish in, so diagnostics merge the same way every time.
+std::vector<ParsedFile> parseFiles(const std::vector<std::string> &paths, unsigned threads);
+
+// parses, compiles and optimizes path as options ask, dumping and timing on
+// the way. with a target the module is set up for and optimized against it.
+// nullptr, with the reasons in errors, if any stage fails.
+std::unique_ptr<llvm::Module> buildModule(const std::string &path, const DriverOptions &options,
+                                          std::vector<std::string> &errors, llvm::TargetMachine *target = nullptr);
+
+// builds path and writes the object file or executable options.emit asks
+// for, taking the object from cache when it has one. false, with the
+// reasons in errors, if anything failed.
+bool compileFile(const std::string &path, const DriverOptions &options, llvm::TargetMachine &target,
+                 std::vector<std::string> &errors, CompileCache *cache = nullptr);
+
+// compileFile for path, parsed already into program
+bool compileParsed(const std::string &path, std::unique_ptr<Program> program, const DriverOptions &options,
+                   llvm::TargetMachine &target, std::vector<std::string> &errors, CompileCache *cache = nullptr);
+
+// jits and runs path's program, optimizing and compiling each function on
+// its first call, or linking what options.cacheDir kept of an earlier run.
+// prints the result on stdout, and with options.stats a breakdown of
+// compile and execute time on stderr. returns the exit code.
+int runFile(const std::string &path, const DriverOptions &options);
+
+// entry point of the executable: compiles every input, reporting problems on
+// stderr, and returns the exit code
+int driverMain(int argc, const char *const *argv);
+
+#endif //DRIVER_H
@@ -0,0 +1,88 @@
+#pragma once
+
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+
+enum struct NodeKind : uint8_t {
+    DECLARE,
+    REFERENCE,
+    RETURN,
+    BREAK,
+    EXPRESSION_STMT,
+    BLOCK,
+    IDENT,
+    INT,
+    BOOL,
+    STRING,
+    FUNC,
+    ARRAY,
+    CALL,
+    INDEX,
+    PREFIX,
+    INFIX,
+    IF,
+    WHILE,
+};
+
+typedef uint32_t NodeIndex;
+constexpr NodeIndex NoNode = UINT32_MAX;
+
+// compact encoding of a Program. every node is one slot across a set of
+// parallel arrays and refers to its children by index, so a pass can switch
+// on kinds[i] and walk the arrays instead of chasing pointers through
+// virtual calls. child lists are runs in `lists`.
+//
+// what a, b and c hold depends on the kind:
+//   DECLARE, REFERENCE   a = name, b = value
+//   RETURN               a = value
+//   BREAK                no operands
+//   EXPRESSION_STMT      a = expression
+//   IDENT, STRING        a = interned symbol
+//   BLOCK, ARRAY         a = first list slot, b = count
+//   INT, BOOL            a = value (int bits / 0 or 1)
+//   FUNC                 a = first param slot, b = param count, c = body
+//   CALL                 a = callee, b = first arg slot, c = arg count
+//   INDEX                a = array, b = index
+//   PREFIX               a = rhs
+//   INFIX                a = lhs, b = rhs
+//   IF                   a = condition, b = consequence, c = alternative
+//   WHILE                a = condition, b = body
+// text is the node's token literal, which is also the name, string value
+// and operator of IDENT, STRING, PREFIX and INFIX nodes. annotations is the
+// type declared for an IDENT naming a declaration or parameter, and for a
+// FUNC's result, NONE everywhere else.
+struct FlatAst {
+    std::vector<NodeKind> kinds;
+    std::vector<int> lines;
+    std::vector<std::string_view> text;
+    std::vector<uint32_t> a, b, c;
+    std::vector<Annotation> annotations;
+    std::vector<NodeIndex> lists;
+    std::vector<NodeIndex> statements; // top level, in order
+    std::shared_ptr<const SourceBuffer> source;
+
+    static FlatAst fromProgram(Program &program);
+
+    [[nodiscard]] size_t size() const { return kinds.size(); }
+    [[nodiscard]] NodeIndex listAt(const uint32_t first, const uint32_t i) const { return lists[first + i]; }
+
+    // same text as the pointer ast's toString
+    [[nodiscard]] std::string toString() const;
+    [[nodiscard]] std::string toString(NodeIndex n) const;
+
+private:
+    NodeIndex add(NodeKind kind, const Token &tok, uint32_t a = NoNode, uint32_t b = NoNode, uint32_t c = NoNode);
+    NodeIndex flatten(Node *node);
+    template <typename T>
+    uint32_t flattenList(const NodeList<T> &list);
+    void print(NodeIndex n, std::string &out) const;
+};
+
+#endif //FLAT_AST_H
@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "arena.h"
+
+typedef uint32_t Symbol;
+constexpr Symbol NoSymbol = UINT32_MAX;
+
+// maps each distinct identifier or string literal of a compilation to a small
+// stable id, so symbol tables key on integers and a name used thousands of
+// times is stored once. names are copied into the interner's own arena, so
+// symbols stay valid after the source buffer that produced them is gone.
+class Interner {
+    Arena storage;
+    std::vector<std::string_view> names;
+    std::vector<uint32_t> hashes; // per symbol, checked before comparing names
+    // open addressing, power of two sized, NoSymbol marks an empty slot
+    std::vector<Symbol> slots;
+
+    static uint64_t hash(std::string_view name);
+    void grow();
+
+public:
+    Symbol intern(std::string_view name);
+    // NoSymbol if name was never interned
+    [[nodiscard]] Symbol find(std::string_view name) const;
+    [[nodiscard]] std::string_view name(const Symbol sym) const { return names[sym]; }
+    [[nodiscard]] size_t size() const { return names.size(); }
+    [[nodiscard]] size_t bytesUsed() const { return storage.bytesUsed(); }
+};
+
+#endif //INTERN_H
@@ -3,8 +3,15 @@
 #ifndef LEX_H
 #define LEX_H
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
-#include <unordered_map>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "intern.h"
+#include "source.h"
 
 // define a token type struct
 enum struct TokenType {
@@ -63,37 +70,139 @@ enum struct TokenType {
     EoF,
 };
 
+// for tables indexed by token type
+constexpr size_t tokenTypeCount = static_cast<size_t>(TokenType::EoF) + 1;
+
+constexpr size_t tokenIndex(const TokenType tt) {
+    return static_cast<size_t>(tt);
+}
+
+// lit is a slice of the lexer's SourceBuffer, so producing a token never
+// allocates. it stays valid for as long as the buffer does. IDENT and STRING
+// tokens also carry their interned symbol.
 struct Token {
     TokenType type;
-    std::string lit;
+    Symbol sym = NoSymbol;
+    std::string_view lit;
     int line;
 
     Token();
-    Token(TokenType type, std::string lit, int line);
+    Token(TokenType type, std::string_view lit, int line);
     [[nodiscard]] std::string toString() const;
 };
 
+// a recoverable lexing error. the lexer emits an ILLEGAL token covering the
+// bad input, records one of these and carries on from the next byte.
+struct LexDiagnostic {
+    std::string message;
+    int line;
+    int column; // linePos at the point of the error
+    size_t offset; // byte offset of the ILLEGAL token in the source
+
+    [[nodiscard]] std::string toString() const;
+};
+
+// every token of a source in struct-of-arrays form, as produced by
+// lex::tokenizeAll. a parser walking it by index reads only the arrays it
+// needs and can look arbitrarily far ahead. the last entry is always EoF.
+struct TokenBuffer {
+    std::shared_ptr<const SourceBuffer> source;
+    std::shared_ptr<Interner> symbols;
+    std::vector<TokenType> types;
+    std::vector<Symbol> syms;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<int> lines;
+    std::vector<LexDiagnostic> diagnostics;
+
+    [[nodiscard]] size_t size() const { return types.size(); }
+    // indexes past the end read as the trailing EoF
+    [[nodiscard]] Token at(size_t i) const {
+        i = std::min(i, types.size() - 1);
+        Token t(types[i], std::string_view(source->data() + offsets[i], lengths[i]), lines[i]);
+        t.sym = syms[i];
+        return t;
+    }
+};
+
 class lex {
-    std::string input;
+    std::shared_ptr<const SourceBuffer> source;
+    std::shared_ptr<Interner> symbols;
+    std::string_view input;
     char ch;
     int pos, readPos, line{}, linePos;
-    std::unordered_map<std::string, TokenType> keywords;
+    std::vector<LexDiagnostic> diagnostics;
 
 public:
 
     static std::string tokenTypeToString(TokenType type);
+
+    // keyword or IDENT. the length and first byte pick at most one
+    // candidate, so an identifier costs one short compare and no hashing.
+    static constexpr TokenType lookupIdent(const std::string_view ident) {
+        auto is = [&](const std::string_view kw, const TokenType tt) {
+            return ident == kw ? tt : TokenType::IDENT;
+        };
+        switch (ident.size()) {
+            case 2:
+                return is("if", TokenType::IF);
+            case 3:
+                return is("var", TokenType::VAR_DECL);
+            case 4:
+                switch (ident[0]) {
+                    case 'f': return is("func", TokenType::FUNCTION);
+                    case 'e': return is("else", TokenType::ELSE);
+                    case 't': return is("true", TokenType::TRUE);
+                    default: return TokenType::IDENT;
+                }
+            case 5:
+                switch (ident[0]) {
+                    case 'w': return is("while", TokenType::WHILE);
+                    case 'b': return is("break", TokenType::BREAK);
+                    case 'f': return is("false", TokenType::FALSE);
+                    default: return TokenType::IDENT;
+                }
+            case 6:
+                return is("return", TokenType::RETURN);
+            default:
+                return TokenType::IDENT;
+        }
+    }
+
     explicit lex(std::string &input);
+    // symbols is shared by every lexer of one compilation. a lexer given
+    // none starts a fresh table of its own.
+    explicit lex(std::shared_ptr<const SourceBuffer> source, std::shared_ptr<Interner> symbols = nullptr);
+    // lexes straight out of a read-only mapping of path, see SourceBuffer::fromFile
+    static lex fromFile(const std::string &path);
+
+    [[nodiscard]] const std::shared_ptr<const SourceBuffer> &getSource() const { return source; }
+    [[nodiscard]] const std::shared_ptr<Interner> &getSymbols() const { return symbols; }
+    // neither moves while a token is lexed, only across the whitespace
+    // before it, so just after a token they're still those at its start
+    [[nodiscard]] int getLine() const { return line; }
+    [[nodiscard]] int getLinePos() const { return linePos; }
+    // carries on from offset, the start of a token, as if lexing up to it
+    // had left line and linePos there
+    void resume(int offset, int line, int linePos);
     void readChar();
+    // jumps straight to index to, as if readChar had been called up to it
+    void seek(int to);
     void skipWhitespace();
 
-    void printError(const Token &t) const;
+    // kept out of line so the error-free path carries no string building
+    [[gnu::cold, gnu::noinline]] void addDiagnostic(std::string_view message, std::string_view got, int offset);
+    [[nodiscard]] const std::vector<LexDiagnostic> &Diagnostics() const { return diagnostics; }
+
     [[nodiscard]] Token nextToken();
+    // lexes the rest of the input in one pass
+    [[nodiscard]] TokenBuffer tokenizeAll();
     [[nodiscard]] char peekChar() const;
 
-    static Token newToken(TokenType type, const std::string &lit, int line);
-    std::string readIdent();
-    std::string readInt();
-    std::string readString();
+    static Token newToken(TokenType type, std::string_view lit, int line);
+    std::string_view readIdent();
+    Token readInt();
+    Token readString();
 };
 
 #endif //LEX_H
\ No newline at end of file
@@ -3,17 +3,19 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <array>
+#include <functional>
+#include <optional>
 #include <vector>
 #include <string>
-#include <unordered_map>
 #include "lex.h"
 #include "ast.h"
 
 struct parser;
 
-typedef std::unique_ptr<Expression> (parser::*PrefixParseFn)();
+typedef Expression *(parser::*PrefixParseFn)();
 
-typedef std::unique_ptr<Expression> (parser::*InfixParseFn)(std::unique_ptr<Expression>);
+typedef Expression *(parser::*InfixParseFn)(Expression *);
 
 enum Precedence {
     LOWEST,
@@ -26,16 +28,53 @@ enum Precedence {
     INDEX,
 };
 
-extern std::unordered_map<TokenType, Precedence> precedence_map;
+// removed bytes of a source at offset, replaced by inserted
+struct TextEdit {
+    size_t offset;
+    size_t removed;
+    std::string_view inserted;
+};
 
 struct parser {
     explicit parser(const lex &l);
+    // batch mode: walks a buffer from lex::tokenizeAll by index instead of
+    // pulling each token through the lexer
+    explicit parser(TokenBuffer tokens);
 
     std::vector<std::string> Errors() { return errors; }
 
+    // malformed input the lexer recovered from, each also seen by the
+    // parser as an ILLEGAL token
+    [[nodiscard]] const std::vector<LexDiagnostic> &LexErrors() const {
+        return l ? l->Diagnostics() : tokens.diagnostics;
+    }
+
     std::unique_ptr<Program> parseProgram();
 
+    // type of the token n places past curTok, so n = 1 is peekTok. free in
+    // batch mode, pull mode has to lex ahead on a copy of the lexer.
+    [[nodiscard]] TokenType peekTypeAt(size_t n) const;
+
+    // parses source in pull mode, keeping the program's units, errors and
+    // lex diagnostics so that edits to it can be reparsed
+    static std::unique_ptr<Program> parseEditable(std::shared_ptr<const SourceBuffer> source,
+                                                  std::shared_ptr<Interner> symbols = nullptr);
+    // previous, from parseEditable or reparse, with edit applied to its
+    // source. lexes and parses only from just before the edit up to the
+    // first unit that starts where one of previous's did, in the same lexer
+    // state give or take a line count, and takes the rest of previous's
+    // units over as they are, moved if the edit added or removed lines: a
+    // unit's line is moved straight away, its tokens' when something reads
+    // them, see Program::settleLines. the result is what parseEditable makes
+    // of the new source.
+    // throws std::out_of_range for an edit past the end of the source.
+    static std::unique_ptr<Program> reparse(std::unique_ptr<Program> previous, const TextEdit &edit);
+
 private:
+    // nodes go into the arena of the program being parsed
+    template <typename T>
+    T *make() { return arena->make<T>(); }
+
     void nextToken();
 
     bool expectPeek(const TokenType &tt);
@@ -44,60 +83,85 @@ private:
 
     [[nodiscard]] Precedence curPrecedence() const;
 
-    std::unique_ptr<Statement> parseStatement();
+    Statement *parseStatement();
 
-    std::unique_ptr<DeclareStatement> parseDeclareStatement();
+    DeclareStatement *parseDeclareStatement();
 
-    std::unique_ptr<ReferenceStatement> parseReferenceStatement();
+    ReferenceStatement *parseReferenceStatement();
 
-    std::unique_ptr<ReturnStatement> parseReturnStatement();
+    ReturnStatement *parseReturnStatement();
 
-    std::unique_ptr<ExpressionStatement> parseExpressionStatement();
+    BreakStatement *parseBreakStatement();
 
-    std::unique_ptr<BlockStatement> parseBlockStatement();
+    ExpressionStatement *parseExpressionStatement();
 
-    std::unique_ptr<Expression> parseExpression(Precedence precedence);
+    BlockStatement *parseBlockStatement();
 
-    std::unique_ptr<Expression> parseIdentifier();
+    Expression *parseExpression(Precedence precedence);
 
-    std::unique_ptr<Expression> parseIntegerLiteral();
+    Expression *parseIdentifier();
 
-    std::unique_ptr<Expression> parseStringLiteral();
+    Expression *parseIntegerLiteral();
 
-    std::unique_ptr<Expression> parsePrefixExpression();
+    Expression *parseStringLiteral();
 
-    std::unique_ptr<Expression> parseBoolean();
+    Expression *parsePrefixExpression();
 
-    std::vector<std::unique_ptr<Identifier>> parseFunctionParameters();
+    Expression *parseBoolean();
 
-    std::unique_ptr<Expression> parseFunctionLiteral();
+    // the type after a `:` at peekTok, if there is one. nullopt, with an
+    // error, for one that isn't a type, or that's bool where passed is set:
+    // for a parameter or result
+    std::optional<Annotation> parseAnnotation(bool passed);
 
-    std::unique_ptr<Expression> parseArrayLiteral();
+    NodeList<Identifier> parseFunctionParameters();
 
-    std::unique_ptr<Expression> parseGroupedExpression();
+    Expression *parseFunctionLiteral();
 
-    std::unique_ptr<Expression> parseIfExpression();
+    Expression *parseArrayLiteral();
 
-    std::unique_ptr<Expression> parseWhileExpression();
+    Expression *parseGroupedExpression();
 
-    std::vector<std::unique_ptr<Expression>> parseExpressionList();
+    Expression *parseIfExpression();
 
-    std::unique_ptr<Expression> parseCallExpression(std::unique_ptr<Expression> callee);
+    Expression *parseWhileExpression();
 
-    std::unique_ptr<Expression> parseIndexExpression(std::unique_ptr<Expression> array);
+    NodeList<Expression> parseExpressionList();
 
-    std::unique_ptr<Expression> parseInfixExpression(std::unique_ptr<Expression> lhs);
+    Expression *parseCallExpression(Expression *callee);
+
+    Expression *parseIndexExpression(Expression *array);
+
+    Expression *parseInfixExpression(Expression *lhs);
 
     void noPrefixParseFnError(TokenType tt);
 
+    // what parseUnits found
+    struct ParsedUnits {
+        std::vector<ParsedUnit> units;
+        std::vector<std::string> errors;
+        std::vector<LexDiagnostic> diagnostics;
+    };
+
+    // parses program's source into units, starting with one at from, until
+    // EoF or until stop accepts where the next unit would start, which is
+    // left in from. true if stopped.
+    static bool parseUnits(Program &program, ParsedUnit &from, const std::function<bool(const ParsedUnit &)> &stop,
+                           ParsedUnits &out);
+
     void peekError(const TokenType &tt);
 
-    lex l;
+    std::optional<lex> l;
+    TokenBuffer tokens;
+    size_t cursor = 0; // index of peekTok in tokens, batch mode only
+    Arena *arena = nullptr;
     Token curTok;
     Token peekTok;
 
-    std::unordered_map<TokenType, PrefixParseFn> prefixParseFns;
-    std::unordered_map<TokenType, InfixParseFn> infixParseFns;
+    // indexed by token type, nullptr where a token has no parse function.
+    // built at compile time and shared by every parser.
+    static const std::array<PrefixParseFn, tokenTypeCount> prefixParseFns;
+    static const std::array<InfixParseFn, tokenTypeCount> infixParseFns;
     std::vector<std::string> errors;
 };
 
@@ -0,0 +1,68 @@
+#pragma once
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// character classes the lexer dispatches on. a fixed table instead of
+// <cctype> keeps classification locale-independent and treats every byte
+// >= 0x80 as illegal, which is what isalnum does in the "C" locale.
+enum CharClass : uint8_t {
+    CC_SPACE = 1 << 0, // ' ', '\t', '\r', '\n'
+    CC_ALPHA = 1 << 1,
+    CC_DIGIT = 1 << 2,
+    CC_ALNUM = CC_ALPHA | CC_DIGIT,
+};
+
+inline constexpr std::array<uint8_t, 256> charClassTable = [] {
+    std::array<uint8_t, 256> table{};
+    table[' '] = table['\t'] = table['\r'] = table['\n'] = CC_SPACE;
+    for (int c = 'a'; c <= 'z'; c++) {
+        table[c] = CC_ALPHA;
+        table[c - 'a' + 'A'] = CC_ALPHA;
+    }
+    for (int c = '0'; c <= '9'; c++) {
+        table[c] = CC_DIGIT;
+    }
+    return table;
+}();
+
+inline bool hasClass(const char c, const uint8_t cls) {
+    return charClassTable[static_cast<uint8_t>(c)] & cls;
+}
+
+enum struct ScanKernel {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// a run of whitespace as the lexer needs to account for it
+struct SpaceRun {
+    size_t end;   // index of the first non-whitespace byte
+    int newlines; // '\n' bytes in the run
+    int spaces;   // ' ' bytes after the last '\n' (or in the whole run if there is none)
+};
+
+// bulk scanners for the lexer's hot loops. each takes the index to start at
+// and returns where the run ends. the vector kernels work on 16 (sse2) or 32
+// (avx2) byte chunks and the widest one the cpu supports is picked on first
+// use.
+struct scan {
+    static SpaceRun whitespace(std::string_view s, size_t from);
+    static size_t alnum(std::string_view s, size_t from);
+    static size_t digits(std::string_view s, size_t from);
+    // first '"', or NUL since the lexer treats that as end of input
+    static size_t stringEnd(std::string_view s, size_t from);
+
+    static ScanKernel bestKernel();
+    static ScanKernel kernel();
+    // overrides the runtime choice. anything wider than bestKernel() is clamped.
+    static void setKernel(ScanKernel k);
+};
+
+#endif //SCAN_H
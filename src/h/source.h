@@ -0,0 +1,44 @@
+#pragma once
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+// owns the text of a single compilation unit. tokens and ast nodes slice
+// into it with string_views, so it is shared (not copied) between the lexer,
+// parser and the resulting program and lives as long as any of them.
+//
+// the text either lives in memory or, for regular files, is a read-only
+// mapping of the file so large inputs are paged in as the lexer reaches them.
+class SourceBuffer {
+    std::string text;
+    const char *mapped = nullptr;
+    size_t mappedLen = 0;
+
+    SourceBuffer(const char *mapped, size_t mappedLen);
+
+public:
+    explicit SourceBuffer(std::string text);
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+
+    // maps path read-only. anything that can't be mapped (pipes, ttys, "-"
+    // for stdin) is streamed into memory instead. throws std::runtime_error
+    // if the file can't be opened or read.
+    static std::shared_ptr<const SourceBuffer> fromFile(const std::string &path);
+    static std::shared_ptr<const SourceBuffer> fromStream(int fd);
+
+    [[nodiscard]] std::string_view view() const {
+        return mapped ? std::string_view(mapped, mappedLen) : std::string_view(text);
+    }
+    [[nodiscard]] const char *data() const { return view().data(); }
+    [[nodiscard]] size_t size() const { return view().size(); }
+    [[nodiscard]] bool isMapped() const { return mapped != nullptr; }
+};
+
+#endif //SOURCE_H
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef TYPES_H
+#define TYPES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "flatAst.h"
+
+// the types a value may have at runtime, a bit each. a set of one is a
+// type proven statically. empty is no value at all: the op always fails,
+// or nothing ever reaches it.
+typedef uint8_t TypeSet;
+constexpr TypeSet IntType = 1;
+constexpr TypeSet BoolType = 2;
+constexpr TypeSet StringType = 4;
+constexpr TypeSet ArrayType = 8;
+constexpr TypeSet FuncType = 16;
+constexpr TypeSet AnyType = 31;
+
+// what a function may return, or be called with: bools come out as ints
+constexpr TypeSet widened(const TypeSet t) {
+    return (t & BoolType) != 0 ? (t & ~BoolType) | IntType : t;
+}
+
+constexpr bool proven(const TypeSet t) {
+    return t != 0 && (t & (t - 1)) == 0;
+}
+
+// what a value of a declares may be, anything for NONE
+constexpr TypeSet annotated(const Annotation a) {
+    return a == Annotation::NONE ? AnyType : static_cast<TypeSet>(1 << (static_cast<int>(a) - 1));
+}
+
+// int, bool, string, array, func, joined by |, or any
+std::string typeSetName(TypeSet t);
+
+struct Types {
+    // by node: the value of an expression, and the variable of a
+    // declaration or a function's parameter
+    std::vector<TypeSet> of;
+    // by DECLARE, parameter or FUNC node with an annotation: whether what's
+    // given for it, its value, arguments or results, is proven of that type
+    // already, so it needn't be checked
+    std::vector<bool> satisfied;
+    size_t expressions = 0; // nodes evaluated as expressions
+    size_t proven = 0;      // of those, with a single type
+};
+
+// works out every expression's types over the whole program, the way the
+// vm will run it. a variable only ever holds the type it was declared
+// with, assigning it anything else fails, so a declaration's type is that
+// of its value. a parameter's is what's passed for it at each direct call
+// by name, or anything if the function is used as a value anywhere, when
+// it could be called from anywhere. a direct call's is what the function
+// returns, unless the name is assigned to. an annotation narrows each of
+// those to its type, as anything else stops the program. that's iterated
+// over the whole program until nothing changes, which settles recursion.
+// elements of arrays aren't tracked, so indexing one is anything.
+Types inferTypes(const FlatAst &ast);
+
+#endif //TYPES_H
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of threads, each with a deque of tasks of its own. a worker
+// runs its own tasks newest first and, once out of them, steals the oldest
+// of another's, so a thread stuck on one big task doesn't leave the work
+// queued behind it waiting. tasks must not throw.
+class WorkPool {
+public:
+    using Task = std::function<void()>;
+
+    // 0 threads for one per hardware thread
+    explicit WorkPool(unsigned threads = 0);
+    // runs whatever is still queued first
+    ~WorkPool();
+
+    WorkPool(const WorkPool &) = delete;
+    WorkPool &operator=(const WorkPool &) = delete;
+
+    // from a task, onto its worker's own deque. from anywhere else onto the
+    // workers' deques in turn.
+    void submit(Task task);
+    // blocks until every task submitted so far, and any they submit, has run
+    void wait();
+
+    [[nodiscard]] unsigned size() const { return static_cast<unsigned>(workers.size()); }
+    // tasks that ran on another worker than the one they were queued on
+    [[nodiscard]] size_t steals() const { return stolen.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    // queued counts tasks sitting in a deque, pending those not finished yet
+    std::mutex stateLock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    size_t queued = 0;
+    size_t pending = 0;
+    bool stopping = false;
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> stolen{0};
+
+    void run(unsigned self);
+    bool take(unsigned self, Task &task);
+};
+
+#endif //WORK_POOL_H
@@ -0,0 +1,78 @@
+#include "h/intern.h"
+
+uint64_t Interner::hash(const std::string_view name) {
+    // word-at-a-time multiply/xorshift mix. identifiers are short, so this
+    // is usually one or two rounds.
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ name.size();
+    const char *p = name.data();
+    size_t n = name.size();
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = (h ^ w) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+    }
+    if (n != 0) {
+        uint64_t w = 0;
+        std::memcpy(&w, p, n);
+        h = (h ^ w) * 0xBF58476D1CE4E5B9ull;
+    }
+    h ^= h >> 29;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 32;
+    return h;
+}
+
+void Interner::grow() {
+    const size_t capacity = slots.empty() ? 1024 : slots.size() * 2;
+    slots.assign(capacity, NoSymbol);
+    const size_t mask = capacity - 1;
+    for (Symbol sym = 0; sym < names.size(); sym++) {
+        size_t i = hashes[sym] & mask;
+        while (slots[i] != NoSymbol) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = sym;
+    }
+}
+
+Symbol Interner::intern(const std::string_view name) {
+    // keep the table at most half full
+    if ((names.size() + 1) * 2 > slots.size()) {
+        grow();
+    }
+    const auto h = static_cast<uint32_t>(hash(name));
+    const size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    for (; slots[i] != NoSymbol; i = (i + 1) & mask) {
+        const Symbol sym = slots[i];
+        if (hashes[sym] == h && names[sym] == name) {
+            return sym;
+        }
+    }
+
+    char *copy = storage.allocateArray<char>(name.size() + 1);
+    std::memcpy(copy, name.data(), name.size());
+    copy[name.size()] = '\0';
+
+    const auto sym = static_cast<Symbol>(names.size());
+    names.emplace_back(copy, name.size());
+    hashes.push_back(h);
+    slots[i] = sym;
+    return sym;
+}
+
+Symbol Interner::find(const std::string_view name) const {
+    if (slots.empty()) {
+        return NoSymbol;
+    }
+    const auto h = static_cast<uint32_t>(hash(name));
+    const size_t mask = slots.size() - 1;
+    for (size_t i = h & mask; slots[i] != NoSymbol; i = (i + 1) & mask) {
+        const Symbol sym = slots[i];
+        if (hashes[sym] == h && names[sym] == name) {
+            return sym;
+        }
+    }
+    return NoSymbol;
+}
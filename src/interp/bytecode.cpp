@@ -0,0 +1,1047 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../h/types.h"
+#include "bytecode.h"
+
+// the a, b and c fields are a byte each
+constexpr uint32_t maxRegisters = 256;
+
+// bump whenever the encoding changes, files of another version don't load
+constexpr uint32_t bytecodeVersion = 2;
+constexpr char bytecodeMagic[] = {'b', 'n', 't', 'r', 'b', 'c'};
+
+size_t opWords(const Op op) {
+    switch (op) {
+        case Op::LOADK:
+        case Op::JMP:
+        case Op::JMPF:
+        case Op::JMPT:
+        case Op::JEQ:
+        case Op::JNEQ:
+        case Op::JLT:
+        case Op::JGT:
+        case Op::JLTE:
+        case Op::JGTE:
+        case Op::NEWARRAY:
+        case Op::ASSIGN:
+        case Op::CHECK:
+        case Op::SETCELL:
+        case Op::SETUP:
+        case Op::CLOSURE:
+        case Op::CALL:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+std::string_view opName(const Op op) {
+    static constexpr std::string_view names[] = {
+        "MOVE", "LOADK",   "LOADBOOL", "ADD",    "SUB",     "MUL",      "DIV",   "MOD",   "EQ",      "NEQ",
+        "LT",   "GT",      "LTE",      "GTE",    "ADDI",    "SUBI",     "NEG",   "NOT",   "JMP",     "JMPF",
+        "JMPT", "JEQ",     "JNEQ",     "JLT",    "JGT",     "JLTE",     "JGTE",  "NEWARRAY", "INDEX", "ASSIGN",
+        "CHECK", "NEWCELL", "GETCELL", "SETCELL", "INITCELL", "GETUP", "SETUP", "CLOSURE", "CALL", "RET",
+    };
+    static_assert(std::size(names) == opCount);
+    return names[static_cast<size_t>(op)];
+}
+
+int Function::lineAt(const uint32_t pc) const {
+    auto after = std::upper_bound(lines.begin(), lines.end(), pc,
+                                  [](const uint32_t p, const std::pair<uint32_t, int> &run) { return p < run.first; });
+    return after == lines.begin() ? 0 : std::prev(after)->second;
+}
+
+std::string Bytecode::toString() const {
+    std::string out;
+    for (size_t f = 0; f < functions.size(); f++) {
+        const Function &fn = functions[f];
+        out += "function " + std::to_string(f) + " " + (fn.name.empty() ? "<anonymous>" : fn.name) +
+               ", params=" + std::to_string(fn.params) + " registers=" + std::to_string(fn.registers) +
+               " cells=" + std::to_string(fn.cells) + "\n";
+        for (size_t pc = 0; pc < fn.code.size(); pc += opWords(opOf(fn.code[pc]))) {
+            const uint32_t word = fn.code[pc];
+            const Op op = opOf(word);
+            out += "  " + std::to_string(pc) + " " + std::string(opName(op)) + " " + std::to_string(argA(word)) + " " +
+                   std::to_string(argB(word)) + " " + std::to_string(argC(word));
+            if (opWords(op) == 2) {
+                const uint32_t x = fn.code[pc + 1];
+                switch (op) {
+                    case Op::LOADK: out += " k" + std::to_string(x) + " = " + constants[x].toString(); break;
+                    case Op::JMP:
+                    case Op::JMPF:
+                    case Op::JMPT:
+                    case Op::JEQ:
+                    case Op::JNEQ:
+                    case Op::JLT:
+                    case Op::JGT:
+                    case Op::JLTE:
+                    case Op::JGTE:
+                        out += " to " + std::to_string(static_cast<int64_t>(pc) + 2 + static_cast<int32_t>(x));
+                        break;
+                    case Op::CLOSURE: out += " function " + std::to_string(x); break;
+                    case Op::NEWARRAY: out += " count " + std::to_string(x); break;
+                    default: out += " " + names[x]; break;
+                }
+            }
+            out += "\n";
+        }
+    }
+    return out;
+}
+
+namespace {
+
+struct Local {
+    Symbol sym;
+    NodeIndex decl; // the DECLARE node, or the parameter's IDENT
+    uint32_t index; // register, or cell if cell
+    bool cell;
+};
+
+// where a name resolved to in the function being compiled
+struct Resolved {
+    enum Kind : uint8_t { NONE, REGISTER, CELL, UP } kind = NONE;
+    uint32_t index = 0;
+};
+
+struct FunctionState {
+    Function fn;
+    NodeIndex literal = NoNode; // FUNC, NoNode for the top level
+    FunctionState *enclosing = nullptr;
+    std::vector<std::vector<Local>> blocks; // innermost last
+    uint32_t next = 0;                      // first free register
+    std::vector<NodeIndex> captured;        // what each of fn.captures holds
+    std::vector<std::vector<size_t>> breaks; // jumps out of each loop around, to patch
+};
+
+struct BytecodeCompiler {
+    const FlatAst &ast;
+    Bytecode &out;
+    std::vector<std::string> &errors;
+    // declarations some function closes over, which get a cell. found as
+    // the function referring to them is compiled, by then the declaring one
+    // may have used a register for them, so that pass is thrown away and
+    // the program compiled again.
+    std::unordered_set<NodeIndex> &cells;
+    std::vector<NodeIndex> &literals; // of each function in out
+    const Types &types;
+    bool missedCells = false;
+
+    FunctionState *fs = nullptr;
+    std::unordered_map<int64_t, uint32_t> intConstants;
+    std::unordered_map<std::string_view, uint32_t> stringConstants;
+    std::unordered_map<std::string, uint32_t> nameIndices;
+
+    void error(const std::string &message, const NodeIndex at) {
+        errors.push_back(message + ", line=" + std::to_string(at == NoNode ? 0 : ast.lines[at]));
+    }
+
+    size_t emit(const NodeIndex at, const uint32_t word) {
+        std::vector<uint32_t> &code = fs->fn.code;
+        const int line = at == NoNode ? 0 : ast.lines[at];
+        if (fs->fn.lines.empty() || fs->fn.lines.back().second != line) {
+            fs->fn.lines.emplace_back(code.size(), line);
+        }
+        code.push_back(word);
+        return code.size() - 1;
+    }
+
+    size_t emit(const NodeIndex at, const uint32_t word, const uint32_t x) {
+        const size_t pc = emit(at, word);
+        fs->fn.code.push_back(x);
+        return pc;
+    }
+
+    // the offset word of the jump at pc, to fill in once the target is known
+    size_t emitJump(const NodeIndex at, const Op op, const uint32_t a = 0) { return emit(at, encode(op, a), 0) + 1; }
+
+    void patch(const size_t offsetWord, const size_t target) {
+        fs->fn.code[offsetWord] = static_cast<uint32_t>(static_cast<int32_t>(target - (offsetWord + 1)));
+    }
+
+    uint32_t reserve(const NodeIndex at) {
+        if (fs->next == maxRegisters) {
+            error("function needs more than " + std::to_string(maxRegisters) + " registers", at);
+            return 0;
+        }
+        fs->fn.registers = std::max(fs->fn.registers, fs->next + 1);
+        return fs->next++;
+    }
+
+    uint32_t newCell(const NodeIndex at) {
+        if (fs->fn.cells == maxRegisters) {
+            error("function closes over more than " + std::to_string(maxRegisters) + " locals", at);
+            return 0;
+        }
+        return fs->fn.cells++;
+    }
+
+    uint32_t name(const std::string &text) {
+        auto [it, added] = nameIndices.try_emplace(text, out.names.size());
+        if (added) {
+            out.names.push_back(text);
+        }
+        return it->second;
+    }
+
+    void loadInt(const NodeIndex at, const uint32_t dest, const int64_t value) {
+        auto [it, added] = intConstants.try_emplace(value, out.constants.size());
+        if (added) {
+            out.constants.emplace_back(value);
+        }
+        emit(at, encode(Op::LOADK, dest), it->second);
+    }
+
+    void loadString(const NodeIndex at, const uint32_t dest, const std::string_view value) {
+        auto [it, added] = stringConstants.try_emplace(value, out.constants.size());
+        if (added) {
+            out.constants.emplace_back(std::string(value));
+        }
+        emit(at, encode(Op::LOADK, dest), it->second);
+    }
+
+    // the latest declaration of sym in state's blocks
+    static const Local *findLocal(const FunctionState &state, const Symbol sym) {
+        for (auto block = state.blocks.rbegin(); block != state.blocks.rend(); ++block) {
+            for (auto local = block->rbegin(); local != block->rend(); ++local) {
+                if (local->sym == sym) {
+                    return &*local;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // index of what decl is among state's captures, adding it if need be
+    static uint32_t capture(FunctionState &state, const NodeIndex decl, const bool local, const uint32_t index) {
+        for (uint32_t i = 0; i < state.captured.size(); i++) {
+            if (state.captured[i] == decl) {
+                return i;
+            }
+        }
+        state.captured.push_back(decl);
+        state.fn.captures.push_back({local, index});
+        return static_cast<uint32_t>(state.captured.size() - 1);
+    }
+
+    // sym as seen from state, from the functions around it if need be
+    std::optional<uint32_t> upvalue(FunctionState &state, const Symbol sym) {
+        if (state.enclosing == nullptr) {
+            return std::nullopt;
+        }
+        if (const Local *local = findLocal(*state.enclosing, sym)) {
+            if (!local->cell) {
+                cells.insert(local->decl);
+                missedCells = true;
+            }
+            return capture(state, local->decl, true, local->index);
+        }
+        const std::optional<uint32_t> outer = upvalue(*state.enclosing, sym);
+        if (!outer) {
+            return std::nullopt;
+        }
+        return capture(state, state.enclosing->captured[*outer], false, *outer);
+    }
+
+    Resolved resolve(const Symbol sym) {
+        if (const Local *local = findLocal(*fs, sym)) {
+            return {local->cell ? Resolved::CELL : Resolved::REGISTER, local->index};
+        }
+        if (const std::optional<uint32_t> up = upvalue(*fs, sym)) {
+            return {Resolved::UP, *up};
+        }
+        return {};
+    }
+
+    // stops the program unless reg holds the type annotated at n, a DECLARE,
+    // parameter or FUNC, where that isn't proven already
+    void check(const NodeIndex n, const Annotation annotation, const uint32_t reg, const Given given,
+               const std::string_view declared) {
+        if (annotation == Annotation::NONE || types.satisfied[n]) {
+            return;
+        }
+        emit(n, encode(Op::CHECK, reg, static_cast<uint32_t>(annotation), static_cast<uint32_t>(given)),
+             name(std::string(declared)));
+    }
+
+    // a declaration, visible from the next one on. a captured one moves into
+    // a fresh cell, so each run of the declaration makes one of its own.
+    void declare(const NodeIndex decl, const Symbol sym, const uint32_t reg) {
+        if (cells.count(decl) != 0) {
+            const uint32_t cell = newCell(decl);
+            emit(decl, encode(Op::NEWCELL, cell));
+            emit(decl, encode(Op::INITCELL, cell, reg));
+            fs->blocks.back().push_back({sym, decl, cell, true});
+        } else {
+            fs->blocks.back().push_back({sym, decl, reg, false});
+        }
+    }
+
+    // whether n only ever comes out of type t, and writes its result once
+    // it's done reading everything. a call may work out its callee in dest
+    // first, so it doesn't qualify.
+    bool provenAs(const NodeIndex n, const TypeSet t) const {
+        if (n == NoNode || !proven(t) || (types.of[n] & ~t) != 0) {
+            return false;
+        }
+        switch (ast.kinds[n]) {
+            case NodeKind::INT:
+            case NodeKind::BOOL:
+            case NodeKind::STRING:
+            case NodeKind::IDENT:
+            case NodeKind::ARRAY:
+            case NodeKind::INDEX:
+            case NodeKind::PREFIX:
+            case NodeKind::INFIX:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // whether evaluating n can assign a local, which only statements in
+    // blocks do. an operand evaluated before it must be copied first.
+    bool assigns(const NodeIndex n) const {
+        if (n == NoNode) {
+            return false;
+        }
+        switch (ast.kinds[n]) {
+            case NodeKind::IF:
+            case NodeKind::WHILE:
+                return true;
+            case NodeKind::INFIX:
+            case NodeKind::INDEX:
+                return assigns(ast.a[n]) || assigns(ast.b[n]);
+            case NodeKind::PREFIX:
+                return assigns(ast.a[n]);
+            case NodeKind::CALL:
+            case NodeKind::ARRAY: {
+                const bool call = ast.kinds[n] == NodeKind::CALL;
+                const uint32_t first = call ? ast.b[n] : ast.a[n];
+                const uint32_t count = call ? ast.c[n] : ast.b[n];
+                for (uint32_t i = 0; i < count; i++) {
+                    if (assigns(ast.listAt(first, i))) {
+                        return true;
+                    }
+                }
+                return call && assigns(ast.a[n]);
+            }
+            default:
+                return false;
+        }
+    }
+
+    // a register holding n's value: a local's own, if n is one that
+    // nothing evaluated after it can change, or a new one
+    uint32_t operand(const NodeIndex n, const bool changes = false) {
+        if (!changes && n != NoNode && ast.kinds[n] == NodeKind::IDENT) {
+            const Resolved r = resolve(ast.a[n]);
+            if (r.kind == Resolved::REGISTER) {
+                return r.index;
+            }
+        }
+        const uint32_t reg = reserve(n);
+        expression(n, reg);
+        return reg;
+    }
+
+    void expression(const NodeIndex n, const uint32_t dest) {
+        if (n == NoNode) {
+            error("missing expression", n);
+            return;
+        }
+        const uint32_t mark = fs->next;
+        switch (ast.kinds[n]) {
+            case NodeKind::IDENT: {
+                const Resolved r = resolve(ast.a[n]);
+                switch (r.kind) {
+                    case Resolved::REGISTER:
+                        if (r.index != dest) {
+                            emit(n, encode(Op::MOVE, dest, r.index));
+                        }
+                        break;
+                    case Resolved::CELL: emit(n, encode(Op::GETCELL, dest, r.index)); break;
+                    case Resolved::UP: emit(n, encode(Op::GETUP, dest, r.index)); break;
+                    case Resolved::NONE: error("unknown identifier=" + std::string(ast.text[n]), n); break;
+                }
+                break;
+            }
+            case NodeKind::INT:
+                loadInt(n, dest, static_cast<int32_t>(ast.a[n]));
+                break;
+            case NodeKind::BOOL:
+                emit(n, encode(Op::LOADBOOL, dest, ast.a[n]));
+                break;
+            case NodeKind::STRING:
+                // the literal keeps its opening quote
+                loadString(n, dest, ast.text[n].substr(1));
+                break;
+            case NodeKind::FUNC:
+                function(n, dest, "");
+                break;
+            case NodeKind::ARRAY: {
+                const uint32_t first = fs->next;
+                for (uint32_t i = 0; i < ast.b[n]; i++) {
+                    expression(ast.listAt(ast.a[n], i), reserve(n));
+                }
+                emit(n, encode(Op::NEWARRAY, dest, first), ast.b[n]);
+                break;
+            }
+            case NodeKind::CALL:
+                call(n, dest);
+                break;
+            case NodeKind::INDEX: {
+                const uint32_t array = operand(ast.a[n], assigns(ast.b[n]));
+                const uint32_t index = operand(ast.b[n]);
+                emit(n, encode(Op::INDEX, dest, array, index));
+                break;
+            }
+            case NodeKind::PREFIX: {
+                const uint32_t rhs = operand(ast.a[n]);
+                if (ast.text[n] == "-") {
+                    emit(n, encode(Op::NEG, dest, rhs));
+                } else if (ast.text[n] == "!") {
+                    emit(n, encode(Op::NOT, dest, rhs));
+                } else {
+                    error("unknown prefix operator=" + std::string(ast.text[n]), n);
+                }
+                break;
+            }
+            case NodeKind::INFIX:
+                infix(n, dest);
+                break;
+            case NodeKind::IF:
+                ifExpression(n, dest);
+                break;
+            case NodeKind::WHILE:
+                whileExpression(n, dest);
+                break;
+            default:
+                error("not an expression", n);
+                break;
+        }
+        fs->next = mark;
+    }
+
+    // ADD through GTE for an infix node, nullopt for anything else
+    std::optional<Op> infixOp(const NodeIndex n) const {
+        static const std::pair<std::string_view, Op> ops[] = {
+            {"+", Op::ADD}, {"-", Op::SUB}, {"*", Op::MUL}, {"/", Op::DIV},  {"%", Op::MOD},  {"==", Op::EQ},
+            {"!=", Op::NEQ}, {"<", Op::LT}, {">", Op::GT},  {"<=", Op::LTE}, {">=", Op::GTE},
+        };
+        if (n == NoNode || ast.kinds[n] != NodeKind::INFIX) {
+            return std::nullopt;
+        }
+        const auto op = std::find_if(std::begin(ops), std::end(ops),
+                                     [&](const auto &o) { return o.first == ast.text[n]; });
+        return op == std::end(ops) ? std::nullopt : std::optional(op->second);
+    }
+
+    static bool comparison(const Op op) { return op >= Op::EQ && op <= Op::GTE; }
+
+    // n's value if it's an int literal that fits a signed byte
+    std::optional<int8_t> smallInt(const NodeIndex n) const {
+        if (n == NoNode || ast.kinds[n] != NodeKind::INT) {
+            return std::nullopt;
+        }
+        const auto value = static_cast<int32_t>(ast.a[n]);
+        return value >= INT8_MIN && value <= INT8_MAX ? std::optional(static_cast<int8_t>(value)) : std::nullopt;
+    }
+
+    void infix(const NodeIndex n, const uint32_t dest) {
+        const std::optional<Op> op = infixOp(n);
+        if (!op) {
+            error("unknown infix operator=" + std::string(ast.text[n]), n);
+            return;
+        }
+        const uint32_t lhs = operand(ast.a[n], assigns(ast.b[n]));
+        // adding or taking away a small constant needs no register for it
+        const std::optional<int8_t> imm = smallInt(ast.b[n]);
+        if (imm && (*op == Op::ADD || *op == Op::SUB)) {
+            emit(n, encode(*op == Op::ADD ? Op::ADDI : Op::SUBI, dest, lhs, static_cast<uint8_t>(*imm)));
+            return;
+        }
+        const uint32_t rhs = operand(ast.b[n]);
+        emit(n, encode(*op, dest, lhs, rhs));
+    }
+
+    // a jump taken if cond is true, or false if not when, to patch. a
+    // comparison jumps on its operands without making a bool first.
+    size_t conditionalJump(const NodeIndex cond, const bool when) {
+        const uint32_t mark = fs->next;
+        size_t jump;
+        const std::optional<Op> op = infixOp(cond);
+        if (op && comparison(*op)) {
+            const uint32_t lhs = operand(ast.a[cond], assigns(ast.b[cond]));
+            const uint32_t rhs = operand(ast.b[cond]);
+            const auto fused = static_cast<Op>(static_cast<uint8_t>(Op::JEQ) + (static_cast<uint8_t>(*op) -
+                                                                              static_cast<uint8_t>(Op::EQ)));
+            jump = emit(cond, encode(fused, when, lhs, rhs), 0) + 1;
+        } else {
+            jump = emitJump(cond, when ? Op::JMPT : Op::JMPF, operand(cond));
+        }
+        fs->next = mark;
+        return jump;
+    }
+
+    // the callee and arguments go in consecutive registers, where the
+    // callee's frame starts at the first argument. the callee's register
+    // gets the result, so it's dest itself when nothing is above dest.
+    void call(const NodeIndex n, const uint32_t dest) {
+        if (ast.c[n] >= maxRegisters) {
+            error("calls take at most " + std::to_string(maxRegisters - 1) + " arguments", n);
+            return;
+        }
+        const uint32_t callee = dest + 1 == fs->next ? dest : reserve(n);
+        expression(ast.a[n], callee);
+        for (uint32_t i = 0; i < ast.c[n]; i++) {
+            expression(ast.listAt(ast.b[n], i), reserve(n));
+        }
+        emit(n, encode(Op::CALL, callee, ast.c[n]), name(ast.a[n] == NoNode ? "" : ast.toString(ast.a[n])));
+        if (callee != dest) {
+            emit(n, encode(Op::MOVE, dest, callee));
+        }
+    }
+
+    // dest is nullopt where the value isn't used
+    void ifExpression(const NodeIndex n, const std::optional<uint32_t> dest) {
+        const size_t toElse = conditionalJump(ast.a[n], false);
+        const bool alternative = ast.c[n] != NoNode;
+        block(ast.b[n], alternative ? dest : std::nullopt);
+        if (alternative) {
+            const size_t toEnd = emitJump(n, Op::JMP);
+            patch(toElse, fs->fn.code.size());
+            block(ast.c[n], dest);
+            patch(toEnd, fs->fn.code.size());
+        } else {
+            patch(toElse, fs->fn.code.size());
+            if (dest) {
+                loadInt(n, *dest, 0);
+            }
+        }
+    }
+
+    // the condition is tested at the bottom, one jump per iteration
+    void whileExpression(const NodeIndex n, const std::optional<uint32_t> dest) {
+        const size_t toCondition = emitJump(n, Op::JMP);
+        const size_t body = fs->fn.code.size();
+        fs->breaks.emplace_back();
+        block(ast.b[n], std::nullopt);
+        patch(toCondition, fs->fn.code.size());
+        patch(conditionalJump(ast.a[n], true), body);
+        for (const size_t jump : fs->breaks.back()) {
+            patch(jump, fs->fn.code.size());
+        }
+        fs->breaks.pop_back();
+        if (dest) {
+            loadInt(n, *dest, 0);
+        }
+    }
+
+    // dest, if any, gets the value of the trailing expression statement, or 0
+    void block(const NodeIndex n, const std::optional<uint32_t> dest) {
+        const uint32_t mark = fs->next;
+        fs->blocks.emplace_back();
+        const uint32_t count = n == NoNode ? 0 : ast.b[n];
+        bool valued = false;
+        for (uint32_t i = 0; i < count; i++) {
+            const NodeIndex stmt = ast.listAt(ast.a[n], i);
+            if (dest && i + 1 == count && stmt != NoNode && ast.kinds[stmt] == NodeKind::EXPRESSION_STMT) {
+                expression(ast.a[stmt], *dest);
+                valued = true;
+            } else {
+                statement(stmt);
+            }
+        }
+        if (dest && !valued) {
+            loadInt(n, *dest, 0);
+        }
+        fs->blocks.pop_back();
+        fs->next = mark;
+    }
+
+    void statement(const NodeIndex n) {
+        if (n == NoNode) {
+            return;
+        }
+        const uint32_t mark = fs->next;
+        switch (ast.kinds[n]) {
+            case NodeKind::DECLARE: {
+                const NodeIndex value = ast.b[n];
+                const Symbol sym = ast.a[ast.a[n]];
+                // a function literal is bound by name first, so it can call itself
+                const Annotation annotation = ast.annotations[ast.a[n]];
+                const std::string_view declared = ast.text[ast.a[n]];
+                if (value != NoNode && ast.kinds[value] == NodeKind::FUNC && cells.count(n) != 0) {
+                    const uint32_t cell = newCell(n);
+                    emit(n, encode(Op::NEWCELL, cell));
+                    fs->blocks.back().push_back({sym, n, cell, true});
+                    const uint32_t reg = reserve(n);
+                    function(value, reg, declared);
+                    check(n, annotation, reg, Given::DECLARED, declared);
+                    emit(n, encode(Op::INITCELL, cell, reg));
+                    fs->next = mark;
+                    return;
+                }
+                const uint32_t reg = reserve(n);
+                if (value != NoNode && ast.kinds[value] == NodeKind::FUNC) {
+                    fs->blocks.back().push_back({sym, n, reg, false});
+                    function(value, reg, declared);
+                    check(n, annotation, reg, Given::DECLARED, declared);
+                    return;
+                }
+                expression(value, reg);
+                check(n, annotation, reg, Given::DECLARED, declared);
+                declare(n, sym, reg);
+                // a cell took the value, the register is free again
+                fs->next = fs->blocks.back().back().cell ? mark : reg + 1;
+                return;
+            }
+            case NodeKind::REFERENCE: {
+                const NodeIndex target = ast.a[n];
+                const Resolved r = resolve(ast.a[target]);
+                // `&x = x + y` works out into x directly: arithmetic comes
+                // out the type of its left operand, so x keeps its type
+                const NodeIndex value = ast.b[n];
+                const std::optional<Op> op = infixOp(value);
+                if (r.kind == Resolved::REGISTER && op && !comparison(*op) && ast.a[value] != NoNode &&
+                    ast.kinds[ast.a[value]] == NodeKind::IDENT && !assigns(ast.b[value])) {
+                    const Resolved lhs = resolve(ast.a[ast.a[value]]);
+                    if (lhs.kind == Resolved::REGISTER && lhs.index == r.index) {
+                        infix(value, r.index);
+                        break;
+                    }
+                }
+                // a value proven to be of the variable's one type can't fail
+                // the check, so it goes straight in
+                if (const Local *local = r.kind != Resolved::UP ? findLocal(*fs, ast.a[target]) : nullptr;
+                    local != nullptr && provenAs(value, types.of[local->decl]) && !assigns(value)) {
+                    if (!local->cell) {
+                        expression(value, local->index);
+                        break;
+                    }
+                    const uint32_t reg = reserve(n);
+                    expression(value, reg);
+                    emit(n, encode(Op::INITCELL, local->index, reg));
+                    break;
+                }
+                const uint32_t reg = reserve(n);
+                expression(value, reg);
+                const uint32_t x = name(std::string(ast.text[target]));
+                switch (r.kind) {
+                    case Resolved::REGISTER: emit(n, encode(Op::ASSIGN, r.index, reg), x); break;
+                    case Resolved::CELL: emit(n, encode(Op::SETCELL, r.index, reg), x); break;
+                    case Resolved::UP: emit(n, encode(Op::SETUP, r.index, reg), x); break;
+                    case Resolved::NONE: error("unknown identifier=" + std::string(ast.text[target]), n); break;
+                }
+                break;
+            }
+            case NodeKind::RETURN: {
+                uint32_t value;
+                if (ast.a[n] != NoNode) {
+                    value = operand(ast.a[n]);
+                } else {
+                    value = reserve(n);
+                    loadInt(n, value, 0);
+                }
+                checkResult(n, value, ast.a[n] != NoNode ? types.of[ast.a[n]] : IntType);
+                emit(n, encode(Op::RET, value));
+                break;
+            }
+            case NodeKind::BREAK:
+                if (fs->breaks.empty()) {
+                    error("break outside of a loop", n);
+                    break;
+                }
+                fs->breaks.back().push_back(emitJump(n, Op::JMP));
+                break;
+            case NodeKind::EXPRESSION_STMT: {
+                // an if or a while for its effects alone doesn't work out a value
+                const NodeIndex e = ast.a[n];
+                if (e != NoNode && ast.kinds[e] == NodeKind::IF) {
+                    ifExpression(e, std::nullopt);
+                } else if (e != NoNode && ast.kinds[e] == NodeKind::WHILE) {
+                    whileExpression(e, std::nullopt);
+                } else {
+                    expression(e, reserve(n));
+                }
+                break;
+            }
+            case NodeKind::BLOCK:
+                block(n, std::nullopt);
+                break;
+            default:
+                expression(n, reserve(n));
+                break;
+        }
+        fs->next = mark;
+    }
+
+    // returns 0 if it falls off the end, which it can't after a return
+    void finish(const NodeIndex at, const NodeIndex body = NoNode) {
+        const uint32_t reg = reserve(at);
+        loadInt(at, reg, 0);
+        const NodeIndex last = body == NoNode || ast.b[body] == 0 ? NoNode : ast.listAt(ast.a[body], ast.b[body] - 1);
+        if (last == NoNode || ast.kinds[last] != NodeKind::RETURN) {
+            checkResult(at, reg, IntType);
+        }
+        emit(at, encode(Op::RET, reg));
+    }
+
+    // what the function being compiled returns from at, in reg, of type given
+    void checkResult(const NodeIndex at, const uint32_t reg, const TypeSet given) {
+        const NodeIndex fn = fs->literal;
+        if (fn == NoNode || ast.annotations[fn] == Annotation::NONE || types.satisfied[fn]) {
+            return;
+        }
+        if ((widened(given) & ~annotated(ast.annotations[fn])) != 0) {
+            emit(at, encode(Op::CHECK, reg, static_cast<uint32_t>(ast.annotations[fn]),
+                            static_cast<uint32_t>(Given::RETURNED)),
+                 name(fs->fn.name));
+        }
+    }
+
+    // compiles the literal at n into a function of its own, and makes a
+    // closure of it in dest
+    void function(const NodeIndex n, const uint32_t dest, const std::string_view declared) {
+        const auto index = static_cast<uint32_t>(out.functions.size());
+        out.functions.emplace_back();
+        literals.push_back(n);
+
+        FunctionState state;
+        state.literal = n;
+        state.enclosing = fs;
+        state.fn.name = declared;
+        state.fn.params = ast.b[n];
+        state.blocks.emplace_back();
+        fs = &state;
+        for (uint32_t i = 0; i < ast.b[n]; i++) {
+            const NodeIndex param = ast.listAt(ast.a[n], i);
+            const uint32_t reg = reserve(param);
+            check(param, ast.annotations[param], reg, Given::PASSED, ast.text[param]);
+            declare(param, ast.a[param], reg);
+        }
+        block(ast.c[n], std::nullopt);
+        finish(n, ast.c[n]);
+        fs = state.enclosing;
+
+        out.functions[index] = std::move(state.fn);
+        emit(n, encode(Op::CLOSURE, dest), index);
+    }
+
+    void program() {
+        out.functions.emplace_back();
+        literals.push_back(NoNode);
+        FunctionState state;
+        state.fn.name = "<main>";
+        state.blocks.emplace_back();
+        fs = &state;
+        for (const NodeIndex stmt : ast.statements) {
+            statement(stmt);
+        }
+        finish(NoNode);
+        fs = nullptr;
+        out.functions[0] = std::move(state.fn);
+    }
+};
+
+} // namespace
+
+std::unique_ptr<Bytecode> compileBytecode(const FlatAst &ast, std::vector<std::string> &errors,
+                                          std::vector<NodeIndex> *literals) {
+    std::unordered_set<NodeIndex> cells;
+    const Types types = inferTypes(ast);
+    for (;;) {
+        auto bytecode = std::make_unique<Bytecode>();
+        std::vector<std::string> passErrors;
+        std::vector<NodeIndex> passLiterals;
+        BytecodeCompiler compiler{ast, *bytecode, passErrors, cells, passLiterals, types, false, nullptr, {}, {}, {}};
+        compiler.program();
+        if (!passErrors.empty()) {
+            errors.insert(errors.end(), passErrors.begin(), passErrors.end());
+            return nullptr;
+        }
+        if (!compiler.missedCells) {
+            if (literals != nullptr) {
+                *literals = std::move(passLiterals);
+            }
+            return bytecode;
+        }
+    }
+}
+
+// the file: magic, version, then constants, names and functions, each a
+// count and its items. numbers are little endian, strings length prefixed.
+namespace {
+
+struct Writer {
+    std::string out;
+
+    void u8(const uint8_t v) { out.push_back(static_cast<char>(v)); }
+    void u32(const uint32_t v) {
+        for (int i = 0; i < 4; i++) {
+            u8(static_cast<uint8_t>(v >> (8 * i)));
+        }
+    }
+    void u64(const uint64_t v) {
+        u32(static_cast<uint32_t>(v));
+        u32(static_cast<uint32_t>(v >> 32));
+    }
+    void string(const std::string_view s) {
+        u32(static_cast<uint32_t>(s.size()));
+        out += s;
+    }
+};
+
+struct Reader {
+    std::string_view in;
+    bool failed = false;
+
+    bool take(const size_t n) {
+        if (failed || in.size() < n) {
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+    uint8_t u8() {
+        if (!take(1)) {
+            return 0;
+        }
+        const auto v = static_cast<uint8_t>(in[0]);
+        in.remove_prefix(1);
+        return v;
+    }
+    uint32_t u32() {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++) {
+            v |= static_cast<uint32_t>(u8()) << (8 * i);
+        }
+        return v;
+    }
+    uint64_t u64() {
+        const uint64_t low = u32();
+        return low | static_cast<uint64_t>(u32()) << 32;
+    }
+    std::string string() {
+        const uint32_t size = u32();
+        if (!take(size)) {
+            return {};
+        }
+        std::string s(in.substr(0, size));
+        in.remove_prefix(size);
+        return s;
+    }
+    // a count of items at least minBytes each, which the input must be able to hold
+    uint32_t count(const size_t minBytes) {
+        const uint32_t n = u32();
+        if (!failed && n > in.size() / minBytes) {
+            failed = true;
+        }
+        return failed ? 0 : n;
+    }
+};
+
+enum ConstantTag : uint8_t { INT_CONSTANT, BOOL_CONSTANT, STRING_CONSTANT };
+
+} // namespace
+
+std::string serializeBytecode(const Bytecode &bytecode) {
+    Writer w;
+    w.out.append(bytecodeMagic, sizeof bytecodeMagic);
+    w.u32(bytecodeVersion);
+    w.u32(static_cast<uint32_t>(bytecode.constants.size()));
+    for (const Value &v : bytecode.constants) {
+        if (v.isInt()) {
+            w.u8(INT_CONSTANT);
+            w.u64(static_cast<uint64_t>(v.asInt()));
+        } else if (v.isBool()) {
+            w.u8(BOOL_CONSTANT);
+            w.u8(v.asBool());
+        } else {
+            w.u8(STRING_CONSTANT);
+            w.string(v.asString());
+        }
+    }
+    w.u32(static_cast<uint32_t>(bytecode.names.size()));
+    for (const std::string &n : bytecode.names) {
+        w.string(n);
+    }
+    w.u32(static_cast<uint32_t>(bytecode.functions.size()));
+    for (const Function &fn : bytecode.functions) {
+        w.string(fn.name);
+        w.u32(fn.params);
+        w.u32(fn.registers);
+        w.u32(fn.cells);
+        w.u32(static_cast<uint32_t>(fn.captures.size()));
+        for (const Capture &c : fn.captures) {
+            w.u8(c.local);
+            w.u32(c.index);
+        }
+        w.u32(static_cast<uint32_t>(fn.code.size()));
+        for (const uint32_t word : fn.code) {
+            w.u32(word);
+        }
+        w.u32(static_cast<uint32_t>(fn.lines.size()));
+        for (const auto &[pc, line] : fn.lines) {
+            w.u32(pc);
+            w.u32(static_cast<uint32_t>(line));
+        }
+    }
+    return std::move(w.out);
+}
+
+// whether every operand of fn's code is in range for what it indexes, every
+// jump lands on an instruction, and the code can't run off its end
+static bool verify(const Bytecode &bytecode, const Function &fn, std::string &problem) {
+    if (fn.registers > maxRegisters || fn.cells > maxRegisters || fn.params > fn.registers || fn.code.empty()) {
+        problem = "bad function header";
+        return false;
+    }
+    std::vector<bool> starts(fn.code.size(), false);
+    size_t pc = 0;
+    Op last = Op::RET;
+    while (pc < fn.code.size()) {
+        starts[pc] = true;
+        last = opOf(fn.code[pc]);
+        if (static_cast<size_t>(last) >= opCount) {
+            problem = "unknown op at " + std::to_string(pc);
+            return false;
+        }
+        pc += opWords(last);
+    }
+    if (pc != fn.code.size()) {
+        problem = "truncated instruction";
+        return false;
+    }
+    if (last != Op::RET && last != Op::JMP) {
+        problem = "code runs off its end";
+        return false;
+    }
+
+    for (pc = 0; pc < fn.code.size(); pc += opWords(opOf(fn.code[pc]))) {
+        const uint32_t word = fn.code[pc];
+        const uint32_t a = argA(word);
+        const uint32_t b = argB(word);
+        const uint32_t c = argC(word);
+        const uint32_t x = opWords(opOf(word)) == 2 ? fn.code[pc + 1] : 0;
+        const auto reg = [&](const uint32_t r) { return r < fn.registers; };
+        bool ok;
+        switch (opOf(word)) {
+            case Op::MOVE:
+            case Op::ADDI:
+            case Op::SUBI:
+            case Op::NEG:
+            case Op::NOT: ok = reg(a) && reg(b); break;
+            case Op::LOADK: ok = reg(a) && x < bytecode.constants.size(); break;
+            case Op::LOADBOOL: ok = reg(a); break;
+            case Op::JMP:
+            case Op::JMPF:
+            case Op::JMPT:
+            case Op::JEQ:
+            case Op::JNEQ:
+            case Op::JLT:
+            case Op::JGT:
+            case Op::JLTE:
+            case Op::JGTE: {
+                const int64_t target = static_cast<int64_t>(pc) + 2 + static_cast<int32_t>(x);
+                const Op op = opOf(word);
+                ok = (op == Op::JMP || (op == Op::JMPF || op == Op::JMPT ? reg(a) : a <= 1 && reg(b) && reg(c))) &&
+                     target >= 0 && static_cast<size_t>(target) < fn.code.size() && starts[target];
+                break;
+            }
+            case Op::NEWARRAY: ok = reg(a) && b + static_cast<uint64_t>(x) <= fn.registers; break;
+            case Op::ASSIGN: ok = reg(a) && reg(b) && x < bytecode.names.size(); break;
+            case Op::CHECK:
+                ok = reg(a) && b > static_cast<uint32_t>(Annotation::NONE) &&
+                     b <= static_cast<uint32_t>(Annotation::FUNC) && c <= static_cast<uint32_t>(Given::RETURNED) &&
+                     x < bytecode.names.size();
+                break;
+            case Op::NEWCELL: ok = a < fn.cells; break;
+            case Op::GETCELL: ok = reg(a) && b < fn.cells; break;
+            case Op::SETCELL: ok = a < fn.cells && reg(b) && x < bytecode.names.size(); break;
+            case Op::INITCELL: ok = a < fn.cells && reg(b); break;
+            case Op::GETUP: ok = reg(a) && b < fn.captures.size(); break;
+            case Op::SETUP: ok = a < fn.captures.size() && reg(b) && x < bytecode.names.size(); break;
+            case Op::CLOSURE: {
+                ok = reg(a) && x > 0 && x < bytecode.functions.size();
+                for (size_t i = 0; ok && i < bytecode.functions[x].captures.size(); i++) {
+                    const Capture &capture = bytecode.functions[x].captures[i];
+                    ok = capture.index < (capture.local ? fn.cells : fn.captures.size());
+                }
+                break;
+            }
+            case Op::CALL: ok = a + static_cast<uint64_t>(b) < fn.registers && x < bytecode.names.size(); break;
+            case Op::RET: ok = reg(a); break;
+            default: ok = reg(a) && reg(b) && reg(c); break;
+        }
+        if (!ok) {
+            problem = "bad operand of " + std::string(opName(opOf(word))) + " at " + std::to_string(pc);
+            return false;
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<Bytecode> deserializeBytecode(const std::string_view bytes, std::vector<std::string> &errors) {
+    Reader r{bytes};
+    if (!r.take(sizeof bytecodeMagic) || std::memcmp(bytes.data(), bytecodeMagic, sizeof bytecodeMagic) != 0) {
+        errors.emplace_back("not bytecode");
+        return nullptr;
+    }
+    r.in.remove_prefix(sizeof bytecodeMagic);
+    const uint32_t version = r.u32();
+    if (version != bytecodeVersion) {
+        errors.push_back("bytecode version " + std::to_string(version) + ", expected " +
+                         std::to_string(bytecodeVersion));
+        return nullptr;
+    }
+
+    auto bytecode = std::make_unique<Bytecode>();
+    for (uint32_t n = r.count(2); n > 0; n--) {
+        switch (r.u8()) {
+            case INT_CONSTANT: bytecode->constants.emplace_back(static_cast<int64_t>(r.u64())); break;
+            case BOOL_CONSTANT: bytecode->constants.emplace_back(r.u8() != 0); break;
+            case STRING_CONSTANT: bytecode->constants.emplace_back(r.string()); break;
+            default: r.failed = true; break;
+        }
+    }
+    for (uint32_t n = r.count(4); n > 0; n--) {
+        bytecode->names.push_back(r.string());
+    }
+    for (uint32_t n = r.count(28); n > 0; n--) {
+        Function &fn = bytecode->functions.emplace_back();
+        fn.name = r.string();
+        fn.params = r.u32();
+        fn.registers = r.u32();
+        fn.cells = r.u32();
+        for (uint32_t i = r.count(5); i > 0; i--) {
+            const bool local = r.u8() != 0;
+            fn.captures.push_back({local, r.u32()});
+        }
+        for (uint32_t i = r.count(4); i > 0; i--) {
+            fn.code.push_back(r.u32());
+        }
+        for (uint32_t i = r.count(8); i > 0; i--) {
+            const uint32_t pc = r.u32();
+            fn.lines.emplace_back(pc, static_cast<int>(r.u32()));
+        }
+    }
+    if (r.failed || !r.in.empty() || bytecode->functions.empty() || bytecode->functions[0].params != 0) {
+        errors.emplace_back("malformed bytecode");
+        return nullptr;
+    }
+    for (size_t f = 0; f < bytecode->functions.size(); f++) {
+        std::string problem;
+        if (!verify(*bytecode, bytecode->functions[f], problem)) {
+            errors.push_back("malformed bytecode in function " + std::to_string(f) + ": " + problem);
+            return nullptr;
+        }
+    }
+    return bytecode;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../h/flatAst.h"
+#include "interpreter.h"
+
+// one instruction is a 32-bit word, op | a << 8 | b << 16 | c << 24, where
+// a, b and c are registers of the running function unless said otherwise.
+// some take a whole extra word, x, right after:
+//   MOVE            a = b
+//   LOADK           a = constants[x]
+//   LOADBOOL        a = b != 0
+//   ADD ... GTE     a = b op c
+//   ADDI, SUBI      a = b + c / b - c, c a signed byte
+//   NEG, NOT        a = op b
+//   JMP             pc += x, signed and counted from the next instruction
+//   JMPF, JMPT      pc += x if a is false / true, which only ints and bools are
+//   JEQ ... JGTE    pc += x if b op c is a, which is 0 or 1
+//   NEWARRAY        a = array of the x registers from b on
+//   INDEX           a = b[c]
+//   ASSIGN          a = b, if of a's type, for `&name = ...` where x = name
+//   CHECK           stops unless a is of the type Annotation b declares, as
+//                   given c, a Given, for x = name, see annotationMismatch
+//   NEWCELL         cell a = a new cell holding 0
+//   GETCELL         a = cell b's value
+//   SETCELL         cell a's value = b, same check as ASSIGN, x = name
+//   INITCELL        cell a's value = b
+//   GETUP, SETUP    as GETCELL and SETCELL, on the closure's captured cell b / a
+//   CLOSURE         a = functions[x], capturing what its captures say
+//   CALL            a = a(a + 1, ..., a + b), x = the callee as written
+//   RET             returns a
+enum struct Op : uint8_t {
+    MOVE,
+    LOADK,
+    LOADBOOL,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    EQ,
+    NEQ,
+    LT,
+    GT,
+    LTE,
+    GTE,
+    ADDI,
+    SUBI,
+    NEG,
+    NOT,
+    JMP,
+    JMPF,
+    JMPT,
+    JEQ,
+    JNEQ,
+    JLT,
+    JGT,
+    JLTE,
+    JGTE,
+    NEWARRAY,
+    INDEX,
+    ASSIGN,
+    CHECK,
+    NEWCELL,
+    GETCELL,
+    SETCELL,
+    INITCELL,
+    GETUP,
+    SETUP,
+    CLOSURE,
+    CALL,
+    RET,
+};
+
+constexpr size_t opCount = static_cast<size_t>(Op::RET) + 1;
+
+// words an instruction of op takes, 1 or 2
+size_t opWords(Op op);
+// as bytecode listings spell it
+std::string_view opName(Op op);
+
+constexpr uint32_t encode(const Op op, const uint32_t a = 0, const uint32_t b = 0, const uint32_t c = 0) {
+    return static_cast<uint32_t>(op) | a << 8 | b << 16 | c << 24;
+}
+constexpr Op opOf(const uint32_t word) { return static_cast<Op>(word & 0xff); }
+constexpr uint32_t argA(const uint32_t word) { return word >> 8 & 0xff; }
+constexpr uint32_t argB(const uint32_t word) { return word >> 16 & 0xff; }
+constexpr uint32_t argC(const uint32_t word) { return word >> 24; }
+
+// where a closure gets each of its cells from when it's made: the maker's
+// own cell index, or the one it captured at index
+struct Capture {
+    bool local;
+    uint32_t index;
+};
+
+// a function literal, or the program's top level. parameters arrive in
+// registers 0 on. cells hold the locals some function closes over, which
+// live on after the call that declared them.
+struct Function {
+    std::string name; // what it was declared as, if anything
+    uint32_t params = 0;
+    uint32_t registers = 0;
+    uint32_t cells = 0;
+    std::vector<Capture> captures;
+    std::vector<uint32_t> code;
+    // (pc, line) where each run of instructions from one line starts
+    std::vector<std::pair<uint32_t, int>> lines;
+
+    [[nodiscard]] int lineAt(uint32_t pc) const;
+};
+
+// a compiled program. functions[0] is the top level. constants are only
+// ever ints, bools and strings, names are what errors call things.
+struct Bytecode {
+    std::vector<Value> constants;
+    std::vector<std::string> names;
+    std::vector<Function> functions;
+
+    // one instruction per line, for tests and debugging
+    [[nodiscard]] std::string toString() const;
+};
+
+// unlike the tree walk, names resolve once, at compile time and lexically,
+// as codegen resolves them: to the latest declaration before them in the
+// blocks around them. so a name no declaration reaches, or a break outside
+// of a loop, is an error even if it never runs. nullptr, with the errors, if
+// the program doesn't compile. literals, if given, gets the FUNC node each
+// function was compiled from, NoNode for the top level.
+std::unique_ptr<Bytecode> compileBytecode(const FlatAst &ast, std::vector<std::string> &errors,
+                                          std::vector<NodeIndex> *literals = nullptr);
+
+// to bytes for a file, and back. deserializing checks that every operand is
+// in range for what it indexes and every jump lands on an instruction, so a
+// corrupt file is turned away before it runs. nullptr, with the error, if
+// it's not bytecode of this version or fails those checks.
+std::string serializeBytecode(const Bytecode &bytecode);
+std::unique_ptr<Bytecode> deserializeBytecode(std::string_view bytes, std::vector<std::string> &errors);
+
+struct VmStats {
+    uint64_t instructions = 0; // executed
+    uint64_t calls = 0;
+    uint64_t nativeCalls = 0; // of those, to native code, see TierHooks
+};
+
+// native code called from the vm takes at most this many arguments
+constexpr uint32_t maxNativeParams = 6;
+
+// lets runBytecode count how hot each function runs and hand the hot ones
+// to be compiled, see Tiers. native[i] is function i's native code, once
+// another thread has compiled it. it takes and returns ints, so the vm
+// calls it instead of the bytecode when every argument is one.
+struct TierHooks {
+    struct Counters {
+        uint64_t calls = 0;     // run in bytecode
+        uint64_t backEdges = 0; // loops taken round again, in bytecode
+        uint64_t nativeCalls = 0;
+    };
+
+    // calls plus back edges a function runs before promote is called for
+    // it, once
+    uint64_t threshold = 0;
+    std::function<void(uint32_t)> promote;
+    std::vector<Counters> counters;
+    std::unique_ptr<std::atomic<uint64_t>[]> native; // addresses, 0 until compiled
+
+    explicit TierHooks(size_t functions)
+        : counters(functions), native(std::make_unique<std::atomic<uint64_t>[]>(functions)) {}
+};
+
+// runs bytecode the way interpretProgram runs the tree, which comes to the
+// same values on the programs the vm's tests check both against. they part
+// ways on how deep calls nest, the vm's frames being on the heap, 100000 of
+// them, and the tree walk's native, 2000, see maxFrames and maxDepth. and a
+// name never declared where it's used fails compileBytecode up front but
+// the tree walk only once it gets there.
+std::optional<Value> runBytecode(const Bytecode &bytecode, std::vector<std::string> &errors,
+                                 VmStats *stats = nullptr, TierHooks *tiers = nullptr);
+
+#endif //BYTECODE_H
@@ -0,0 +1,443 @@
+#include <limits>
+#include <stdexcept>
+
+#include "interpreter.h"
+
+// calls nest this deep at most, which keeps the tree walk, a few native
+// frames per call, well inside the thread's stack
+constexpr size_t maxDepth = 2000;
+
+// stops the program: unwinds out of the tree walk to interpretProgram
+struct RuntimeError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+[[noreturn]] static void runtimeError(const std::string &message, const int line) {
+    throw RuntimeError(message + ", line=" + std::to_string(line));
+}
+
+std::string Value::typeName() const {
+    switch (data.index()) {
+        case 0: return "int";
+        case 1: return "bool";
+        case 2: return "string";
+        case 3: return "array";
+        default: return "func";
+    }
+}
+
+std::string Value::toString() const {
+    switch (data.index()) {
+        case 0: return std::to_string(asInt());
+        case 1: return asBool() ? "true" : "false";
+        case 2: return asString();
+        case 3: {
+            std::string out = "[";
+            for (const Value &v : asArray()) {
+                out += out.size() > 1 ? ", " : "";
+                out += v.isString() ? "\"" + v.asString() + "\"" : v.toString();
+            }
+            return out + "]";
+        }
+        default: return "func";
+    }
+}
+
+Interpreter::~Interpreter() {
+    for (const std::shared_ptr<Scope> &s : captured) {
+        s->bindings.clear();
+        s->parent.reset();
+    }
+}
+
+static Value evaluate(Interpreter &in, Node *node, const int line) {
+    if (node == nullptr) {
+        runtimeError("missing expression", line);
+    }
+    return node->interpret(in);
+}
+
+// ints are true unless 0
+static bool truthy(const Value &v, const int line) {
+    if (v.isBool()) {
+        return v.asBool();
+    }
+    if (v.isInt()) {
+        return v.asInt() != 0;
+    }
+    runtimeError("condition must be int or bool, got " + v.typeName(), line);
+}
+
+// functions take and return ints, bools passed in or returned are widened
+static Value widen(const Value &v) {
+    return v.isBool() ? Value(static_cast<int64_t>(v.asBool())) : v;
+}
+
+std::string annotationMismatch(const Given given, const Annotation annotation, const Value &v,
+                               const std::string_view name) {
+    const Value widened = given == Given::DECLARED ? v : widen(v);
+    if (annotation == Annotation::NONE || static_cast<size_t>(annotation) == widened.data.index() + 1) {
+        return "";
+    }
+    const std::string as = widened.typeName() + " as " + std::string(annotationName(annotation));
+    switch (given) {
+        case Given::DECLARED: return "cannot declare " + as + " " + std::string(name);
+        case Given::PASSED: return "cannot pass " + as + " " + std::string(name);
+        case Given::RETURNED: return "cannot return " + as;
+    }
+    return "";
+}
+
+static void check(const Given given, const Annotation annotation, const Value &v, const std::string_view name,
+                  const int line) {
+    if (std::string mismatch = annotationMismatch(given, annotation, v, name); !mismatch.empty()) {
+        runtimeError(mismatch, line);
+    }
+}
+
+// into the innermost block's scope, which it opens on its first declaration
+static Value &declare(Interpreter &in, const Symbol sym, Value v) {
+    if (!in.blockScope) {
+        const size_t visible = in.scope != nullptr ? in.scope->bindings.size() : 0;
+        in.scope = std::make_shared<Scope>(Scope{{}, std::move(in.scope), visible});
+        in.blockScope = true;
+    }
+    return in.scope->bindings.emplace_back(sym, std::move(v)).second;
+}
+
+// innermost binding of sym, the latest of a scope's first. of the scopes
+// around, only what was declared before the inner one opened counts, so a
+// name means what it did where the code using it was written.
+static Value *lookup(const Interpreter &in, const Symbol sym) {
+    Scope *s = in.scope.get();
+    for (size_t visible = s != nullptr ? s->bindings.size() : 0; s != nullptr;
+         visible = s->visible, s = s->parent.get()) {
+        for (size_t i = visible; i-- > 0;) {
+            if (s->bindings[i].first == sym) {
+                return &s->bindings[i].second;
+            }
+        }
+    }
+    return nullptr;
+}
+
+static Value *lookup(const Interpreter &in, const Identifier *name, const int line) {
+    Value *v = lookup(in, name->sym);
+    if (v == nullptr) {
+        runtimeError("unknown identifier=" + std::string(name->value), line);
+    }
+    return v;
+}
+
+static Value makeClosure(Interpreter &in, FuncLiteral *lit) {
+    if (in.captured.empty() || in.captured.back() != in.scope) {
+        in.captured.push_back(in.scope);
+    }
+    return Value(std::make_shared<const Closure>(Closure{lit, in.scope, in.scope->bindings.size(), nullptr, {}}));
+}
+
+std::optional<Value> interpretProgram(Program &program, std::vector<std::string> &errors) {
+    program.settleLines();
+    Interpreter in;
+    try {
+        return program.interpret(in);
+    } catch (const RuntimeError &e) {
+        errors.emplace_back(e.what());
+        return std::nullopt;
+    }
+}
+
+Value Program::interpret(Interpreter &in) {
+    in.scope = std::make_shared<Scope>();
+    in.blockScope = true;
+    for (Statement *stmt : statements) {
+        if (stmt == nullptr) {
+            continue;
+        }
+        stmt->interpret(in);
+        if (in.flow == Flow::RETURN) {
+            return in.returned;
+        }
+    }
+    return Value();
+}
+
+// a block is a scope. its value is that of its trailing expression
+// statement, if any, else 0.
+Value BlockStatement::interpret(Interpreter &in) {
+    const bool outerScope = in.blockScope;
+    in.blockScope = false;
+    Value last;
+    for (Statement *stmt : statements) {
+        if (stmt == nullptr) {
+            continue;
+        }
+        last = stmt->interpret(in);
+        if (in.flow != Flow::NEXT) {
+            last = Value();
+            break;
+        }
+    }
+    if (in.blockScope) {
+        in.scope = in.scope->parent;
+    }
+    in.blockScope = outerScope;
+    return last;
+}
+
+Value Identifier::interpret(Interpreter &in) {
+    return *lookup(in, this, tok.line);
+}
+
+Value IntLiteral::interpret(Interpreter &) {
+    return Value(static_cast<int64_t>(value));
+}
+
+Value BoolLiteral::interpret(Interpreter &) {
+    return Value(value);
+}
+
+// the literal keeps its opening quote
+Value StringLiteral::interpret(Interpreter &) {
+    return Value(std::string(value.substr(1)));
+}
+
+Value FuncLiteral::interpret(Interpreter &in) {
+    return makeClosure(in, this);
+}
+
+Value ArrayLiteral::interpret(Interpreter &in) {
+    Array items;
+    items.reserve(elements.size());
+    for (Expression *e : elements) {
+        items.push_back(evaluate(in, e, tok.line));
+    }
+    return Value(std::move(items));
+}
+
+// arguments are evaluated left to right in the caller, then the body runs
+// in a scope of the parameters inside the one the function closes over
+Value CallExpression::interpret(Interpreter &in) {
+    const Value fn = evaluate(in, callee, tok.line);
+    if (!fn.isFunction()) {
+        runtimeError(fn.typeName() + " " + callee->toString() + " is not a function", tok.line);
+    }
+    const Closure &closure = fn.asFunction();
+    if (closure.lit->params.size() != arguments.size()) {
+        runtimeError(callee->toString() + " takes " + std::to_string(closure.lit->params.size()) +
+                     " arguments, got " + std::to_string(arguments.size()), tok.line);
+    }
+    if (in.depth == maxDepth) {
+        runtimeError("calls nested deeper than " + std::to_string(maxDepth), tok.line);
+    }
+
+    auto frame = std::make_shared<Scope>(Scope{{}, closure.scope, closure.visible});
+    frame->bindings.reserve(arguments.size());
+    for (size_t i = 0; i < arguments.size(); i++) {
+        frame->bindings.emplace_back(closure.lit->params[i]->sym, widen(evaluate(in, arguments[i], tok.line)));
+    }
+    // once they're all in, as the vm checks them on entry
+    for (size_t i = 0; i < arguments.size(); i++) {
+        const Identifier *param = closure.lit->params[i];
+        check(Given::PASSED, param->annotation, frame->bindings[i].second, param->value, param->tok.line);
+    }
+
+    std::shared_ptr<Scope> caller = std::move(in.scope);
+    const bool callerScope = in.blockScope;
+    const size_t callerLoops = in.loops;
+    const FuncLiteral *callerFunction = in.function;
+    in.scope = std::move(frame);
+    in.blockScope = true;
+    in.loops = 0;
+    in.function = closure.lit;
+    in.depth++;
+    if (closure.lit->body != nullptr) {
+        closure.lit->body->interpret(in);
+    }
+    in.depth--;
+    in.scope = std::move(caller);
+    in.blockScope = callerScope;
+    in.loops = callerLoops;
+    in.function = callerFunction;
+
+    if (in.flow == Flow::RETURN) {
+        in.flow = Flow::NEXT;
+        return std::move(in.returned);
+    }
+    // falling off the end returns 0
+    check(Given::RETURNED, closure.lit->returns, Value(), "", closure.lit->tok.line);
+    return Value();
+}
+
+// into an array, or a string for the one-byte string at index
+Value IndexExpression::interpret(Interpreter &in) {
+    const Value a = evaluate(in, array, tok.line);
+    const Value i = evaluate(in, index, tok.line);
+    if (!i.isInt()) {
+        runtimeError("index must be int, got " + i.typeName(), tok.line);
+    }
+    size_t size;
+    if (a.isArray()) {
+        size = a.asArray().size();
+    } else if (a.isString()) {
+        size = a.asString().size();
+    } else {
+        runtimeError("cannot index " + a.typeName(), tok.line);
+    }
+    if (i.asInt() < 0 || static_cast<uint64_t>(i.asInt()) >= size) {
+        runtimeError("index " + std::to_string(i.asInt()) + " out of range for " + a.typeName() + " of " +
+                     std::to_string(size), tok.line);
+    }
+    const auto at = static_cast<size_t>(i.asInt());
+    return a.isArray() ? a.asArray()[at] : Value(std::string(1, a.asString()[at]));
+}
+
+Value PrefixExpression::interpret(Interpreter &in) {
+    const Value operand = evaluate(in, rhs, tok.line);
+    switch (tok.type) {
+        case TokenType::SUB:
+            if (!operand.isInt()) {
+                runtimeError("invalid operand for -: " + operand.typeName(), tok.line);
+            }
+            return Value(static_cast<int64_t>(0ULL - static_cast<uint64_t>(operand.asInt())));
+        case TokenType::BANG:
+            // !int is true only for 0
+            if (!operand.isInt() && !operand.isBool()) {
+                runtimeError("invalid operand for !: " + operand.typeName(), tok.line);
+            }
+            return Value(!truthy(operand, tok.line));
+        default:
+            runtimeError("unknown prefix operator=" + std::string(op), tok.line);
+    }
+}
+
+// ints wrap around like the i64 codegen emits. a division by zero, which
+// compiled code leaves undefined, stops the program.
+static Value arithmetic(const TokenType type, const int64_t l, const int64_t r, const std::string_view op,
+                        const int line) {
+    const auto ul = static_cast<uint64_t>(l);
+    const auto ur = static_cast<uint64_t>(r);
+    switch (type) {
+        case TokenType::ADD: return Value(static_cast<int64_t>(ul + ur));
+        case TokenType::SUB: return Value(static_cast<int64_t>(ul - ur));
+        case TokenType::MUL: return Value(static_cast<int64_t>(ul * ur));
+        case TokenType::DIV:
+        case TokenType::MOD:
+            if (r == 0) {
+                runtimeError("division by zero", line);
+            }
+            if (l == std::numeric_limits<int64_t>::min() && r == -1) {
+                return Value(type == TokenType::DIV ? l : int64_t{0});
+            }
+            return Value(type == TokenType::DIV ? l / r : l % r);
+        case TokenType::EQ: return Value(l == r);
+        case TokenType::NEQ: return Value(l != r);
+        case TokenType::LT: return Value(l < r);
+        case TokenType::GT: return Value(l > r);
+        case TokenType::LTE: return Value(l <= r);
+        case TokenType::GTE: return Value(l >= r);
+        default:
+            runtimeError("unknown infix operator=" + std::string(op), line);
+    }
+}
+
+// ints do arithmetic and compare, bools only compare for equality, strings
+// also concatenate with +
+Value InfixExpression::interpret(Interpreter &in) {
+    const Value l = evaluate(in, lhs, tok.line);
+    const Value r = evaluate(in, rhs, tok.line);
+    if (l.data.index() != r.data.index()) {
+        runtimeError("type mismatch: " + l.typeName() + " " + std::string(op) + " " + r.typeName(), tok.line);
+    }
+    if (l.isInt()) {
+        return arithmetic(tok.type, l.asInt(), r.asInt(), op, tok.line);
+    }
+    const bool equality = tok.type == TokenType::EQ || tok.type == TokenType::NEQ;
+    if (l.isBool() && equality) {
+        return Value((l.asBool() == r.asBool()) == (tok.type == TokenType::EQ));
+    }
+    if (l.isString() && equality) {
+        return Value((l.asString() == r.asString()) == (tok.type == TokenType::EQ));
+    }
+    if (l.isString() && tok.type == TokenType::ADD) {
+        return Value(l.asString() + r.asString());
+    }
+    runtimeError("invalid operands for " + std::string(op) + ": " + l.typeName(), tok.line);
+}
+
+// the value is that of whichever branch ran, or 0 for an if without an else
+Value IfExpression::interpret(Interpreter &in) {
+    if (truthy(evaluate(in, condition, tok.line), tok.line)) {
+        Value v = consequence != nullptr ? consequence->interpret(in) : Value();
+        return alternative != nullptr ? v : Value();
+    }
+    return alternative != nullptr ? alternative->interpret(in) : Value();
+}
+
+// the value is 0
+Value WhileExpression::interpret(Interpreter &in) {
+    in.loops++;
+    while (truthy(evaluate(in, condition, tok.line), tok.line)) {
+        if (consequence != nullptr) {
+            consequence->interpret(in);
+        }
+        if (in.flow == Flow::BREAK) {
+            in.flow = Flow::NEXT;
+            break;
+        }
+        if (in.flow == Flow::RETURN) {
+            break;
+        }
+    }
+    in.loops--;
+    return Value();
+}
+
+// a function literal is bound by name before it closes over the scope, so
+// it can call itself. anything else is bound after its value is worked out,
+// so `var x = x + 1;` reads the outer x.
+Value DeclareStatement::interpret(Interpreter &in) {
+    if (auto *fn = dynamic_cast<FuncLiteral *>(value)) {
+        Value &binding = declare(in, name->sym, Value());
+        binding = makeClosure(in, fn);
+        check(Given::DECLARED, name->annotation, binding, name->value, tok.line);
+        return Value();
+    }
+    Value v = evaluate(in, value, tok.line);
+    check(Given::DECLARED, name->annotation, v, name->value, tok.line);
+    declare(in, name->sym, std::move(v));
+    return Value();
+}
+
+// `&x = value;` rebinds the innermost x in scope, which keeps its type
+Value ReferenceStatement::interpret(Interpreter &in) {
+    Value v = evaluate(in, value, tok.line);
+    Value *binding = lookup(in, name, tok.line);
+    if (binding->data.index() != v.data.index()) {
+        runtimeError("cannot assign " + v.typeName() + " to " + binding->typeName() + " " + std::string(name->value),
+                     tok.line);
+    }
+    *binding = std::move(v);
+    return Value();
+}
+
+Value ReturnStatement::interpret(Interpreter &in) {
+    in.returned = returnVal != nullptr ? widen(returnVal->interpret(in)) : Value();
+    if (in.function != nullptr) {
+        check(Given::RETURNED, in.function->returns, in.returned, "", tok.line);
+    }
+    in.flow = Flow::RETURN;
+    return Value();
+}
+
+Value BreakStatement::interpret(Interpreter &in) {
+    if (in.loops == 0) {
+        runtimeError("break outside of a loop", tok.line);
+    }
+    in.flow = Flow::BREAK;
+    return Value();
+}
+
+Value ExpressionStatement::interpret(Interpreter &in) {
+    return evaluate(in, expression, tok.line);
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../h/ast.h"
+
+struct Closure;
+struct Function;
+struct Value;
+
+using Array = std::vector<Value>;
+
+// what the interpreter computes with: an int, a bool, or a string, array or
+// function shared by every copy of the value. none of them ever changes once
+// made, assigning a name only rebinds it.
+struct Value {
+    std::variant<int64_t, bool, std::shared_ptr<const std::string>, std::shared_ptr<const Array>,
+                 std::shared_ptr<const Closure>> data;
+
+    Value() : data(int64_t{0}) {}
+    explicit Value(const int64_t i) : data(i) {}
+    explicit Value(const bool b) : data(b) {}
+    explicit Value(std::string s) : data(std::make_shared<const std::string>(std::move(s))) {}
+    explicit Value(Array a) : data(std::make_shared<const Array>(std::move(a))) {}
+    explicit Value(std::shared_ptr<const Closure> fn) : data(std::move(fn)) {}
+
+    [[nodiscard]] bool isInt() const { return std::holds_alternative<int64_t>(data); }
+    [[nodiscard]] bool isBool() const { return std::holds_alternative<bool>(data); }
+    [[nodiscard]] bool isString() const { return data.index() == 2; }
+    [[nodiscard]] bool isArray() const { return data.index() == 3; }
+    [[nodiscard]] bool isFunction() const { return data.index() == 4; }
+
+    [[nodiscard]] int64_t asInt() const { return std::get<int64_t>(data); }
+    [[nodiscard]] bool asBool() const { return std::get<bool>(data); }
+    [[nodiscard]] const std::string &asString() const { return *std::get<2>(data); }
+    [[nodiscard]] const Array &asArray() const { return *std::get<3>(data); }
+    [[nodiscard]] const Closure &asFunction() const { return *std::get<4>(data); }
+
+    // int, bool, string, array or func, as errors name it
+    [[nodiscard]] std::string typeName() const;
+    // what run prints for it: ints in decimal, strings without quotes
+    [[nodiscard]] std::string toString() const;
+};
+
+// the names one scope declared, in order, and the scope it's in. the
+// parent may go on declaring after this scope opened, but only the first
+// visible of its bindings were there to see.
+struct Scope {
+    std::vector<std::pair<Symbol, Value>> bindings;
+    std::shared_ptr<Scope> parent;
+    size_t visible = 0;
+};
+
+// a local some function closes over, see runBytecode
+struct Cell {
+    Value value;
+};
+
+// a function literal and the scope it was evaluated in, which its body sees
+// as it was then, the first visible bindings. or, made by the bytecode vm,
+// a compiled function and the cells it closes over.
+struct Closure {
+    FuncLiteral *lit = nullptr;
+    std::shared_ptr<Scope> scope;
+    size_t visible = 0;
+    const Function *fn = nullptr;
+    std::vector<std::shared_ptr<Cell>> cells;
+};
+
+// whether control carries on to the next statement or leaves for a return
+// or a break
+enum struct Flow : uint8_t {
+    NEXT,
+    RETURN,
+    BREAK,
+};
+
+// where an annotated value comes from, see Annotation
+enum struct Given : uint8_t {
+    DECLARED,
+    PASSED,
+    RETURNED,
+};
+
+// why v, given for name as annotated, isn't of that type, or "" if it is.
+// what's passed or returned counts as widened.
+std::string annotationMismatch(Given given, Annotation annotation, const Value &v, std::string_view name);
+
+// a program being run by walking its tree, see Node::interpret
+struct Interpreter {
+    std::shared_ptr<Scope> scope;
+    // false while the innermost block hasn't declared anything, and so
+    // declares into the scope around it. a block only pays for a scope of
+    // its own once it needs one.
+    bool blockScope = false;
+    Flow flow = Flow::NEXT;
+    Value returned; // by the return that set flow
+    size_t loops = 0; // enclosing the statement being run, in its function
+    size_t depth = 0; // of calls
+    const FuncLiteral *function = nullptr; // whose body is running, if any
+    // every scope a closure was made in. a function bound in the scope it
+    // closes over, or in one around it, keeps that scope alive through
+    // itself, so these are emptied and cut from their parents once the
+    // program is done.
+    std::vector<std::shared_ptr<Scope>> captured;
+
+    Interpreter() = default;
+    ~Interpreter();
+
+    Interpreter(const Interpreter &) = delete;
+    Interpreter &operator=(const Interpreter &) = delete;
+};
+
+// runs program's top-level statements in order, the way banter_main does:
+// the value of the first top-level return, or 0. bools come back from
+// functions and the program as 1 and 0, as they do from compiled code.
+// unlike codegen it takes strings, arrays, indexing, calls through any
+// expression and functions closing over the locals around them. nullopt,
+// with the error in errors, if the program goes wrong, which stops it there.
+std::optional<Value> interpretProgram(Program &program, std::vector<std::string> &errors);
+
+#endif //INTERPRETER_H
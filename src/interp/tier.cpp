@@ -0,0 +1,207 @@
+#include "tier.h"
+#include "../codegen/jit.h"
+
+static double millisSince(const std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string_view tierName(const Tier tier) {
+    switch (tier) {
+        case Tier::BYTECODE: return "bytecode";
+        case Tier::QUEUED: return "queued";
+        case Tier::NATIVE: return "native";
+        case Tier::FAILED: return "failed";
+    }
+    return "?";
+}
+
+Tiers::Tiers(const TierOptions &options) : options(options) {}
+
+std::unique_ptr<Tiers> Tiers::create(Program &program, const TierOptions &options,
+                                     std::vector<std::string> &errors) {
+    std::unique_ptr<Tiers> t(new Tiers(options));
+    const FlatAst ast = FlatAst::fromProgram(program);
+    std::vector<NodeIndex> literals;
+    t->code = compileBytecode(ast, errors, &literals);
+    if (t->code == nullptr) {
+        return nullptr;
+    }
+    t->compiler = std::make_unique<TopLevelCompiler>(program);
+
+    // a name assigned anywhere may be one a compiled call would bind for good
+    std::unordered_set<Symbol> assigned;
+    for (NodeIndex n = 0; n < ast.size(); n++) {
+        if (ast.kinds[n] == NodeKind::REFERENCE) {
+            assigned.insert(ast.a[ast.a[n]]);
+        }
+    }
+    std::unordered_map<NodeIndex, size_t> declaredAt;
+    for (size_t i = 0; i < ast.statements.size(); i++) {
+        const NodeIndex stmt = ast.statements[i];
+        if (stmt == NoNode || ast.kinds[stmt] != NodeKind::DECLARE || !t->compiler->nameAt(i)) {
+            continue;
+        }
+        declaredAt.emplace(ast.b[stmt], i);
+        if (assigned.count(ast.a[ast.a[stmt]]) != 0) {
+            t->reassigned.insert(i);
+        }
+    }
+
+    const size_t functions = t->code->functions.size();
+    t->positions.resize(functions);
+    t->tiers.resize(functions);
+    t->hotAt.resize(functions);
+    for (size_t i = 0; i < functions; i++) {
+        FunctionTier &tier = t->tiers[i];
+        tier.name = i == 0 ? "<main>" : t->code->functions[i].name.empty() ? "func" : t->code->functions[i].name;
+        if (const auto at = declaredAt.find(literals[i]); at != declaredAt.end()) {
+            t->positions[i] = at->second;
+        } else {
+            tier.reason = i == 0 ? "the top level" : "not declared at the top level";
+        }
+    }
+
+    t->hooks = std::make_unique<TierHooks>(functions);
+    t->hooks->threshold = options.threshold;
+    t->hooks->promote = [raw = t.get()](const uint32_t index) { raw->promote(index); };
+    return t;
+}
+
+Tiers::~Tiers() {
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+        queue.clear();
+    }
+    wake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+std::optional<Value> Tiers::run(std::vector<std::string> &errors, VmStats *stats) {
+    return runBytecode(*code, errors, stats, hooks.get());
+}
+
+void Tiers::wait() {
+    std::unique_lock<std::mutex> lock(stateLock);
+    idle.wait(lock, [this] { return queue.empty() && !busy; });
+}
+
+std::vector<FunctionTier> Tiers::stats() const {
+    std::lock_guard<std::mutex> guard(stateLock);
+    std::vector<FunctionTier> out = tiers;
+    for (size_t i = 0; i < out.size(); i++) {
+        out[i].counters = hooks->counters[i];
+    }
+    return out;
+}
+
+// on the vm's thread, which only waits as long as it takes to queue it
+void Tiers::promote(const uint32_t index) {
+    std::lock_guard<std::mutex> guard(stateLock);
+    if (!positions[index] || tiers[index].tier != Tier::BYTECODE || stopping) {
+        return;
+    }
+    tiers[index].tier = Tier::QUEUED;
+    hotAt[index] = std::chrono::steady_clock::now();
+    queue.push_back(index);
+    if (!worker.joinable()) {
+        worker = std::thread([this] { work(); });
+    }
+    wake.notify_one();
+}
+
+void Tiers::work() {
+    std::unique_lock<std::mutex> lock(stateLock);
+    for (;;) {
+        wake.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+        const uint32_t index = queue.front();
+        queue.pop_front();
+        busy = true;
+        lock.unlock();
+
+        const auto start = std::chrono::steady_clock::now();
+        std::string reason;
+        const std::optional<uint64_t> address = compile(index, reason);
+        const double compileMs = millisSince(start);
+
+        lock.lock();
+        busy = false;
+        FunctionTier &tier = tiers[index];
+        tier.compileMs = compileMs;
+        tier.queuedMs = millisSince(hotAt[index]);
+        if (address) {
+            tier.tier = Tier::NATIVE;
+            hooks->native[index].store(*address, std::memory_order_release);
+        } else {
+            tier.tier = Tier::FAILED;
+            tier.reason = std::move(reason);
+        }
+        idle.notify_all();
+    }
+}
+
+// the function at index, with every top-level function it calls that
+// isn't in the jit yet. all of them compile, or none goes in.
+std::optional<uint64_t> Tiers::compile(const uint32_t index, std::string &reason) {
+    std::vector<std::string> errors;
+    if (code->functions[index].params > maxNativeParams) {
+        reason = "takes more than " + std::to_string(maxNativeParams) + " arguments";
+        return std::nullopt;
+    }
+    if (jit == nullptr && (jit = Jit::create(options.level, errors)) == nullptr) {
+        reason = errors.front();
+        return std::nullopt;
+    }
+
+    const std::string name = *compiler->nameAt(*positions[index]);
+    std::vector<std::pair<std::string, llvm::orc::ThreadSafeModule>> modules;
+    std::vector<std::string> pending{name};
+    std::unordered_set<std::string> seen{name};
+    while (!pending.empty()) {
+        const std::string next = std::move(pending.back());
+        pending.pop_back();
+        if (added.count(next) != 0) {
+            continue;
+        }
+        auto fail = [&](const std::string &why) {
+            failed.emplace(next, why);
+            reason = next == name ? why : "calls " + next + ", which " + why;
+            return std::nullopt;
+        };
+        if (const auto f = failed.find(next); f != failed.end()) {
+            return fail(f->second);
+        }
+        if (reassigned.count(*compiler->positionOf(next)) != 0) {
+            return fail("is assigned to");
+        }
+        auto context = std::make_unique<llvm::LLVMContext>();
+        std::unique_ptr<llvm::Module> module = compiler->compile(next, *context, errors, {.matchInterpreter = true});
+        if (module == nullptr) {
+            return fail(errors.front());
+        }
+        for (const llvm::Function &fn : *module) {
+            if (fn.isDeclaration() && seen.insert(fn.getName().str()).second) {
+                pending.push_back(fn.getName().str());
+            }
+        }
+        modules.emplace_back(next, llvm::orc::ThreadSafeModule(std::move(module), std::move(context)));
+    }
+
+    for (auto &[top, module] : modules) {
+        if (!jit->addEagerly(std::move(module), errors)) {
+            reason = errors.front();
+            return std::nullopt;
+        }
+        added.insert(top);
+    }
+    const std::optional<uint64_t> address = jit->lookup(name, errors);
+    if (!address) {
+        reason = errors.front();
+    }
+    return address;
+}
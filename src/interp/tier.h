@@ -0,0 +1,121 @@
+#pragma once
+
+#ifndef TIER_H
+#define TIER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../codegen/codegen.h"
+#include "bytecode.h"
+
+class Jit;
+
+// where a function runs
+enum struct Tier : uint8_t {
+    BYTECODE, // not hot yet, or never to be compiled, see FunctionTier::reason
+    QUEUED,   // hot, waiting to be compiled or being compiled
+    NATIVE,
+    FAILED, // hot, but codegen can't compile it to do what the bytecode does
+};
+
+std::string_view tierName(Tier tier);
+
+struct TierOptions {
+    // calls plus loop back edges a function runs in bytecode before it's
+    // compiled, see TierHooks
+    uint64_t threshold = 1000;
+    OptLevel level = OptLevel::O2;
+};
+
+// one function of the program, as a stats dump shows it
+struct FunctionTier {
+    std::string name;
+    Tier tier = Tier::BYTECODE;
+    TierHooks::Counters counters;
+    double queuedMs = 0;  // from getting hot to running natively, or failing
+    double compileMs = 0; // of that, compiling it and the functions it calls
+    std::string reason;   // why it failed, or is never compiled
+};
+
+// runs a program as bytecode, and compiles each function that gets hot
+// through codegen and the jit on a thread of its own, so the program never
+// waits on llvm. once a function's native code is ready, the calls to it
+// from bytecode go there instead, see TierHooks. nothing is replaced on the
+// stack: a call running when its function is promoted finishes in bytecode.
+//
+// only functions declared by name at the top level are compiled, each with
+// the top-level functions it calls, and only if codegen lowers them to do
+// exactly what the bytecode does, see CodegenOptions::matchInterpreter. a
+// function that reads the top level's variables, or calls a function the
+// program assigns to, or one of those, stays in bytecode. native code runs
+// on the native stack, so recursing too deep there crashes, as under the
+// plain jit, where the vm would stop with an error.
+class Tiers {
+public:
+    // compiles program to bytecode. nullptr, with the errors, if it doesn't
+    // compile. program has to outlive the result, unchanged.
+    static std::unique_ptr<Tiers> create(Program &program, const TierOptions &options,
+                                         std::vector<std::string> &errors);
+    // waits out the compile in progress, if any, dropping the ones queued
+    ~Tiers();
+
+    Tiers(const Tiers &) = delete;
+    Tiers &operator=(const Tiers &) = delete;
+
+    // runBytecode, counting and promoting. functions stay promoted, and
+    // counters keep counting, from one run to the next.
+    std::optional<Value> run(std::vector<std::string> &errors, VmStats *stats = nullptr);
+    // blocks until nothing is queued, for tests and benchmarks
+    void wait();
+
+    // by bytecode function index, 0 being the top level
+    [[nodiscard]] std::vector<FunctionTier> stats() const;
+    [[nodiscard]] const Bytecode &bytecode() const { return *code; }
+
+private:
+    TierOptions options;
+    std::unique_ptr<Bytecode> code;
+    std::unique_ptr<TierHooks> hooks;
+    // the top-level statement declaring each function, if it's one that
+    // may be compiled
+    std::vector<std::optional<size_t>> positions;
+    // of top-level functions whose name is assigned to somewhere
+    std::unordered_set<size_t> reassigned;
+
+    // the compile thread, started by the first function to get hot. tiers,
+    // the queue and the flags are shared with it.
+    std::thread worker;
+    mutable std::mutex stateLock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::vector<FunctionTier> tiers;
+    std::vector<std::chrono::steady_clock::time_point> hotAt;
+    std::deque<uint32_t> queue;
+    bool busy = false;
+    bool stopping = false;
+
+    // the compile thread's alone
+    std::unique_ptr<TopLevelCompiler> compiler;
+    std::unique_ptr<Jit> jit;
+    std::unordered_set<std::string> added;               // to the jit, by name
+    std::unordered_map<std::string, std::string> failed; // by name, why
+
+    explicit Tiers(const TierOptions &options);
+
+    void promote(uint32_t index);
+    void work();
+    std::optional<uint64_t> compile(uint32_t index, std::string &reason);
+};
+
+#endif //TIER_H
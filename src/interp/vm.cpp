@@ -0,0 +1,580 @@
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+#include "bytecode.h"
+
+// dispatch jumps straight from one instruction's handler to the next's
+// through a table of label addresses where the compiler supports it, a
+// switch in a loop elsewhere or with BANTER_NO_COMPUTED_GOTO defined
+#if defined(__GNUC__) && !defined(BANTER_NO_COMPUTED_GOTO)
+#define BANTER_COMPUTED_GOTO 1
+#endif
+
+// frames live on the heap, not the native stack, so this only stops a
+// runaway recursion before it eats all memory
+constexpr size_t maxFrames = 100000;
+
+namespace {
+
+struct VmError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+struct Frame {
+    const Function *fn;
+    const uint32_t *pc; // where the frame carries on, once it's not the top one
+    size_t base;        // of its registers in the register stack
+    size_t cellBase;
+    const Closure *closure; // nullptr for the top level
+    uint32_t result;        // the caller's register the call's value goes in
+};
+
+void setInt(Value &v, const int64_t i) {
+    if (auto *p = std::get_if<int64_t>(&v.data)) {
+        *p = i;
+    } else {
+        v.data = i;
+    }
+}
+
+void setBool(Value &v, const bool b) {
+    if (auto *p = std::get_if<bool>(&v.data)) {
+        *p = b;
+    } else {
+        v.data = b;
+    }
+}
+
+// ints are true unless 0
+bool truthy(const Value &v) {
+    if (v.isBool()) {
+        return v.asBool();
+    }
+    if (v.isInt()) {
+        return v.asInt() != 0;
+    }
+    throw VmError("condition must be int or bool, got " + v.typeName());
+}
+
+// how infix ops are spelled in errors, ADD through GTE
+std::string_view infixName(const Op op) {
+    static constexpr std::string_view names[] = {"+", "-", "*", "/", "%", "==", "!=", "<", ">", "<=", ">="};
+    return names[static_cast<size_t>(op) - static_cast<size_t>(Op::ADD)];
+}
+
+// ints wrap around, dividing by zero stops the program. the same as the
+// tree walk's, see InfixExpression::interpret.
+Value infix(const Op op, const Value &l, const Value &r) {
+    if (l.data.index() != r.data.index()) {
+        throw VmError("type mismatch: " + l.typeName() + " " + std::string(infixName(op)) + " " + r.typeName());
+    }
+    if (l.isInt()) {
+        const int64_t a = l.asInt();
+        const int64_t b = r.asInt();
+        const auto ua = static_cast<uint64_t>(a);
+        const auto ub = static_cast<uint64_t>(b);
+        switch (op) {
+            case Op::ADD: return Value(static_cast<int64_t>(ua + ub));
+            case Op::SUB: return Value(static_cast<int64_t>(ua - ub));
+            case Op::MUL: return Value(static_cast<int64_t>(ua * ub));
+            case Op::DIV:
+            case Op::MOD:
+                if (b == 0) {
+                    throw VmError("division by zero");
+                }
+                if (a == std::numeric_limits<int64_t>::min() && b == -1) {
+                    return Value(op == Op::DIV ? a : int64_t{0});
+                }
+                return Value(op == Op::DIV ? a / b : a % b);
+            case Op::EQ: return Value(a == b);
+            case Op::NEQ: return Value(a != b);
+            case Op::LT: return Value(a < b);
+            case Op::GT: return Value(a > b);
+            case Op::LTE: return Value(a <= b);
+            default: return Value(a >= b);
+        }
+    }
+    const bool equality = op == Op::EQ || op == Op::NEQ;
+    if (l.isBool() && equality) {
+        return Value((l.asBool() == r.asBool()) == (op == Op::EQ));
+    }
+    if (l.isString() && equality) {
+        return Value((l.asString() == r.asString()) == (op == Op::EQ));
+    }
+    if (l.isString() && op == Op::ADD) {
+        return Value(l.asString() + r.asString());
+    }
+    throw VmError("invalid operands for " + std::string(infixName(op)) + ": " + l.typeName());
+}
+
+Value index(const Value &a, const Value &i) {
+    if (!i.isInt()) {
+        throw VmError("index must be int, got " + i.typeName());
+    }
+    size_t size;
+    if (a.isArray()) {
+        size = a.asArray().size();
+    } else if (a.isString()) {
+        size = a.asString().size();
+    } else {
+        throw VmError("cannot index " + a.typeName());
+    }
+    if (i.asInt() < 0 || static_cast<uint64_t>(i.asInt()) >= size) {
+        throw VmError("index " + std::to_string(i.asInt()) + " out of range for " + a.typeName() + " of " +
+                      std::to_string(size));
+    }
+    const auto at = static_cast<size_t>(i.asInt());
+    return a.isArray() ? a.asArray()[at] : Value(std::string(1, a.asString()[at]));
+}
+
+// `&name = value` keeps the binding's type
+void assign(Value &binding, Value &value, const std::string &name) {
+    if (binding.data.index() != value.data.index()) {
+        throw VmError("cannot assign " + value.typeName() + " to " + binding.typeName() + " " + name);
+    }
+    binding = std::move(value);
+}
+
+// functions take and return ints, bools passed in or returned are widened
+void widen(Value &v) {
+    if (v.isBool()) {
+        v.data = static_cast<int64_t>(v.asBool());
+    }
+}
+
+// native code taking argc ints, see TierHooks
+int64_t callNative(const uint64_t address, const Value *args, const uint32_t argc) {
+    using I = int64_t;
+    switch (argc) {
+        case 0: return reinterpret_cast<I (*)()>(address)();
+        case 1: return reinterpret_cast<I (*)(I)>(address)(args[0].asInt());
+        case 2: return reinterpret_cast<I (*)(I, I)>(address)(args[0].asInt(), args[1].asInt());
+        case 3: return reinterpret_cast<I (*)(I, I, I)>(address)(args[0].asInt(), args[1].asInt(), args[2].asInt());
+        case 4:
+            return reinterpret_cast<I (*)(I, I, I, I)>(address)(args[0].asInt(), args[1].asInt(), args[2].asInt(),
+                                                                args[3].asInt());
+        case 5:
+            return reinterpret_cast<I (*)(I, I, I, I, I)>(address)(args[0].asInt(), args[1].asInt(),
+                                                                   args[2].asInt(), args[3].asInt(),
+                                                                   args[4].asInt());
+        default:
+            static_assert(maxNativeParams == 6);
+            return reinterpret_cast<I (*)(I, I, I, I, I, I)>(address)(args[0].asInt(), args[1].asInt(),
+                                                                      args[2].asInt(), args[3].asInt(),
+                                                                      args[4].asInt(), args[5].asInt());
+    }
+}
+
+bool allInts(const Value *values, const uint32_t count) {
+    return std::all_of(values, values + count, [](const Value &v) { return v.isInt(); });
+}
+
+struct Vm {
+    const Bytecode &bytecode;
+    TierHooks *tiers;
+    std::vector<Value> registers;
+    std::vector<std::shared_ptr<Cell>> cells;
+    std::vector<Frame> frames;
+    // every cell a closure was made with. a function stored in a cell it
+    // closes over keeps itself alive, so these are emptied once the program
+    // is done.
+    std::vector<std::shared_ptr<Cell>> captured;
+    uint64_t executed = 0;
+    uint64_t calls = 0;
+    uint64_t nativeCalls = 0;
+
+    Vm(const Bytecode &bytecode, TierHooks *tiers) : bytecode(bytecode), tiers(tiers) {}
+
+    ~Vm() {
+        for (const std::shared_ptr<Cell> &cell : captured) {
+            cell->value = Value();
+        }
+    }
+
+    Value run();
+
+    void heat(const Function *fn, uint64_t TierHooks::Counters::*counter) {
+        const auto index = static_cast<uint32_t>(fn - bytecode.functions.data());
+        TierHooks::Counters &c = tiers->counters[index];
+        c.*counter += 1;
+        if (c.calls + c.backEdges == tiers->threshold) {
+            tiers->promote(index);
+        }
+    }
+};
+
+Value Vm::run() {
+    const Value *constants = bytecode.constants.data();
+    const Function *fn = &bytecode.functions[0];
+    registers.resize(fn->registers);
+    cells.resize(fn->cells);
+    frames.push_back({fn, nullptr, 0, 0, nullptr, 0});
+
+    const uint32_t *pc = fn->code.data();
+    Value *r = registers.data();
+    std::shared_ptr<Cell> *cell = cells.data();
+    const std::vector<std::shared_ptr<Cell>> *up = nullptr;
+    uint32_t insn;
+
+    // the extra word of the current instruction
+#define VM_X() (*pc++)
+#if BANTER_COMPUTED_GOTO
+    static const void *const targets[] = {
+        &&op_MOVE,    &&op_LOADK,   &&op_LOADBOOL, &&op_ADD,     &&op_SUB,      &&op_MUL,     &&op_DIV,
+        &&op_MOD,     &&op_EQ,      &&op_NEQ,      &&op_LT,      &&op_GT,       &&op_LTE,     &&op_GTE,
+        &&op_ADDI,    &&op_SUBI,    &&op_NEG,      &&op_NOT,     &&op_JMP,      &&op_JMPF,    &&op_JMPT,
+        &&op_JEQ,     &&op_JNEQ,    &&op_JLT,      &&op_JGT,     &&op_JLTE,     &&op_JGTE,    &&op_NEWARRAY,
+        &&op_INDEX,   &&op_ASSIGN,  &&op_CHECK,    &&op_NEWCELL, &&op_GETCELL,  &&op_SETCELL, &&op_INITCELL,
+        &&op_GETUP,   &&op_SETUP,   &&op_CLOSURE,  &&op_CALL,    &&op_RET,
+    };
+    static_assert(std::size(targets) == opCount);
+#define VM_CASE(op) \
+    case Op::op:    \
+    op_##op
+#define VM_NEXT()                            \
+    do {                                     \
+        executed++;                          \
+        insn = *pc++;                        \
+        goto *targets[insn & 0xff];          \
+    } while (0)
+#else
+#define VM_CASE(op) case Op::op
+#define VM_NEXT() continue
+#endif
+    // a jump backwards is a loop going round again
+#define VM_JUMP(offset)                                       \
+    do {                                                      \
+        pc += (offset);                                       \
+        if ((offset) < 0 && tiers != nullptr) {               \
+            heat(fn, &TierHooks::Counters::backEdges);        \
+        }                                                     \
+    } while (0)
+
+    try {
+        for (;;) {
+            executed++;
+            insn = *pc++;
+            switch (opOf(insn)) {
+                VM_CASE(MOVE) : {
+                    r[argA(insn)] = r[argB(insn)];
+                    VM_NEXT();
+                }
+                VM_CASE(LOADK) : {
+                    r[argA(insn)] = constants[VM_X()];
+                    VM_NEXT();
+                }
+                VM_CASE(LOADBOOL) : {
+                    setBool(r[argA(insn)], argB(insn) != 0);
+                    VM_NEXT();
+                }
+
+#define VM_INT_OP(op, expr)                                        \
+    VM_CASE(op) : {                                                \
+        const Value &b = r[argB(insn)];                            \
+        const Value &c = r[argC(insn)];                            \
+        if (b.isInt() && c.isInt()) {                              \
+            const auto x = static_cast<uint64_t>(b.asInt());       \
+            const auto y = static_cast<uint64_t>(c.asInt());       \
+            setInt(r[argA(insn)], static_cast<int64_t>(expr));     \
+        } else {                                                   \
+            r[argA(insn)] = infix(Op::op, b, c);                   \
+        }                                                          \
+        VM_NEXT();                                                 \
+    }
+#define VM_COMPARE(op, cmp)                                        \
+    VM_CASE(op) : {                                                \
+        const Value &b = r[argB(insn)];                            \
+        const Value &c = r[argC(insn)];                            \
+        if (b.isInt() && c.isInt()) {                              \
+            setBool(r[argA(insn)], b.asInt() cmp c.asInt());       \
+        } else {                                                   \
+            r[argA(insn)] = infix(Op::op, b, c);                   \
+        }                                                          \
+        VM_NEXT();                                                 \
+    }
+#define VM_IMMEDIATE(op, base, expr)                                          \
+    VM_CASE(op) : {                                                           \
+        const Value &b = r[argB(insn)];                                       \
+        const auto y = static_cast<int64_t>(static_cast<int8_t>(argC(insn))); \
+        if (b.isInt()) {                                                      \
+            const auto x = static_cast<uint64_t>(b.asInt());                  \
+            setInt(r[argA(insn)], static_cast<int64_t>(expr));                \
+        } else {                                                              \
+            r[argA(insn)] = infix(Op::base, b, Value(y));                     \
+        }                                                                     \
+        VM_NEXT();                                                            \
+    }
+#define VM_COMPARE_JUMP(op, base, cmp)                                        \
+    VM_CASE(op) : {                                                           \
+        const Value &b = r[argB(insn)];                                       \
+        const Value &c = r[argC(insn)];                                       \
+        bool t;                                                               \
+        if (b.isInt() && c.isInt()) {                                         \
+            t = b.asInt() cmp c.asInt();                                      \
+        } else {                                                              \
+            t = infix(Op::base, b, c).asBool();                               \
+        }                                                                     \
+        const auto offset = static_cast<int32_t>(VM_X());                     \
+        if (t == (argA(insn) != 0)) {                                         \
+            VM_JUMP(offset);                                                  \
+        }                                                                     \
+        VM_NEXT();                                                            \
+    }
+                VM_INT_OP(ADD, x + y)
+                VM_INT_OP(SUB, x - y)
+                VM_INT_OP(MUL, x * y)
+                VM_COMPARE(EQ, ==)
+                VM_COMPARE(NEQ, !=)
+                VM_COMPARE(LT, <)
+                VM_COMPARE(GT, >)
+                VM_COMPARE(LTE, <=)
+                VM_COMPARE(GTE, >=)
+                VM_IMMEDIATE(ADDI, ADD, x + static_cast<uint64_t>(y))
+                VM_IMMEDIATE(SUBI, SUB, x - static_cast<uint64_t>(y))
+                VM_COMPARE_JUMP(JEQ, EQ, ==)
+                VM_COMPARE_JUMP(JNEQ, NEQ, !=)
+                VM_COMPARE_JUMP(JLT, LT, <)
+                VM_COMPARE_JUMP(JGT, GT, >)
+                VM_COMPARE_JUMP(JLTE, LTE, <=)
+                VM_COMPARE_JUMP(JGTE, GTE, >=)
+#undef VM_INT_OP
+#undef VM_COMPARE
+#undef VM_IMMEDIATE
+#undef VM_COMPARE_JUMP
+
+#define VM_DIVISION(op, expr)                                                              \
+    VM_CASE(op) : {                                                                        \
+        const Value &b = r[argB(insn)];                                                    \
+        const Value &c = r[argC(insn)];                                                    \
+        if (b.isInt() && c.isInt() && c.asInt() > 0) {                                     \
+            const int64_t x = b.asInt();                                                   \
+            const int64_t y = c.asInt();                                                   \
+            setInt(r[argA(insn)], expr);                                                   \
+        } else {                                                                           \
+            r[argA(insn)] = infix(Op::op, b, c);                                           \
+        }                                                                                  \
+        VM_NEXT();                                                                         \
+    }
+                // a positive divisor is neither 0 nor the -1 that overflows
+                VM_DIVISION(DIV, x / y)
+                VM_DIVISION(MOD, x % y)
+#undef VM_DIVISION
+                VM_CASE(NEG) : {
+                    const Value &b = r[argB(insn)];
+                    if (!b.isInt()) {
+                        throw VmError("invalid operand for -: " + b.typeName());
+                    }
+                    setInt(r[argA(insn)], static_cast<int64_t>(0ULL - static_cast<uint64_t>(b.asInt())));
+                    VM_NEXT();
+                }
+                VM_CASE(NOT) : {
+                    // !int is true only for 0
+                    const Value &b = r[argB(insn)];
+                    if (!b.isInt() && !b.isBool()) {
+                        throw VmError("invalid operand for !: " + b.typeName());
+                    }
+                    setBool(r[argA(insn)], !truthy(b));
+                    VM_NEXT();
+                }
+                VM_CASE(JMP) : {
+                    const auto offset = static_cast<int32_t>(VM_X());
+                    VM_JUMP(offset);
+                    VM_NEXT();
+                }
+                VM_CASE(JMPF) : {
+                    const bool t = truthy(r[argA(insn)]);
+                    const auto offset = static_cast<int32_t>(VM_X());
+                    if (!t) {
+                        VM_JUMP(offset);
+                    }
+                    VM_NEXT();
+                }
+                VM_CASE(JMPT) : {
+                    const bool t = truthy(r[argA(insn)]);
+                    const auto offset = static_cast<int32_t>(VM_X());
+                    if (t) {
+                        VM_JUMP(offset);
+                    }
+                    VM_NEXT();
+                }
+                VM_CASE(NEWARRAY) : {
+                    const uint32_t count = VM_X();
+                    r[argA(insn)] = Value(Array(r + argB(insn), r + argB(insn) + count));
+                    VM_NEXT();
+                }
+                VM_CASE(INDEX) : {
+                    const Value &b = r[argB(insn)];
+                    const Value &c = r[argC(insn)];
+                    if (b.isArray() && c.isInt() && static_cast<uint64_t>(c.asInt()) < b.asArray().size()) {
+                        r[argA(insn)] = b.asArray()[static_cast<size_t>(c.asInt())];
+                    } else {
+                        r[argA(insn)] = index(b, c);
+                    }
+                    VM_NEXT();
+                }
+                VM_CASE(ASSIGN) : {
+                    const uint32_t name = VM_X();
+                    Value &binding = r[argA(insn)];
+                    Value &value = r[argB(insn)];
+                    if (binding.isInt() && value.isInt()) {
+                        setInt(binding, value.asInt());
+                    } else {
+                        assign(binding, value, bytecode.names[name]);
+                    }
+                    VM_NEXT();
+                }
+                VM_CASE(CHECK) : {
+                    const uint32_t name = VM_X();
+                    const Value &v = r[argA(insn)];
+                    if (v.data.index() + 1 != argB(insn)) {
+                        const std::string mismatch = annotationMismatch(
+                            static_cast<Given>(argC(insn)), static_cast<Annotation>(argB(insn)), v,
+                            bytecode.names[name]);
+                        if (!mismatch.empty()) {
+                            throw VmError(mismatch);
+                        }
+                    }
+                    VM_NEXT();
+                }
+                VM_CASE(NEWCELL) : {
+                    cell[argA(insn)] = std::make_shared<Cell>();
+                    VM_NEXT();
+                }
+                VM_CASE(GETCELL) : {
+                    r[argA(insn)] = cell[argB(insn)]->value;
+                    VM_NEXT();
+                }
+                VM_CASE(SETCELL) : {
+                    assign(cell[argA(insn)]->value, r[argB(insn)], bytecode.names[VM_X()]);
+                    VM_NEXT();
+                }
+                VM_CASE(INITCELL) : {
+                    cell[argA(insn)]->value = r[argB(insn)];
+                    VM_NEXT();
+                }
+                VM_CASE(GETUP) : {
+                    r[argA(insn)] = (*up)[argB(insn)]->value;
+                    VM_NEXT();
+                }
+                VM_CASE(SETUP) : {
+                    assign((*up)[argA(insn)]->value, r[argB(insn)], bytecode.names[VM_X()]);
+                    VM_NEXT();
+                }
+                VM_CASE(CLOSURE) : {
+                    const Function &target = bytecode.functions[VM_X()];
+                    auto closure = std::make_shared<Closure>();
+                    closure->fn = &target;
+                    closure->cells.reserve(target.captures.size());
+                    for (const Capture &c : target.captures) {
+                        if (c.local) {
+                            closure->cells.push_back(cell[c.index]);
+                            if (captured.empty() || captured.back() != cell[c.index]) {
+                                captured.push_back(cell[c.index]);
+                            }
+                        } else {
+                            closure->cells.push_back((*up)[c.index]);
+                        }
+                    }
+                    r[argA(insn)] = Value(std::shared_ptr<const Closure>(std::move(closure)));
+                    VM_NEXT();
+                }
+                VM_CASE(CALL) : {
+                    const uint32_t a = argA(insn);
+                    const uint32_t argc = argB(insn);
+                    const std::string &name = bytecode.names[VM_X()];
+                    const Value &callee = r[a];
+                    if (!callee.isFunction() || callee.asFunction().fn == nullptr) {
+                        throw VmError(callee.typeName() + " " + name + " is not a function");
+                    }
+                    const Closure &closure = callee.asFunction();
+                    const Function *target = closure.fn;
+                    if (target->params != argc) {
+                        throw VmError(name + " takes " + std::to_string(target->params) + " arguments, got " +
+                                      std::to_string(argc));
+                    }
+                    for (uint32_t i = 1; i <= argc; i++) {
+                        widen(r[a + i]);
+                    }
+                    if (tiers != nullptr) {
+                        const auto index = static_cast<size_t>(target - bytecode.functions.data());
+                        const uint64_t native = tiers->native[index].load(std::memory_order_acquire);
+                        if (native != 0 && argc <= maxNativeParams && allInts(r + a + 1, argc)) {
+                            tiers->counters[index].nativeCalls++;
+                            nativeCalls++;
+                            r[a] = Value(callNative(native, r + a + 1, argc));
+                            VM_NEXT();
+                        }
+                        heat(target, &TierHooks::Counters::calls);
+                    }
+                    if (frames.size() == maxFrames) {
+                        throw VmError("calls nested deeper than " + std::to_string(maxFrames));
+                    }
+
+                    frames.back().pc = pc;
+                    const size_t base = frames.back().base + a + 1;
+                    frames.push_back({target, nullptr, base, cells.size(), &closure, a});
+                    if (registers.size() < base + target->registers) {
+                        registers.resize(std::max(base + target->registers, registers.size() * 2));
+                    }
+                    cells.resize(cells.size() + target->cells);
+                    calls++;
+
+                    fn = target;
+                    pc = fn->code.data();
+                    r = registers.data() + base;
+                    cell = cells.data() + frames.back().cellBase;
+                    up = &closure.cells;
+                    VM_NEXT();
+                }
+                VM_CASE(RET) : {
+                    Value result = std::move(r[argA(insn)]);
+                    widen(result);
+                    const Frame done = frames.back();
+                    frames.pop_back();
+                    cells.resize(done.cellBase);
+                    if (frames.empty()) {
+                        return result;
+                    }
+
+                    const Frame &caller = frames.back();
+                    fn = caller.fn;
+                    pc = caller.pc;
+                    r = registers.data() + caller.base;
+                    cell = cells.data() + caller.cellBase;
+                    up = caller.closure != nullptr ? &caller.closure->cells : nullptr;
+                    r[done.result] = std::move(result);
+                    VM_NEXT();
+                }
+            }
+        }
+    } catch (const VmError &e) {
+        // pc is past the failing instruction, or at most past its extra word
+        const auto at = static_cast<uint32_t>(pc - fn->code.data() - 1);
+        throw VmError(std::string(e.what()) + ", line=" + std::to_string(fn->lineAt(at)));
+    }
+#undef VM_X
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_JUMP
+}
+
+} // namespace
+
+std::optional<Value> runBytecode(const Bytecode &bytecode, std::vector<std::string> &errors, VmStats *stats,
+                                 TierHooks *tiers) {
+    Vm vm(bytecode, tiers);
+    std::optional<Value> result;
+    try {
+        result = vm.run();
+    } catch (const VmError &e) {
+        errors.emplace_back(e.what());
+    }
+    if (stats != nullptr) {
+        stats->instructions = vm.executed;
+        stats->calls = vm.calls;
+        stats->nativeCalls = vm.nativeCalls;
+    }
+    return result;
+}
@@ -1,6 +1,7 @@
 #include <utility>
 
 #include "../src/h/lex.h"
+#include "../src/h/scan.h"
 
 std::string lex::tokenTypeToString(const TokenType type) {
     switch (type) {
@@ -45,7 +46,8 @@ std::string lex::tokenTypeToString(const TokenType type) {
         case TokenType::IF: return "IF";
         case TokenType::ELSE: return "ELSE";
         case TokenType::WHILE: return "WHILE";
-        case TokenType::RETURN: return "BREAK";
+        case TokenType::RETURN: return "RETURN";
+        case TokenType::BREAK: return "BREAK";
         case TokenType::TRUE: return "TRUE";
         case TokenType::FALSE: return "FALSE";
 
@@ -59,32 +61,40 @@ std::string lex::tokenTypeToString(const TokenType type) {
 
 // token implementations
 Token::Token() : type(TokenType::IDENT), line(1) {}
-Token::Token(const TokenType type, std::string lit, const int line)
-    : type(type), lit(std::move(lit)), line(line) {}
+Token::Token(const TokenType type, const std::string_view lit, const int line)
+    : type(type), lit(lit), line(line) {}
+std::string LexDiagnostic::toString() const {
+    return "line=" + std::to_string(line) + ", linepos=" + std::to_string(column) +
+           ", offset=" + std::to_string(offset) + ": " + message;
+}
+
 [[nodiscard]] std::string Token::toString() const {
     return "tok(type: " + lex::tokenTypeToString(type) +
-           ", literal: " + lit + ", line: " + std::to_string(line) + ")";
+           ", literal: " + std::string(lit) + ", line: " + std::to_string(line) + ")";
 }
 
 // lexer implementations
 lex::lex(std::string &input)
- : input(std::move(input)), ch(' '), pos(0), readPos(0), line(1), linePos(1),
-  keywords({
-      {"var", TokenType::VAR_DECL},
-      {"func", TokenType::FUNCTION},
-      {"if", TokenType::IF},
-      {"else", TokenType::ELSE},
-      {"while", TokenType::WHILE},
-      {"return", TokenType::RETURN},
-      {"break", TokenType::BREAK},
-      {"true", TokenType::TRUE},
-      {"false", TokenType::FALSE},
-  }) {
+ : lex(std::make_shared<const SourceBuffer>(std::move(input))) {}
+
+lex::lex(std::shared_ptr<const SourceBuffer> source, std::shared_ptr<Interner> symbols)
+ : source(std::move(source)),
+   symbols(symbols ? std::move(symbols) : std::make_shared<Interner>()), ch(' '), pos(0), readPos(0), line(1), linePos(1) {
+    input = this->source->view();
     readChar();
 }
 
+static_assert(lex::lookupIdent("while") == TokenType::WHILE);
+static_assert(lex::lookupIdent("whale") == TokenType::IDENT);
+static_assert(lex::lookupIdent("func") == TokenType::FUNCTION);
+static_assert(lex::lookupIdent("funcs") == TokenType::IDENT);
+
+lex lex::fromFile(const std::string &path) {
+    return lex(SourceBuffer::fromFile(path));
+}
+
 void lex::readChar() {
-    if (pos >= input.size()) {
+    if (readPos >= input.size()) {
         ch = 0;
     } else {
         ch = input[readPos];
@@ -93,19 +103,39 @@ void lex::readChar() {
     readPos++;
 }
 
+void lex::seek(const int to) {
+    pos = to;
+    readPos = to + 1;
+    ch = static_cast<size_t>(to) < input.size() ? input[to] : 0;
+}
+
+void lex::resume(const int offset, const int line, const int linePos) {
+    seek(offset);
+    this->line = line;
+    this->linePos = linePos;
+}
+
 void lex::skipWhitespace() {
-    while (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
-        if (ch == '\n') {
-            line++;
-            linePos = 1;
-        } else if (ch == ' ') {
-            linePos++;
-        }
+    if (!hasClass(ch, CC_SPACE)) {
+        return;
+    }
+    // most runs are the single space between two tokens
+    if (ch == ' ' && !hasClass(peekChar(), CC_SPACE)) {
+        linePos++;
         readChar();
+        return;
+    }
+    const SpaceRun run = scan::whitespace(input, pos);
+    if (run.newlines > 0) {
+        line += run.newlines;
+        linePos = 1 + run.spaces;
+    } else {
+        linePos += run.spaces;
     }
+    seek(static_cast<int>(run.end));
 }
 
-Token lex::newToken(const TokenType type, const std::string &lit, const int line) {
+Token lex::newToken(const TokenType type, const std::string_view lit, const int line) {
     return Token(type, lit, line);
 }
 
@@ -116,50 +146,40 @@ Token lex::newToken(const TokenType type, const std::string &lit, const int line
     return input[readPos];
 }
 
-void lex::printError(const Token &t) const {
-    std::cerr << "Lexing error on, line=" << t.line << ", linepos=" << linePos << "." << std::endl;
-    std::cerr << "Expected a valid token, got=" << t.lit << "." << std::endl;
-    std::cerr << "Full token err: " << t.toString() << std::endl;
+void lex::addDiagnostic(const std::string_view message, const std::string_view got, const int offset) {
+    diagnostics.push_back({std::string(message) + std::string(got), line, linePos, static_cast<size_t>(offset)});
 }
 
-std::string lex::readIdent() {
+std::string_view lex::readIdent() {
     const int start = pos;
-    while (isalnum(ch)) {
-        readChar();
-    }
+    seek(static_cast<int>(scan::alnum(input, pos)));
     return input.substr(start, pos - start);
 }
 
-std::string lex::readInt() {
+Token lex::readInt() {
     const int start = pos;
-    readChar();
-    while (isdigit(ch)) {
-        readChar();
-    }
-    if (isalpha(ch)) {
-        std::cerr << "TokenType IDENT must not start with INT." << std::endl;
-        std::cerr << "Lexing error on, line=" << line << ", linepos=" << linePos << "." << std::endl;
-        std::cerr << "Expected INT, got=" << input.substr(start, pos - start) << std::endl;
-        std::abort();
+    seek(static_cast<int>(scan::digits(input, pos + 1)));
+    if (hasClass(ch, CC_ALPHA)) {
+        // resync after the rest of the would-be identifier
+        seek(static_cast<int>(scan::alnum(input, pos)));
+        addDiagnostic("identifier must not start with a digit, got=", input.substr(start, pos - start), start);
+        return newToken(TokenType::ILLEGAL, input.substr(start, pos - start), line);
     }
-    return input.substr(start, pos - start);
+    return newToken(TokenType::INT, input.substr(start, pos - start), line);
 }
 
-std::string lex::readString() {
+Token lex::readString() {
     const int start = pos;
-    readChar();
-    while (ch != '"' && ch != 0) {
-        readChar();
-    }
+    seek(static_cast<int>(scan::stringEnd(input, pos + 1)));
 
     if (ch == 0) {
-        std::cerr << "Lexing error on, line=" << line << ", linepos=" << linePos << "." << std::endl;
-        std::cerr << "Expected \", got=tt::ILLEGAL." << std::endl;
-        std::cerr << "Error: unterminated string sequence" << std::endl;
-        std::abort();
+        addDiagnostic("unterminated string sequence, expected=\"", {}, start);
+        return newToken(TokenType::ILLEGAL, input.substr(start, pos - start), line);
     }
 
-    return input.substr(start, pos - start);
+    Token tok = newToken(TokenType::STRING, input.substr(start, pos - start), line);
+    tok.sym = symbols->intern(tok.lit);
+    return tok;
 }
 
 Token lex::nextToken() {
@@ -169,129 +189,153 @@ Token lex::nextToken() {
         case '=':
             if (peekChar() == '=') {
                 readChar();
-                tok = newToken(TokenType::EQ, "==", line);
+                tok = newToken(TokenType::EQ, input.substr(pos - 1, 2), line);
                 break;
             }
-            tok = newToken(TokenType::ASSIGN, std::string(1, ch), line);
+            tok = newToken(TokenType::ASSIGN, input.substr(pos, 1), line);
             break;
         case '+':
-            tok = newToken(TokenType::ADD, std::string(1, ch), line);
+            tok = newToken(TokenType::ADD, input.substr(pos, 1), line);
             break;
         case '-':
-            tok = newToken(TokenType::SUB, std::string(1, ch), line);
+            tok = newToken(TokenType::SUB, input.substr(pos, 1), line);
             break;
         case '*':
-            tok = newToken(TokenType::MUL, std::string(1, ch), line);
+            tok = newToken(TokenType::MUL, input.substr(pos, 1), line);
             break;
         case '/':
-            tok = newToken(TokenType::DIV, std::string(1, ch), line);
+            tok = newToken(TokenType::DIV, input.substr(pos, 1), line);
             break;
         case '%':
-            tok = newToken(TokenType::MOD, std::string(1, ch), line);
+            tok = newToken(TokenType::MOD, input.substr(pos, 1), line);
             break;
         case '(':
-            tok = newToken(TokenType::LPAREN, std::string(1, ch), line);
+            tok = newToken(TokenType::LPAREN, input.substr(pos, 1), line);
             break;
         case ')':
-            tok = newToken(TokenType::RPAREN, std::string(1, ch), line);
+            tok = newToken(TokenType::RPAREN, input.substr(pos, 1), line);
             break;
         case '[':
-            tok = newToken(TokenType::LBRACKET, std::string(1, ch), line);
+            tok = newToken(TokenType::LBRACKET, input.substr(pos, 1), line);
             break;
         case ']':
-            tok = newToken(TokenType::RBRACKET, std::string(1, ch), line);
+            tok = newToken(TokenType::RBRACKET, input.substr(pos, 1), line);
             break;
         case '{':
-            tok = newToken(TokenType::LBRACE, std::string(1, ch), line);
+            tok = newToken(TokenType::LBRACE, input.substr(pos, 1), line);
             break;
         case '}':
-            tok = newToken(TokenType::RBRACE, std::string(1, ch), line);
+            tok = newToken(TokenType::RBRACE, input.substr(pos, 1), line);
             break;
         case ';':
-            tok = newToken(TokenType::SEMICOLON, std::string(1, ch), line);
+            tok = newToken(TokenType::SEMICOLON, input.substr(pos, 1), line);
             break;
         case ':':
-            tok = newToken(TokenType::COLON, std::string(1, ch), line);
+            tok = newToken(TokenType::COLON, input.substr(pos, 1), line);
             break;
         case ',':
-            tok = newToken(TokenType::COMMA, std::string(1, ch), line);
+            tok = newToken(TokenType::COMMA, input.substr(pos, 1), line);
             break;
         case '!':
             if (peekChar() == '=') {
                 readChar();
-                tok = newToken(TokenType::NEQ, "!=", line);
+                tok = newToken(TokenType::NEQ, input.substr(pos - 1, 2), line);
                 break;
             }
-            tok = newToken(TokenType::BANG, std::string(1, ch), line);
+            tok = newToken(TokenType::BANG, input.substr(pos, 1), line);
             break;
         case '|':
             if  (peekChar() == '|') {
                 readChar();
-                tok = newToken(TokenType::OR, "||", line);
+                tok = newToken(TokenType::OR, input.substr(pos - 1, 2), line);
                 break;
             }
-            tok = newToken(TokenType::BAR, std::string(1, ch), line);
+            tok = newToken(TokenType::BAR, input.substr(pos, 1), line);
             break;
         case '&':
             if (peekChar() == '&') {
                 readChar();
-                tok = newToken(TokenType::AND, "&&", line);
+                tok = newToken(TokenType::AND, input.substr(pos - 1, 2), line);
                 break;
             }
-            tok  = newToken(TokenType::AMPERSAND, std::string(1, ch), line);
+            tok  = newToken(TokenType::AMPERSAND, input.substr(pos, 1), line);
             break;
         case '.':
-            tok = newToken(TokenType::DOT, std::string(1, ch), line);
+            tok = newToken(TokenType::DOT, input.substr(pos, 1), line);
             break;
         case '"':
-            tok = newToken(TokenType::STRING, readString(), line);
+            tok = readString();
             break;
         case '>':
             if (peekChar() == '=') {
                 readChar();
-                tok = newToken(TokenType::GTE, ">=", line);
+                tok = newToken(TokenType::GTE, input.substr(pos - 1, 2), line);
                 break;
             }
-            tok = newToken(TokenType::GT, std::string(1, ch), line);
+            tok = newToken(TokenType::GT, input.substr(pos, 1), line);
             break;
         case '<':
             if (peekChar() == '=') {
                 readChar();
-                tok = newToken(TokenType::LTE, "<=", line);
+                tok = newToken(TokenType::LTE, input.substr(pos - 1, 2), line);
                 break;
             }
-            tok = newToken(TokenType::LT, std::string(1, ch), line);
+            tok = newToken(TokenType::LT, input.substr(pos, 1), line);
             break;
         case 0:
-            tok.lit = "";
+            tok.lit = input.substr(input.size());
             tok.type = TokenType::EoF;
             tok.line = line;
             break;
         default: {
-            if (isalpha(ch)) {
+            if (hasClass(ch, CC_ALPHA)) {
                 tok.lit = readIdent();
-                if (keywords.find(tok.lit) != keywords.end()) {
-                    tok.type = keywords[tok.lit];
-                } else {
-                    tok.type = TokenType::IDENT;
+                tok.type = lookupIdent(tok.lit);
+                if (tok.type == TokenType::IDENT) {
+                    tok.sym = symbols->intern(tok.lit);
                 }
                 tok.line = line;
                 return tok;
             }
-            if (isdigit(ch)) {
-                tok.lit =  readInt();
-                tok.type = TokenType::INT;
-                tok.line = line;
+            if (hasClass(ch, CC_DIGIT)) {
+                tok = readInt();
                 return tok;
             }
+            // skip just the offending byte and carry on
             tok.type = TokenType::ILLEGAL;
             tok.line = line;
-            tok.lit = ch;
-            printError(tok);
-            std::abort();
+            tok.lit = input.substr(pos, 1);
+            addDiagnostic("expected a valid token, got=", tok.lit, pos);
+            break;
         }
     }
 
     readChar();
     return tok;
-}
\ No newline at end of file
+}
+
+TokenBuffer lex::tokenizeAll() {
+    TokenBuffer buf;
+    buf.source = source;
+    buf.symbols = symbols;
+    // generated scripts average a token every 4-6 bytes
+    const size_t guess = input.size() / 4 + 1;
+    buf.types.reserve(guess);
+    buf.syms.reserve(guess);
+    buf.offsets.reserve(guess);
+    buf.lengths.reserve(guess);
+    buf.lines.reserve(guess);
+
+    while (true) {
+        const Token t = nextToken();
+        buf.types.push_back(t.type);
+        buf.syms.push_back(t.sym);
+        buf.offsets.push_back(static_cast<uint32_t>(t.lit.data() - input.data()));
+        buf.lengths.push_back(static_cast<uint32_t>(t.lit.size()));
+        buf.lines.push_back(t.line);
+        if (t.type == TokenType::EoF) {
+            buf.diagnostics = diagnostics;
+            return buf;
+        }
+    }
+}
@@ -1,26 +1,91 @@
 #include "h/parser.h"
 #include "h/lex.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <iterator>
 #include <stdexcept>
-
-std::unordered_map<TokenType, Precedence> precedences({
-    {TokenType::EQ, EQUALS},
-    {TokenType::NEQ, EQUALS},
-    {TokenType::LT, LESSGREATER},
-    {TokenType::GT, LESSGREATER},
-    {TokenType::LTE, LESSGREATER},
-    {TokenType::GTE, LESSGREATER},
-    {TokenType::ADD, SUM},
-    {TokenType::SUB, SUM},
-    {TokenType::DIV, PRODUCT},
-    {TokenType::MUL, PRODUCT},
-    {TokenType::MOD, PRODUCT},
-    {TokenType::LPAREN, CALL},
-    {TokenType::LBRACKET, INDEX},
-});
+#include <utility>
+
+static constexpr std::array<Precedence, tokenTypeCount> precedences = [] {
+    std::array<Precedence, tokenTypeCount> table{};
+    table.fill(LOWEST);
+    table[tokenIndex(TokenType::EQ)] = EQUALS;
+    table[tokenIndex(TokenType::NEQ)] = EQUALS;
+    table[tokenIndex(TokenType::LT)] = LESSGREATER;
+    table[tokenIndex(TokenType::GT)] = LESSGREATER;
+    table[tokenIndex(TokenType::LTE)] = LESSGREATER;
+    table[tokenIndex(TokenType::GTE)] = LESSGREATER;
+    table[tokenIndex(TokenType::ADD)] = SUM;
+    table[tokenIndex(TokenType::SUB)] = SUM;
+    table[tokenIndex(TokenType::DIV)] = PRODUCT;
+    table[tokenIndex(TokenType::MUL)] = PRODUCT;
+    table[tokenIndex(TokenType::MOD)] = PRODUCT;
+    table[tokenIndex(TokenType::LPAREN)] = CALL;
+    table[tokenIndex(TokenType::LBRACKET)] = INDEX;
+    return table;
+}();
+
+constexpr std::array<PrefixParseFn, tokenTypeCount> parser::prefixParseFns = [] {
+    std::array<PrefixParseFn, tokenTypeCount> table{};
+    table[tokenIndex(TokenType::IDENT)] = &parser::parseIdentifier;
+    table[tokenIndex(TokenType::INT)] = &parser::parseIntegerLiteral;
+    table[tokenIndex(TokenType::STRING)] = &parser::parseStringLiteral;
+    table[tokenIndex(TokenType::BANG)] = &parser::parsePrefixExpression;
+    table[tokenIndex(TokenType::SUB)] = &parser::parsePrefixExpression;
+    table[tokenIndex(TokenType::TRUE)] = &parser::parseBoolean;
+    table[tokenIndex(TokenType::FALSE)] = &parser::parseBoolean;
+    table[tokenIndex(TokenType::LPAREN)] = &parser::parseGroupedExpression;
+    table[tokenIndex(TokenType::IF)] = &parser::parseIfExpression;
+    table[tokenIndex(TokenType::WHILE)] = &parser::parseWhileExpression;
+    table[tokenIndex(TokenType::FUNCTION)] = &parser::parseFunctionLiteral;
+    table[tokenIndex(TokenType::LBRACKET)] = &parser::parseArrayLiteral;
+    return table;
+}();
+
+constexpr std::array<InfixParseFn, tokenTypeCount> parser::infixParseFns = [] {
+    std::array<InfixParseFn, tokenTypeCount> table{};
+    table[tokenIndex(TokenType::ADD)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::SUB)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::DIV)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::MUL)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::MOD)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::EQ)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::NEQ)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::LT)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::GT)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::LTE)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::GTE)] = &parser::parseInfixExpression;
+    table[tokenIndex(TokenType::LPAREN)] = &parser::parseCallExpression;
+    table[tokenIndex(TokenType::LBRACKET)] = &parser::parseIndexExpression;
+    return table;
+}();
 
 void parser::nextToken() {
     curTok = peekTok;
-    peekTok = l.nextToken();
+    if (l) {
+        peekTok = l->nextToken();
+    } else {
+        peekTok = tokens.at(++cursor);
+    }
+}
+
+TokenType parser::peekTypeAt(const size_t n) const {
+    if (n == 0) {
+        return curTok.type;
+    }
+    if (!l) {
+        return tokens.types[std::min(cursor + n - 1, tokens.size() - 1)];
+    }
+    if (n == 1) {
+        return peekTok.type;
+    }
+    lex ahead = *l;
+    Token t = peekTok;
+    for (size_t i = 1; i < n && t.type != TokenType::EoF; i++) {
+        t = ahead.nextToken();
+    }
+    return t.type;
 }
 
 bool parser::expectPeek(const TokenType &tt) {
@@ -33,17 +98,11 @@ bool parser::expectPeek(const TokenType &tt) {
 }
 
 Precedence parser::peekPrecedence() const {
-    if (precedences.find(peekTok.type) != precedences.end()) {
-        return precedences[peekTok.type];
-    }
-    return LOWEST;
+    return precedences[tokenIndex(peekTok.type)];
 }
 
 Precedence parser::curPrecedence() const {
-    if (precedences.find(curTok.type) != precedences.end()) {
-        return precedences[curTok.type];
-    }
-    return LOWEST;
+    return precedences[tokenIndex(curTok.type)];
 }
 
 void parser::peekError(const TokenType &tt) {
@@ -51,7 +110,7 @@ void parser::peekError(const TokenType &tt) {
                         "\nFound on line=" + std::to_string(curTok.line));
 }
 
-std::unique_ptr<Statement> parser::parseStatement() {
+Statement *parser::parseStatement() {
     if (curTok.type == TokenType::VAR_DECL) {
         return parseDeclareStatement();
     }
@@ -61,23 +120,29 @@ std::unique_ptr<Statement> parser::parseStatement() {
     if (curTok.type == TokenType::RETURN) {
         return parseReturnStatement();
     }
+    if (curTok.type == TokenType::BREAK) {
+        return parseBreakStatement();
+    }
     return parseExpressionStatement();
 }
 
-std::unique_ptr<DeclareStatement> parser::parseDeclareStatement() {
-    auto stmt = std::unique_ptr<DeclareStatement>();
+DeclareStatement *parser::parseDeclareStatement() {
+    auto stmt = make<DeclareStatement>();
     stmt->tok = curTok;
 
-    // ensure a var declaration is accompanied by a type declaration
-    // ie, for ident x, we say "store x : int = 5;"
-
-    // ^^^^ I got lazy and deleted that shit
+    // the type after the name is optional, `var x: int = 5;`
     if (!expectPeek(TokenType::IDENT)) {
         return nullptr;
     }
+    stmt->name = make<Identifier>();
     stmt->name->tok = curTok;
     stmt->name->value = curTok.lit;
-    nextToken();
+    stmt->name->sym = curTok.sym;
+    const std::optional<Annotation> annotation = parseAnnotation(false);
+    if (!annotation) {
+        return nullptr;
+    }
+    stmt->name->annotation = *annotation;
     if (!expectPeek(TokenType::ASSIGN)) {
         return nullptr;
     }
@@ -89,15 +154,17 @@ std::unique_ptr<DeclareStatement> parser::parseDeclareStatement() {
     return stmt;
 }
 
-std::unique_ptr<ReferenceStatement> parser::parseReferenceStatement() {
-    auto stmt = std::make_unique<ReferenceStatement>();
+ReferenceStatement *parser::parseReferenceStatement() {
+    auto stmt = make<ReferenceStatement>();
     stmt->tok = curTok;
 
     if (!expectPeek(TokenType::IDENT)) {
         return nullptr;
     }
+    stmt->name = make<Identifier>();
     stmt->name->tok = curTok;
     stmt->name->value = curTok.lit;
+    stmt->name->sym = curTok.sym;
     if (!expectPeek(TokenType::ASSIGN)) {
         return nullptr;
     }
@@ -110,8 +177,8 @@ std::unique_ptr<ReferenceStatement> parser::parseReferenceStatement() {
     return stmt;
 }
 
-std::unique_ptr<ReturnStatement> parser::parseReturnStatement() {
-    auto stmt = std::unique_ptr<ReturnStatement>();
+ReturnStatement *parser::parseReturnStatement() {
+    auto stmt = make<ReturnStatement>();
     stmt->tok = curTok;
     nextToken();
 
@@ -122,8 +189,17 @@ std::unique_ptr<ReturnStatement> parser::parseReturnStatement() {
     return stmt;
 }
 
-std::unique_ptr<ExpressionStatement> parser::parseExpressionStatement() {
-    auto stmt = std::unique_ptr<ExpressionStatement>();
+BreakStatement *parser::parseBreakStatement() {
+    auto stmt = make<BreakStatement>();
+    stmt->tok = curTok;
+    if (peekTok.type == TokenType::SEMICOLON) {
+        nextToken();
+    }
+    return stmt;
+}
+
+ExpressionStatement *parser::parseExpressionStatement() {
+    auto stmt = make<ExpressionStatement>();
     stmt->tok = curTok;
     stmt->expression = parseExpression(LOWEST);
 
@@ -133,8 +209,8 @@ std::unique_ptr<ExpressionStatement> parser::parseExpressionStatement() {
     return stmt;
 }
 
-std::unique_ptr<BlockStatement> parser::parseBlockStatement() {
-    auto block = std::unique_ptr<BlockStatement>();
+BlockStatement *parser::parseBlockStatement() {
+    auto block = make<BlockStatement>();
     block->tok = curTok;
 
     nextToken();
@@ -142,86 +218,118 @@ std::unique_ptr<BlockStatement> parser::parseBlockStatement() {
     while (curTok.type != TokenType::RBRACE && curTok.type != TokenType::EoF) {
         auto stmt = parseStatement();
         if (stmt != nullptr) {
-            block->statements.push_back(std::move(stmt));
+            block->statements.push_back(*arena, stmt);
         }
         nextToken();
     }
     return block;
 }
 
-std::unique_ptr<Expression> parser::parseExpression(Precedence precedence) {
-    if (prefixParseFns.find(curTok.type) == prefixParseFns.end()) {
+Expression *parser::parseExpression(Precedence precedence) {
+    const PrefixParseFn prefix = prefixParseFns[tokenIndex(curTok.type)];
+    if (prefix == nullptr) {
         noPrefixParseFnError(curTok.type);
         return nullptr;
     }
-    PrefixParseFn prefix = prefixParseFns[curTok.type];
-    std::unique_ptr<Expression> lhs = (this->*prefix)();
+    Expression *lhs = (this->*prefix)();
 
     while (peekTok.type != TokenType::SEMICOLON && precedence < peekPrecedence()) {
-        if (infixParseFns.find(peekTok.type) == infixParseFns.end()) {
+        const InfixParseFn infix = infixParseFns[tokenIndex(peekTok.type)];
+        if (infix == nullptr) {
             return lhs;
         }
-        InfixParseFn infix = infixParseFns[peekTok.type];
         nextToken();
-        lhs = (this->*infix)(std::move(lhs));
+        lhs = (this->*infix)(lhs);
     }
     return lhs;
 }
 
-std::vector<std::unique_ptr<Expression> > parser::parseExpressionList() {
-    std::vector<std::unique_ptr<Expression> > args;
+NodeList<Expression> parser::parseExpressionList() {
+    NodeList<Expression> args;
 
     nextToken();
-    args.push_back(parseExpression(LOWEST));
+    args.push_back(*arena, parseExpression(LOWEST));
     while (peekTok.type == TokenType::COMMA) {
         nextToken();
         nextToken();
-        args.push_back(parseExpression(LOWEST));
+        args.push_back(*arena, parseExpression(LOWEST));
     }
     return args;
 }
 
-std::unique_ptr<Expression> parser::parseIdentifier() {
-    auto ident = std::make_unique<Identifier>();
+Expression *parser::parseIdentifier() {
+    auto ident = make<Identifier>();
     ident->tok = curTok;
     ident->value = curTok.lit;
+    ident->sym = curTok.sym;
     return ident;
 }
 
-std::unique_ptr<Expression> parser::parseBoolean() {
-    auto ident = std::make_unique<BoolLiteral>();
+Expression *parser::parseBoolean() {
+    auto ident = make<BoolLiteral>();
     ident->tok = curTok;
     ident->value = curTok.type == TokenType::TRUE; // i fw this
     return ident;
 }
 
-std::unique_ptr<Expression> parser::parseIntegerLiteral() {
-    auto num = std::make_unique<IntLiteral>();
+Expression *parser::parseIntegerLiteral() {
+    auto num = make<IntLiteral>();
     num->tok = curTok;
-    try {
-        num->value = std::stoi(curTok.lit);
-    } catch (const std::invalid_argument &e) {
-        errors.push_back("unable to parse token literal=" + curTok.lit + " to int." +
-                         "\n expected=int, got=" + curTok.lit + ", line=" + std::to_string(curTok.line) +
-                         "\n" + e.what());
+    // from_chars reads straight out of the source slice, no temporary string
+    const char *first = curTok.lit.data();
+    const char *last = first + curTok.lit.size();
+    auto [end, ec] = std::from_chars(first, last, num->value);
+    if (ec == std::errc::invalid_argument || end != last) {
+        errors.push_back("unable to parse token literal=" + std::string(curTok.lit) + " to int." +
+                         "\n expected=int, got=" + std::string(curTok.lit) + ", line=" + std::to_string(curTok.line));
         return nullptr;
-    } catch (const std::out_of_range &e) {
-        errors.push_back("unable to parse token literal=" + curTok.lit + ", int out of range" +
-                         ", line=" + std::to_string(curTok.line) + "\n" + e.what());
+    }
+    if (ec == std::errc::result_out_of_range) {
+        errors.push_back("unable to parse token literal=" + std::string(curTok.lit) + ", int out of range" +
+                         ", line=" + std::to_string(curTok.line));
         return nullptr;
     }
     return num;
 }
 
-std::unique_ptr<Expression> parser::parseStringLiteral() {
-    auto s = std::make_unique<StringLiteral>();
+Expression *parser::parseStringLiteral() {
+    auto s = make<StringLiteral>();
     s->tok = curTok;
     s->value = curTok.lit;
+    s->sym = curTok.sym;
     return s;
 }
 
-std::vector<std::unique_ptr<Identifier> > parser::parseFunctionParameters() {
-    std::vector<std::unique_ptr<Identifier> > params;
+std::optional<Annotation> parser::parseAnnotation(const bool passed) {
+    if (peekTok.type != TokenType::COLON) {
+        return Annotation::NONE;
+    }
+    nextToken();
+    nextToken();
+    Annotation annotation = Annotation::NONE;
+    if (curTok.type == TokenType::FUNCTION) {
+        annotation = Annotation::FUNC;
+    } else if (curTok.type == TokenType::IDENT) {
+        for (const Annotation a : {Annotation::INT, Annotation::BOOL, Annotation::STRING, Annotation::ARRAY}) {
+            if (curTok.lit == annotationName(a)) {
+                annotation = a;
+            }
+        }
+    }
+    if (annotation == Annotation::NONE) {
+        errors.push_back("unknown type=" + std::string(curTok.lit) + ". line=" + std::to_string(curTok.line));
+        return std::nullopt;
+    }
+    if (passed && annotation == Annotation::BOOL) {
+        errors.push_back("bools are passed and returned as ints, declare int instead. line=" +
+                         std::to_string(curTok.line));
+        return std::nullopt;
+    }
+    return annotation;
+}
+
+NodeList<Identifier> parser::parseFunctionParameters() {
+    NodeList<Identifier> params;
 
     if (peekTok.type == TokenType::RPAREN) {
         nextToken();
@@ -230,36 +338,52 @@ std::vector<std::unique_ptr<Identifier> > parser::parseFunctionParameters() {
 
     nextToken();
 
-    auto ident = std::make_unique<Identifier>();
+    auto ident = make<Identifier>();
     ident->tok = curTok;
     ident->value = curTok.lit;
-    params.push_back(std::move(ident));
+    ident->sym = curTok.sym;
+    std::optional<Annotation> annotation = parseAnnotation(true);
+    if (!annotation) {
+        return {};
+    }
+    ident->annotation = *annotation;
+    params.push_back(*arena, ident);
 
     while (peekTok.type == TokenType::COMMA) {
         nextToken();
         nextToken();
-        ident = std::make_unique<Identifier>();
+        ident = make<Identifier>();
         ident->tok = curTok;
         ident->value = curTok.lit;
-        params.push_back(std::move(ident));
+        ident->sym = curTok.sym;
+        if (!(annotation = parseAnnotation(true))) {
+            return {};
+        }
+        ident->annotation = *annotation;
+        params.push_back(*arena, ident);
     }
 
     if (!expectPeek(TokenType::RPAREN)) {
         errors.push_back("function parameters not closed. expected=\')\' got=" +
-                         curTok.lit + ". line=" + std::to_string(curTok.line));
+                         std::string(curTok.lit) + ". line=" + std::to_string(curTok.line));
         return {};
     }
     return params;
 }
 
-std::unique_ptr<Expression> parser::parseFunctionLiteral() {
-    auto fn = std::make_unique<FuncLiteral>();
+Expression *parser::parseFunctionLiteral() {
+    auto fn = make<FuncLiteral>();
     fn->tok = curTok;
 
     if (!expectPeek(TokenType::LPAREN)) {
         return nullptr;
     }
     fn->params = parseFunctionParameters();
+    const std::optional<Annotation> returns = parseAnnotation(true);
+    if (!returns) {
+        return nullptr;
+    }
+    fn->returns = *returns;
     if (!expectPeek(TokenType::LBRACE)) {
         return nullptr;
     }
@@ -268,8 +392,8 @@ std::unique_ptr<Expression> parser::parseFunctionLiteral() {
     return fn;
 }
 
-std::unique_ptr<Expression> parser::parseArrayLiteral() {
-    auto expr = std::make_unique<ArrayLiteral>();
+Expression *parser::parseArrayLiteral() {
+    auto expr = make<ArrayLiteral>();
     expr->tok = curTok;
     if (peekTok.type == TokenType::RBRACKET) {
         nextToken();
@@ -278,22 +402,22 @@ std::unique_ptr<Expression> parser::parseArrayLiteral() {
 
     expr->elements = parseExpressionList();
     if (!expectPeek(TokenType::RBRACKET)) {
-        expr->elements = std::vector<std::unique_ptr<Expression> >{};
+        expr->elements.clear();
     }
     return expr;
 }
 
-std::unique_ptr<Expression> parser::parsePrefixExpression() {
-    auto expr = std::make_unique<PrefixExpression>();
+Expression *parser::parsePrefixExpression() {
+    auto expr = make<PrefixExpression>();
     expr->tok = curTok;
     expr->op = curTok.lit;
     nextToken();
 
-    expr->rhs = parseExpression(LOWEST);
+    expr->rhs = parseExpression(PREFIX);
     return expr;
 }
 
-std::unique_ptr<Expression> parser::parseGroupedExpression() {
+Expression *parser::parseGroupedExpression() {
     nextToken();
     auto expr = parseExpression(LOWEST);
 
@@ -304,8 +428,8 @@ std::unique_ptr<Expression> parser::parseGroupedExpression() {
     return expr;
 }
 
-std::unique_ptr<Expression> parser::parseIfExpression() {
-    auto expr = std::make_unique<IfExpression>();
+Expression *parser::parseIfExpression() {
+    auto expr = make<IfExpression>();
     expr->tok = curTok;
 
     if (!expectPeek(TokenType::LPAREN)) {
@@ -332,8 +456,8 @@ std::unique_ptr<Expression> parser::parseIfExpression() {
     return expr;
 }
 
-std::unique_ptr<Expression> parser::parseWhileExpression() {
-    auto expr = std::make_unique<WhileExpression>();
+Expression *parser::parseWhileExpression() {
+    auto expr = make<WhileExpression>();
     expr->tok = curTok;
 
     if (!expectPeek(TokenType::LPAREN)) {
@@ -352,10 +476,10 @@ std::unique_ptr<Expression> parser::parseWhileExpression() {
     return expr;
 }
 
-std::unique_ptr<Expression> parser::parseCallExpression(std::unique_ptr<Expression> callee) {
-    auto expr = std::make_unique<CallExpression>();
+Expression *parser::parseCallExpression(Expression *callee) {
+    auto expr = make<CallExpression>();
     expr->tok = curTok;
-    expr->callee = std::move(callee);
+    expr->callee = callee;
 
     if (peekTok.type == TokenType::RPAREN) {
         nextToken();
@@ -363,15 +487,15 @@ std::unique_ptr<Expression> parser::parseCallExpression(std::unique_ptr<Expressi
     }
     expr->arguments = parseExpressionList();
     if (!expectPeek(TokenType::RPAREN)) {
-        expr->arguments = std::vector<std::unique_ptr<Expression> >{};
+        expr->arguments.clear();
     }
     return expr;
 }
 
-std::unique_ptr<Expression> parser::parseIndexExpression(std::unique_ptr<Expression> array) {
-    auto expr = std::make_unique<IndexExpression>();
+Expression *parser::parseIndexExpression(Expression *array) {
+    auto expr = make<IndexExpression>();
     expr->tok = curTok;
-    expr->array = std::move(array);
+    expr->array = array;
     nextToken();
     expr->index = parseExpression(LOWEST);
     if (!expectPeek(TokenType::RBRACKET)) {
@@ -380,11 +504,11 @@ std::unique_ptr<Expression> parser::parseIndexExpression(std::unique_ptr<Express
     return expr;
 }
 
-std::unique_ptr<Expression> parser::parseInfixExpression(std::unique_ptr<Expression> lhs) {
-    auto expr = std::make_unique<InfixExpression>();
+Expression *parser::parseInfixExpression(Expression *lhs) {
+    auto expr = make<InfixExpression>();
     expr->tok = curTok;
     expr->op = curTok.lit;
-    expr->lhs = std::move(lhs);
+    expr->lhs = lhs;
 
     Precedence precedence = curPrecedence();
     nextToken();
@@ -398,47 +522,248 @@ void parser::noPrefixParseFnError(TokenType tt) {
 }
 
 parser::parser(const lex &l) : l(l) {
-
-    prefixParseFns[TokenType::IDENT] = &parser::parseIdentifier;
-    prefixParseFns[TokenType::INT] = &parser::parseIntegerLiteral;
-    prefixParseFns[TokenType::STRING] = &parser::parseStringLiteral;
-    prefixParseFns[TokenType::BANG] = &parser::parsePrefixExpression;
-    prefixParseFns[TokenType::SUB] = &parser::parsePrefixExpression;
-    prefixParseFns[TokenType::TRUE] = &parser::parseBoolean;
-    prefixParseFns[TokenType::FALSE] = &parser::parseBoolean;
-    prefixParseFns[TokenType::LPAREN] = &parser::parseGroupedExpression;
-    prefixParseFns[TokenType::IF] = &parser::parseIfExpression;
-    prefixParseFns[TokenType::WHILE] = &parser::parseWhileExpression;
-    prefixParseFns[TokenType::FUNCTION] = &parser::parseFunctionLiteral;
-    prefixParseFns[TokenType::LBRACKET] = &parser::parseArrayLiteral;
-
-    infixParseFns[TokenType::ADD] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::SUB] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::DIV] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::MUL] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::MOD] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::EQ] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::NEQ] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::LT] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::GT] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::LTE] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::GTE] = &parser::parseInfixExpression;
-    infixParseFns[TokenType::LPAREN] = &parser::parseCallExpression;
-    infixParseFns[TokenType::LBRACKET] = &parser::parseIndexExpression;
     nextToken();
     nextToken();
 }
 
+parser::parser(TokenBuffer tokens) : tokens(std::move(tokens)) {
+    // prime curTok/peekTok with entries 0 and 1, leaving cursor on peekTok
+    curTok = this->tokens.at(0);
+    peekTok = this->tokens.at(1);
+    cursor = 1;
+}
+
 std::unique_ptr<Program> parser::parseProgram() {
     auto program = std::make_unique<Program>();
+    arena = &program->arena;
+    program->source = l ? l->getSource() : tokens.source;
+    program->symbols = l ? l->getSymbols() : tokens.symbols;
 
     while (curTok.type != TokenType::EoF) {
-        std::unique_ptr<Statement> stmt = parseStatement();
+        Statement *stmt = parseStatement();
         if (stmt != nullptr) {
-            program->statements.push_back(std::move(stmt));
+            program->statements.push_back(stmt);
         }
         nextToken();
     }
 
     return program;
 }
+
+bool parser::parseUnits(Program &program, ParsedUnit &from, const std::function<bool(const ParsedUnit &)> &stop,
+                        ParsedUnits &out) {
+    lex lexer(program.source, program.symbols);
+    lexer.resume(static_cast<int>(from.begin), from.line, from.column);
+    parser p(lexer);
+    p.arena = &program.arena;
+    const char *base = program.source->data();
+    const size_t firstUnit = out.units.size();
+
+    bool stopped = false;
+    while (p.curTok.type != TokenType::EoF) {
+        ParsedUnit unit = from;
+        const size_t errorsBefore = p.errors.size();
+        unit.statement = p.parseStatement();
+        unit.generation = program.generation;
+        unit.errors = static_cast<uint32_t>(p.errors.size() - errorsBefore);
+        unit.diagnostics = 0;
+        unit.shift = 0;
+        out.units.push_back(unit);
+
+        // peekTok is the next unit's first token, and the lexer just read it
+        from.begin = static_cast<uint32_t>(p.peekTok.lit.data() - base);
+        from.line = p.l->getLine();
+        from.column = p.l->getLinePos();
+        p.nextToken();
+        if (p.curTok.type != TokenType::EoF && stop(from)) {
+            stopped = true;
+            break;
+        }
+    }
+
+    // each diagnostic goes to the unit holding its token. those of tokens
+    // read ahead past a stop aren't ours.
+    size_t unit = firstUnit;
+    for (const LexDiagnostic &d : p.l->Diagnostics()) {
+        if (unit == out.units.size() || (stopped && d.offset >= from.begin)) {
+            break;
+        }
+        while (unit + 1 < out.units.size() && out.units[unit + 1].begin <= d.offset) {
+            unit++;
+        }
+        out.units[unit].diagnostics++;
+        out.diagnostics.push_back(d);
+    }
+    out.errors.insert(out.errors.end(), std::make_move_iterator(p.errors.begin()),
+                      std::make_move_iterator(p.errors.end()));
+    return stopped;
+}
+
+std::unique_ptr<Program> parser::parseEditable(std::shared_ptr<const SourceBuffer> source,
+                                               std::shared_ptr<Interner> symbols) {
+    auto program = std::make_unique<Program>();
+    program->source = std::move(source);
+    program->symbols = symbols ? std::move(symbols) : std::make_shared<Interner>();
+
+    ParsedUnit from{nullptr, 0, 1, 1, 0, 0, 0, 0};
+    ParsedUnits parsed;
+    parseUnits(*program, from, [](const ParsedUnit &) { return false; }, parsed);
+    for (const ParsedUnit &unit : parsed.units) {
+        if (unit.statement != nullptr) {
+            program->statements.push_back(unit.statement);
+        }
+    }
+    program->ownUnits = parsed.units.size();
+    program->units = std::move(parsed.units);
+    program->errors = std::move(parsed.errors);
+    program->diagnostics = std::move(parsed.diagnostics);
+    return program;
+}
+
+// replaces count items of v from at on with those of with
+template <typename T>
+static void splice(std::vector<T> &v, const size_t at, const size_t count, std::vector<T> &&with) {
+    const size_t n = with.size();
+    if (count > n) {
+        v.erase(v.begin() + static_cast<long>(at + n), v.begin() + static_cast<long>(at + count));
+    } else {
+        v.insert(v.begin() + static_cast<long>(at + count), std::make_move_iterator(with.begin() + static_cast<long>(count)),
+                 std::make_move_iterator(with.end()));
+    }
+    std::move(with.begin(), with.begin() + static_cast<long>(std::min(count, n)), v.begin() + static_cast<long>(at));
+}
+
+// once a program holds this many earlier ones, the next edit is parsed from
+// scratch rather than keep more old sources and arenas around
+static constexpr size_t maxRetained = 8;
+
+std::unique_ptr<Program> parser::reparse(std::unique_ptr<Program> previous, const TextEdit &edit) {
+    const std::string_view old = previous->source->view();
+    if (edit.offset > old.size() || edit.removed > old.size() - edit.offset) {
+        throw std::out_of_range("edit runs past the end of the source");
+    }
+    std::string text;
+    text.reserve(old.size() - edit.removed + edit.inserted.size());
+    text.append(old.substr(0, edit.offset)).append(edit.inserted).append(old.substr(edit.offset + edit.removed));
+    auto source = std::make_shared<const SourceBuffer>(std::move(text));
+
+    std::vector<ParsedUnit> &units = previous->units;
+    if (units.empty() || previous->retained.size() >= maxRetained) {
+        return parseEditable(std::move(source), previous->symbols);
+    }
+
+    auto next = std::make_unique<Program>();
+    next->source = std::move(source);
+    next->symbols = previous->symbols;
+    next->generation = previous->generation + 1;
+
+    auto startingAt = [&units](const size_t from, const uint32_t offset) {
+        return static_cast<size_t>(
+            std::lower_bound(units.begin() + static_cast<long>(from), units.end(), offset,
+                             [](const ParsedUnit &u, const uint32_t o) { return u.begin < o; }) - units.begin());
+    };
+    // the unit the edit starts in may run on into it, and the one before
+    // that read the first token of that one as its peekTok
+    const size_t first = startingAt(0, static_cast<uint32_t>(edit.offset));
+    const size_t start = first >= 2 ? first - 2 : 0;
+
+    // a failed unit's errors name its line, so once lines move it has to be
+    // parsed again instead of taken over
+    long lastFailed = -1;
+    if (!previous->errors.empty()) {
+        for (size_t i = units.size(); i-- > 0;) {
+            if (units[i].errors != 0) {
+                lastFailed = static_cast<long>(i);
+                break;
+            }
+        }
+    }
+
+    const long delta = static_cast<long>(edit.inserted.size()) - static_cast<long>(edit.removed);
+    const size_t editEnd = edit.offset + edit.inserted.size();
+    size_t resumeAt = units.size();
+    int lineDelta = 0;
+    ParsedUnit from = units[start];
+    ParsedUnits parsed;
+    parseUnits(*next, from, [&](const ParsedUnit &at) {
+        if (at.begin < editEnd) {
+            return false;
+        }
+        const auto was = static_cast<uint32_t>(at.begin - delta);
+        const size_t j = startingAt(start, was);
+        if (j == units.size() || units[j].begin != was || units[j].column != at.column) {
+            return false;
+        }
+        const int lines = at.line - units[j].line;
+        if (lines != 0 && static_cast<long>(j) <= lastFailed) {
+            return false;
+        }
+        resumeAt = j;
+        lineDelta = lines;
+        return true;
+    }, parsed);
+
+    // how much of each list the units before start and the replaced ones
+    // account for, and which earlier programs the replaced ones lived in
+    std::vector<std::pair<std::shared_ptr<const Program>, size_t>> retained = std::move(previous->retained);
+    size_t previousUnits = previous->ownUnits;
+    size_t statementsBefore = 0, errorsBefore = 0, diagnosticsBefore = 0;
+    for (size_t i = 0; i < start; i++) {
+        statementsBefore += units[i].statement != nullptr;
+        errorsBefore += units[i].errors;
+        diagnosticsBefore += units[i].diagnostics;
+    }
+    size_t statementsReplaced = 0, errorsReplaced = 0, diagnosticsReplaced = 0;
+    for (size_t i = start; i < resumeAt; i++) {
+        const ParsedUnit &u = units[i];
+        statementsReplaced += u.statement != nullptr;
+        errorsReplaced += u.errors;
+        diagnosticsReplaced += u.diagnostics;
+        if (u.generation == previous->generation) {
+            previousUnits--;
+            continue;
+        }
+        for (auto &[program, count] : retained) {
+            if (program->generation == u.generation) {
+                count--;
+                break;
+            }
+        }
+    }
+
+    std::vector<Statement *> statements;
+    for (const ParsedUnit &unit : parsed.units) {
+        if (unit.statement != nullptr) {
+            statements.push_back(unit.statement);
+        }
+    }
+    const size_t unitsAdded = parsed.units.size();
+    const size_t diagnosticsAdded = parsed.diagnostics.size();
+
+    // the units after the edit move, their tokens only once they're read
+    splice(units, start, resumeAt - start, std::move(parsed.units));
+    for (size_t i = start + unitsAdded; i < units.size(); i++) {
+        units[i].begin = static_cast<uint32_t>(units[i].begin + delta);
+        units[i].line += lineDelta;
+        units[i].shift += lineDelta;
+    }
+    splice(previous->statements, statementsBefore, statementsReplaced, std::move(statements));
+    splice(previous->errors, errorsBefore, errorsReplaced, std::move(parsed.errors));
+    splice(previous->diagnostics, diagnosticsBefore, diagnosticsReplaced, std::move(parsed.diagnostics));
+    for (size_t i = diagnosticsBefore + diagnosticsAdded; i < previous->diagnostics.size(); i++) {
+        previous->diagnostics[i].offset = static_cast<size_t>(static_cast<long>(previous->diagnostics[i].offset) + delta);
+        previous->diagnostics[i].line += lineDelta;
+    }
+
+    next->units = std::move(units);
+    next->statements = std::move(previous->statements);
+    next->errors = std::move(previous->errors);
+    next->diagnostics = std::move(previous->diagnostics);
+    next->ownUnits = unitsAdded;
+    std::erase_if(retained, [](const auto &r) { return r.second == 0; });
+    if (previousUnits != 0) {
+        retained.emplace_back(std::move(previous), previousUnits);
+    }
+    next->retained = std::move(retained);
+    return next;
+}
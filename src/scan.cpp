@@ -0,0 +1,259 @@
+#include <atomic>
+#include <cstring>
+
+#include "h/scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BANTER_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// a kernel only has to find where a run stops; spaces after the last newline
+// are counted afterwards over what is normally just the indentation.
+struct RawSpaceRun {
+    size_t end;
+    int newlines;
+    size_t lastNewline; // index of the last '\n', or SIZE_MAX
+};
+
+struct ScanFns {
+    RawSpaceRun (*whitespace)(const char *s, size_t i, size_t n);
+    size_t (*alnum)(const char *s, size_t i, size_t n);
+    size_t (*digits)(const char *s, size_t i, size_t n);
+};
+
+static RawSpaceRun whitespaceScalar(const char *s, size_t i, const size_t n, RawSpaceRun run) {
+    while (i < n && hasClass(s[i], CC_SPACE)) {
+        if (s[i] == '\n') {
+            run.newlines++;
+            run.lastNewline = i;
+        }
+        i++;
+    }
+    run.end = i;
+    return run;
+}
+
+static RawSpaceRun whitespaceScalar(const char *s, const size_t i, const size_t n) {
+    return whitespaceScalar(s, i, n, {i, 0, SIZE_MAX});
+}
+
+static size_t classScalar(const char *s, size_t i, const size_t n, const uint8_t cls) {
+    while (i < n && hasClass(s[i], cls)) {
+        i++;
+    }
+    return i;
+}
+
+static size_t alnumScalar(const char *s, const size_t i, const size_t n) {
+    return classScalar(s, i, n, CC_ALNUM);
+}
+
+static size_t digitsScalar(const char *s, const size_t i, const size_t n) {
+    return classScalar(s, i, n, CC_DIGIT);
+}
+
+#ifdef BANTER_SCAN_X86
+
+// signed byte compares: everything >= 0x80 is negative and so falls outside
+// both ranges, matching the table.
+static __m128i digitMask128(const __m128i v) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+}
+
+static __m128i alnumMask128(const __m128i v) {
+    const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    const __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                        _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    return _mm_or_si128(alpha, digitMask128(v));
+}
+
+static RawSpaceRun whitespaceSse2(const char *s, size_t i, const size_t n) {
+    RawSpaceRun run{i, 0, SIZE_MAX};
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        const __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        const __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), nl),
+                                        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                                                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        const unsigned stop = ~static_cast<unsigned>(_mm_movemask_epi8(ws)) & 0xFFFFu;
+        unsigned nlBits = static_cast<unsigned>(_mm_movemask_epi8(nl));
+        const unsigned k = stop != 0 ? __builtin_ctz(stop) : 16;
+        nlBits &= (1u << k) - 1;
+        if (nlBits != 0) {
+            run.newlines += __builtin_popcount(nlBits);
+            run.lastNewline = i + 31 - __builtin_clz(nlBits);
+        }
+        if (k < 16) {
+            run.end = i + k;
+            return run;
+        }
+    }
+    return whitespaceScalar(s, i, n, run);
+}
+
+template <__m128i (*Mask)(__m128i)>
+static size_t classSse2(const char *s, size_t i, const size_t n, const uint8_t cls) {
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        const unsigned stop = ~static_cast<unsigned>(_mm_movemask_epi8(Mask(v))) & 0xFFFFu;
+        if (stop != 0) {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return classScalar(s, i, n, cls);
+}
+
+static size_t alnumSse2(const char *s, const size_t i, const size_t n) {
+    return classSse2<alnumMask128>(s, i, n, CC_ALNUM);
+}
+
+static size_t digitsSse2(const char *s, const size_t i, const size_t n) {
+    return classSse2<digitMask128>(s, i, n, CC_DIGIT);
+}
+
+#define BANTER_AVX2 __attribute__((target("avx2")))
+
+BANTER_AVX2 static __m256i digitMask256(const __m256i v) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+}
+
+BANTER_AVX2 static __m256i alnumMask256(const __m256i v) {
+    const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    const __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                           _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    return _mm256_or_si256(alpha, digitMask256(v));
+}
+
+BANTER_AVX2 static RawSpaceRun whitespaceAvx2(const char *s, size_t i, const size_t n) {
+    RawSpaceRun run{i, 0, SIZE_MAX};
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+        const __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        const __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), nl),
+                                           _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                                                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+        const unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(ws));
+        unsigned nlBits = static_cast<unsigned>(_mm256_movemask_epi8(nl));
+        const unsigned k = stop != 0 ? __builtin_ctz(stop) : 32;
+        if (k < 32) {
+            nlBits &= (1u << k) - 1;
+        }
+        if (nlBits != 0) {
+            run.newlines += __builtin_popcount(nlBits);
+            run.lastNewline = i + 31 - __builtin_clz(nlBits);
+        }
+        if (k < 32) {
+            run.end = i + k;
+            return run;
+        }
+    }
+    return whitespaceScalar(s, i, n, run);
+}
+
+template <__m256i (*Mask)(__m256i)>
+BANTER_AVX2 static size_t classAvx2(const char *s, size_t i, const size_t n, const uint8_t cls) {
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+        const unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(Mask(v)));
+        if (stop != 0) {
+            return i + __builtin_ctz(stop);
+        }
+    }
+    return classScalar(s, i, n, cls);
+}
+
+BANTER_AVX2 static size_t alnumAvx2(const char *s, const size_t i, const size_t n) {
+    return classAvx2<alnumMask256>(s, i, n, CC_ALNUM);
+}
+
+BANTER_AVX2 static size_t digitsAvx2(const char *s, const size_t i, const size_t n) {
+    return classAvx2<digitMask256>(s, i, n, CC_DIGIT);
+}
+
+#endif //BANTER_SCAN_X86
+
+static constexpr ScanFns fnsFor(const ScanKernel k) {
+    switch (k) {
+#ifdef BANTER_SCAN_X86
+        case ScanKernel::AVX2: return {whitespaceAvx2, alnumAvx2, digitsAvx2};
+        case ScanKernel::SSE2: return {whitespaceSse2, alnumSse2, digitsSse2};
+#endif
+        default: return {whitespaceScalar, alnumScalar, digitsScalar};
+    }
+}
+
+static ScanKernel detectKernel() {
+#ifdef BANTER_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return ScanKernel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return ScanKernel::SSE2;
+    }
+#endif
+    return ScanKernel::SCALAR;
+}
+
+ScanKernel scan::bestKernel() {
+    static const ScanKernel best = detectKernel();
+    return best;
+}
+
+static constexpr ScanFns kernels[] = {fnsFor(ScanKernel::SCALAR), fnsFor(ScanKernel::SSE2),
+                                      fnsFor(ScanKernel::AVX2)};
+
+// function-local so a lexer running during static init still sees a kernel.
+// lexers on any number of threads read it, so switching is a single atomic
+// store rather than a rewrite of the function pointers under their feet.
+static std::atomic<ScanKernel> &activeKernel() {
+    static std::atomic<ScanKernel> k{scan::bestKernel()};
+    return k;
+}
+
+static const ScanFns &active() {
+    return kernels[static_cast<int>(activeKernel().load(std::memory_order_relaxed))];
+}
+
+ScanKernel scan::kernel() {
+    return activeKernel().load(std::memory_order_relaxed);
+}
+
+void scan::setKernel(const ScanKernel k) {
+    activeKernel().store(static_cast<int>(k) > static_cast<int>(bestKernel()) ? bestKernel() : k,
+                         std::memory_order_relaxed);
+}
+
+SpaceRun scan::whitespace(const std::string_view s, const size_t from) {
+    const RawSpaceRun raw = active().whitespace(s.data(), from, s.size());
+    size_t i = raw.lastNewline == SIZE_MAX ? from : raw.lastNewline + 1;
+    int spaces = 0;
+    for (; i < raw.end; i++) {
+        spaces += s[i] == ' ';
+    }
+    return {raw.end, raw.newlines, spaces};
+}
+
+size_t scan::alnum(const std::string_view s, const size_t from) {
+    return active().alnum(s.data(), from, s.size());
+}
+
+size_t scan::digits(const std::string_view s, const size_t from) {
+    return active().digits(s.data(), from, s.size());
+}
+
+size_t scan::stringEnd(const std::string_view s, const size_t from) {
+    if (from >= s.size()) {
+        return s.size();
+    }
+    // memchr is already vectorised by libc
+    const char *p = s.data() + from;
+    const size_t n = s.size() - from;
+    const auto *quote = static_cast<const char *>(std::memchr(p, '"', n));
+    const size_t end = quote != nullptr ? static_cast<size_t>(quote - p) : n;
+    const auto *nul = static_cast<const char *>(std::memchr(p, '\0', end));
+    return from + (nul != nullptr ? static_cast<size_t>(nul - p) : end);
+}
@@ -0,0 +1,73 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "h/source.h"
+
+SourceBuffer::SourceBuffer(std::string text) : text(std::move(text)) {}
+
+SourceBuffer::SourceBuffer(const char *mapped, const size_t mappedLen)
+    : mapped(mapped), mappedLen(mappedLen) {}
+
+SourceBuffer::~SourceBuffer() {
+    if (mapped != nullptr) {
+        munmap(const_cast<char *>(mapped), mappedLen);
+    }
+}
+
+std::shared_ptr<const SourceBuffer> SourceBuffer::fromFile(const std::string &path) {
+    if (path == "-") {
+        return fromStream(STDIN_FILENO);
+    }
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("unable to open " + path + ": " + std::strerror(errno));
+    }
+    // closed on every way out, fromStream throws if a read fails
+    struct Closer {
+        int fd;
+        ~Closer() { close(fd); }
+    } closer{fd};
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        // an empty file can't be mapped, and a fifo has no size to map
+        return fromStream(fd);
+    }
+
+    const auto len = static_cast<size_t>(st.st_size);
+    void *addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        return fromStream(fd);
+    }
+    // the mapping keeps the file referenced once fd is closed
+    madvise(addr, len, MADV_SEQUENTIAL);
+
+    return std::shared_ptr<const SourceBuffer>(new SourceBuffer(static_cast<const char *>(addr), len));
+}
+
+std::shared_ptr<const SourceBuffer> SourceBuffer::fromStream(const int fd) {
+    std::string text;
+    char chunk[1 << 16];
+    while (true) {
+        const ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("unable to read source: ") + std::strerror(errno));
+        }
+        text.append(chunk, static_cast<size_t>(n));
+    }
+    return std::make_shared<const SourceBuffer>(std::move(text));
+}
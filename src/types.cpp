@@ -0,0 +1,292 @@
+#include "h/types.h"
+
+std::string typeSetName(const TypeSet t) {
+    if (t == AnyType) {
+        return "any";
+    }
+    static const char *names[] = {"int", "bool", "string", "array", "func"};
+    std::string out;
+    for (int i = 0; i < 5; i++) {
+        if ((t & 1 << i) != 0) {
+            out += (out.empty() ? "" : "|") + std::string(names[i]);
+        }
+    }
+    return out.empty() ? "none" : out;
+}
+
+namespace {
+
+struct Inference {
+    const FlatAst &ast;
+    Types &types;
+    // by FUNC node, what comes back before the annotation's checked
+    std::vector<TypeSet> returns;
+    std::vector<bool> escapes;
+    // by parameter, what's passed for it before the annotation's checked
+    std::vector<TypeSet> passed;
+    // by declaration node
+    std::vector<bool> reassigned;
+    bool changed = false;
+
+    // what each name in scope was declared by, innermost scope last. the
+    // functions around the one being walked are in here too, which is how
+    // it sees their locals.
+    std::vector<std::vector<std::pair<Symbol, NodeIndex>>> scopes;
+    std::vector<NodeIndex> functions; // FUNC nodes being walked, innermost last
+
+    explicit Inference(const FlatAst &ast, Types &types)
+        : ast(ast), types(types), returns(ast.size()), escapes(ast.size()), passed(ast.size()),
+          reassigned(ast.size()) {
+        types.of.assign(ast.size(), 0);
+        types.satisfied.assign(ast.size(), true);
+    }
+
+    // of the annotated node n, for what's given for it
+    TypeSet narrow(const NodeIndex n, const Annotation annotation, const TypeSet given) {
+        types.satisfied[n] = (given & ~annotated(annotation)) == 0;
+        return given & annotated(annotation);
+    }
+
+    void grow(TypeSet &slot, const TypeSet t) {
+        if ((slot | t) != slot) {
+            slot |= t;
+            changed = true;
+        }
+    }
+
+    void mark(std::vector<bool> &flags, const NodeIndex n) {
+        if (!flags[n]) {
+            flags[n] = true;
+            changed = true;
+        }
+    }
+
+    NodeIndex lookup(const Symbol sym) const {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+            for (auto decl = scope->rbegin(); decl != scope->rend(); ++decl) {
+                if (decl->first == sym) {
+                    return decl->second;
+                }
+            }
+        }
+        return NoNode;
+    }
+
+    // the literal decl binds its name to, if it's a function's declaration
+    NodeIndex declaredFunction(const NodeIndex decl) const {
+        if (decl == NoNode || ast.kinds[decl] != NodeKind::DECLARE || ast.b[decl] == NoNode ||
+            ast.kinds[ast.b[decl]] != NodeKind::FUNC) {
+            return NoNode;
+        }
+        return ast.b[decl];
+    }
+
+    void program() {
+        types.expressions = 0;
+        types.proven = 0;
+        scopes.emplace_back();
+        for (const NodeIndex stmt : ast.statements) {
+            statement(stmt);
+        }
+        scopes.pop_back();
+    }
+
+    void statement(const NodeIndex n) {
+        if (n == NoNode) {
+            return;
+        }
+        switch (ast.kinds[n]) {
+            case NodeKind::DECLARE: {
+                const NodeIndex value = ast.b[n];
+                const Symbol sym = ast.a[ast.a[n]];
+                const Annotation annotation = ast.annotations[ast.a[n]];
+                if (value != NoNode && ast.kinds[value] == NodeKind::FUNC) {
+                    // bound first, so it can call itself
+                    scopes.back().emplace_back(sym, n);
+                    grow(types.of[n], narrow(n, annotation, FuncType));
+                    types.of[value] = FuncType;
+                    function(value);
+                    return;
+                }
+                grow(types.of[n], narrow(n, annotation, expression(value)));
+                scopes.back().emplace_back(sym, n);
+                return;
+            }
+            case NodeKind::REFERENCE: {
+                // the variable keeps its type, or the program stops
+                expression(ast.b[n]);
+                if (const NodeIndex decl = lookup(ast.a[ast.a[n]]); decl != NoNode) {
+                    mark(reassigned, decl);
+                }
+                return;
+            }
+            case NodeKind::RETURN: {
+                const TypeSet t = ast.a[n] != NoNode ? widened(expression(ast.a[n])) : IntType;
+                if (!functions.empty()) {
+                    grow(returns[functions.back()], t);
+                }
+                return;
+            }
+            case NodeKind::BREAK:
+                return;
+            case NodeKind::EXPRESSION_STMT:
+                expression(ast.a[n]);
+                return;
+            case NodeKind::BLOCK:
+                block(n);
+                return;
+            default:
+                expression(n);
+                return;
+        }
+    }
+
+    // the value of a block is its trailing expression statement's, or 0
+    TypeSet block(const NodeIndex n) {
+        TypeSet value = IntType;
+        scopes.emplace_back();
+        const uint32_t count = n == NoNode ? 0 : ast.b[n];
+        for (uint32_t i = 0; i < count; i++) {
+            const NodeIndex stmt = ast.listAt(ast.a[n], i);
+            if (i + 1 == count && stmt != NoNode && ast.kinds[stmt] == NodeKind::EXPRESSION_STMT) {
+                value = expression(ast.a[stmt]);
+            } else {
+                statement(stmt);
+            }
+        }
+        scopes.pop_back();
+        return value;
+    }
+
+    void function(const NodeIndex n) {
+        functions.push_back(n);
+        scopes.emplace_back();
+        for (uint32_t i = 0; i < ast.b[n]; i++) {
+            const NodeIndex param = ast.listAt(ast.a[n], i);
+            if (escapes[n]) {
+                grow(passed[param], widened(AnyType));
+            }
+            types.of[param] = narrow(param, ast.annotations[param], passed[param]);
+            scopes.back().emplace_back(ast.a[param], param);
+        }
+        const NodeIndex body = ast.c[n];
+        block(body);
+        // falling off the end returns 0
+        const uint32_t count = body == NoNode ? 0 : ast.b[body];
+        const NodeIndex last = count == 0 ? NoNode : ast.listAt(ast.a[body], count - 1);
+        if (last == NoNode || ast.kinds[last] != NodeKind::RETURN) {
+            grow(returns[n], IntType);
+        }
+        narrow(n, ast.annotations[n], returns[n]);
+        scopes.pop_back();
+        functions.pop_back();
+    }
+
+    TypeSet expression(const NodeIndex n) {
+        if (n == NoNode) {
+            return 0;
+        }
+        const TypeSet t = infer(n);
+        types.of[n] = t;
+        types.expressions++;
+        types.proven += proven(t);
+        return t;
+    }
+
+    TypeSet infer(const NodeIndex n) {
+        switch (ast.kinds[n]) {
+            case NodeKind::IDENT: {
+                const NodeIndex decl = lookup(ast.a[n]);
+                if (decl == NoNode) {
+                    return AnyType;
+                }
+                // a function used as a value could be called from anywhere
+                if (const NodeIndex fn = declaredFunction(decl); fn != NoNode) {
+                    mark(escapes, fn);
+                }
+                return types.of[decl];
+            }
+            case NodeKind::INT: return IntType;
+            case NodeKind::BOOL: return BoolType;
+            case NodeKind::STRING: return StringType;
+            case NodeKind::FUNC:
+                mark(escapes, n);
+                function(n);
+                return FuncType;
+            case NodeKind::ARRAY:
+                for (uint32_t i = 0; i < ast.b[n]; i++) {
+                    expression(ast.listAt(ast.a[n], i));
+                }
+                return ArrayType;
+            case NodeKind::CALL: return call(n);
+            case NodeKind::INDEX: {
+                const TypeSet array = expression(ast.a[n]);
+                expression(ast.b[n]);
+                return ((array & ArrayType) != 0 ? AnyType : 0) | ((array & StringType) != 0 ? StringType : 0);
+            }
+            case NodeKind::PREFIX:
+                expression(ast.a[n]);
+                return ast.text[n] == "!" ? BoolType : IntType;
+            case NodeKind::INFIX: {
+                // both sides have to be of one type. ints do everything,
+                // strings only add and compare for equality, bools compare.
+                const TypeSet both = expression(ast.a[n]) & expression(ast.b[n]);
+                const std::string_view op = ast.text[n];
+                if (op == "==" || op == "!=" || op == "<" || op == ">" || op == "<=" || op == ">=") {
+                    return BoolType;
+                }
+                return both & (op == "+" ? IntType | StringType : IntType);
+            }
+            case NodeKind::IF: {
+                expression(ast.a[n]);
+                const TypeSet consequence = block(ast.b[n]);
+                return ast.c[n] == NoNode ? IntType : consequence | block(ast.c[n]);
+            }
+            case NodeKind::WHILE:
+                expression(ast.a[n]);
+                block(ast.b[n]);
+                return IntType;
+            default:
+                return AnyType;
+        }
+    }
+
+    // a call by a function's own name passes its arguments to it, and gets
+    // what it returns, unless the name may since hold another function
+    TypeSet call(const NodeIndex n) {
+        const NodeIndex callee = ast.a[n];
+        const NodeIndex decl =
+            callee != NoNode && ast.kinds[callee] == NodeKind::IDENT ? lookup(ast.a[callee]) : NoNode;
+        const NodeIndex fn = declaredFunction(decl);
+        if (fn == NoNode) {
+            expression(callee);
+        } else {
+            types.of[callee] = FuncType;
+            types.expressions++;
+            types.proven++;
+        }
+        for (uint32_t i = 0; i < ast.c[n]; i++) {
+            const TypeSet arg = widened(expression(ast.listAt(ast.b[n], i)));
+            if (fn != NoNode && i < ast.b[fn]) {
+                grow(passed[ast.listAt(ast.a[fn], i)], arg);
+            }
+        }
+        if (fn == NoNode || reassigned[decl]) {
+            return widened(AnyType);
+        }
+        // the wrong number of arguments always fails
+        return ast.c[n] == ast.b[fn] ? returns[fn] & annotated(ast.annotations[fn]) : 0;
+    }
+};
+
+} // namespace
+
+Types inferTypes(const FlatAst &ast) {
+    Types types;
+    Inference inference(ast, types);
+    do {
+        inference.changed = false;
+        inference.program();
+    } while (inference.changed);
+    return types;
+}
@@ -0,0 +1,100 @@
+#include <algorithm>
+
+#include "h/workPool.h"
+
+// the pool and index of the worker running on this thread, if any
+static thread_local const WorkPool *currentPool = nullptr;
+static thread_local unsigned currentWorker = 0;
+
+WorkPool::WorkPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        this->threads.emplace_back([this, i] { run(i); });
+    }
+}
+
+WorkPool::~WorkPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+}
+
+void WorkPool::submit(Task task) {
+    const unsigned target = currentPool == this ? currentWorker : next++ % workers.size();
+    // counted before it's pushed, so queued never drops below what the
+    // deques hold. a worker woken early only finds it a moment later.
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        pending++;
+        queued++;
+    }
+    wake.notify_one();
+    std::lock_guard<std::mutex> guard(workers[target]->lock);
+    workers[target]->tasks.push_back(std::move(task));
+}
+
+void WorkPool::wait() {
+    std::unique_lock<std::mutex> lock(stateLock);
+    idle.wait(lock, [this] { return pending == 0; });
+}
+
+// the newest of self's own tasks, or else the oldest of the first other
+// worker's that has any
+bool WorkPool::take(const unsigned self, Task &task) {
+    for (size_t i = 0; i < workers.size(); i++) {
+        const size_t victim = (self + i) % workers.size();
+        Worker &w = *workers[victim];
+        std::lock_guard<std::mutex> guard(w.lock);
+        if (w.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+        } else {
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+            stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+    return false;
+}
+
+void WorkPool::run(const unsigned self) {
+    currentPool = this;
+    currentWorker = self;
+    for (;;) {
+        Task task;
+        if (take(self, task)) {
+            {
+                std::lock_guard<std::mutex> guard(stateLock);
+                queued--;
+            }
+            task();
+            std::lock_guard<std::mutex> guard(stateLock);
+            if (--pending == 0) {
+                idle.notify_all();
+            }
+            continue;
+        }
+        // submit counts a task under the lock before notifying, so checking
+        // queued here can't miss one
+        std::unique_lock<std::mutex> lock(stateLock);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
@@ -1,9 +1,75 @@
 #include <cassert>
 #include <iostream>
 #include "../src/h/ast.h"
+#include "../src/h/flatAst.h"
+#include "../src/h/parser.h"
 
 struct astTests {
     static void test_ast() {
-        std::cout << "Unimplemented: AST tests \n";
+        testArena();
+        testFlatAst();
+    }
+
+    static void testArena() {
+        Arena arena;
+        auto *a = arena.make<IntLiteral>();
+        a->value = 7;
+        auto *d = arena.allocateArray<double>(3);
+        assert(reinterpret_cast<uintptr_t>(d) % alignof(double) == 0);
+
+        // bigger than a block, gets one of its own
+        char *big = arena.allocateArray<char>(Arena::blockSize * 2);
+        big[Arena::blockSize * 2 - 1] = 1;
+        assert(arena.bytesReserved() > Arena::blockSize * 2);
+
+        NodeList<Expression> list;
+        for (int i = 0; i < 100; i++) {
+            auto *n = arena.make<IntLiteral>();
+            n->value = i;
+            list.push_back(arena, n);
+        }
+        assert(list.size() == 100);
+        int i = 0;
+        for (Expression *e : list) {
+            assert(dynamic_cast<IntLiteral *>(e)->value == i++);
+        }
+        assert(a->value == 7);
+
+        Arena moved = std::move(arena);
+        assert(arena.bytesUsed() == 0);
+        assert(moved.bytesUsed() > 0);
+
+        std::cout << "✓ testArena passed\n";
+    }
+
+    static void testFlatAst() {
+        std::string src = "var x = 5; var f = func(a, b) { return -a + b * x; }; "
+                          "if (x < 10) { f(x, \"s\"); } else { [1, true][0]; }; while (!false) { x; break; }; &x = 1;";
+        const lex l(src);
+        parser p(l);
+        std::unique_ptr<Program> program = p.parseProgram();
+
+        const FlatAst flat = FlatAst::fromProgram(*program);
+        assert(flat.statements.size() == program->statements.size());
+        assert(flat.toString() == program->toString());
+        for (size_t i = 0; i < flat.statements.size(); i++) {
+            assert(flat.toString(flat.statements[i]) == program->statements[i]->toString());
+        }
+
+        const NodeIndex decl = flat.statements[0];
+        assert(flat.kinds[decl] == NodeKind::DECLARE);
+        assert(flat.kinds[flat.a[decl]] == NodeKind::IDENT);
+        assert(flat.text[flat.a[decl]] == "x");
+        assert(flat.kinds[flat.b[decl]] == NodeKind::INT);
+        assert(flat.b[flat.b[decl]] == NoNode);
+        assert(static_cast<int>(flat.a[flat.b[decl]]) == 5);
+
+        const NodeIndex fn = flat.b[flat.statements[1]];
+        assert(flat.kinds[fn] == NodeKind::FUNC);
+        assert(flat.b[fn] == 2);
+        assert(flat.text[flat.listAt(flat.a[fn], 1)] == "b");
+        assert(flat.kinds[flat.c[fn]] == NodeKind::BLOCK);
+
+        std::cout << "✓ testFlatAst passed\n";
     }
 };
\ No newline at end of file
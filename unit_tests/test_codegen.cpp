@@ -0,0 +1,458 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <set>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include "../src/h/lex.h"
+#include "../src/h/parser.h"
+#include "../src/codegen/codegen.h"
+#include "../src/codegen/jit.h"
+
+struct codegenTests {
+    static void test_codegen() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+
+        testArithmetic();
+        testComparisons();
+        testDeclarations();
+        testIf();
+        testWhile();
+        testLoopShape();
+        testScopes();
+        testFunctions();
+        testPromotion();
+        testOptimize();
+        testJit();
+        testParallel();
+        testErrors();
+    }
+
+    static std::unique_ptr<llvm::Module> compile(const std::string &text) {
+        std::string src = text;
+        lex l(src);
+        parser p(l.tokenizeAll());
+        std::unique_ptr<Program> program = p.parseProgram();
+        assert(p.Errors().empty());
+
+        std::vector<std::string> errors;
+        std::unique_ptr<llvm::Module> module = compileProgram(*program, errors);
+        assert(module != nullptr && errors.empty());
+        return module;
+    }
+
+    // parses, compiles and jits text, returning what banter_main returns
+    static int64_t run(const std::string &text) {
+        return runModule(compile(text));
+    }
+
+    static int64_t runModule(std::unique_ptr<llvm::Module> module) {
+
+        std::string err;
+        std::unique_ptr<llvm::ExecutionEngine> engine(
+            llvm::EngineBuilder(std::move(module)).setErrorStr(&err).setEngineKind(llvm::EngineKind::JIT).create());
+        assert(engine != nullptr);
+        auto *entry = reinterpret_cast<int64_t (*)()>(engine->getFunctionAddress(entryName));
+        assert(entry != nullptr);
+        return entry();
+    }
+
+    static std::vector<std::string> compileErrors(const std::string &text) {
+        std::string src = text;
+        lex l(src);
+        parser p(l);
+        std::unique_ptr<Program> program = p.parseProgram();
+        std::vector<std::string> errors;
+        assert(compileProgram(*program, errors) == nullptr);
+        return errors;
+    }
+
+    static void testArithmetic() {
+        assert(run("return 5;") == 5);
+        assert(run("return 1 + 2 * 3;") == 7);
+        assert(run("return (1 + 2) * 3;") == 9);
+        assert(run("return 7 - 10;") == -3);
+        assert(run("return 17 / 5;") == 3);
+        assert(run("return 17 % 5;") == 2);
+        assert(run("return -5 + 10;") == 5);
+        assert(run("return --5;") == 5);
+        assert(run("return 2147483647 + 1;") == 2147483648);
+        // no return falls off the end with 0
+        assert(run("1 + 1;") == 0);
+        assert(run("var x = 17; var y = -5; return x / y * 10 + x % y;") == -28);
+        // INT64_MIN by -1 wraps around, as in the interpreter
+        const std::string min = "var m = 1073741824 * 1073741824 * 8; ";
+        assert(run(min + "var f = func(a, b) { return a / b; }; return f(m, 0 - 1);") == INT64_MIN);
+        assert(run(min + "var f = func(a, b) { return a % b; }; return f(m, 0 - 1);") == 0);
+        assert(run(min + "return m / -1 + m % -1;") == INT64_MIN);
+        assert(run("var f = func(a, b) { return a / b * 10 + a % b; }; return f(7, 0 - 1);") == -70);
+        // a divisor that turns out to be 0 traps, in a child, where it can
+        const pid_t child = fork();
+        assert(child >= 0);
+        if (child == 0) {
+            run("var x = 5; var y = x - 5; return x / y;");
+            _exit(0);
+        }
+        int status = 0;
+        assert(waitpid(child, &status, 0) == child);
+        assert(WIFSIGNALED(status));
+
+        std::cout << "✓ testArithmetic passed\n";
+    }
+
+    static void testComparisons() {
+        assert(run("return true;") == 1);
+        assert(run("return false;") == 0);
+        assert(run("return 1 < 2;") == 1);
+        assert(run("return 1 > 2;") == 0);
+        assert(run("return 2 <= 2;") == 1);
+        assert(run("return 3 >= 4;") == 0);
+        assert(run("return 3 == 3;") == 1);
+        assert(run("return 3 != 3;") == 0);
+        assert(run("return (1 < 2) == true;") == 1);
+        assert(run("return true != false;") == 1);
+        assert(run("return !true;") == 0);
+        assert(run("return !0;") == 1);
+        assert(run("return !5;") == 0);
+
+        std::cout << "✓ testComparisons passed\n";
+    }
+
+    static void testDeclarations() {
+        assert(run("var x = 5; var y = x * 2; return x + y;") == 15);
+        assert(run("var a = 3; var b = a < 4; return b;") == 1);
+        // redeclaring rebinds the name
+        assert(run("var x = 1; var x = x + 1; return x;") == 2);
+        // the first return wins
+        assert(run("return 1; return 2;") == 1);
+        assert(run("var x: int = 5; var b: bool = x < 6; var f = func(a: int): int { return a * 2; }; "
+                   "if (b) { return f(x); } return 0;") == 10);
+
+        std::cout << "✓ testDeclarations passed\n";
+    }
+
+    static void testIf() {
+        assert(run("if (1 < 2) { return 10; } else { return 20; }") == 10);
+        assert(run("if (false) { return 10; } return 20;") == 20);
+        // ints are true unless 0
+        assert(run("if (0) { return 1; } else { return 2; }") == 2);
+        // if as an expression
+        assert(run("var x = if (3 > 2) { 5 } else { 6 }; return x * 2;") == 10);
+        assert(run("var c = 0; var x = if (c) { 1 == 1 } else { 1 == 2 }; return x;") == 0);
+        assert(run("var x = if (true) { 5 }; return x;") == 0);
+        // rebinding in a branch merges at the end of the if
+        assert(run("var x = 1; var c = x; if (c == 1) { &x = 2; } return x;") == 2);
+        assert(run("var x = 1; var c = x; if (c == 2) { &x = 2; } else { &x = 3; } return x;") == 3);
+        assert(run("var x = 1; var c = x; if (c == 2) { &x = 2; } return x;") == 1);
+        // names declared in a branch don't outlive it
+        assert(run("var x = 1; if (true) { var y = 5; &x = y; } return x;") == 5);
+        // nested
+        assert(run("var a = 5; var r = if (a > 3) { if (a > 4) { 2 } else { 1 } } else { 0 }; return r;") == 2);
+
+        std::cout << "✓ testIf passed\n";
+    }
+
+    static void testWhile() {
+        assert(run("var i = 0; var sum = 0; while (i < 10) { &i = i + 1; &sum = sum + i; } return sum;") == 55);
+        assert(run("var i = 0; while (i < 100) { &i = i + 1; if (i == 7) { break; } } return i;") == 7);
+        // a break taken with different bindings than the header exit
+        assert(run("var i = 0; var r = 0; while (true) { &i = i + 1; if (i * i > 50) { &r = i; break; } } "
+                   "return r * 100 + i;") == 808);
+        // nested loops, break only leaves the inner one
+        assert(run("var n = 0; var i = 0; while (i < 4) { var j = 0; while (true) { &j = j + 1; "
+                   "if (j > i) { break; } &n = n + 1; } &i = i + 1; } return n;") == 6);
+        assert(run("var i = 0; while (i < 5) { if (i == 3) { return i * 10; } &i = i + 1; } return 0;") == 30);
+        assert(run("var i = 10; while (i < 5) { &i = i + 1; } return i;") == 10);
+
+        std::cout << "✓ testWhile passed\n";
+    }
+
+    // loop simplify form is what licm, indvars and the vectorizer start from
+    static void testLoopShape() {
+        std::unique_ptr<llvm::Module> module =
+            compile("var i = 0; var sum = 0; while (i < 10) { if (i == 8) { break; } &i = i + 1; &sum = sum + i; } "
+                    "return sum;");
+        llvm::Function *fn = module->getFunction(entryName);
+        llvm::DominatorTree dt(*fn);
+        llvm::LoopInfo li(dt);
+        assert(li.getTopLevelLoops().size() == 1);
+        llvm::Loop *loop = li.getTopLevelLoops().front();
+        assert(loop->isLoopSimplifyForm());
+        assert(loop->getHeader()->getName() == "while.cond");
+        assert(loop->getLoopLatch()->getName() == "while.latch");
+        assert(loop->getHeader()->getTerminator()->getSuccessor(1)->getName() == "while.exit");
+        assert(loop->getLoopPreheader() == &fn->getEntryBlock());
+        // only i and sum are carried around the loop
+        assert(std::distance(loop->getHeader()->phis().begin(), loop->getHeader()->phis().end()) == 2);
+
+        std::cout << "✓ testLoopShape passed\n";
+    }
+
+    static void testScopes() {
+        // a declaration in a block shadows the outer name until the block ends
+        assert(run("var x = 1; if (true) { var x = 2; &x = x + 1; } return x;") == 1);
+        assert(run("var x = 1; if (true) { var x = x + 10; return x; } return 0;") == 11);
+        // assignment goes to the innermost x in scope
+        assert(run("var x = 1; if (true) { &x = 5; } return x;") == 5);
+        assert(run("var x = 1; if (true) { var x = 2; if (true) { &x = 7; } &x = x * 2; } return x;") == 1);
+        // a shadowing declaration can change the type
+        assert(run("var x = 1; if (true) { var x = true; if (x) { var x = 10; return x; } } return 0;") == 10);
+        // each loop iteration starts the body's scope over
+        assert(run("var i = 0; var s = 0; while (i < 3) { var s = 100; &s = s + i; &i = i + 1; } return s;") == 0);
+        assert(run("var i = 0; var s = 0; while (i < 3) { var t = i * 2; &s = s + t; &i = i + 1; } return s;") == 6);
+        // redeclaring in the same scope shadows too
+        assert(run("var x = 1; var x = x + 1; return x;") == 2);
+
+        std::cout << "✓ testScopes passed\n";
+    }
+
+    static void testFunctions() {
+        assert(run("var add = func(a, b) { return a + b; }; return add(2, 3);") == 5);
+        assert(run("var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; "
+                   "return fib(20);") == 6765);
+        // parameters shadow, and reassigning one doesn't touch the caller
+        assert(run("var n = 5; var dec = func(n) { &n = n - 1; return n; }; var m = dec(n); return n * 10 + m;") ==
+               54);
+        // bools are passed and returned as ints
+        assert(run("var lt = func(a, b) { return a < b; }; return lt(1, 2) + lt(2, 1);") == 1);
+        assert(run("var none = func() { 1; }; return none();") == 0);
+
+        std::cout << "✓ testFunctions passed\n";
+    }
+
+    static size_t countInstructions(llvm::Function &fn, const unsigned opcode) {
+        size_t n = 0;
+        for (llvm::BasicBlock &bb : fn) {
+            for (llvm::Instruction &inst : bb) {
+                n += inst.getOpcode() == opcode;
+            }
+        }
+        return n;
+    }
+
+    // every local ends up in an ssa register, none in memory
+    static void testPromotion() {
+        const std::string text = "var step = func(x) { var y = x * 2; &y = y + 1; return y; }; "
+                                 "var i = 0; var s = 0; while (i < 10) { var t = step(i); &s = s + t; &i = i + 1; } "
+                                 "return s;";
+        std::unique_ptr<llvm::Module> module = compile(text);
+        for (llvm::Function &fn : *module) {
+            assert(countInstructions(fn, llvm::Instruction::Alloca) == 0);
+            assert(countInstructions(fn, llvm::Instruction::Load) == 0);
+            assert(countInstructions(fn, llvm::Instruction::Store) == 0);
+        }
+
+        std::string src = text;
+        lex l(src);
+        parser p(l);
+        std::unique_ptr<Program> program = p.parseProgram();
+        std::vector<std::string> errors;
+        module = compileProgram(*program, errors, {.promoteLocals = false});
+        assert(countInstructions(*module->getFunction(entryName), llvm::Instruction::Alloca) == 3);
+        assert(run(text) == 100);
+
+        std::cout << "✓ testPromotion passed\n";
+    }
+
+    static void testOptimize() {
+        const std::string loop = "var f = func(n) { var i = 0; var s = 0; while (i < n) { &s = s + i * i; "
+                                 "&i = i + 1; } return s; }; return f(1000);";
+        for (const OptLevel level : {OptLevel::O0, OptLevel::O1, OptLevel::O2, OptLevel::O3}) {
+            std::unique_ptr<llvm::Module> module = compile(loop);
+            optimizeModule(*module, {.level = level});
+            assert(!llvm::verifyModule(*module, &llvm::errs()));
+            assert(runModule(std::move(module)) == 332833500);
+            // nothing the optimizer may assume away for INT64_MIN / -1
+            module = compile("var m = 1073741824 * 1073741824 * 8; var f = func(a, b) { return a / b + a % b; }; "
+                             "return f(m, 0 - 1);");
+            optimizeModule(*module, {.level = level});
+            assert(runModule(std::move(module)) == INT64_MIN);
+        }
+
+        // a loop with a constant trip count folds away entirely
+        std::unique_ptr<llvm::Module> module =
+            compile("var i = 0; var sum = 0; while (i < 10) { &sum = sum + i; &i = i + 1; } return sum;");
+        optimizeModule(*module, {.level = OptLevel::O2});
+        llvm::Function *main = module->getFunction(entryName);
+        assert(main->size() == 1);
+        auto *ret = llvm::dyn_cast<llvm::ReturnInst>(main->getEntryBlock().getTerminator());
+        assert(ret != nullptr);
+        auto *folded = llvm::dyn_cast<llvm::ConstantInt>(ret->getReturnValue());
+        assert(folded != nullptr && folded->getSExtValue() == 45);
+
+        // and O0 leaves it alone
+        module = compile("var i = 0; var sum = 0; while (i < 10) { &sum = sum + i; &i = i + 1; } return sum;");
+        const size_t blocks = module->getFunction(entryName)->size();
+        optimizeModule(*module, {.level = OptLevel::O0});
+        assert(module->getFunction(entryName)->size() == blocks);
+
+        std::string timings;
+        llvm::raw_string_ostream os(timings);
+        module = compile(loop);
+        optimizeModule(*module, {.level = OptLevel::O2, .timePasses = &os});
+        assert(os.str().find("Pass execution timing report") != std::string::npos);
+        assert(os.str().find("InstCombinePass") != std::string::npos);
+
+        std::cout << "✓ testOptimize passed\n";
+    }
+
+    // only what banter_main reaches gets compiled, and calls between the
+    // lazily compiled functions, recursion included, still work
+    static void testJit() {
+        std::string src = "var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; "
+                          "var twice = func(x) { return fib(x) * 2; }; "
+                          "var unused = func(x) { return x - 1; }; "
+                          "var alsoUnused = func(x) { return unused(x) + 1; }; "
+                          "return twice(10);";
+        lex l(src);
+        parser p(l);
+        std::unique_ptr<Program> program = p.parseProgram();
+        std::vector<std::string> errors;
+        auto context = std::make_unique<llvm::LLVMContext>();
+        std::unique_ptr<llvm::Module> module = compileProgram(*program, *context, errors);
+        assert(module != nullptr);
+
+        std::unique_ptr<Jit> jit = Jit::create(OptLevel::O2, errors);
+        assert(jit != nullptr);
+        assert(jit->add(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)), errors));
+        assert(jit->stats().functions == 5);
+        assert(jit->stats().functionsCompiled == 0);
+
+        assert(jit->run(errors) == 110);
+        assert(errors.empty());
+        assert(jit->stats().functionsCompiled == 3);
+        // already compiled, so a second run compiles nothing more
+        assert(jit->run(errors) == 110);
+        assert(jit->stats().functionsCompiled == 3);
+
+        std::cout << "✓ testJit passed\n";
+    }
+
+    // each top-level function lands in one of the modules, declared in every
+    // other that calls it, and together they jit to what the program returns
+    static void testParallel() {
+        std::string src = "var f = func(a) { return a + 1; }; "
+                          "var k = func(a) { var g = func(b) { return f(b) * 2; }; return g(a); }; "
+                          "var f = func(a) { return k(a) + 1000; }; "
+                          "var h = func() { var g = func(c) { return c + 100; }; return g(f(1)); }; "
+                          "var x = 5; return h() + x;";
+        lex l(src);
+        parser p(l);
+        std::unique_ptr<Program> program = p.parseProgram();
+        std::vector<std::string> errors;
+        std::vector<llvm::orc::ThreadSafeModule> modules = compileProgramParallel(*program, 2, errors);
+        assert(errors.empty());
+        // banter_main's, then a slice of one function each
+        assert(modules.size() == 5);
+        std::set<std::string> defined;
+        for (llvm::orc::ThreadSafeModule &module : modules) {
+            module.withModuleDo([&](llvm::Module &m) {
+                for (const llvm::Function &fn : m) {
+                    if (!fn.isDeclaration()) {
+                        assert(defined.insert(fn.getName().str()).second);
+                    }
+                }
+            });
+        }
+        assert(defined == std::set<std::string>({entryName, "f", "k", "k.g", "f.1", "h", "h.g"}));
+
+        std::unique_ptr<Jit> jit = Jit::create(OptLevel::O2, errors);
+        assert(jit != nullptr);
+        for (llvm::orc::ThreadSafeModule &module : modules) {
+            assert(jit->add(std::move(module), errors));
+        }
+        assert(jit->run(errors) == 1109);
+        assert(errors.empty());
+
+        // a job only sees its slice, whatever it trips over is reported the
+        // way the whole program compiled at once reports it
+        for (const std::string text : {"var f = func() { return g(); }; var g = func() { return 1; }; return f();",
+                                        "var x = 5; var f = func() { return x; }; return f();",
+                                        "var f = func(a) { return a; }; var f = 5; var g = func() { return f(1); };"}) {
+            std::string copy = text;
+            lex bad(copy);
+            parser q(bad);
+            std::unique_ptr<Program> invalid = q.parseProgram();
+            errors.clear();
+            assert(compileProgramParallel(*invalid, 4, errors).empty());
+            assert(errors == compileErrors(text));
+        }
+
+        std::cout << "✓ testParallel passed\n";
+    }
+
+    static void testErrors() {
+        std::vector<std::string> errors = compileErrors("return y;");
+        assert(errors.size() == 1);
+        assert(errors[0].find("unknown identifier=y") != std::string::npos);
+
+        errors = compileErrors("return 1 + true;");
+        assert(errors.size() == 1);
+        assert(errors[0].find("type mismatch: int + bool") != std::string::npos);
+
+        errors = compileErrors("return true < false;");
+        assert(errors[0].find("invalid operands for <: bool") != std::string::npos);
+
+        errors = compileErrors("return -true;");
+        assert(errors[0].find("invalid operand for -: bool") != std::string::npos);
+
+        errors = compileErrors("var x = 5; return x / 0;");
+        assert(errors[0].find("division by zero") != std::string::npos);
+        errors = compileErrors("return 5 % (2 - 2);");
+        assert(errors[0].find("division by zero") != std::string::npos);
+
+        errors = compileErrors("break;");
+        assert(errors[0].find("break outside of a loop") != std::string::npos);
+
+        errors = compileErrors("var x = 1; &x = true;");
+        assert(errors[0].find("cannot assign bool to int x") != std::string::npos);
+
+        errors = compileErrors("if (true) { var y = 1; } return y;");
+        assert(errors[0].find("unknown identifier=y") != std::string::npos);
+
+        errors = compileErrors("var x = 1; var f = func() { return x; }; return f();");
+        assert(errors[0].find("cannot capture x") != std::string::npos);
+
+        errors = compileErrors("var f = func(a) { return a; }; return f(1, 2);");
+        assert(errors[0].find("f takes 1 arguments, got 2") != std::string::npos);
+
+        errors = compileErrors("var f = func(a) { return a; }; return f + 1;");
+        assert(errors[0].find("function f used as a value") != std::string::npos);
+
+        // a function literal anywhere but a declaration would be a value
+        for (const std::string text : {"var f = func(g) { return 1; }; return f(func() { return 2; });",
+                                       "return func() { return 1; };", "var x = 1; &x = func() {};",
+                                       "func() {} + 2;"}) {
+            errors = compileErrors(text);
+            assert(errors.size() == 1);
+            assert(errors[0].find("function values not supported by codegen yet") != std::string::npos);
+        }
+
+        // annotations are checked as it compiles
+        errors = compileErrors("var x: int = true;");
+        assert(errors[0].find("cannot declare bool as int x") != std::string::npos);
+
+        errors = compileErrors("var f: int = func() { return 1; };");
+        assert(errors[0].find("cannot declare func as int f") != std::string::npos);
+
+        errors = compileErrors("var f = func(s: string) { return 1; }; return f(1);");
+        assert(errors[0].find("string parameters not supported by codegen yet") != std::string::npos);
+
+        errors = compileErrors("var f = func(): array { return 1; }; return f();");
+        assert(errors[0].find("array results not supported by codegen yet") != std::string::npos);
+
+        // a failed compile leaves nothing behind for the next one
+        assert(run("return 4;") == 4);
+
+        std::cout << "✓ testErrors passed\n";
+    }
+};
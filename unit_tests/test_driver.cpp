@@ -0,0 +1,488 @@
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <unistd.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Path.h>
+
+#include "../src/codegen/jit.h"
+#include "../src/h/driver.h"
+#include "../src/h/lex.h"
+#include "../src/h/parser.h"
+#include "../src/h/workPool.h"
+
+struct driverTests {
+    static void test_driver() {
+        testParseArgs();
+        testBuildModule();
+        testWorkPool();
+        testParseFiles();
+        testTargetMachine();
+        testObjectAndExecutable();
+        testCacheKeys();
+        testObjectCache();
+        testJitCache();
+        testJitCacheUncalled();
+    }
+
+    static void testParseArgs() {
+        std::vector<std::string> errors;
+        const char *defaults[] = {"banter", "a.bt"};
+        DriverOptions options = DriverOptions::parse(2, defaults, errors);
+        assert(errors.empty());
+        assert(options.inputs == std::vector<std::string>{"a.bt"});
+        assert(options.optLevel == OptLevel::O2);
+        assert(!options.dumpIrBefore && !options.dumpIrAfter && !options.timePasses);
+
+        const char *all[] = {"banter", "-O3", "a.bt", "-dump-ir-before", "-dump-ir-after", "-time-passes", "-", "-O0"};
+        options = DriverOptions::parse(8, all, errors);
+        assert(errors.empty());
+        assert((options.inputs == std::vector<std::string>{"a.bt", "-"}));
+        // the last level given wins
+        assert(options.optLevel == OptLevel::O0);
+        assert(options.dumpIrBefore && options.dumpIrAfter && options.timePasses);
+
+        const char *bad[] = {"banter", "-O9"};
+        DriverOptions::parse(2, bad, errors);
+        assert(errors.size() == 2);
+        assert(errors[0] == "unknown option -O9");
+        assert(errors[1] == "no input files");
+        errors.clear();
+
+        const char *run[] = {"banter", "run", "-O1", "-stats", "a.bt"};
+        options = DriverOptions::parse(5, run, errors);
+        assert(errors.empty());
+        assert(options.mode == DriverMode::RUN);
+        assert(options.optLevel == OptLevel::O1 && options.stats);
+        assert(options.inputs == std::vector<std::string>{"a.bt"});
+        assert(options.engine == RunEngine::JIT);
+
+        // -interp and -vm only mean something to run, the last one wins
+        const char *interp[] = {"banter", "run", "-vm", "-interp", "a.bt"};
+        assert(DriverOptions::parse(5, interp, errors).engine == RunEngine::TREE && errors.empty());
+        const char *vm[] = {"banter", "run", "-interp", "-vm", "a.bt"};
+        assert(DriverOptions::parse(5, vm, errors).engine == RunEngine::BYTECODE && errors.empty());
+        const char *tiered[] = {"banter", "run", "-vm", "-tiered", "a.bt"};
+        assert(DriverOptions::parse(5, tiered, errors).engine == RunEngine::TIERED && errors.empty());
+        const char *compileInterp[] = {"banter", "-interp", "a.bt"};
+        DriverOptions::parse(3, compileInterp, errors);
+        assert(errors.size() == 1 && errors[0] == "unknown option -interp");
+        errors.clear();
+        // run optimizes lazily, inside the jit, out of sight
+        const char *runDumps[] = {"banter", "run", "-dump-ir-before", "-dump-ir-after", "-time-passes", "a.bt"};
+        options = DriverOptions::parse(6, runDumps, errors);
+        assert(errors == (std::vector<std::string>{"unknown option -dump-ir-after", "unknown option -time-passes"}));
+        assert(options.dumpIrBefore);
+        errors.clear();
+
+        const char *threads[] = {"banter", "run", "-threads=0", "a.bt"};
+        options = DriverOptions::parse(4, threads, errors);
+        assert(errors.empty() && options.threads == 0);
+        assert(DriverOptions::parse(2, defaults, errors).threads == 1);
+        const char *badThreads[] = {"banter", "-threads=many", "a.bt"};
+        DriverOptions::parse(3, badThreads, errors);
+        assert(errors.size() == 1 && errors[0] == "-threads needs a number, got -threads=many");
+        errors.clear();
+
+        const char *runTwo[] = {"banter", "run", "a.bt", "b.bt"};
+        DriverOptions::parse(4, runTwo, errors);
+        assert(errors.size() == 1 && errors[0] == "run takes a single file");
+        errors.clear();
+
+        // compiles have cache stats to show
+        const char *compileStats[] = {"banter", "-stats", "-cache-dir=/tmp/c", "a.bt"};
+        options = DriverOptions::parse(4, compileStats, errors);
+        assert(errors.empty());
+        assert(options.mode == DriverMode::COMPILE && options.stats && options.cacheDir == "/tmp/c");
+
+        const char *object[] = {"banter", "-c", "-march=native", "a.bt", "b.bt"};
+        options = DriverOptions::parse(5, object, errors);
+        assert(errors.empty());
+        assert(options.emit == EmitKind::OBJECT && options.output.empty() && options.target.cpu == "native");
+
+        // -o alone means an executable
+        const char *executable[] = {"banter", "-mcpu=x86-64", "-o", "a.out", "a.bt"};
+        options = DriverOptions::parse(5, executable, errors);
+        assert(errors.empty());
+        assert(options.emit == EmitKind::EXECUTABLE && options.output == "a.out" && options.target.cpu == "x86-64");
+
+        const char *twoOutputs[] = {"banter", "-c", "-o", "a.o", "a.bt", "b.bt"};
+        DriverOptions::parse(6, twoOutputs, errors);
+        assert(errors.size() == 1 && errors[0] == "-o with more than one input");
+        errors.clear();
+
+        const char *stdinObject[] = {"banter", "-c", "-"};
+        DriverOptions::parse(3, stdinObject, errors);
+        assert(errors.size() == 1 && errors[0] == "-c from stdin needs -o");
+        errors.clear();
+
+        std::cout << "✓ testParseArgs passed\n";
+    }
+
+    static std::string writeTemp(const std::string &text) {
+        char path[] = "/tmp/banter_driver_XXXXXX";
+        const int fd = mkstemp(path);
+        assert(fd >= 0);
+        assert(write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+        close(fd);
+        return path;
+    }
+
+    static void testBuildModule() {
+        const std::string good = writeTemp("var sq = func(x) { return x * x; }; return sq(7);");
+        DriverOptions options;
+        options.optLevel = OptLevel::O2;
+        std::vector<std::string> errors;
+        std::unique_ptr<llvm::Module> module = buildModule(good, options, errors);
+        assert(module != nullptr && errors.empty());
+        assert(module->getSourceFileName() == good);
+        // sq was inlined into banter_main and folded
+        auto *ret = llvm::dyn_cast<llvm::ReturnInst>(module->getFunction(entryName)->getEntryBlock().getTerminator());
+        assert(ret != nullptr && llvm::isa<llvm::ConstantInt>(ret->getReturnValue()));
+        std::remove(good.c_str());
+
+        // lex, parse and codegen problems all come back as errors
+        const std::string bad = writeTemp("var x = 5 $; return y;");
+        module = buildModule(bad, options, errors);
+        assert(module == nullptr);
+        assert(!errors.empty());
+        errors.clear();
+        std::remove(bad.c_str());
+
+        const std::string unknown = writeTemp("return y;");
+        assert(buildModule(unknown, options, errors) == nullptr);
+        assert(errors.size() == 1 && errors[0].find("unknown identifier=y") != std::string::npos);
+        errors.clear();
+        std::remove(unknown.c_str());
+
+        assert(buildModule("/nonexistent/file.bt", options, errors) == nullptr);
+        assert(errors.size() == 1 && errors[0].find("unable to open") != std::string::npos);
+
+        std::cout << "✓ testBuildModule passed\n";
+    }
+
+    static void testWorkPool() {
+        WorkPool pool(4);
+        assert(pool.size() == 4);
+        std::atomic<int> ran{0};
+        // tasks queue more from inside, onto their own worker's deque
+        for (int i = 0; i < 100; i++) {
+            pool.submit([&] {
+                ran++;
+                for (int j = 0; j < 10; j++) {
+                    pool.submit([&] { ran++; });
+                }
+            });
+        }
+        pool.wait();
+        assert(ran == 1100);
+        // the pool is reusable after a wait, and runs what's left on the way out
+        {
+            WorkPool once(2);
+            for (int i = 0; i < 50; i++) {
+                once.submit([&] { ran++; });
+            }
+        }
+        assert(ran == 1150);
+
+        // one worker's deque loaded with slow tasks drains onto the rest
+        WorkPool stealing(2);
+        stealing.submit([&] {
+            for (int i = 0; i < 8; i++) {
+                stealing.submit([] { usleep(2000); });
+            }
+        });
+        stealing.wait();
+        assert(stealing.steals() > 0);
+
+        std::cout << "✓ testWorkPool passed\n";
+    }
+
+    static void testParseFiles() {
+        std::vector<std::string> paths;
+        for (int i = 0; i < 20; i++) {
+            // every third file has a lex error and a parse error
+            paths.push_back(writeTemp(i % 3 == 0 ? "var x = 5 $; var = " + std::to_string(i) + ";"
+                                                 : "var f = func(a) { return a * " + std::to_string(i) + "; };"));
+        }
+        paths.emplace_back("/nonexistent/file.bt");
+
+        std::vector<ParsedFile> files = parseFiles(paths, 4);
+        assert(files.size() == paths.size());
+        // the same errors, in the same order, as parsing one file at a time
+        for (size_t i = 0; i < paths.size(); i++) {
+            std::vector<std::string> errors;
+            std::unique_ptr<Program> program = parseFile(paths[i], errors);
+            assert(files[i].errors == errors);
+            assert((files[i].program == nullptr) == (program == nullptr));
+            if (program != nullptr) {
+                assert(files[i].program->toString() == program->toString());
+            }
+        }
+        assert(files[3].program == nullptr && files[3].errors.size() >= 2);
+        assert(files[4].program != nullptr && files[4].errors.empty());
+        assert(files.back().errors.size() == 1 && files.back().errors[0].find("unable to open") != std::string::npos);
+        for (size_t i = 0; i + 1 < paths.size(); i++) {
+            std::remove(paths[i].c_str());
+        }
+
+        std::cout << "✓ testParseFiles passed\n";
+    }
+
+    static void testTargetMachine() {
+        std::vector<std::string> errors;
+        std::unique_ptr<llvm::TargetMachine> target = createTargetMachine({}, OptLevel::O2, errors);
+        assert(target != nullptr && errors.empty());
+        assert(target->getTargetTriple().str() == llvm::sys::getDefaultTargetTriple());
+
+        target = createTargetMachine({.cpu = "native"}, OptLevel::O2, errors);
+        assert(target != nullptr);
+        assert(target->getTargetCPU() == llvm::sys::getHostCPUName());
+
+        assert(createTargetMachine({.cpu = "not-a-cpu"}, OptLevel::O2, errors) == nullptr);
+        assert(errors.size() == 1 && errors[0].find("unknown cpu not-a-cpu") != std::string::npos);
+        errors.clear();
+
+        assert(createTargetMachine({.triple = "nonsense-unknown-none"}, OptLevel::O2, errors) == nullptr);
+        assert(errors.size() == 1 && errors[0].find("unsupported target") != std::string::npos);
+
+        std::cout << "✓ testTargetMachine passed\n";
+    }
+
+    static std::string readAll(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    }
+
+    // runs command, returning what it printed
+    static std::string output(const std::string &command) {
+        FILE *pipe = popen(command.c_str(), "r");
+        assert(pipe != nullptr);
+        std::string out;
+        char buf[256];
+        while (fgets(buf, sizeof buf, pipe) != nullptr) {
+            out += buf;
+        }
+        assert(pclose(pipe) == 0);
+        return out;
+    }
+
+    static void testObjectAndExecutable() {
+        // main and printf are the runtime's, the program's own get moved aside
+        const std::string source = writeTemp("var main = func(x) { return x * x; }; "
+                                             "var printf = func(x) { return x + 1; }; return printf(main(7));");
+        std::vector<std::string> errors;
+        std::unique_ptr<llvm::TargetMachine> target = createTargetMachine({.cpu = "native"}, OptLevel::O2, errors);
+        assert(target != nullptr);
+
+        DriverOptions options;
+        options.emit = EmitKind::OBJECT;
+        options.output = source + ".o";
+        assert(compileFile(source, options, *target, errors));
+        assert(errors.empty());
+        assert(readAll(options.output).substr(0, 4) == "\x7f" "ELF");
+        std::remove(options.output.c_str());
+
+        options.emit = EmitKind::EXECUTABLE;
+        options.output = source + ".exe";
+        for (const OptLevel level : {OptLevel::O0, OptLevel::O2}) {
+            options.optLevel = level;
+            assert(compileFile(source, options, *target, errors));
+            assert(errors.empty());
+            assert(output(options.output) == "50\n");
+        }
+        std::remove(options.output.c_str());
+
+        // split into modules, the program's main and printf keep out of the
+        // runtime's way all the same
+        options.threads = 3;
+        assert(compileFile(source, options, *target, errors));
+        assert(errors.empty());
+        assert(output(options.output) == "50\n");
+        std::remove(options.output.c_str());
+        options.emit = EmitKind::OBJECT;
+        options.output = source + ".o";
+        assert(compileFile(source, options, *target, errors));
+        assert(errors.empty());
+        assert(readAll(options.output).substr(0, 4) == "\x7f" "ELF");
+        std::remove(options.output.c_str());
+        options.emit = EmitKind::EXECUTABLE;
+        options.output = source + ".exe";
+        options.threads = 1;
+
+        // $CC picks the linker
+        setenv("CC", "false", 1);
+        assert(!compileFile(source, options, *target, errors));
+        assert(errors.size() == 1 && errors[0].find("linking " + options.output + " failed") == 0);
+        unsetenv("CC");
+        std::remove(source.c_str());
+
+        std::cout << "✓ testObjectAndExecutable passed\n";
+    }
+
+    static void testCacheKeys() {
+        std::vector<std::string> errors;
+        std::unique_ptr<llvm::TargetMachine> baseline = createTargetMachine({}, OptLevel::O2, errors);
+        std::unique_ptr<llvm::TargetMachine> native = createTargetMachine({.cpu = "native"}, OptLevel::O2, errors);
+        const std::string key = CompileCache::key("return 1;", "object", OptLevel::O2, *baseline);
+        assert(key.size() == 64);
+        assert(key == CompileCache::key("return 1;", "object", OptLevel::O2, *baseline));
+        // anything that changes the code changes the key
+        assert(key != CompileCache::key("return 1; ", "object", OptLevel::O2, *baseline));
+        assert(key != CompileCache::key("return 1;", "executable", OptLevel::O2, *baseline));
+        assert(key != CompileCache::key("return 1;", "object", OptLevel::O1, *baseline));
+        assert(key != CompileCache::key("return 1;", "object", OptLevel::O2, *native));
+
+        std::cout << "✓ testCacheKeys passed\n";
+    }
+
+    static std::string tempDir() {
+        llvm::SmallString<128> dir;
+        assert(!llvm::sys::fs::createUniqueDirectory("banter_cache", dir));
+        return dir.str().str();
+    }
+
+    static void testObjectCache() {
+        const std::string source = writeTemp("var sq = func(x) { return x * x; }; return sq(9);");
+        const std::string dir = tempDir();
+        std::vector<std::string> errors;
+        std::unique_ptr<llvm::TargetMachine> target = createTargetMachine({}, OptLevel::O2, errors);
+        DriverOptions options;
+        options.emit = EmitKind::OBJECT;
+        options.output = source + ".o";
+
+        CompileCache cache(dir);
+        assert(compileFile(source, options, *target, errors, &cache));
+        const std::string compiled = readAll(options.output);
+        std::remove(options.output.c_str());
+        assert(cache.stats().misses == 1 && cache.stats().stores == 1);
+
+        // a fresh cache over the same directory, as the next compiler would see it
+        CompileCache again(dir);
+        assert(compileFile(source, options, *target, errors, &again));
+        assert(errors.empty());
+        assert(again.stats().hits == 1 && again.stats().misses == 0 && again.stats().stores == 0);
+        assert(readAll(options.output) == compiled);
+        std::remove(options.output.c_str());
+
+        // executables are cached apart from plain objects
+        options.emit = EmitKind::EXECUTABLE;
+        options.output = source + ".exe";
+        assert(compileFile(source, options, *target, errors, &again));
+        assert(compileFile(source, options, *target, errors, &again));
+        assert(again.stats().hits == 2 && again.stats().misses == 1);
+        assert(output(options.output) == "81\n");
+        std::remove(options.output.c_str());
+
+        std::remove(source.c_str());
+        llvm::sys::fs::remove_directories(dir);
+        std::cout << "✓ testObjectCache passed\n";
+    }
+
+    static void testJitCache() {
+        std::string text = "var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; "
+                           "var unused = func(n) { return n; }; return fib(15);";
+        const std::string dir = tempDir();
+        std::vector<std::string> errors;
+
+        CompileCache cache(dir);
+        std::unique_ptr<Jit> jit = Jit::create(OptLevel::O2, errors, &cache);
+        const std::string key = CompileCache::key(text, "jit", OptLevel::O2, jit->target());
+        assert(cache.loadObjects(key).empty());
+        cache.collectObjects(key);
+
+        lex l(text);
+        parser p(l);
+        std::unique_ptr<Program> program = p.parseProgram();
+        auto context = std::make_unique<llvm::LLVMContext>();
+        std::unique_ptr<llvm::Module> module = compileProgram(*program, *context, errors);
+        assert(jit->add(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)), errors));
+        assert(jit->run(errors) == 610);
+        // one object per function that ran
+        assert(cache.stats().stores == 2);
+        // not loadable until the run that filled it commits it
+        assert(cache.loadObjects(key).empty());
+        // and that waits for the functions that didn't run
+        assert(jit->compileAll(errors));
+        assert(cache.stats().stores == 3);
+        cache.commitObjects();
+
+        std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects = cache.loadObjects(key);
+        assert(objects.size() == 3);
+        assert(cache.stats().hits == 1 && cache.stats().misses == 2);
+        jit = Jit::create(OptLevel::O2, errors);
+        assert(jit->addObjects(std::move(objects), errors));
+        assert(jit->run(errors) == 610);
+        assert(errors.empty());
+        assert(jit->stats().functionsCompiled == 0);
+
+        llvm::sys::fs::remove_directories(dir);
+        std::cout << "✓ testJitCache passed\n";
+    }
+
+    // runFile with what it prints on stdout and stderr
+    static int runCaptured(const std::string &path, const DriverOptions &options, std::string &out,
+                           std::string &err) {
+        std::ostringstream outs;
+        std::ostringstream errs;
+        std::streambuf *oldOut = std::cout.rdbuf(outs.rdbuf());
+        std::streambuf *oldErr = std::cerr.rdbuf(errs.rdbuf());
+        const int code = runFile(path, options);
+        std::cout.rdbuf(oldOut);
+        std::cerr.rdbuf(oldErr);
+        out = outs.str();
+        err = errs.str();
+        return code;
+    }
+
+    static void testJitCacheUncalled() {
+        // g is referenced but never called, so running alone doesn't compile it
+        const std::string source = writeTemp("var g = func(x) { return x * 2; }; "
+                                             "var f = func(x) { if (x > 100) { return g(x); } return x + 1; }; "
+                                             "return f(5);");
+        DriverOptions options;
+        options.mode = DriverMode::RUN;
+        options.stats = true;
+        options.cacheDir = tempDir();
+        std::string out;
+        std::string err;
+
+        assert(runCaptured(source, options, out, err) == 0);
+        assert(out == "6\n");
+        assert(err.find("cache    0 hits, 1 misses, 3 stored") != std::string::npos);
+
+        // the second run links all three and compiles nothing
+        assert(runCaptured(source, options, out, err) == 0);
+        assert(out == "6\n");
+        assert(err.find("compiled 0 of 3 functions") != std::string::npos);
+        assert(err.find("cache    1 hits, 0 misses, 0 stored") != std::string::npos);
+
+        // objects that no longer link are a miss, and get replaced
+        llvm::SmallString<256> entry;
+        std::error_code ec;
+        for (llvm::sys::fs::directory_iterator it(options.cacheDir, ec), end; it != end && !ec; it.increment(ec)) {
+            entry = it->path();
+        }
+        llvm::SmallString<256> object(entry);
+        llvm::sys::path::append(object, std::string(entryName) + ".o");
+        assert(!llvm::sys::fs::remove(object));
+        assert(runCaptured(source, options, out, err) == 0);
+        assert(out == "6\n");
+        assert(err.find("cache    0 hits, 1 misses, 3 stored") != std::string::npos);
+        assert(runCaptured(source, options, out, err) == 0);
+        assert(err.find("compiled 0 of 3 functions") != std::string::npos);
+
+        llvm::sys::fs::remove_directories(options.cacheDir);
+        std::remove(source.c_str());
+        std::cout << "✓ testJitCacheUncalled passed\n";
+    }
+};
@@ -0,0 +1,163 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include "../src/h/lex.h"
+#include "../src/h/parser.h"
+#include "../src/codegen/codegen.h"
+#include "../src/interp/interpreter.h"
+
+struct interpTests {
+    static void test_interp() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+
+        testMatchesCodegen();
+        testValues();
+        testClosures();
+        testErrors();
+    }
+
+    static std::unique_ptr<Program> parse(const std::string &text) {
+        std::string src = text;
+        lex l(src);
+        parser p(l.tokenizeAll());
+        std::unique_ptr<Program> program = p.parseProgram();
+        assert(p.Errors().empty());
+        return program;
+    }
+
+    static Value interpret(const std::string &text) {
+        std::unique_ptr<Program> program = parse(text);
+        std::vector<std::string> errors;
+        std::optional<Value> result = interpretProgram(*program, errors);
+        assert(result.has_value() && errors.empty());
+        return *result;
+    }
+
+    static int64_t compiled(const std::string &text) {
+        std::unique_ptr<Program> program = parse(text);
+        std::vector<std::string> errors;
+        std::unique_ptr<llvm::Module> module = compileProgram(*program, errors);
+        assert(module != nullptr);
+        std::unique_ptr<llvm::ExecutionEngine> engine(
+            llvm::EngineBuilder(std::move(module)).setEngineKind(llvm::EngineKind::JIT).create());
+        return reinterpret_cast<int64_t (*)()>(engine->getFunctionAddress(entryName))();
+    }
+
+    static std::string runtimeError(const std::string &text) {
+        std::unique_ptr<Program> program = parse(text);
+        std::vector<std::string> errors;
+        assert(!interpretProgram(*program, errors).has_value());
+        assert(errors.size() == 1);
+        return errors[0];
+    }
+
+    // whatever codegen takes, the interpreter works out the same
+    static void testMatchesCodegen() {
+        const char *programs[] = {
+            "return 1 + 2 * 3 - 17 / 5 + 17 % 5;",
+            "return 2147483647 * 2147483647 * 4;",
+            "return --5 + -(3 - 10);",
+            "1 + 1;",
+            "return (1 < 2) == true;",
+            "return (!0 == !false) == !5;",
+            "return 1; return 2;",
+            "var x = 1; var x = x + 1; return x;",
+            "var x = if (3 > 2) { 5 } else { 6 }; return x * 2;",
+            "var c = 0; var x = if (c) { 1 == 1 } else { 1 == 2 }; return x;",
+            "var x = if (true) { 5 }; return x;",
+            "var x = 1; if (true) { var x = 2; if (true) { &x = 7; } &x = x * 2; } return x;",
+            "var x = 1; if (true) { var x = true; if (x) { var x = 10; return x; } } return 0;",
+            "var i = 0; var s = 0; while (i < 3) { var s = 100; &s = s + i; &i = i + 1; } return s;",
+            "var i = 0; var r = 0; while (true) { &i = i + 1; if (i * i > 50) { &r = i; break; } } return r * 100 + i;",
+            "var n = 0; var i = 0; while (i < 4) { var j = 0; while (true) { &j = j + 1; "
+            "if (j > i) { break; } &n = n + 1; } &i = i + 1; } return n;",
+            "var i = 0; while (i < 5) { if (i == 3) { return i * 10; } &i = i + 1; } return 0;",
+            "var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; return fib(20);",
+            "var n = 5; var dec = func(n) { &n = n - 1; return n; }; var m = dec(n); return n * 10 + m;",
+            "var lt = func(a, b) { return a < b; }; return lt(1, 2) + lt(2, 1);",
+            "var none = func() { 1; }; return none();",
+            "var f = func(n) { var i = 0; while (true) { if (i == n) { return i * 2; } &i = i + 1; } }; return f(21);",
+            "return true;",
+        };
+        for (const char *text : programs) {
+            assert(interpret(text).asInt() == compiled(text));
+        }
+
+        std::cout << "✓ testMatchesCodegen passed\n";
+    }
+
+    static void testValues() {
+        assert(interpret("return \"ab\" + \"c\";").toString() == "abc");
+        assert(interpret("return \"ab\" == \"ab\";").asInt() == 1);
+        assert(interpret("var s = \"hello\"; return s[1];").toString() == "e");
+        assert(interpret("var a = [1, 2 + 3, [4]]; return a;").toString() == "[1, 5, [4]]");
+        assert(interpret("var a = [10, 20, 30]; var i = 0; var s = 0; while (i < 3) { &s = s + a[i]; &i = i + 1; } "
+                         "return s;").asInt() == 60);
+        assert(interpret("return [[1, 2], [3, 4]][1][0];").asInt() == 3);
+        assert(interpret("return [\"x\", true];").toString() == "[\"x\", true]");
+        assert(interpret("var a = [1]; &a = [2, 3]; return a[1];").asInt() == 3);
+
+        std::cout << "✓ testValues passed\n";
+    }
+
+    static void testClosures() {
+        // functions see the locals around them, even once those are gone
+        assert(interpret("var adder = func(n) { return func(x) { return x + n; }; }; var add5 = adder(5); "
+                         "return add5(10);").asInt() == 15);
+        assert(interpret("var x = 1; var f = func() { return x; }; &x = 2; return f();").asInt() == 2);
+        // but not what's declared after them, even under a name they know
+        assert(interpret("var x = 1; var g = func() { return x; }; var x = 2; return g();").asInt() == 1);
+        assert(interpret("var h = func() { return 9; }; var f = func() { return h() * 1000; }; "
+                         "var h = func() { return 12; }; return f();").asInt() == 9000);
+        assert(interpret("var f = func() { var y = 5; var k = func() { return y; }; var y = 7; return k(); }; "
+                         "return f();").asInt() == 5);
+        // calls through any expression
+        assert(interpret("return [func(a) { return a * 2; }][0](21);").asInt() == 42);
+        assert(interpret("var twice = func(f, x) { return f(f(x)); }; return twice(func(y) { return y * 3; }, 2);")
+                   .asInt() == 18);
+        // functions are values, nested ones can recurse by name
+        assert(interpret("var f = func() { var g = func(n) { if (n == 0) { return 0; } return n + g(n - 1); }; "
+                         "return g; }; return f()(100);").asInt() == 5050);
+        assert(interpret("return func() { 1; };").toString() == "func");
+
+        std::cout << "✓ testClosures passed\n";
+    }
+
+    static void testErrors() {
+        assert(runtimeError("return y;").find("unknown identifier=y, line=1") != std::string::npos);
+        assert(runtimeError("var f = func() { return g(); }; var g = func() { return 1; }; return f();")
+                   .find("unknown identifier=g, line=1") != std::string::npos);
+        assert(runtimeError("return 1 + true;").find("type mismatch: int + bool") != std::string::npos);
+        assert(runtimeError("return true < false;").find("invalid operands for <: bool") != std::string::npos);
+        assert(runtimeError("return -true;").find("invalid operand for -: bool") != std::string::npos);
+        assert(runtimeError("break;").find("break outside of a loop") != std::string::npos);
+        assert(runtimeError("var x = 1; &x = true;").find("cannot assign bool to int x") != std::string::npos);
+        assert(runtimeError("if (true) { var y = 1; } return y;").find("unknown identifier=y") != std::string::npos);
+        assert(runtimeError("var f = func(a) { return a; };\nreturn f(1, 2);")
+                   .find("f takes 1 arguments, got 2, line=2") != std::string::npos);
+        assert(runtimeError("var x = 1; return x(2);").find("int x is not a function") != std::string::npos);
+        assert(runtimeError("var x = 0; return 5 / x;").find("division by zero") != std::string::npos);
+        assert(runtimeError("return [1, 2][2];").find("index 2 out of range for array of 2") != std::string::npos);
+        assert(runtimeError("return 5[0];").find("cannot index int") != std::string::npos);
+        assert(runtimeError("if (\"s\") { return 1; }").find("condition must be int or bool, got string") !=
+               std::string::npos);
+        assert(runtimeError("var f = func(n) { return f(n + 1); }; return f(0);").find("calls nested deeper") !=
+               std::string::npos);
+        assert(runtimeError("var x: bool = 1;").find("cannot declare int as bool x") != std::string::npos);
+        assert(runtimeError("var f = func(a: string) { return a; }; return f(1);")
+                   .find("cannot pass int as string a") != std::string::npos);
+        assert(runtimeError("var f = func(): array { return 1; }; return f();").find("cannot return int as array") !=
+               std::string::npos);
+        // statements before the error ran, nothing after it does
+        assert(runtimeError("var i = 0; while (i < 10) { &i = i + 1; if (i == 5) { return 1 / 0; } } return i;")
+                   .find("division by zero") != std::string::npos);
+
+        std::cout << "✓ testErrors passed\n";
+    }
+};
@@ -1,6 +1,10 @@
 #include <cassert>
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
+#include <unistd.h>
 #include "../src/h/lex.h"
+#include "../src/h/scan.h"
 
 struct lexerTests {
     static void test_lexer() {
@@ -130,5 +134,194 @@ var
         assert(t23.type == TokenType::EoF);
 
         std::cout << "Lexer tests pass ✔︎" << std::endl;
+        test_zero_copy();
+        test_file_input();
+        test_scan_kernels();
+        test_keywords();
+        test_error_recovery();
+        test_interning();
+    }
+
+    // every literal, including the two-char operators and EoF, must be a
+    // slice of the shared source buffer rather than a copy of it
+    static void test_zero_copy() {
+        std::string src = "var abc = 10 >= \"str\";";
+        lex lexer(src);
+        const std::string_view buf = lexer.getSource()->view();
+
+        for (Token t = lexer.nextToken();; t = lexer.nextToken()) {
+            assert(t.lit.data() >= buf.data());
+            assert(t.lit.data() + t.lit.size() <= buf.data() + buf.size());
+            if (t.type == TokenType::EoF) {
+                break;
+            }
+        }
+
+        std::cout << "Lexer zero-copy tests pass ✔︎" << std::endl;
+    }
+
+    static void assert_same_tokens(lex a, lex b) {
+        while (true) {
+            Token ta = a.nextToken();
+            Token tb = b.nextToken();
+            assert(ta.type == tb.type);
+            assert(ta.lit == tb.lit);
+            assert(ta.line == tb.line);
+            if (ta.type == TokenType::EoF) {
+                return;
+            }
+        }
+    }
+
+    // a mapped file and a piped stream must lex exactly like an in-memory string
+    static void test_file_input() {
+        const std::string text = "var x = func(a, b) {\n return a >= b;\n};\n\"s\" 42";
+
+        char path[] = "/tmp/banter_lex_XXXXXX";
+        const int fd = mkstemp(path);
+        assert(fd >= 0);
+        assert(write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+        close(fd);
+
+        std::string copy = text;
+        lex mapped = lex::fromFile(path);
+        assert(mapped.getSource()->isMapped());
+        assert_same_tokens(mapped, lex(copy));
+        std::remove(path);
+
+        int fds[2];
+        assert(pipe(fds) == 0);
+        assert(write(fds[1], text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+        close(fds[1]);
+        lex piped(SourceBuffer::fromStream(fds[0]));
+        close(fds[0]);
+        assert(!piped.getSource()->isMapped());
+        copy = text;
+        assert_same_tokens(piped, lex(copy));
+
+        // a directory opens but fails to read, and its descriptor is closed
+        // all the same: the next one opened gets the same number
+        const int before = dup(0);
+        close(before);
+        bool threw = false;
+        try {
+            SourceBuffer::fromFile("/tmp");
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        assert(threw);
+        const int after = dup(0);
+        close(after);
+        assert(after == before);
+
+        std::cout << "Lexer file input tests pass ✔︎" << std::endl;
+    }
+
+    // every vector kernel must agree with the scalar table on runs that
+    // straddle chunk boundaries, tabs/crs that don't move linePos, and
+    // bytes >= 0x80 that end an identifier
+    static void test_scan_kernels() {
+        std::string text;
+        for (int i = 0; i < 40; i++) {
+            text += std::string(i, ' ') + "\t\r\n" + std::string(i % 7, ' ');
+            text += std::string(i + 1, 'a') + std::to_string(i * 7919) + " " + std::to_string(i * 104729);
+            text += " \"" + std::string(i, 'q') + "\" != " + std::string(i % 33, 'Z') + "9;";
+        }
+        text += "abc\xC3\xA9";
+
+        const std::string_view s = text;
+        const ScanKernel best = scan::bestKernel();
+        for (int k = 0; k <= static_cast<int>(best); k++) {
+            for (size_t i = 0; i < s.size(); i++) {
+                scan::setKernel(ScanKernel::SCALAR);
+                const SpaceRun ws = scan::whitespace(s, i);
+                const size_t al = scan::alnum(s, i);
+                const size_t dg = scan::digits(s, i);
+                scan::setKernel(static_cast<ScanKernel>(k));
+                const SpaceRun vws = scan::whitespace(s, i);
+                assert(vws.end == ws.end && vws.newlines == ws.newlines && vws.spaces == ws.spaces);
+                assert(scan::alnum(s, i) == al);
+                assert(scan::digits(s, i) == dg);
+            }
+        }
+        scan::setKernel(best);
+
+        std::cout << "Lexer scan kernel tests pass ✔︎" << std::endl;
+    }
+
+    static void test_keywords() {
+        std::string src = "var func if else while return break true false "
+                          "va vars fun iff elsewhere whilst returns brake truee fals x";
+        lex lexer(src);
+        const TokenType expected[] = {
+            TokenType::VAR_DECL, TokenType::FUNCTION, TokenType::IF, TokenType::ELSE, TokenType::WHILE,
+            TokenType::RETURN, TokenType::BREAK, TokenType::TRUE, TokenType::FALSE,
+        };
+        for (const TokenType tt : expected) {
+            assert(lexer.nextToken().type == tt);
+        }
+        for (Token t = lexer.nextToken(); t.type != TokenType::EoF; t = lexer.nextToken()) {
+            assert(t.type == TokenType::IDENT);
+        }
+
+        std::cout << "Lexer keyword tests pass ✔︎" << std::endl;
+    }
+
+    // bad input becomes an ILLEGAL token plus a diagnostic, and lexing
+    // resumes right after it
+    static void test_error_recovery() {
+        const std::string text = "var 9lives = 1;\n@ x\n\"open";
+        std::string src = text;
+        lex lexer(src);
+        const TokenType expected[] = {
+            TokenType::VAR_DECL, TokenType::ILLEGAL, TokenType::ASSIGN, TokenType::INT, TokenType::SEMICOLON,
+            TokenType::ILLEGAL, TokenType::IDENT, TokenType::ILLEGAL, TokenType::EoF,
+        };
+        std::vector<Token> toks;
+        for (const TokenType tt : expected) {
+            toks.push_back(lexer.nextToken());
+            assert(toks.back().type == tt);
+        }
+        assert(toks[1].lit == "9lives");
+        assert(toks[5].lit == "@");
+        assert(toks[7].lit == "\"open");
+
+        const std::vector<LexDiagnostic> &diags = lexer.Diagnostics();
+        assert(diags.size() == 3);
+        assert(diags[0].line == 1 && diags[0].offset == 4);
+        assert(diags[1].line == 2 && diags[1].offset == text.find('@'));
+        assert(diags[2].line == 3 && diags[2].offset == text.find('"'));
+
+        std::cout << "Lexer error recovery tests pass ✔︎" << std::endl;
+    }
+
+    static void test_interning() {
+        std::string src = "abc x abc \"abc\" var \"abc\"";
+        lex lexer(src);
+        const Token a1 = lexer.nextToken();
+        const Token x = lexer.nextToken();
+        const Token a2 = lexer.nextToken();
+        const Token s1 = lexer.nextToken();
+        const Token kw = lexer.nextToken();
+        const Token s2 = lexer.nextToken();
+
+        assert(a1.sym != NoSymbol && a1.sym == a2.sym);
+        assert(x.sym != a1.sym);
+        assert(s1.sym == s2.sym && s1.sym != a1.sym);
+        assert(kw.sym == NoSymbol);
+
+        const std::shared_ptr<Interner> &symbols = lexer.getSymbols();
+        assert(symbols->size() == 3);
+        assert(symbols->name(a1.sym) == "abc");
+        assert(symbols->find("x") == x.sym);
+        assert(symbols->find("nope") == NoSymbol);
+
+        // a second lexer of the same compilation shares the table
+        std::string more = "x y";
+        lex other(std::make_shared<const SourceBuffer>(std::move(more)), symbols);
+        assert(other.nextToken().sym == x.sym);
+        assert(other.nextToken().sym == 3);
+
+        std::cout << "Lexer interning tests pass ✔︎" << std::endl;
     }
 };
\ No newline at end of file
@@ -1,13 +1,21 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <stdexcept>
 
 #include "../src/h/lex.h"
 #include "../src/h/ast.h"
+#include "../src/h/flatAst.h"
 #include "../src/h/parser.h"
 
 struct  parserTests {
     static void test_parser() {
         testDeclarationStatements();
+        testBatchMode();
+        testReparse();
+        testAnnotations();
 
         std::cout << "Unfinished: parser tests \n";
     }
@@ -21,7 +29,7 @@ struct  parserTests {
         assert(program != nullptr);
         assert(program->statements.size() == 1);
 
-        Statement* stmt = program->statements[0].get();
+        Statement* stmt = program->statements[0];
         assert(stmt != nullptr);
         assert(stmt->type() == "declare_statement");
 
@@ -36,4 +44,194 @@ struct  parserTests {
         std::cout << "✓ testDeclarationStatements passed\n";
     }
 
+    static std::vector<std::string> parseErrors(const std::string &text) {
+        std::string src = text;
+        const lex l(src);
+        parser p(l);
+        p.parseProgram();
+        return p.Errors();
+    }
+
+    static void testAnnotations() {
+        std::string src = "var x: int = 5; var f = func(a: int, b, c: func): string { return b; };";
+        const lex l(src);
+        parser p(l);
+        std::unique_ptr<Program> program = p.parseProgram();
+        assert(p.Errors().empty());
+
+        auto *decl = dynamic_cast<DeclareStatement *>(program->statements[0]);
+        assert(decl->name->annotation == Annotation::INT);
+        auto *fn = dynamic_cast<FuncLiteral *>(dynamic_cast<DeclareStatement *>(program->statements[1])->value);
+        assert(dynamic_cast<DeclareStatement *>(program->statements[1])->name->annotation == Annotation::NONE);
+        assert(fn->params[0]->annotation == Annotation::INT);
+        assert(fn->params[1]->annotation == Annotation::NONE);
+        assert(fn->params[2]->annotation == Annotation::FUNC);
+        assert(fn->returns == Annotation::STRING);
+        assert(program->toString() == "var x: int = 5;\nvar f = func (a: int, b, c: func, ): string { return b; };\n");
+
+        const FlatAst flat = FlatAst::fromProgram(*program);
+        assert(flat.toString() == program->toString());
+        assert(flat.annotations[flat.a[flat.statements[0]]] == Annotation::INT);
+        assert(flat.annotations[flat.b[flat.statements[1]]] == Annotation::STRING);
+
+        assert(parseErrors("var x: float = 1;")[0] == "unknown type=float. line=1");
+        assert(parseErrors("var x: = 1;")[0] == "unknown type==. line=1");
+        assert(parseErrors("var f = func(a: bool) { return a; };")[0] ==
+               "bools are passed and returned as ints, declare int instead. line=1");
+        assert(parseErrors("var f = func(): bool { return true; };")[0] ==
+               "bools are passed and returned as ints, declare int instead. line=1");
+        assert(parseErrors("var b: bool = true;").empty());
+
+        std::cout << "✓ testAnnotations passed\n";
+    }
+
+    static void testBatchMode() {
+        const std::string text = "var x = 5; var f = func(a, b) { return a + b * x; }; "
+                                 "if (x < 10) { f(x, 2); } else { [1, 2][0]; }";
+        std::string src = text;
+        const lex pullLexer(src);
+        parser pull(pullLexer);
+        assert(pull.peekTypeAt(2) == TokenType::ASSIGN);
+        assert(pull.peekTypeAt(3) == TokenType::INT);
+        std::unique_ptr<Program> expected = pull.parseProgram();
+
+        src = text;
+        lex batchLexer(src);
+        TokenBuffer tokens = batchLexer.tokenizeAll();
+        assert(tokens.types.back() == TokenType::EoF);
+        assert(tokens.at(tokens.size() + 10).type == TokenType::EoF);
+
+        parser batch(std::move(tokens));
+        assert(batch.peekTypeAt(0) == TokenType::VAR_DECL);
+        assert(batch.peekTypeAt(2) == TokenType::ASSIGN);
+        assert(batch.peekTypeAt(3) == TokenType::INT);
+        assert(batch.peekTypeAt(1000) == TokenType::EoF);
+        std::unique_ptr<Program> program = batch.parseProgram();
+
+        assert(batch.Errors().empty());
+        assert(program->statements.size() == expected->statements.size());
+        assert(program->toString() == expected->toString());
+
+        // the declared x and the x inside the function body are one symbol
+        auto *decl = dynamic_cast<DeclareStatement *>(program->statements[0]);
+        auto *fn = dynamic_cast<FuncLiteral *>(dynamic_cast<DeclareStatement *>(program->statements[1])->value);
+        auto *ret = dynamic_cast<ReturnStatement *>(fn->body->statements[0]);
+        auto *use = dynamic_cast<Identifier *>(dynamic_cast<InfixExpression *>(
+            dynamic_cast<InfixExpression *>(ret->returnVal)->rhs)->rhs);
+        assert(use->sym == decl->name->sym);
+        assert(program->symbols->name(use->sym) == "x");
+
+        std::cout << "✓ testBatchMode passed\n";
+    }
+
+    // the tree, token lines, errors and diagnostics of a full parse of text
+    static std::string fullParse(const std::string &text) {
+        std::unique_ptr<Program> program = parser::parseEditable(std::make_shared<const SourceBuffer>(text));
+        return describe(*program);
+    }
+
+    // flattened, as failed parses leave nullptrs Program::toString can't print
+    static std::string describe(Program &program) {
+        const FlatAst flat = FlatAst::fromProgram(program);
+        std::string out = flat.toString();
+        for (const int line : flat.lines) {
+            out += std::to_string(line) + " ";
+        }
+        for (const std::string &e : program.errors) {
+            out += "\n" + e;
+        }
+        for (const LexDiagnostic &d : program.diagnostics) {
+            out += "\n" + d.toString();
+        }
+        return out;
+    }
+
+    static void testReparse() {
+        std::string text = "var x = 5;\n"
+                           "var f = func(a, b) {\n  return a + b * x;\n};\n"
+                           "if (x < 10) { f(x, 2); } else { [1, 2][0]; }\n"
+                           "var s = \"two\nlines\";\n"
+                           "f(1, 2)\n"
+                           "var y = x @ 2;\n"
+                           "var z = f(y, 3);\n";
+        std::unique_ptr<Program> program = parser::parseEditable(std::make_shared<const SourceBuffer>(text));
+        // x @ 2 is an illegal token and a statement that can't start with it
+        assert(program->statements.size() == 9);
+        assert(program->errors.size() == 1);
+        assert(program->diagnostics.size() == 1);
+
+        auto edit = [&](const size_t offset, const size_t removed, const std::string &inserted) {
+            program = parser::reparse(std::move(program), {offset, removed, inserted});
+            text.replace(offset, removed, inserted);
+            assert(program->source->view() == text);
+            assert(describe(*program) == fullParse(text));
+        };
+
+        // a single-line edit takes over every statement but its own and the
+        // one before it
+        Statement *last = program->statements.back();
+        edit(text.find("5;"), 1, "7");
+        assert(program->statements.back() == last);
+        assert(program->retained.size() == 1);
+
+        // new lines move those after it, diagnostics too
+        const int illegalLine = program->diagnostics[0].line;
+        edit(text.find("if"), 0, "var w = 1;\n\n");
+        assert(program->statements.back() == last);
+        assert(program->diagnostics[0].line == illegalLine + 2);
+        // their tokens only once something reads them
+        auto *lastDecl = static_cast<DeclareStatement *>(last);
+        const int lastLine = lastDecl->tok.line;
+        program = parser::reparse(std::move(program), {0, 0, "\n"});
+        text.insert(0, "\n");
+        assert(lastDecl->tok.line == lastLine && program->units.back().shift == 1);
+        assert(describe(*program) == fullParse(text));
+        assert(lastDecl->tok.line == lastLine + 1);
+        assert(program->units.back().shift == 0);
+        // across statements, and splitting one token into two
+        edit(text.find("7;"), text.find("var f") + 5 - text.find("7;"), "8; var g");
+        edit(text.find("var y"), 3, "v ar");
+        assert(program->errors.size() > 1);
+        // lines moving past a failed statement have it parsed again
+        edit(0, 0, "\n");
+        edit(text.find("v ar"), 4, "var");
+        assert(program->errors.size() == 1);
+        // the unterminated string eats everything after it
+        edit(text.find("f(1, 2)"), 0, "\"");
+        edit(text.find("\"f(1, 2)"), 1, "");
+        edit(text.size(), 0, "return z");
+        edit(0, text.size(), "");
+        assert(program->statements.empty());
+        edit(0, 0, "var a = 1; var b = 2;");
+
+        // random edits out of the language's own tokens, each checked
+        // against a full parse of the edited text
+        const char *pieces[] = {"var ", "x", " = ", "1", ";", "\n", " ", "func(a) { ", "}", "(", ")",
+                                "if (", "\"", "@", "return ", "+ 2", "[", "]", ",", "f(x)"};
+        uint64_t seed = 12345;
+        auto random = [&](const size_t n) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            return static_cast<size_t>((seed >> 33) % n);
+        };
+        for (int i = 0; i < 2000; i++) {
+            const size_t offset = random(text.size() + 1);
+            const size_t removed = random(4) == 0 ? random(std::min<size_t>(text.size() - offset, 12) + 1) : 0;
+            std::string inserted;
+            for (size_t k = random(3); k > 0; k--) {
+                inserted += pieces[random(std::size(pieces))];
+            }
+            edit(offset, removed, inserted);
+            assert(program->retained.size() <= 8);
+        }
+
+        bool threw = false;
+        try {
+            parser::reparse(std::move(program), {text.size() + 1, 0, ""});
+        } catch (const std::out_of_range &) {
+            threw = true;
+        }
+        assert(threw);
+
+        std::cout << "✓ testReparse passed\n";
+    }
 };
@@ -0,0 +1,131 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+
+#include "../src/h/lex.h"
+#include "../src/h/parser.h"
+#include "../src/interp/bytecode.h"
+#include "../src/interp/tier.h"
+#include "test_vm.cpp"
+
+struct tierTests {
+    static void test_tier() {
+        testMatchesVm();
+        testPromotes();
+        testStaysInBytecode();
+    }
+
+    struct Tiered {
+        std::unique_ptr<Program> program;
+        std::unique_ptr<Tiers> tiers;
+
+        std::string run() const {
+            std::vector<std::string> errors;
+            std::optional<Value> result = tiers->run(errors);
+            assert(result.has_value() && errors.empty());
+            return result->toString();
+        }
+
+        const FunctionTier &of(const std::string &name) const {
+            static std::vector<FunctionTier> all;
+            all = tiers->stats();
+            for (const FunctionTier &t : all) {
+                if (t.name == name) {
+                    return t;
+                }
+            }
+            assert(false);
+            return all[0];
+        }
+    };
+
+    static Tiered tiered(const std::string &text, const uint64_t threshold) {
+        Tiered t{vmTests::parse(text), nullptr};
+        std::vector<std::string> errors;
+        t.tiers = Tiers::create(*t.program, {.threshold = threshold}, errors);
+        assert(t.tiers != nullptr && errors.empty());
+        return t;
+    }
+
+    // whichever tier each call lands in, and once every hot function has
+    // had its chance at native code, the vm's values
+    static void testMatchesVm() {
+        for (const std::string &text : vmTests::programs()) {
+            Tiered t = tiered(text, 1);
+            const std::string expected = vmTests::run(*vmTests::compile(text));
+            assert(t.run() == expected);
+            t.tiers->wait();
+            assert(t.run() == expected);
+        }
+
+        std::cout << "✓ testMatchesVm passed\n";
+    }
+
+    static void testPromotes() {
+        Tiered fib = tiered("var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; "
+                            "return fib(20);",
+                            100);
+        assert(fib.run() == "6765");
+        fib.tiers->wait();
+        assert(fib.of("fib").tier == Tier::NATIVE);
+        assert(fib.of("fib").counters.calls >= 100);
+        assert(fib.of("<main>").tier == Tier::BYTECODE && fib.of("<main>").reason == "the top level");
+
+        // the next run calls into native code once, and it does the rest
+        std::vector<std::string> errors;
+        VmStats stats;
+        assert(fib.tiers->run(errors, &stats)->asInt() == 6765);
+        assert(stats.calls == 0 && stats.nativeCalls == 1);
+
+        // a loop heats up its function before a second call, and what it
+        // calls comes along
+        Tiered loop = tiered("var add = func(a, b) { return a + b; }; "
+                             "var sum = func(n) { var i = 0; var s = 0; while (i < n) { &s = add(s, i); &i = i + 1; } "
+                             "return s; }; return sum(50);",
+                             40);
+        assert(loop.run() == "1225");
+        loop.tiers->wait();
+        assert(loop.of("sum").tier == Tier::NATIVE && loop.of("sum").counters.calls == 1);
+        assert(loop.of("sum").counters.backEdges >= 40);
+        assert(loop.of("add").tier == Tier::NATIVE);
+
+        // bools passed in are ints by the time they get there, either way
+        Tiered flags = tiered("var pick = func(c, a, b) { if (c) { return a; } return b; }; "
+                              "var i = 0; var s = 0; while (i < 10) { &s = s + pick(i < 5, 1, 10); &i = i + 1; } "
+                              "return s + pick(true, 0, 1);",
+                              3);
+        assert(flags.run() == "55");
+        flags.tiers->wait();
+        assert(flags.of("pick").tier == Tier::NATIVE && flags.run() == "55");
+
+        std::cout << "✓ testPromotes passed\n";
+    }
+
+    static std::string reason(const std::string &text, const std::string &name) {
+        Tiered t = tiered(text, 1);
+        t.run();
+        t.tiers->wait();
+        const FunctionTier &tier = t.of(name);
+        assert(tier.tier != Tier::NATIVE);
+        return tier.reason;
+    }
+
+    static void testStaysInBytecode() {
+        assert(reason("var x = 1; var f = func() { return x; }; return f();", "f") == "unknown identifier=x, line=1");
+        assert(reason("var f = func() { return \"s\"; }; return f();", "f") ==
+               "string literals not supported by codegen yet, line=1");
+        assert(reason("var f = func(a) { return 10 / a; }; return f(2);", "f")
+                   .find("division by anything but a positive constant") == 0);
+        assert(reason("var f = func(a) { return if (a) { 1 } else { a == 1 }; }; return f(0);", "f")
+                   .find("if branches of different types") == 0);
+        assert(reason("var g = func() { return 1; }; var f = func() { return g(); }; &g = func() { return 2; }; "
+                      "return f() + f();",
+                      "f") == "calls g, which is assigned to");
+        assert(reason("var f = func() { var g = func() { return 1; }; return g(); }; return f();", "g") ==
+               "not declared at the top level");
+        assert(reason("var f = func(a, b, c, d, e, f, g) { return a; }; return f(1, 2, 3, 4, 5, 6, 7);", "f") ==
+               "takes more than 6 arguments");
+
+        std::cout << "✓ testStaysInBytecode passed\n";
+    }
+};
@@ -0,0 +1,133 @@
+#include <cassert>
+#include <iostream>
+
+#include "../src/h/flatAst.h"
+#include "../src/h/types.h"
+#include "test_vm.cpp"
+
+struct typesTests {
+    static void test_types() {
+        testInfers();
+        testCalls();
+        testCoverage();
+        testSkipsChecks();
+        testAnnotations();
+    }
+
+    // of what the program's last statement, a return, returns
+    static std::string returned(const std::string &text) {
+        std::unique_ptr<Program> program = vmTests::parse(text);
+        const FlatAst ast = FlatAst::fromProgram(*program);
+        const Types types = inferTypes(ast);
+        const NodeIndex last = ast.statements.back();
+        assert(ast.kinds[last] == NodeKind::RETURN);
+        return typeSetName(types.of[ast.a[last]]);
+    }
+
+    static void testInfers() {
+        assert(returned("return 1 + 2 * 3;") == "int");
+        assert(returned("return \"a\" + \"b\";") == "string");
+        assert(returned("return !1 == 2 < 3;") == "bool");
+        assert(returned("var x = true; if (x) { &x = false; } return x;") == "bool");
+        assert(returned("return \"ab\"[0];") == "string");
+        assert(returned("return [1, 2][0];") == "any");
+        assert(returned("return if (true) { 1 };") == "int");
+        assert(returned("return if (true) { 1 } else { \"s\" };") == "int|string");
+        assert(returned("return if (true) { var x = 1; } else { 2 };") == "int");
+        assert(returned("return while (false) { 1; };") == "int");
+        // always fails
+        assert(returned("return 1 + true;") == "none");
+        assert(returned("return -\"s\";") == "int");
+
+        std::cout << "✓ testInfers passed\n";
+    }
+
+    static void testCalls() {
+        assert(returned("var f = func(a, b) { return a + b; }; return f(1, 2);") == "int");
+        assert(returned("var f = func(a) { return a; }; f(\"s\"); return f(1);") == "int|string");
+        // bools come back as ints
+        assert(returned("var lt = func(a, b) { return a < b; }; return lt(1, 2);") == "int");
+        assert(returned("var f = func() { 1; }; return f();") == "int");
+        assert(returned("var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; "
+                        "return fib(20);") == "int");
+        assert(returned("var f = func(a) { return a; }; return f(1, 2);") == "none");
+        // used as a value, it could be called with anything
+        assert(returned("var id = func(a) { return a; }; var g = id; return id(1);") == "int|string|array|func");
+        assert(returned("var f = func() { return 1; }; &f = func() { return \"s\"; }; return f();") ==
+               "int|string|array|func");
+        assert(returned("var f = func(g) { return g(1); }; return f(func(a) { return a; });") ==
+               "int|string|array|func");
+
+        std::cout << "✓ testCalls passed\n";
+    }
+
+    static void testCoverage() {
+        std::unique_ptr<Program> program =
+            vmTests::parse("var f = func(a) { return a + 1; }; var x = f(2); return [x, x + 1][0];");
+        const Types types = inferTypes(FlatAst::fromProgram(*program));
+        // a + 1 and its operands, f(2), f and 2, the index, the array, x,
+        // x + 1 and its operands, and 0: all but the element got by index
+        assert(types.expressions == 13);
+        assert(types.proven == 12);
+
+        std::cout << "✓ testCoverage passed\n";
+    }
+
+    static uint64_t instructions(const std::string &text, const std::string &expected) {
+        std::unique_ptr<Bytecode> bytecode = vmTests::compile(text);
+        VmStats stats;
+        std::vector<std::string> errors;
+        assert(runBytecode(*bytecode, errors, &stats)->toString() == expected && errors.empty());
+        return stats.instructions;
+    }
+
+    static void testSkipsChecks() {
+        // a proven assignment goes straight into the variable: the body is a
+        // LOADK and a MUL into j, with no ASSIGN checking a copy, and an ADDI
+        const std::string loop = "var i = 0; var j = 0; while (i < 3) { &j = i * 2; &i = i + 1; } return j;";
+        assert(instructions(loop, "4") == 1 + 1 + 1 + 3 * 3 + 4 * 2 + 1);
+        // a cell is stored to unchecked
+        instructions("var j = 0; var f = func() { return j; }; &j = j + 5; return f();", "5");
+
+        // what isn't proven is still checked
+        assert(vmTests::runtimeError("var x = 1; var f = func(a) { &x = a; }; f(\"s\");") ==
+               "cannot assign string to int x, line=1");
+        assert(vmTests::runtimeError("var x = 1; var f = func(a) { &x = a; }; var g = f; g(\"s\");") ==
+               "cannot assign string to int x, line=1");
+        assert(vmTests::runtimeError("var s = \"\"; &s = [1][0];") == "cannot assign int to string s, line=1");
+
+        std::cout << "✓ testSkipsChecks passed\n";
+    }
+
+    static size_t count(const std::string &text, const Op op) {
+        std::unique_ptr<Bytecode> bytecode = vmTests::compile(text);
+        size_t n = 0;
+        for (const Function &fn : bytecode->functions) {
+            for (size_t pc = 0; pc < fn.code.size(); pc += opWords(opOf(fn.code[pc]))) {
+                n += opOf(fn.code[pc]) == op;
+            }
+        }
+        return n;
+    }
+
+    static void testAnnotations() {
+        // trusted where they're checked, so they hold where nothing else is known
+        assert(returned("var f = func(a: int) { return a; }; var g = f; return f(1);") == "int");
+        assert(returned("var f = func(g): int { return g(1); }; return f(func(a) { return a; });") == "int");
+        assert(returned("var x: string = [\"a\"][0]; return x;") == "string");
+        assert(returned("var x: int = \"s\"; return x;") == "none");
+
+        // and checked only where they aren't proven
+        assert(count("var f = func(a: int): int { return a + 1; }; var x: int = f(1); return x;", Op::CHECK) == 0);
+        assert(count("var f = func(a: int): int { return a + 1; }; var g = f; return g(1);", Op::CHECK) == 1);
+        assert(count("var f = func(a, b): string { if (a) { return b; } return \"\"; }; return f(1, 2);",
+                     Op::CHECK) == 1);
+        assert(count("var x: int = [1][0]; return x;", Op::CHECK) == 1);
+        // an escaping function's annotated parameter is as good as proven
+        assert(count("var f = func(a: int) { var s = 0; &s = a; return s; }; var g = f; return g(2);",
+                     Op::ASSIGN) == 0);
+        assert(count("var f = func(a) { var s = 0; &s = a; return s; }; var g = f; return g(2);", Op::ASSIGN) == 1);
+
+        std::cout << "✓ testAnnotations passed\n";
+    }
+};
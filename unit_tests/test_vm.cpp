@@ -0,0 +1,259 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+
+#include "../src/h/flatAst.h"
+#include "../src/h/lex.h"
+#include "../src/h/parser.h"
+#include "../src/interp/bytecode.h"
+#include "../src/interp/interpreter.h"
+
+struct vmTests {
+    static void test_vm() {
+        testMatchesInterpreter();
+        testCompileErrors();
+        testRuntimeErrors();
+        testSerialization();
+        testMalformed();
+    }
+
+    static std::unique_ptr<Program> parse(const std::string &text) {
+        std::string src = text;
+        lex l(src);
+        parser p(l.tokenizeAll());
+        std::unique_ptr<Program> program = p.parseProgram();
+        assert(p.Errors().empty());
+        return program;
+    }
+
+    static std::unique_ptr<Bytecode> compile(const std::string &text, std::vector<std::string> &errors) {
+        std::unique_ptr<Program> program = parse(text);
+        return compileBytecode(FlatAst::fromProgram(*program), errors);
+    }
+
+    static std::unique_ptr<Bytecode> compile(const std::string &text) {
+        std::vector<std::string> errors;
+        std::unique_ptr<Bytecode> bytecode = compile(text, errors);
+        assert(bytecode != nullptr && errors.empty());
+        return bytecode;
+    }
+
+    static std::string run(const Bytecode &bytecode) {
+        std::vector<std::string> errors;
+        std::optional<Value> result = runBytecode(bytecode, errors);
+        assert(result.has_value() && errors.empty());
+        return result->toString();
+    }
+
+    static std::string interpreted(const std::string &text) {
+        std::unique_ptr<Program> program = parse(text);
+        std::vector<std::string> errors;
+        std::optional<Value> result = interpretProgram(*program, errors);
+        assert(result.has_value());
+        return result->toString();
+    }
+
+    static std::string runtimeError(const std::string &text) {
+        std::unique_ptr<Bytecode> bytecode = compile(text);
+        std::vector<std::string> errors;
+        assert(!runBytecode(*bytecode, errors).has_value());
+        assert(errors.size() == 1);
+        return errors[0];
+    }
+
+    static std::string compileError(const std::string &text) {
+        std::vector<std::string> errors;
+        assert(compile(text, errors) == nullptr);
+        assert(!errors.empty());
+        return errors[0];
+    }
+
+    static const std::vector<std::string> &programs() {
+        static const std::vector<std::string> all = {
+            "return 1 + 2 * 3 - 17 / 5 + 17 % 5;",
+            "return 2147483647 * 2147483647 * 4;",
+            "return --5 + -(3 - 10);",
+            "1 + 1;",
+            "return (1 < 2) == true;",
+            "return (!0 == !false) == !5;",
+            "return 1; return 2;",
+            "var x = 1; var x = x + 1; return x;",
+            "var x = if (3 > 2) { 5 } else { 6 }; return x * 2;",
+            "var x = if (true) { 5 }; return x;",
+            "var x = 1; if (true) { var x = 2; if (true) { &x = 7; } &x = x * 2; } return x;",
+            "var i = 0; var s = 0; while (i < 3) { var s = 100; &s = s + i; &i = i + 1; } return s;",
+            "var i = 0; var r = 0; while (true) { &i = i + 1; if (i * i > 50) { &r = i; break; } } return r * 100 + i;",
+            "var n = 0; var i = 0; while (i < 4) { var j = 0; while (true) { &j = j + 1; "
+            "if (j > i) { break; } &n = n + 1; } &i = i + 1; } return n;",
+            "var fib = func(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; return fib(20);",
+            "var n = 5; var dec = func(n) { &n = n - 1; return n; }; var m = dec(n); return n * 10 + m;",
+            "var lt = func(a, b) { return a < b; }; return lt(1, 2) + lt(2, 1);",
+            "var none = func() { 1; }; return none();",
+            "return true;",
+            // the left operand is read before a block on the right assigns it
+            "var x = 1; return x + if (true) { &x = 10; x } else { 0 };",
+            "return \"ab\" + \"c\" + \"ab\"[1];",
+            "var a = [10, 20, [30]]; var i = 0; var s = 0; while (i < 2) { &s = s + a[i]; &i = i + 1; } "
+            "return [s, a[2][0], a];",
+            "var adder = func(n) { return func(x) { return x + n; }; }; var add5 = adder(5); return add5(10);",
+            "var x = 1; var f = func() { return x; }; &x = 2; return f();",
+            "var x = 1; var f = func() { &x = x + 1; return x; }; f(); f(); return x;",
+            "return [func(a) { return a * 2; }][0](21);",
+            "var twice = func(f, x) { return f(f(x)); }; return twice(func(y) { return y * 3; }, 2);",
+            "var f = func() { var g = func(n) { if (n == 0) { return 0; } return n + g(n - 1); }; "
+            "return g; }; return f()(100);",
+            // each run of a declaration makes a new variable for closures to keep
+            "var fs = []; var i = 0; while (i < 3) { var j = i; &fs = [func() { return j; }, fs]; &i = i + 1; } "
+            "return fs[0]() * 100 + fs[1][0]() * 10 + fs[1][1][0]();",
+            // captured through two functions, by a parameter
+            "var outer = func(a) { var mid = func() { return func() { &a = a + 1; return a; }; }; var inc = mid(); "
+            "inc(); return inc(); }; return outer(40);",
+            "return func() { 1; };",
+            // annotated, and passed or returned as such, bools widened
+            "var x: int = 5; var s: string = \"a\" + \"b\"; var add = func(a: int, b: int): int { return a + b; }; "
+            "return [add(x, 2), s];",
+            "var apply = func(f: func, x: int): int { return f(x); }; "
+            "return apply(func(a: int): int { return a * 2; }, 21);",
+            "var lt = func(a: int, b: int): int { return a < b; }; var c: bool = 1 < 2; "
+            "return if (c) { lt(1, 2) + lt(true, 3) } else { 0 };",
+            // closures see their names as they were, not as redeclared after
+            "var x = 1; var g = func() { return x; }; var x = 2; return g();",
+            // calls go to the function the name meant where the call was written
+            "var h = func() { return 9; }; var f = func() { return h() * 1000; }; var h = func() { return 12; }; "
+            "return f();",
+        };
+        return all;
+    }
+
+    static void testMatchesInterpreter() {
+        for (const std::string &text : programs()) {
+            assert(run(*compile(text)) == interpreted(text));
+        }
+
+        // the bottom-tested loop runs the body only while the condition holds
+        std::unique_ptr<Bytecode> loop = compile("var i = 0; while (i < 3) { &i = i + 1; } return i;");
+        VmStats stats;
+        std::vector<std::string> errors;
+        assert(runBytecode(*loop, errors, &stats)->asInt() == 3);
+        // the declaration, a jump to the test, 3 runs of the body, an ADDI
+        // in place, 4 tests of a LOADK and a JLT, and the return
+        assert(stats.instructions == 1 + 1 + 3 * 1 + 4 * 2 + 1);
+
+        std::cout << "✓ testMatchesInterpreter passed\n";
+    }
+
+    static void testCompileErrors() {
+        assert(compileError("return y;") == "unknown identifier=y, line=1");
+        assert(compileError("if (true) { var y = 1; }\nreturn y;") == "unknown identifier=y, line=2");
+        // even where it never runs
+        assert(compileError("if (false) { &z = 1; }") == "unknown identifier=z, line=1");
+        assert(compileError("break;") == "break outside of a loop, line=1");
+        assert(compileError("while (true) { var f = func() { break; }; }") == "break outside of a loop, line=1");
+        // lexically, only declarations before a function reach it
+        assert(compileError("var f = func() { return g(); }; var g = func() { return 1; };")
+                   .find("unknown identifier=g") == 0);
+
+        std::string many = "return [";
+        for (int i = 0; i < 300; i++) {
+            many += std::to_string(i) + ", ";
+        }
+        assert(compileError(many + "0];").find("function needs more than 256 registers") == 0);
+
+        std::cout << "✓ testCompileErrors passed\n";
+    }
+
+    static void testRuntimeErrors() {
+        assert(runtimeError("return 1 + true;") == "type mismatch: int + bool, line=1");
+        assert(runtimeError("return true < false;") == "invalid operands for <: bool, line=1");
+        assert(runtimeError("return -true;") == "invalid operand for -: bool, line=1");
+        assert(runtimeError("var x = 1;\n&x = true;") == "cannot assign bool to int x, line=2");
+        assert(runtimeError("var x = 1; var f = func() { &x = \"s\"; }; f();") ==
+               "cannot assign string to int x, line=1");
+        assert(runtimeError("var f = func(a) { return a; };\nreturn f(1, 2);") ==
+               "f takes 1 arguments, got 2, line=2");
+        assert(runtimeError("var x = 1; return x(2);") == "int x is not a function, line=1");
+        assert(runtimeError("var x = 0;\n\nreturn 5 / x;") == "division by zero, line=3");
+        assert(runtimeError("return [1, 2][2];") == "index 2 out of range for array of 2, line=1");
+        assert(runtimeError("return 5[0];") == "cannot index int, line=1");
+        assert(runtimeError("if (\"s\") { return 1; }") == "condition must be int or bool, got string, line=1");
+        assert(runtimeError("var f = func(n) { return f(n + 1); }; return f(0);").find("calls nested deeper") == 0);
+        // raised inside a call, on the callee's line
+        assert(runtimeError("var f = func(a) {\nreturn a + true; };\nreturn f(1);") ==
+               "type mismatch: int + bool, line=2");
+
+        // an annotation is checked where it isn't proven, as the tree walk
+        // checks it: a parameter on entry, a result as it's returned
+        const std::vector<std::pair<std::string, std::string>> annotated = {
+            {"var x: int = \"s\";", "cannot declare string as int x, line=1"},
+            {"var f: int = func() { return 1; };", "cannot declare func as int f, line=1"},
+            {"var f = func(a: int) { return a; };\nreturn f(\"s\");", "cannot pass string as int a, line=1"},
+            {"var f = func(a: int) { return a; }; var g = f;\nreturn g([1]);", "cannot pass array as int a, line=1"},
+            {"var f = func(): string {\nreturn 1; };\nreturn f();", "cannot return int as string, line=2"},
+            {"var f = func(): string { 1; };\nreturn f();", "cannot return int as string, line=1"},
+        };
+        for (const auto &[text, error] : annotated) {
+            assert(runtimeError(text) == error);
+            std::vector<std::string> errors;
+            assert(!interpretProgram(*parse(text), errors).has_value() && errors[0] == error);
+        }
+
+        std::cout << "✓ testRuntimeErrors passed\n";
+    }
+
+    static void testSerialization() {
+        for (const std::string &text : programs()) {
+            std::unique_ptr<Bytecode> bytecode = compile(text);
+            const std::string bytes = serializeBytecode(*bytecode);
+            std::vector<std::string> errors;
+            std::unique_ptr<Bytecode> loaded = deserializeBytecode(bytes, errors);
+            assert(loaded != nullptr && errors.empty());
+            assert(loaded->toString() == bytecode->toString());
+            assert(serializeBytecode(*loaded) == bytes);
+            assert(run(*loaded) == run(*bytecode));
+        }
+
+        // errors keep their lines
+        std::unique_ptr<Bytecode> failing = compile("var x = 0;\nreturn 1 / x;");
+        std::vector<std::string> errors;
+        std::unique_ptr<Bytecode> loaded = deserializeBytecode(serializeBytecode(*failing), errors);
+        assert(!runBytecode(*loaded, errors).has_value());
+        assert(errors.size() == 1 && errors[0] == "division by zero, line=2");
+
+        std::cout << "✓ testSerialization passed\n";
+    }
+
+    static void testMalformed() {
+        const std::string bytes = serializeBytecode(*compile(programs()[14]));
+        std::vector<std::string> errors;
+
+        assert(deserializeBytecode("", errors) == nullptr && errors.back() == "not bytecode");
+        std::string versioned = bytes;
+        versioned[6] = 99;
+        assert(deserializeBytecode(versioned, errors) == nullptr);
+        assert(errors.back() == "bytecode version 99, expected 2");
+
+        // every truncation is turned away, and so is trailing junk
+        for (size_t n = 0; n < bytes.size(); n++) {
+            assert(deserializeBytecode(std::string_view(bytes).substr(0, n), errors) == nullptr);
+        }
+        assert(deserializeBytecode(bytes + "x", errors) == nullptr);
+
+        // as is any operand out of range, whichever byte of the code is off
+        std::unique_ptr<Bytecode> bytecode = compile(programs()[14]);
+        Function &fib = bytecode->functions[1];
+        for (size_t pc = 0; pc < fib.code.size(); pc += opWords(opOf(fib.code[pc]))) {
+            Bytecode broken = *bytecode;
+            broken.functions[1].code[pc] |= 0xff00; // a = 255
+            const Op op = opOf(fib.code[pc]);
+            assert(deserializeBytecode(serializeBytecode(broken), errors) == nullptr || op == Op::JMP);
+        }
+        Bytecode jump = *bytecode;
+        jump.functions[0].code.insert(jump.functions[0].code.begin(), {encode(Op::JMP), 1000});
+        assert(deserializeBytecode(serializeBytecode(jump), errors) == nullptr);
+        assert(errors.back() == "malformed bytecode in function 0: bad operand of JMP at 0");
+
+        std::cout << "✓ testMalformed passed\n";
+    }
+};